@@ -0,0 +1,621 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ProgramGenerator.h"
+
+const char* const genOperatorNames[NUM_GEN_OPERATORS] = {
+    "+", "-", "*", "/", "neg",
+    "=", "!=", "<", "<=", ">", ">=",
+    "and", "or", "not"
+};
+
+static const char* const operatorText[NUM_GEN_OPERATORS] = {
+    "+", "-", "*", "/", "-",
+    "=", "!=", "<", "<=", ">", ">=",
+    "and", "or", "not"
+};
+
+static const char* const typeNames[] = { "integer", "boolean", "string" };
+
+static const char* const words[] = {
+    "alpha", "beta", "count", "done", "even", "odd", "hello", "world",
+    "total", "value", "result", "number", "is", "the", "next", "step"
+};
+static const int NUM_WORDS = sizeof(words) / sizeof(words[0]);
+
+// Operator precedence, from loosest to tightest binding
+enum { PREC_LOGICAL, PREC_RELATIONAL, PREC_ADDITIVE, PREC_MULTIPLICATIVE };
+
+bool GeneratorConfig::SetWeights(const char *spec) {
+    while (*spec) {
+        const char *eq = strchr(spec, '=');
+        // "=" and "!=" are operators too, so the name runs up to the last '='
+        // before the weight
+        if (eq == spec) eq = strchr(spec + 1, '=');
+        else if (eq && eq[1] == '=') eq++;
+        if (eq == nullptr) return false;
+
+        int op = -1;
+        for (int i = 0; i < NUM_GEN_OPERATORS; i++) {
+            if ((size_t)(eq - spec) == strlen(genOperatorNames[i]) &&
+                strncmp(spec, genOperatorNames[i], eq - spec) == 0) {
+                op = i;
+            }
+        }
+        char *end;
+        long weight = strtol(eq + 1, &end, 10);
+        if (op < 0 || end == eq + 1 || weight < 0 || (*end != ',' && *end != '\0'))
+            return false;
+        weights[op] = (int)weight;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+ProgramGenerator::ProgramGenerator(const GeneratorConfig &config)
+    : config(config) {
+    if (this->config.nestingDepth < 0) this->config.nestingDepth = 0;
+    if (this->config.exprDepth < 0) this->config.exprDepth = 0;
+    if (this->config.loopTrips < 1) this->config.loopTrips = 1;
+    if (this->config.statements < 1) this->config.statements = 1;
+}
+
+long ProgramGenerator::Generate(FILE *file) {
+    this->file = file;
+    generate();
+    flush();
+    return written;
+}
+
+std::string ProgramGenerator::Generate() {
+    file = nullptr;
+    generate();
+    std::string result;
+    result.swap(out);
+    return result;
+}
+
+// splitmix64
+unsigned long long ProgramGenerator::next() {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+int ProgramGenerator::below(int n) {
+    return n > 0 ? (int)((next() >> 33) % (unsigned long long)n) : 0;
+}
+
+bool ProgramGenerator::chance(double p) {
+    return (next() >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+// An operator from first..last by weight, or -1 if they all weigh 0
+int ProgramGenerator::pickOperator(int first, int last) {
+    int total = 0;
+    for (int op = first; op <= last; op++) total += config.weights[op];
+    if (total == 0) return -1;
+    int r = below(total);
+    for (int op = first; op <= last; op++) {
+        if (r < config.weights[op]) return op;
+        r -= config.weights[op];
+    }
+    return last;
+}
+
+void ProgramGenerator::emit(const char *text) {
+    out += text;
+}
+
+void ProgramGenerator::emit(const std::string &text) {
+    out += text;
+}
+
+void ProgramGenerator::emitNumber(long value) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%ld", value);
+    out += buffer;
+}
+
+// Starts a new line at the current indentation
+void ProgramGenerator::newline() {
+    out += '\n';
+    out.append(indent * 4, ' ');
+    if (file && out.size() >= (1 << 16)) flush();
+}
+
+void ProgramGenerator::flush() {
+    if (file && !out.empty()) {
+        fwrite(out.data(), 1, out.size(), file);
+        written += out.size();
+        out.clear();
+    }
+}
+
+long ProgramGenerator::size() const {
+    return written + (long)out.size();
+}
+
+void ProgramGenerator::enterScope() {
+    Scope scope;
+    for (int t = 0; t < NUM_GEN_TYPES; t++) {
+        scope.readable[t] = readable[t].size();
+        scope.assignable[t] = assignable[t].size();
+    }
+    scopes.push_back(scope);
+}
+
+void ProgramGenerator::exitScope() {
+    Scope scope = scopes.back();
+    scopes.pop_back();
+    for (int t = 0; t < NUM_GEN_TYPES; t++) {
+        readable[t].resize(scope.readable[t]);
+        assignable[t].resize(scope.assignable[t]);
+        // The recent names may have gone out of scope
+        recent[t].clear();
+        recentNext[t] = 0;
+    }
+}
+
+void ProgramGenerator::declare(const std::string &name, int type, bool isAssignable) {
+    readable[type].push_back(Variable{name, type});
+    if (isAssignable) assignable[type].push_back(Variable{name, type});
+}
+
+// A visible variable of the type, preferring recently used names with
+// probability config.reuse; nullptr if there is none
+const std::string* ProgramGenerator::pickVariable(int type, bool toAssign) {
+    std::vector<Variable> &vars = toAssign ? assignable[type] : readable[type];
+    if (vars.empty()) return nullptr;
+
+    if (!recent[type].empty() && chance(config.reuse)) {
+        const std::string &name = recent[type][below((int)recent[type].size())];
+        if (!toAssign) return &name;
+        for (const Variable &var : vars) {
+            if (var.name == name) return &name;
+        }
+    }
+
+    const std::string *name = &vars[below((int)vars.size())].name;
+    const size_t RECENT = 4;
+    if (recent[type].size() < RECENT) {
+        recent[type].push_back(*name);
+    } else {
+        recent[type][recentNext[type]] = *name;
+        recentNext[type] = (recentNext[type] + 1) % RECENT;
+    }
+    return name;
+}
+
+// A routine with the return type (-1 for a procedure) whose calls fit in
+// the work budget, or nullptr
+const ProgramGenerator::Routine* ProgramGenerator::pickRoutine(int returnType) {
+    if (routines.empty()) return nullptr;
+    for (int tries = 0; tries < 4; tries++) {
+        const Routine &routine = routines[below((int)routines.size())];
+        if (routine.returnType == returnType &&
+            work + multiplier * (routine.cost + 1) <= config.workBudget) {
+            return &routine;
+        }
+    }
+    return nullptr;
+}
+
+void ProgramGenerator::call(const Routine &routine, int depth) {
+    work += multiplier * (routine.cost + 1);
+    emit(routine.name);
+    emit("(");
+    for (size_t i = 0; i < routine.params.size(); i++) {
+        if (i > 0) emit(", ");
+        expr(routine.params[i], depth - 1);
+    }
+    emit(")");
+}
+
+void ProgramGenerator::expr(int type, int depth) {
+    if (type == GEN_INTEGER) {
+        intExpr(depth, PREC_LOGICAL);
+    } else if (type == GEN_BOOLEAN) {
+        boolExpr(depth, PREC_LOGICAL);
+    } else {
+        const std::string *var = pickVariable(GEN_STRING, false);
+        if (var && chance(0.5)) {
+            emit(*var);
+        } else {
+            emit("\"");
+            int count = 1 + below(3);
+            for (int i = 0; i < count; i++) {
+                if (i > 0) emit(" ");
+                emit(words[below(NUM_WORDS)]);
+            }
+            emit("\"");
+        }
+    }
+}
+
+// An integer expression in a context that binds at least as tightly as
+// precedence, parenthesized if its operator binds more loosely
+void ProgramGenerator::intExpr(int depth, int precedence) {
+    int op = depth > 0 && chance(0.7) ? pickOperator(GEN_PLUS, GEN_NEG) : -1;
+    if (op < 0) {
+        const std::string *var = pickVariable(GEN_INTEGER, false);
+        const Routine *function = depth > 0 && chance(0.1) ? pickRoutine(GEN_INTEGER)
+                                                           : nullptr;
+        if (function) {
+            call(*function, depth);
+        } else if (var && chance(0.7)) {
+            emit(*var);
+        } else {
+            emitNumber(chance(0.9) ? below(100) : below(100000));
+        }
+        return;
+    }
+
+    if (op == GEN_NEG) {
+        emit("-(");
+        intExpr(depth - 1, PREC_LOGICAL);
+        emit(")");
+        return;
+    }
+
+    int own = op == GEN_PLUS || op == GEN_MINUS ? PREC_ADDITIVE : PREC_MULTIPLICATIVE;
+    bool parens = own < precedence || chance(0.1);
+    if (parens) emit("(");
+    intExpr(depth - 1, own);
+    emit(" ");
+    emit(operatorText[op]);
+    emit(" ");
+    if (op == GEN_DIVIDE) {
+        emitNumber(1 + below(9));
+    } else {
+        // Operators associate to the left, so a right operand at the same
+        // level is grouped
+        intExpr(depth - 1, own + 1);
+    }
+    if (parens) emit(")");
+}
+
+void ProgramGenerator::boolExpr(int depth, int precedence) {
+    int op = depth > 0 && chance(0.6) ? pickOperator(GEN_AND, GEN_NOT) : -1;
+    if (op < 0) {
+        const Routine *function = depth > 0 && chance(0.1) ? pickRoutine(GEN_BOOLEAN)
+                                                           : nullptr;
+        const std::string *var = pickVariable(GEN_BOOLEAN, false);
+        int comparisons = 0;
+        for (int c = GEN_EQ; c <= GEN_GE; c++) comparisons += config.weights[c];
+        if (function) {
+            call(*function, depth);
+        } else if (comparisons > 0 && chance(0.6)) {
+            relation(depth, precedence);
+        } else if (var && chance(0.8)) {
+            emit(*var);
+        } else {
+            emit(chance(0.5) ? "true" : "false");
+        }
+        return;
+    }
+
+    if (op == GEN_NOT) {
+        emit("not(");
+        boolExpr(depth - 1, PREC_LOGICAL);
+        emit(")");
+        return;
+    }
+
+    bool parens = PREC_LOGICAL < precedence || chance(0.1);
+    if (parens) emit("(");
+    boolExpr(depth - 1, PREC_LOGICAL);
+    emit(" ");
+    emit(operatorText[op]);
+    emit(" ");
+    boolExpr(depth - 1, PREC_RELATIONAL);
+    if (parens) emit(")");
+}
+
+// A comparison of two integer expressions. Comparisons are never chained.
+void ProgramGenerator::relation(int depth, int precedence) {
+    int op = pickOperator(GEN_EQ, GEN_GE);
+    bool parens = PREC_RELATIONAL < precedence || chance(0.5);
+    if (parens) emit("(");
+    intExpr(depth - 1, PREC_ADDITIVE);
+    emit(" ");
+    emit(operatorText[op]);
+    emit(" ");
+    intExpr(depth - 1, PREC_ADDITIVE);
+    if (parens) emit(")");
+}
+
+void ProgramGenerator::declareLocals(int count, const char *prefix) {
+    for (int i = 0; i < count; i++) {
+        std::string name = prefix + std::to_string(localCount++);
+        int type = below(NUM_GEN_TYPES);
+        newline();
+        emit("var ");
+        emit(name);
+        emit(" : ");
+        emit(typeNames[type]);
+        emit(";");
+        declare(name, type, true);
+    }
+}
+
+// begin <locals> <statements> end, with the loop counters declared for a
+// routine's outermost block, a final return(...) for a function's, and a
+// final increment of counter for a while loop's
+void ProgramGenerator::block(int depth, bool outermost, int returnType, int counter) {
+    emit("begin");
+    indent++;
+    enterScope();
+    if (outermost) {
+        for (int n = 0; n < config.nestingDepth; n++) {
+            std::string name = "n" + std::to_string(n);
+            newline();
+            emit("var ");
+            emit(name);
+            emit(" : integer;");
+            declare(name, GEN_INTEGER, false);
+        }
+    }
+    // At least one variable, so there is always something to assign
+    declareLocals(outermost ? (config.locals > 0 ? config.locals : 1)
+                            : below(config.locals + 1),
+                  outermost ? "l" : "v");
+
+    int count = outermost ? config.statements : 1 + below(config.statements);
+    for (int i = 0; i < count; i++) {
+        statement(depth, false);
+        emit(";");
+    }
+    if (counter >= 0) {
+        newline();
+        emit("n" + std::to_string(counter) + " := n" + std::to_string(counter) + " + 1;");
+    }
+    if (returnType >= 0) {
+        newline();
+        emit("return(");
+        expr(returnType, config.exprDepth);
+        emit(");");
+    }
+    exitScope();
+    indent--;
+    newline();
+    emit("end");
+}
+
+// The body of an if or a loop: a block, or a single simple statement
+void ProgramGenerator::body(int depth, int counter) {
+    if (depth > 0 || counter >= 0 || chance(0.5)) {
+        newline();
+        block(depth, false, -1, counter);
+    } else {
+        indent++;
+        statement(0, true);
+        indent--;
+    }
+}
+
+void ProgramGenerator::statement(int depth, bool single) {
+    work += multiplier;
+    if (config.comments && chance(0.05)) {
+        newline();
+        emit("## ");
+        emit(words[below(NUM_WORDS)]);
+        emit(" ");
+        emit(words[below(NUM_WORDS)]);
+    }
+    newline();
+
+    // Weights of assignment, call, if, while, for, block, write and read
+    int weights[] = {
+        6, 1,
+        depth > 0 ? 2 : 0,
+        depth > 0 && !single ? 1 : 0,
+        depth > 0 ? 1 : 0,
+        depth > 0 ? 1 : 0,
+        1,
+        config.reads ? 1 : 0
+    };
+    int total = 0;
+    for (int w : weights) total += w;
+    int kind = 0;
+    for (int r = below(total); r >= weights[kind]; kind++) r -= weights[kind];
+
+    // Loops must fit in the budget even if every statement of the body runs
+    long trips = 1 + below(config.loopTrips);
+    if ((kind == 3 || kind == 4) &&
+        work + multiplier * trips * (config.statements + 1) > config.workBudget) {
+        kind = 0;
+    }
+
+    switch (kind) {
+        case 1: {
+            const Routine *procedure = pickRoutine(-1);
+            if (procedure) {
+                call(*procedure, config.exprDepth);
+                return;
+            }
+            break;
+        }
+        case 2: {
+            emit("if ");
+            boolExpr(config.exprDepth, PREC_LOGICAL);
+            emit(" then");
+            body(depth - 1, -1);
+            if (chance(0.5)) {
+                newline();
+                emit("else");
+                body(depth - 1, -1);
+            }
+            newline();
+            emit("fi");
+            return;
+        }
+        case 3:
+        case 4: {
+            std::string counter = "n" + std::to_string(loopDepth);
+            long saved = multiplier;
+            multiplier *= trips + 1;
+            if (kind == 3) {
+                emit(counter + " := 0;");
+                newline();
+                emit("while " + counter + " < ");
+                emitNumber(trips);
+                if (chance(0.3)) {
+                    emit(" and ");
+                    boolExpr(config.exprDepth - 1, PREC_RELATIONAL);
+                }
+            } else {
+                emit("for " + counter + " := 1 to ");
+                emitNumber(trips);
+            }
+            emit(" do");
+            multiplier = saved * trips;
+            loopDepth++;
+            body(depth - 1, kind == 3 ? loopDepth - 1 : -1);
+            loopDepth--;
+            multiplier = saved;
+            newline();
+            emit("od");
+            return;
+        }
+        case 5:
+            block(depth - 1, false, -1, -1);
+            return;
+        case 6:
+        case 7: {
+            const std::string *var = pickVariable(below(NUM_GEN_TYPES), kind == 7);
+            if (var) {
+                emit(kind == 6 ? "write(" : "read(");
+                emit(*var);
+                emit(")");
+                return;
+            }
+            break;
+        }
+    }
+
+    // Assignment, also the fallback when nothing else fits. Every routine
+    // declares a local, so some type has a variable.
+    int type = below(NUM_GEN_TYPES);
+    const std::string *var = pickVariable(type, true);
+    for (int t = 0; var == nullptr; t++) {
+        type = t;
+        var = pickVariable(type, true);
+    }
+    emit(*var);
+    emit(" := ");
+    expr(type, config.exprDepth);
+}
+
+void ProgramGenerator::routine(int index) {
+    Routine r;
+    r.returnType = chance(0.6) ? below(2) : -1;
+    r.name = (r.returnType >= 0 ? "f" : "p") + std::to_string(index);
+    int count = below(config.maxParams + 1);
+    for (int i = 0; i < count; i++) r.params.push_back(below(NUM_GEN_TYPES));
+
+    newline();
+    newline();
+    emit(r.returnType >= 0 ? "function " : "procedure ");
+    emit(r.name);
+    emit("(");
+    enterScope();
+    for (int i = 0; i < count; i++) {
+        std::string name = "a" + std::to_string(i);
+        if (i > 0) emit(", ");
+        emit(name + " : " + typeNames[r.params[i]]);
+        declare(name, r.params[i], true);
+    }
+    emit(")");
+    if (r.returnType >= 0) {
+        emit(" : ");
+        emit(typeNames[r.returnType]);
+    }
+
+    work = 0;
+    multiplier = 1;
+    localCount = 0;
+    newline();
+    block(config.nestingDepth, true, r.returnType, -1);
+    emit(";");
+    exitScope();
+
+    r.cost = work;
+    routines.push_back(r);
+}
+
+void ProgramGenerator::header() {
+    emit("program");
+    for (int i = 0; i < config.globals; i++) {
+        std::string name = "g" + std::to_string(i);
+        int type = below(NUM_GEN_TYPES);
+        newline();
+        emit("var " + name + " : " + typeNames[type] + ";");
+        declare(name, type, true);
+    }
+
+    // Constants are evaluated by the parser, so they only combine small
+    // literals and can't overflow
+    for (int i = 0; i < config.constants; i++) {
+        std::string name = "K" + std::to_string(i);
+        newline();
+        emit("constant " + name + " = ");
+        constantExpr(2);
+        emit(";");
+    }
+    for (int i = 0; i < config.constants; i++) {
+        declare("K" + std::to_string(i), GEN_INTEGER, false);
+    }
+}
+
+void ProgramGenerator::constantExpr(int depth) {
+    int op = depth > 0 && chance(0.7) ? pickOperator(GEN_PLUS, GEN_NEG) : -1;
+    if (op < 0) {
+        emitNumber(1 + below(20));
+    } else if (op == GEN_NEG) {
+        emit("-(");
+        constantExpr(depth - 1);
+        emit(")");
+    } else {
+        emit("(");
+        constantExpr(depth - 1);
+        emit(" ");
+        emit(operatorText[op]);
+        emit(" ");
+        if (op == GEN_DIVIDE) emitNumber(1 + below(9));
+        else constantExpr(depth - 1);
+        emit(")");
+    }
+}
+
+void ProgramGenerator::generate() {
+    state = config.seed;
+    out.clear();
+    written = 0;
+    for (int t = 0; t < NUM_GEN_TYPES; t++) {
+        readable[t].clear();
+        assignable[t].clear();
+        recent[t].clear();
+        recentNext[t] = 0;
+    }
+    scopes.clear();
+    routines.clear();
+    indent = 0;
+    loopDepth = 0;
+
+    header();
+    for (int i = 0; config.targetBytes > 0 ? size() < config.targetBytes : i < config.routines;
+         i++) {
+        routine(i);
+    }
+
+    // Main block
+    newline();
+    newline();
+    work = 0;
+    multiplier = 1;
+    localCount = 0;
+    block(config.nestingDepth, true, -1, -1);
+    emit(";");
+    emit("\n");
+}
@@ -0,0 +1,59 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+// Helpers shared by the benchmark programs
+
+#include <chrono>
+#include <string>
+#include <string.h>
+#include "../include/FileDescriptor.h"
+#include "../include/ProgramGenerator.h"
+
+// Wall clock time in seconds
+static inline double bench_now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Reads a file and repeats its contents copies times
+static inline std::string bench_replicate_file(const char *fileName, int copies) {
+    long length = 0;
+    char *data = FileDescriptor::LoadFile(fileName, &length);
+    if (data == nullptr) {
+        fprintf(stderr, "Could not read %s\n", fileName);
+        exit(1);
+    }
+    std::string text(data, length);
+    delete[] data;
+    if (!text.empty() && text.back() != '\n') {
+        text += '\n';
+    }
+
+    std::string result;
+    result.reserve(text.size() * copies);
+    for (int i = 0; i < copies; i++) {
+        result += text;
+    }
+    return result;
+}
+
+// A benchmark input: "gen:SIZE[:SEED]" is a generated program of about SIZE
+// bytes (with an optional K, M or G suffix), anything else a file repeated
+// copies times
+static inline std::string bench_source(const char *spec, int copies) {
+    if (strncmp(spec, "gen:", 4) != 0) {
+        return bench_replicate_file(spec, copies);
+    }
+    char *end;
+    double size = strtod(spec + 4, &end);
+    switch (*end) {
+        case 'k': case 'K': size *= 1e3; end++; break;
+        case 'm': case 'M': size *= 1e6; end++; break;
+        case 'g': case 'G': size *= 1e9; end++; break;
+    }
+    GeneratorConfig config;
+    config.targetBytes = (long)size;
+    if (*end == ':') config.seed = strtoull(end + 1, nullptr, 10);
+    return ProgramGenerator(config).Generate();
+}
+
+#endif // BENCH_UTIL_H
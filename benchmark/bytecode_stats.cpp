@@ -0,0 +1,47 @@
+// Lowers programs to bytecode, optimizes and schedules them, and reports
+// how often each peephole pattern applied and how many instructions it
+// removed, summed over all of them, with each program's instruction count
+// before and after.
+// Usage: bytecode_stats [sources...]   (sources as in bench_source)
+// Run from parser/ or benchmark/: the parser writes ../tests/output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bench_util.h"
+#include "../include/parser.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/PeepholeOptimizer.h"
+
+int main(int argc, char **argv) {
+    std::vector<const char *> sources;
+    for (int i = 1; i < argc; i++) sources.push_back(argv[i]);
+    if (sources.empty()) {
+        // The test programs that run, and generated ones
+        static const char *corpus[] = {
+            "../tests/test1_isEven.txt", "../tests/test3_outer_scope.txt",
+            "../tests/test5_all_operators.txt", "gen:1M:1", "gen:1M:2",
+        };
+        for (const char *spec : corpus) sources.push_back(spec);
+    }
+
+    PeepholeOptimizer optimizer;
+    printf("%-36s %10s %10s %10s\n", "source", "before", "after", "moved");
+    for (const char *spec : sources) {
+        std::string source = bench_source(spec, 1);
+        Parser parser(new Scanner(new FileDescriptor(source.data(), source.size())));
+        AST *program = parser.start_parsing();
+        Module module;
+        if (parser.had_error || BytecodeCompiler().compile(program, module) != 0) {
+            printf("%-36s does not compile\n", spec);
+            continue;
+        }
+        long before = optimizer.before(), after = optimizer.after(), moved = optimizer.moved();
+        optimizer.optimize(module);
+        optimizer.schedule(module);
+        printf("%-36s %10ld %10ld %10ld\n", spec, optimizer.before() - before,
+               optimizer.after() - after, optimizer.moved() - moved);
+    }
+    printf("\n");
+    optimizer.report(stdout);
+    return 0;
+}
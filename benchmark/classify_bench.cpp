@@ -0,0 +1,103 @@
+// Character classification: the scanner's class table against the old
+// comparison chain, and end-to-end scanner throughput.
+// Usage: classify_bench [source] [copies] [runs]
+// (source as in bench_source, default gen:2M)
+#include <stdio.h>
+#include <ctype.h>
+#include "bench_util.h"
+#include "../include/Scanner.h"
+
+// Scanner::getClass before it was table driven
+static int getClassChain(char c) {
+    if (isalpha(c))
+        return LETTER_CHAR;
+    else if (c >= '0' && c <= '9')
+        return NUMERIC_DIGIT;
+    else if (c == ';' || c == ' ' || c == '\n' || isspace(c) || c == EOF)
+        return SEPARATOR;
+    else if (c == '(' || c == ')' || c == '+' || c == '*' ||
+             c == '/' || c == '=' || c == '[' || c == ']' ||
+             c == '{' || c == '}' || c == ',' || c == ':' ||
+             c == '=' || c == '>' || c == '<' || c == '-' ||
+             c == '!')
+        return OPERATOR;
+    else if (c == '.')
+        return lx_dot;
+    else if (c == '_')
+        return SPECIAL_CHAR;
+    else if (c == '#')
+        return COMMENT_MARKER;
+    return 0;
+}
+
+static int getClassTable(char c) {
+    return char_tables.cls[(unsigned char)c];
+}
+
+// Sum of the classes of every character, so the loop can't be dropped
+template <typename Classify>
+static long classifyAll(const std::string &source, Classify classify) {
+    long sum = 0;
+    for (char c : source) {
+        sum += classify(c);
+    }
+    return sum;
+}
+
+template <typename Classify>
+static double bestOf(int runs, const std::string &source, Classify classify, long *sum) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        double start = bench_now();
+        *sum = classifyAll(source, classify);
+        double seconds = bench_now() - start;
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const char *fileName = argc > 1 ? argv[1] : "gen:2M";
+    int copies = argc > 2 ? atoi(argv[2]) : 1000;
+    int runs = argc > 3 ? atoi(argv[3]) : 5;
+
+    std::string source = bench_source(fileName, copies);
+    printf("input: %s, %.1f MB\n\n", fileName, source.size() / 1e6);
+
+    // Every byte value must land in the same class both ways
+    for (int c = 0; c < 256; c++) {
+        if (getClassChain((char)c) != getClassTable((char)c)) {
+            printf("class mismatch for byte %d: chain %d, table %d\n", c,
+                   getClassChain((char)c), getClassTable((char)c));
+            return 1;
+        }
+    }
+
+    long chainSum, tableSum;
+    double chain = bestOf(runs, source, getClassChain, &chainSum);
+    double table = bestOf(runs, source, getClassTable, &tableSum);
+    printf("%-12s %10s %14s\n", "classify", "seconds", "chars/sec");
+    printf("%-12s %10.4f %14.0f\n", "chain", chain, source.size() / chain);
+    printf("%-12s %10.4f %14.0f%s\n\n", "table", table, source.size() / table,
+           chainSum == tableSum ? "" : "  MISMATCH");
+
+    // Whole scanner over the in-memory source
+    double best = 1e30;
+    long count = 0;
+    for (int i = 0; i < runs; i++) {
+        Scanner scanner(new FileDescriptor(source.data(), source.size()));
+        double start = bench_now();
+        count = 0;
+        bool eof;
+        do {
+            TOKEN *token = scanner.Scan();
+            count++;
+            eof = token->type == lx_eof;
+            delete token;
+        } while (!eof);
+        double seconds = bench_now() - start;
+        if (seconds < best) best = seconds;
+    }
+    printf("scanner: %ld tokens, %.4f s, %.0f tokens/sec\n", count, best, count / best);
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Microbenchmark of each scanner kernel (scalar / SSE2 / AVX2) on runs of
+// different lengths. Usage: kernel_bench [megabytes per measurement]
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "../include/ScanKernels.h"
+
+typedef size_t (*Kernel)(const char *p, size_t n);
+
+// A buffer of runs of run_length bytes from fill, each followed by stop
+static std::string make_runs(const char *fill, char stop, int run_length, size_t total) {
+    std::string text;
+    size_t fill_length = strlen(fill);
+    while (text.size() < total) {
+        for (int i = 0; i < run_length; i++) {
+            text += fill[i % fill_length];
+        }
+        text += stop;
+    }
+    return text;
+}
+
+// Walks the buffer run by run; returns bytes per second
+static double measure(Kernel kernel, const std::string &text, size_t *check) {
+    const char *p = text.data();
+    size_t n = text.size();
+    double start = bench_now();
+    size_t runs = 0;
+    for (size_t i = 0; i < n; ) {
+        i += kernel(p + i, n - i) + 1;
+        runs++;
+    }
+    double seconds = bench_now() - start;
+    *check = runs;
+    return n / seconds;
+}
+
+int main(int argc, char **argv) {
+    size_t total = (size_t)(argc > 1 ? atof(argv[1]) : 64) * 1000000;
+
+    std::vector<const ScanKernels *> variants;
+    variants.push_back(&scan_kernels_scalar);
+    if (scan_kernels_sse2) variants.push_back(scan_kernels_sse2);
+    if (scan_kernels_avx2) variants.push_back(scan_kernels_avx2);
+    printf("selected kernels: %s\n\n", scan_kernels->name);
+
+    struct Case {
+        const char *kernel;
+        const char *fill;
+        char stop;
+    } cases[] = {
+        { "span_space", " \t ", 'x' },
+        { "find_comment_stop", "comment text ", '\n' },
+        { "span_ident", "ident_42", ' ' },
+        { "span_digits", "0123456789", ';' },
+    };
+    int lengths[] = { 4, 8, 16, 32, 64, 256 };
+
+    printf("%-18s %6s", "kernel", "run");
+    for (const ScanKernels *v : variants) printf(" %10s", v->name);
+    printf("   (GB/s)\n");
+
+    for (const Case &c : cases) {
+        for (int length : lengths) {
+            std::string text = make_runs(c.fill, c.stop, length, total);
+            printf("%-18s %6d", c.kernel, length);
+            size_t expected = 0;
+            for (const ScanKernels *v : variants) {
+                Kernel kernel = !strcmp(c.kernel, "span_space") ? v->span_space
+                              : !strcmp(c.kernel, "find_comment_stop") ? v->find_comment_stop
+                              : !strcmp(c.kernel, "span_ident") ? v->span_ident
+                              : v->span_digits;
+                size_t runs;
+                double rate = measure(kernel, text, &runs);
+                if (expected == 0) expected = runs;
+                printf(" %10.2f%s", rate / 1e9, runs == expected ? "" : "!");
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
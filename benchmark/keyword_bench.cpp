@@ -0,0 +1,107 @@
+// Keyword lookup: the scanner's perfect hash against the unordered_map it
+// replaced, on every identifier-like word of a source file.
+// Usage: keyword_bench [source] [copies] [runs]
+// (source as in bench_source, default gen:2M)
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include "bench_util.h"
+#include "../include/Scanner.h"
+
+struct Word {
+    const char *text;
+    int len;
+};
+
+// The lookup the scanner used before: build a string, probe the map
+static std::unordered_map<std::string, int> keywordMap = []() {
+    std::unordered_map<std::string, int> map;
+    for (int i = 0; i < NUM_KEYWORDS; i++) {
+        map[keywords[i]] = i;
+    }
+    return map;
+}();
+
+static int mapLookup(const char *word, int len) {
+    auto it = keywordMap.find(std::string(word, len));
+    return it != keywordMap.end() ? it->second : -1;
+}
+
+// Keywords, and words one edit away from them
+static std::vector<std::string> nearMisses() {
+    std::vector<std::string> words;
+    for (int i = 0; i < NUM_KEYWORDS; i++) {
+        std::string kw = keywords[i];
+        words.push_back(kw);
+        words.push_back(kw + "s");
+        words.push_back(kw.substr(1));
+        words.push_back(kw.substr(0, kw.size() - 1));
+        for (size_t j = 0; j < kw.size(); j++) {
+            std::string upper = kw, changed = kw;
+            upper[j] = toupper(upper[j]);
+            changed[j] = changed[j] == 'z' ? 'a' : changed[j] + 1;
+            words.push_back(upper);
+            words.push_back(changed);
+        }
+    }
+    return words;
+}
+
+template <typename Lookup>
+static double bestOf(int runs, const std::vector<Word> &words, Lookup lookup, long *sum) {
+    double best = 1e30;
+    for (int r = 0; r < runs; r++) {
+        double start = bench_now();
+        long s = 0;
+        for (const Word &w : words) {
+            s += lookup(w.text, w.len);
+        }
+        double seconds = bench_now() - start;
+        *sum = s;
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const char *fileName = argc > 1 ? argv[1] : "gen:2M";
+    int copies = argc > 2 ? atoi(argv[2]) : 1000;
+    int runs = argc > 3 ? atoi(argv[3]) : 5;
+
+    for (const std::string &w : nearMisses()) {
+        int expected = mapLookup(w.data(), (int)w.size());
+        int actual = Scanner::checkKeyword(w.data(), (int)w.size());
+        if (expected != actual) {
+            printf("lookup mismatch for '%s': map %d, hash %d\n", w.c_str(), expected, actual);
+            return 1;
+        }
+    }
+
+    // Every run of identifier characters that starts with a letter or '_'
+    std::string source = bench_source(fileName, copies);
+    std::vector<Word> words;
+    long keywordCount = 0;
+    for (size_t i = 0; i < source.size();) {
+        if (!isIdentChar(source[i]) || isDigitChar(source[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < source.size() && isIdentChar(source[i])) i++;
+        words.push_back(Word{source.data() + start, (int)(i - start)});
+        if (mapLookup(source.data() + start, (int)(i - start)) >= 0) keywordCount++;
+    }
+    printf("input: %s, %zu words, %ld keywords\n\n", fileName, words.size(),
+           keywordCount);
+
+    long mapSum, hashSum;
+    double map = bestOf(runs, words, mapLookup, &mapSum);
+    double hash = bestOf(runs, words, Scanner::checkKeyword, &hashSum);
+    printf("%-14s %10s %12s %14s\n", "lookup", "seconds", "ns/word", "words/sec");
+    printf("%-14s %10.4f %12.2f %14.0f\n", "unordered_map", map, map * 1e9 / words.size(),
+           words.size() / map);
+    printf("%-14s %10.4f %12.2f %14.0f%s\n", "perfect hash", hash, hash * 1e9 / words.size(),
+           words.size() / hash, mapSum == hashSum ? "" : "  MISMATCH");
+    return 0;
+}
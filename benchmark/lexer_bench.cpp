@@ -0,0 +1,117 @@
+// Head-to-head throughput of the two Lexer backends, the hand-written
+// Scanner and the flex-generated FlexScanner, on in-memory sources.
+// Usage: lexer_bench [copies] [runs] [sources...]
+// (sources as in bench_source)
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+#include "../include/FlexScanner.h"
+
+struct Result {
+    long tokens;
+    double seconds;
+};
+
+// Scans everything, deleting tokens as it goes
+static long scanAll(Lexer *lexer) {
+    long count = 0;
+    bool eof;
+    do {
+        TOKEN *token = lexer->Scan();
+        count++;
+        eof = token->type == lx_eof;
+        delete token;
+    } while (!eof);
+    return count;
+}
+
+static Lexer *makeLexer(bool flex, const std::string &source) {
+    if (flex)
+        return new FlexScanner(source.data(), source.size());
+    return new Scanner(new FileDescriptor(source.data(), source.size()));
+}
+
+static Result bestOf(int runs, bool flex, const std::string &source) {
+    Result best = {0, 1e30};
+    for (int i = 0; i < runs; i++) {
+        Lexer *lexer = makeLexer(flex, source);
+        double start = bench_now();
+        long tokens = scanAll(lexer);
+        double seconds = bench_now() - start;
+        delete lexer;
+        if (seconds < best.seconds) best = Result{tokens, seconds};
+    }
+    return best;
+}
+
+// The token streams of both backends, compared by type and line
+static bool sameTokens(const std::string &source) {
+    Lexer *hand = makeLexer(false, source);
+    Lexer *flex = makeLexer(true, source);
+    bool same = true;
+    TOKEN *a, *b;
+    do {
+        a = hand->Scan();
+        b = flex->Scan();
+        same = a->type == b->type && a->line == b->line;
+        bool end = a->type == lx_eof;
+        delete a;
+        delete b;
+        if (end) break;
+    } while (same);
+    delete hand;
+    delete flex;
+    return same;
+}
+
+int main(int argc, char **argv) {
+    int copies = argc > 1 ? atoi(argv[1]) : 1000;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    std::vector<const char *> files;
+    for (int i = 3; i < argc; i++) files.push_back(argv[i]);
+    if (files.empty()) {
+        files.push_back("gen:2M:1");
+        files.push_back("gen:2M:2");
+        files.push_back("../tests/test5_all_operators.txt");
+        files.push_back("../tests/example_program.txt");
+    }
+
+    printf("%-40s %10s %14s %14s %8s\n", "input", "tokens", "hand tok/s", "flex tok/s",
+           "flex/hand");
+    for (const char *file : files) {
+        std::string source = bench_source(file, copies);
+        Result hand = bestOf(runs, false, source);
+        Result flex = bestOf(runs, true, source);
+        printf("%-40s %10ld %14.0f %14.0f %7.2fx%s\n", file, hand.tokens,
+               hand.tokens / hand.seconds, flex.tokens / flex.seconds,
+               hand.seconds / flex.seconds, sameTokens(source) ? "" : "  MISMATCH");
+    }
+
+    // Both backends keep per-thread state, so one lexer per thread must give
+    // the same results as one at a time
+    std::string source = bench_source(files[0], copies);
+    int threads = std::thread::hardware_concurrency() > 1 ? 4 : 2;
+    for (int flex = 0; flex <= 1; flex++) {
+        Lexer *reference = makeLexer(flex, source);
+        long expected = scanAll(reference);
+        delete reference;
+        std::vector<long> counts(threads);
+        std::vector<std::thread> workers;
+        double start = bench_now();
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&, t]() {
+                Lexer *lexer = makeLexer(flex, source);
+                counts[t] = scanAll(lexer);
+                delete lexer;
+            }));
+        }
+        for (auto &worker : workers) worker.join();
+        double seconds = bench_now() - start;
+        bool same = true;
+        for (long count : counts) same = same && count == expected;
+        printf("%s, %d threads: %.0f tok/s total%s\n", flex ? "flex" : "hand", threads,
+               expected * threads / seconds, same ? "" : "  MISMATCH");
+    }
+    return 0;
+}
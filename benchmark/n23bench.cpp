@@ -0,0 +1,482 @@
+// Front-end microbenchmarks with summary statistics, for tracking
+// performance from change to change. Every benchmark is run once to warm
+// up, then --reps times; the report gives the median, mean, standard
+// deviation and minimum of the repetitions, and throughput at the median.
+// Inputs are generated with fixed seeds, so runs are comparable.
+// Usage: n23bench [--reps N] [--filter TEXT] [--size BYTES] [--json] [--list]
+// Run from parser/ or benchmark/: the parser writes ../tests/output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "bench_util.h"
+#include "../include/parser.h"
+#include "../include/FlexScanner.h"
+#include "../include/TreeEvaluator.h"
+#include "../include/ClosureCompiler.h"
+#include "../include/RewritingInterpreter.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/BytecodeInterpreter.h"
+#include "../include/PeepholeOptimizer.h"
+#include "../include/ModuleImage.h"
+
+struct Benchmark {
+    std::string name;
+    const char *unit;               // what run() counts
+    std::function<long()> run;      // one repetition; returns units processed
+};
+
+struct Result {
+    long items;
+    double median, mean, stddev, min;   // seconds per repetition
+};
+
+static Result measure(Benchmark &bench, int reps) {
+    bench.run();    // warm up
+    std::vector<double> times;
+    long items = 0;
+    for (int i = 0; i < reps; i++) {
+        double start = bench_now();
+        items = bench.run();
+        times.push_back(bench_now() - start);
+    }
+
+    Result r;
+    r.items = items;
+    std::sort(times.begin(), times.end());
+    size_t n = times.size();
+    r.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    r.min = times[0];
+    double sum = 0;
+    for (double t : times) sum += t;
+    r.mean = sum / n;
+    double squares = 0;
+    for (double t : times) squares += (t - r.mean) * (t - r.mean);
+    r.stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+    return r;
+}
+
+// Identifier-like words of a source, for keyword lookup
+static std::vector<std::string> wordsOf(const std::string &source) {
+    std::vector<std::string> words;
+    for (size_t i = 0; i < source.size();) {
+        if (!isIdentChar(source[i]) || isDigitChar(source[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < source.size() && isIdentChar(source[i])) i++;
+        words.push_back(source.substr(start, i - start));
+    }
+    return words;
+}
+
+static std::vector<std::string> symbolNames(int count, const char *prefix) {
+    std::vector<std::string> names;
+    for (int i = 0; i < count; i++) names.push_back(prefix + std::to_string(i));
+    return names;
+}
+
+// A program of statements assignments, each an expression of operators
+// binary operators: a flat chain, or nested in parentheses
+static std::string expressionProgram(int statements, int operators, bool nested) {
+    static const char *ops[] = {" + ", " * ", " - ", " / "};
+    std::string program = "program\nvar x : integer;\nbegin\n";
+    for (int s = 0; s < statements; s++) {
+        program += "x := ";
+        if (nested) program.append(operators, '(');
+        program += "1";
+        for (int i = 0; i < operators; i++) {
+            program += ops[i % 4];
+            program += std::to_string(i % 9 + 1);
+            if (nested) program += ')';
+        }
+        program += ";\n";
+    }
+    return program + "end;\n";
+}
+
+// The AST refers to the parser's symbol table entries, so a caller that
+// uses the AST has the parser kept alive
+static AST *parse(const std::string &source, bool flex, bool keep = false) {
+    Lexer *lexer;
+    if (flex)
+        lexer = new FlexScanner(source.data(), source.size());
+    else
+        lexer = new Scanner(new FileDescriptor(source.data(), source.size()));
+    Parser *parser = new Parser(lexer);
+    AST *root = parser->start_parsing();
+    if (parser->had_error) {
+        fprintf(stderr, "benchmark program failed to parse\n");
+        exit(1);
+    }
+    if (!keep)
+        delete parser;
+    return root;
+}
+
+// A chain of count additions nested in the left operand, as parsed from
+// 1 + 1 + ... + 1
+static AST *deepExpression(int count) {
+    AST *node = make_ast_node(ast_integer, 1);
+    for (int i = 0; i < count; i++)
+        node = make_ast_node(ast_plus, node, make_ast_node(ast_integer, 1));
+    return node;
+}
+
+// Programs for the execution engines: fib(25) recursively, which makes
+// 242785 calls; and nested loops of a million iterations
+static const char *fibProgram =
+    "program\n"
+    "var r : integer;\n"
+    "function fib(n : integer) : integer\n"
+    "begin\n"
+    "    if n < 2 then return(n) fi;\n"
+    "    return(fib(n - 1) + fib(n - 2));\n"
+    "end;\n"
+    "begin r := fib(25); write(r); end;\n";
+static const char *shortProgram =
+    "program\n"
+    "var r : integer;\n"
+    "function fib(n : integer) : integer\n"
+    "begin\n"
+    "    if n < 2 then return(n) fi;\n"
+    "    return(fib(n - 1) + fib(n - 2));\n"
+    "end;\n"
+    "begin r := fib(13); write(r); end;\n";
+static const char *loopProgram =
+    "program\n"
+    "var total : integer;\n"
+    "begin\n"
+    "    var i : integer;\n"
+    "    var j : integer;\n"
+    "    for i := 1 to 1000 do\n"
+    "    begin\n"
+    "        j := 0;\n"
+    "        while j < 1000 do\n"
+    "        begin\n"
+    "            if (i + j) / 3 * 3 = i + j then total := total + j fi;\n"
+    "            j := j + 1;\n"
+    "        end\n"
+    "        od;\n"
+    "    end\n"
+    "    od;\n"
+    "    write(total);\n"
+    "end;\n";
+
+// One run of source's program on an engine ("tree", "closure", "rewriting",
+// "tiered" or "bytecode"), which must write expected. The program is
+// parsed, and for the closure engine compiled, or for bytecode lowered and
+// optimized, on the first call, so the warm-up run pays for it; the
+// rewriting engine keeps its nodes specialized between runs, and tiered,
+// the routines it compiled.
+// With cold, every call starts over on a new engine instead, and what is
+// measured is the time to the program's first run.
+static std::function<long()> runBench(const char *source, const char *expected,
+                                      const char *name, long items, bool cold = false) {
+    struct Engine {
+        AST *program = nullptr;
+        FILE *output = nullptr;
+        Runtime *runtime = nullptr;
+        ClosureCompiler *compiler = nullptr;
+        RewritingInterpreter *interpreter = nullptr;
+        ModuleImage *image = nullptr;
+    };
+    auto engine = std::make_shared<Engine>();
+    return [=]() {
+        if (engine->program == nullptr) {
+            engine->program = parse(source, false, true);
+            engine->output = tmpfile();
+            engine->runtime = new Runtime(stdin, engine->output);
+        }
+        if (engine->compiler == nullptr && strcmp(name, "closure") == 0) {
+            engine->compiler = new ClosureCompiler(*engine->runtime);
+            if (engine->compiler->compile(engine->program) != 0)
+                exit(1);
+        }
+        if (engine->interpreter == nullptr && strcmp(name, "rewriting") == 0)
+            engine->interpreter = new RewritingInterpreter(*engine->runtime);
+        if (engine->interpreter == nullptr && strcmp(name, "tiered") == 0)
+            engine->interpreter = new RewritingInterpreter(*engine->runtime,
+                                                           RewritingInterpreter::HOT_THRESHOLD);
+        if (engine->image == nullptr && strcmp(name, "bytecode") == 0) {
+            Module module;
+            if (BytecodeCompiler().compile(engine->program, module) != 0)
+                exit(1);
+            PeepholeOptimizer optimizer;
+            optimizer.optimize(module);
+            optimizer.schedule(module);
+            engine->image = new ModuleImage();
+            engine->image->build(module);
+        }
+        rewind(engine->output);
+        int status = engine->compiler ? engine->compiler->run()
+                     : engine->interpreter ? engine->interpreter->run(engine->program)
+                     : engine->image ? BytecodeInterpreter(*engine->runtime).run(*engine->image)
+                     : TreeEvaluator(*engine->runtime).run(engine->program);
+        char written[64] = "";
+        long length = ftell(engine->output);
+        rewind(engine->output);
+        if (status != 0 || length >= (long)sizeof(written) ||
+            fread(written, 1, length, engine->output) != (size_t)length ||
+            strncmp(written, expected, length) != 0 || expected[length] != 0) {
+            fprintf(stderr, "%s engine: wrong output\n", name);
+            exit(1);
+        }
+        if (cold) {
+            delete engine->compiler;
+            delete engine->interpreter;
+            delete engine->image;
+            engine->compiler = nullptr;
+            engine->interpreter = nullptr;
+            engine->image = nullptr;
+        }
+        return items;
+    };
+}
+
+int main(int argc, char **argv) {
+    int reps = 10;
+    const char *filter = "";
+    long size = 2000000;    // scanning inputs; parsing uses size / 16
+    bool json = false, list = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (reps < 1) reps = 1;
+
+    GeneratorConfig config;
+    config.targetBytes = size;
+    std::string source = ProgramGenerator(config).Generate();
+    // The parser keeps every token and node, so it gets a smaller program
+    config.targetBytes = size / 16;
+    config.seed = 2;
+    std::string small = ProgramGenerator(config).Generate();
+    std::vector<std::string> words = wordsOf(source);
+
+    std::vector<Benchmark> benchmarks;
+
+    benchmarks.push_back({"keyword_lookup", "words", [&]() {
+        long keywords = 0;
+        for (const std::string &w : words)
+            keywords += Scanner::checkKeyword(w.data(), (int)w.size()) >= 0;
+        return keywords >= 0 ? (long)words.size() : 0;
+    }});
+
+    benchmarks.push_back({"getchar", "chars", [&]() {
+        FileDescriptor fd(source.data(), source.size());
+        long chars = 0;
+        while (fd.GetChar() != EOF) chars++;
+        return chars;
+    }});
+
+    // Insertion of fresh names into one scope, for several table sizes
+    static std::vector<std::string> names = symbolNames(20000, "name");
+    for (int tableSize : {19, 211, 4099}) {
+        benchmarks.push_back({"symbol_put/size=" + std::to_string(tableSize), "symbols",
+                              [tableSize]() {
+            SymbolTable table(tableSize, 0);
+            for (std::string &name : names) table.PutSymbol(&name[0], STE_INT, 1);
+            return (long)names.size();
+        }});
+    }
+
+    // Lookups of global names from the innermost of depth scopes, each inner
+    // scope holding a few locals; and at depth 1 for several table sizes
+    struct Chain {
+        std::vector<SymbolTable*> tables;
+        ~Chain() { for (SymbolTable *t : tables) delete t; }
+    };
+    static std::vector<std::string> globals = symbolNames(1000, "g");
+    static std::vector<std::string> locals = symbolNames(8, "l");
+    auto lookupBench = [&](int depth, int tableSize) {
+        auto chain = std::make_shared<Chain>();
+        SymbolTable *scope = nullptr;
+        for (int d = 0; d < depth; d++) {
+            SymbolTable *table = new SymbolTable(tableSize, 0);
+            table->next = scope;
+            for (std::string &name : (d == 0 ? globals : locals))
+                table->PutSymbol(&name[0], STE_INT, 1);
+            chain->tables.push_back(table);
+            scope = table;
+        }
+        return [chain, scope]() {
+            long found = 0;
+            for (int r = 0; r < 100; r++)
+                for (std::string &name : globals)
+                    found += scope->GetSymbolFromScopes(&name[0]) != nullptr;
+            return found;
+        };
+    };
+    for (int depth : {1, 4, 16, 64}) {
+        benchmarks.push_back({"symbol_lookup/depth=" + std::to_string(depth), "lookups",
+                              lookupBench(depth, SymbolTable::DEFAULT_SIZE)});
+    }
+    for (int tableSize : {211, 4099}) {
+        benchmarks.push_back({"symbol_lookup/size=" + std::to_string(tableSize), "lookups",
+                              lookupBench(1, tableSize)});
+    }
+
+    benchmarks.push_back({"make_ast_node", "nodes", []() {
+        const int count = 200000;
+        std::vector<AST*> nodes(count);
+        for (int i = 0; i < count; i++) {
+            nodes[i] = make_ast_node(ast_plus, make_ast_node(ast_integer, i),
+                                     make_ast_node(ast_integer, 1));
+        }
+        for (AST *node : nodes) {
+            free(node->f.a_binary_op.larg);
+            free(node->f.a_binary_op.rarg);
+            free(node);
+        }
+        return 3L * count;
+    }});
+
+    benchmarks.push_back({"parse/hand", "bytes", [&]() {
+        parse(small, false);
+        return (long)small.size();
+    }});
+    benchmarks.push_back({"parse/flex", "bytes", [&]() {
+        parse(small, true);
+        return (long)small.size();
+    }});
+
+    // Expressions alone, long and deep
+    static std::string longExpressions = expressionProgram(100, 2000, false);
+    static std::string deepExpressions = expressionProgram(100, 2000, true);
+    benchmarks.push_back({"parse_expr/long", "bytes", []() {
+        parse(longExpressions, false);
+        return (long)longExpressions.size();
+    }});
+    benchmarks.push_back({"parse_expr/deep", "bytes", []() {
+        parse(deepExpressions, false);
+        return (long)deepExpressions.size();
+    }});
+
+    AST *printed = nullptr;
+    FILE *out = nullptr;
+    benchmarks.push_back({"print_ast_node", "bytes", [&]() {
+        if (printed == nullptr) {
+            printed = parse(small, true, true);
+            out = tmpfile();
+        }
+        rewind(out);
+        print_ast_node(out, printed);
+        fflush(out);
+        return ftell(out);
+    }});
+
+    // Walks of a pathologically deep tree
+    static AST *deep = nullptr;
+    static FILE *deepOut = nullptr;
+    const int depth = 1000000;
+    benchmarks.push_back({"print_ast_node/deep", "nodes", [&]() {
+        if (deep == nullptr) deep = deepExpression(depth);
+        if (deepOut == nullptr) deepOut = tmpfile();
+        rewind(deepOut);
+        print_ast_node(deepOut, deep);
+        return 2L * depth + 1;
+    }});
+    benchmarks.push_back({"eval_ast_expr/deep", "nodes", [&]() {
+        if (deep == nullptr) deep = deepExpression(depth);
+        if (eval_ast_expr(nullptr, deep) != depth + 1) {
+            fprintf(stderr, "eval_ast_expr/deep: wrong value\n");
+            exit(1);
+        }
+        return 2L * depth + 1;
+    }});
+
+    // The execution engines, on recursive calls and on loops
+    static const char *engines[] = {"tree", "closure", "rewriting", "tiered", "bytecode"};
+    for (const char *engine : engines) {
+        benchmarks.push_back({std::string("run_fib/") + engine, "calls",
+                              runBench(fibProgram, "75025\n", engine, 242785)});
+    }
+    for (const char *engine : engines) {
+        benchmarks.push_back({std::string("run_loops/") + engine, "iters",
+                              runBench(loopProgram, "166500000\n", engine, 1000000)});
+    }
+    // ... and from nothing to the program's output, compiling or specializing
+    // included, on a short run
+    for (const char *engine : engines) {
+        benchmarks.push_back({std::string("first_run/") + engine, "calls",
+                              runBench(shortProgram, "233\n", engine, 753, true)});
+    }
+
+    // What the closure engine pays up front, on the generated program
+    AST *compiled = nullptr;
+    benchmarks.push_back({"compile/closure", "bytes", [&]() {
+        if (compiled == nullptr) compiled = parse(small, false, true);
+        Runtime runtime(stdin, stdout);
+        ClosureCompiler compiler(runtime);
+        if (compiler.compile(compiled) != 0)
+            exit(1);
+        return (long)small.size();
+    }});
+    // ... and the bytecode engine, lowering, optimizing and scheduling
+    benchmarks.push_back({"compile/bytecode", "bytes", [&]() {
+        if (compiled == nullptr) compiled = parse(small, false, true);
+        Module module;
+        if (BytecodeCompiler().compile(compiled, module) != 0)
+            exit(1);
+        PeepholeOptimizer optimizer;
+        optimizer.optimize(module);
+        optimizer.schedule(module);
+        return (long)small.size();
+    }});
+
+    std::vector<std::pair<Benchmark*, Result>> results;
+    for (Benchmark &bench : benchmarks) {
+        if (strstr(bench.name.c_str(), filter) == nullptr)
+            continue;
+        if (list) {
+            printf("%s\n", bench.name.c_str());
+            continue;
+        }
+        Result r = measure(bench, reps);
+        results.push_back({&bench, r});
+        if (!json) {
+            if (results.size() == 1) {
+                printf("input: %.1f MB generated (parser %.2f MB), %d reps\n\n", source.size() / 1e6,
+                       small.size() / 1e6, reps);
+                printf("%-24s %12s %9s %11s %11s %10s %14s\n", "benchmark", "items", "unit",
+                       "median ms", "mean ms", "stddev %", "items/s");
+            }
+            printf("%-24s %12ld %9s %11.3f %11.3f %9.1f%% %14.0f\n", bench.name.c_str(), r.items,
+                   bench.unit, r.median * 1e3, r.mean * 1e3,
+                   r.mean > 0 ? r.stddev * 100 / r.mean : 0.0, r.items / r.median);
+        }
+    }
+
+    if (json) {
+        printf("{\n  \"reps\": %d,\n  \"source_bytes\": %zu,\n  \"parse_bytes\": %zu,\n"
+               "  \"benchmarks\": [", reps, source.size(), small.size());
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i].second;
+            printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"items\": %ld, "
+                   "\"median_s\": %.9f, \"mean_s\": %.9f, \"stddev_s\": %.9f, \"min_s\": %.9f, "
+                   "\"items_per_s\": %.1f}",
+                   i ? "," : "", results[i].first->name.c_str(), results[i].first->unit,
+                   r.items, r.median, r.mean, r.stddev, r.min, r.items / r.median);
+        }
+        printf("\n  ]\n}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Writes a random, valid N23 program (see ProgramGenerator.h).
+// Usage: n23gen [options] [output file]
+//   --seed N        program to generate (default 1)
+//   --size N[K|M|G] add routines until the program is this big
+//   --routines N    number of routines, when --size isn't given
+//   --globals N  --constants N  --params N  --locals N  --statements N
+//   --depth N       statement nesting depth
+//   --expr-depth N  expression nesting depth
+//   --trips N       maximum loop trip count
+//   --work N        statements a routine may execute per call
+//   --reuse P       chance (0..1) that a reference reuses a recent name
+//   --ops SPEC      operator weights, e.g. "+=4,*=2,/=0,not=1"
+//   --reads         emit read() statements
+//   --no-comments   don't emit comments
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ProgramGenerator.h"
+
+static long parseSize(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    switch (*end) {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case 'g': case 'G': value *= 1e9; break;
+    }
+    return (long)value;
+}
+
+int main(int argc, char **argv) {
+    GeneratorConfig config;
+    const char *outName = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool used = true;
+        if (strcmp(arg, "--reads") == 0) {
+            config.reads = true;
+            used = false;
+        } else if (strcmp(arg, "--no-comments") == 0) {
+            config.comments = false;
+            used = false;
+        } else if (arg[0] != '-' || arg[1] != '-') {
+            outName = arg;
+            used = false;
+        } else if (value == nullptr) {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return 1;
+        } else if (strcmp(arg, "--seed") == 0) {
+            config.seed = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--size") == 0) {
+            config.targetBytes = parseSize(value);
+        } else if (strcmp(arg, "--routines") == 0) {
+            config.routines = atoi(value);
+        } else if (strcmp(arg, "--globals") == 0) {
+            config.globals = atoi(value);
+        } else if (strcmp(arg, "--constants") == 0) {
+            config.constants = atoi(value);
+        } else if (strcmp(arg, "--params") == 0) {
+            config.maxParams = atoi(value);
+        } else if (strcmp(arg, "--locals") == 0) {
+            config.locals = atoi(value);
+        } else if (strcmp(arg, "--statements") == 0) {
+            config.statements = atoi(value);
+        } else if (strcmp(arg, "--depth") == 0) {
+            config.nestingDepth = atoi(value);
+        } else if (strcmp(arg, "--expr-depth") == 0) {
+            config.exprDepth = atoi(value);
+        } else if (strcmp(arg, "--trips") == 0) {
+            config.loopTrips = atoi(value);
+        } else if (strcmp(arg, "--work") == 0) {
+            config.workBudget = atol(value);
+        } else if (strcmp(arg, "--reuse") == 0) {
+            config.reuse = atof(value);
+        } else if (strcmp(arg, "--ops") == 0) {
+            if (!config.SetWeights(value)) {
+                fprintf(stderr, "Bad operator weights: %s\n", value);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+        if (used) i++;
+    }
+
+    FILE *file = outName ? fopen(outName, "w") : stdout;
+    if (file == nullptr) {
+        fprintf(stderr, "Could not write %s\n", outName);
+        return 1;
+    }
+    ProgramGenerator generator(config);
+    long bytes = generator.Generate(file);
+    if (outName) {
+        fclose(file);
+        fprintf(stderr, "%s: %ld bytes\n", outName, bytes);
+    }
+    return 0;
+}
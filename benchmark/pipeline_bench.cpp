@@ -0,0 +1,81 @@
+// Parsing with the lexer on its own thread (PipelinedLexer) against the
+// ordinary interleaved path, for both lexers, on large generated programs.
+// Reports the best of several runs and checks that both paths print the
+// same program. The pipeline can only win with two or more cores.
+// Usage: pipeline_bench [runs] [sources...]   (sources as in bench_source)
+// Run from parser/ or benchmark/: the parser writes ../tests/output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+#include "../include/parser.h"
+#include "../include/FlexScanner.h"
+#include "../include/PipelinedLexer.h"
+
+static Lexer *makeLexer(bool flex, bool pipelined, const std::string &source) {
+    Lexer *lexer;
+    if (flex)
+        lexer = new FlexScanner(source.data(), source.size());
+    else
+        lexer = new Scanner(new FileDescriptor(source.data(), source.size()));
+    return pipelined ? new PipelinedLexer(lexer) : lexer;
+}
+
+// The program printed from the AST
+static std::string printed(AST *root) {
+    char *text = nullptr;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    print_ast_node(out, root);
+    fclose(out);
+    std::string result(text, length);
+    free(text);
+    return result;
+}
+
+// Best time of runs parses, and the program of the last one
+static double bestOf(int runs, bool flex, bool pipelined, const std::string &source,
+                     std::string *program) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        Parser *parser = new Parser(makeLexer(flex, pipelined, source));
+        double start = bench_now();
+        AST *root = parser->start_parsing();
+        double seconds = bench_now() - start;
+        if (parser->had_error) {
+            fprintf(stderr, "benchmark program failed to parse\n");
+            exit(1);
+        }
+        if (seconds < best) best = seconds;
+        if (i == runs - 1) *program = printed(root);
+        delete parser;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int runs = argc > 1 ? atoi(argv[1]) : 3;
+    std::vector<const char *> sources;
+    for (int i = 2; i < argc; i++) sources.push_back(argv[i]);
+    if (sources.empty()) {
+        sources.push_back("gen:4M:1");
+        sources.push_back("gen:16M:2");
+    }
+
+    printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    printf("%-14s %-5s %10s %14s %14s %8s\n", "input", "lexer", "MB", "interleaved s",
+           "pipelined s", "speedup");
+    for (const char *spec : sources) {
+        std::string source = bench_source(spec, 1);
+        for (int flex = 0; flex <= 1; flex++) {
+            std::string sequentialProgram, pipelinedProgram;
+            double sequential = bestOf(runs, flex, false, source, &sequentialProgram);
+            double pipelined = bestOf(runs, flex, true, source, &pipelinedProgram);
+            printf("%-14s %-5s %10.1f %14.3f %14.3f %7.2fx%s\n", spec, flex ? "flex" : "hand",
+                   source.size() / 1e6, sequential, pipelined, sequential / pipelined,
+                   sequentialProgram == pipelinedProgram ? "" : "  MISMATCH");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Lowers programs to bytecode, optimizes them, and allocates registers for
+// every routine, reporting for each how many values it has, how many were
+// spilled to the stack and how often those are read or written, and how
+// many registers are saved around calls.
+// Usage: regalloc_stats [--registers N] [sources...]   (sources as in
+// bench_source; --registers allocates only the first N of the usual 11)
+// Run from parser/ or benchmark/: the parser writes ../tests/output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bench_util.h"
+#include "../include/parser.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/PeepholeOptimizer.h"
+#include "../include/RegisterAllocator.h"
+
+int main(int argc, char **argv) {
+    std::vector<const char *> sources;
+    int registers = 32;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--registers") == 0 && i + 1 < argc)
+            registers = atoi(argv[++i]);
+        else
+            sources.push_back(argv[i]);
+    }
+    if (sources.empty()) {
+        // The test programs that run, and a generated one
+        static const char *corpus[] = {
+            "../tests/test1_isEven.txt", "../tests/test3_outer_scope.txt",
+            "../tests/test5_all_operators.txt", "gen:100K:1",
+        };
+        for (const char *spec : corpus) sources.push_back(spec);
+    }
+    uint32_t allowed = 0;
+    for (int reg = 0; reg < NUM_X86_REGISTERS && registers > 0; reg++) {
+        if (RegisterAllocator::DEFAULT_REGISTERS >> reg & 1) {
+            allowed |= 1u << reg;
+            registers--;
+        }
+    }
+
+    RegisterAllocator allocator(allowed);
+    long values = 0, spilled = 0, accesses = 0, saves = 0, routines = 0, spilling = 0;
+    printf("%-36s %-12s %8s %8s %8s %8s %8s\n", "source", "routine", "code", "values",
+           "spilled", "accesses", "saves");
+    for (const char *spec : sources) {
+        std::string source = bench_source(spec, 1);
+        Parser parser(new Scanner(new FileDescriptor(source.data(), source.size())));
+        AST *program = parser.start_parsing();
+        Module module;
+        if (parser.had_error || BytecodeCompiler().compile(program, module) != 0) {
+            printf("%-36s does not compile\n", spec);
+            continue;
+        }
+        PeepholeOptimizer optimizer;
+        optimizer.optimize(module);
+        optimizer.schedule(module);
+        for (const Function &function : module.functions) {
+            Allocation allocation;
+            allocator.allocate(module, function, allocation);
+            printf("%-36s %-12s %8zu %8d %8d %8d %8d\n", spec, function.name.c_str(),
+                   function.code.size(), allocation.intervals, allocation.spilled,
+                   allocation.spillAccesses, allocation.callSaves);
+            routines++;
+            spilling += allocation.spilled > 0;
+            values += allocation.intervals;
+            spilled += allocation.spilled;
+            accesses += allocation.spillAccesses;
+            saves += allocation.callSaves;
+        }
+    }
+    printf("\n%ld routines with %d registers, %ld of them spilling: %ld values, %ld spilled "
+           "(%.1f%%), %ld spill accesses, %ld saves at calls\n",
+           routines, __builtin_popcount(allowed), spilling, values, spilled,
+           values ? 100.0 * spilled / values : 0.0, accesses, saves);
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Scaling of the ParallelScanner over 1..max_threads threads. Threads beyond
+// the hardware's take turns on its cores, so their speedups say nothing
+// about scaling; they are marked.
+// Usage: scan_bench [source] [copies] [max threads]
+// (source as in bench_source, default gen:4M)
+#include <stdio.h>
+#include <thread>
+#include "bench_util.h"
+#include "../include/ParallelScanner.h"
+
+static void free_tokens(std::vector<TOKEN*> &tokens) {
+    for (TOKEN *token : tokens) {
+        delete token;
+    }
+    tokens.clear();
+}
+
+int main(int argc, char **argv) {
+    const char *fileName = argc > 1 ? argv[1] : "gen:4M";
+    int copies = argc > 2 ? atoi(argv[2]) : 2000;
+    int maxThreads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    if (maxThreads < 1) maxThreads = 1;
+
+    std::string source = bench_source(fileName, copies);
+    printf("input: %s, %.1f MB, %u hardware threads\n", fileName,
+           source.size() / 1e6, std::thread::hardware_concurrency());
+
+    // Single chunk result to check the others against
+    std::vector<TOKEN*> reference = ParallelScanner(source.data(), source.size(), 1).ScanAll();
+    printf("%zu tokens\n\n%8s %10s %14s %8s\n", reference.size(), "threads", "seconds",
+           "tokens/sec", "speedup");
+
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double start = bench_now();
+        std::vector<TOKEN*> tokens = ParallelScanner(source.data(), source.size(), threads).ScanAll();
+        double seconds = bench_now() - start;
+
+        bool same = tokens.size() == reference.size();
+        for (size_t i = 0; same && i < tokens.size(); i++) {
+            same = tokens[i]->type == reference[i]->type && tokens[i]->line == reference[i]->line;
+        }
+        if (threads == 1) base = seconds;
+        printf("%8d %10.3f %14.0f %7.2fx%s%s\n", threads, seconds, tokens.size() / seconds,
+               base / seconds, same ? "" : "  MISMATCH",
+               threads > (int)std::thread::hardware_concurrency() ? "  (oversubscribed)" : "");
+        free_tokens(tokens);
+    }
+    free_tokens(reference);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Measures how long a program takes to be ready to run, launched from its
+// source (read, parse, check, lower to bytecode, optimize and schedule) and
+// from a ModuleImage written beforehand (map and check), reporting the
+// median of each over repetitions and the sizes of source and image. Each
+// source is written to a file first, so both launches start from one.
+// Usage: startup_bench [--reps N] [sources...]   (sources as in bench_source)
+// Run from parser/ or benchmark/: the parser writes ../tests/output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "bench_util.h"
+#include "../include/parser.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/PeepholeOptimizer.h"
+#include "../include/ModuleImage.h"
+
+static double median(std::vector<double> &times) {
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Returns whether the source compiled
+static bool launchSource(const char *fileName, Module &module) {
+    Parser parser(new FileDescriptor(fileName));
+    AST *program = parser.start_parsing();
+    if (parser.had_error || BytecodeCompiler().compile(program, module) != 0)
+        return false;
+    PeepholeOptimizer optimizer;
+    optimizer.optimize(module);
+    optimizer.schedule(module);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::vector<const char *> sources;
+    int reps = 21;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+            reps = std::max(1, atoi(argv[++i]));
+        else
+            sources.push_back(argv[i]);
+    }
+    if (sources.empty()) {
+        // The test programs that run without input, and generated ones
+        static const char *corpus[] = {
+            "../tests/test3_outer_scope.txt", "../tests/test5_all_operators.txt",
+            "gen:10K:1", "gen:100K:1", "gen:1M:1",
+        };
+        for (const char *spec : corpus) sources.push_back(spec);
+    }
+    char directory[] = "/tmp/startup_bench.XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        fprintf(stderr, "Could not make a directory\n");
+        return 1;
+    }
+    std::string sourceName = std::string(directory) + "/source";
+    std::string imageName = std::string(directory) + "/image";
+
+    printf("%-36s %10s %10s %12s %12s %9s\n", "source", "bytes", "image", "source ms",
+           "image ms", "speedup");
+    for (const char *spec : sources) {
+        std::string source = bench_source(spec, 1);
+        FILE *file = fopen(sourceName.c_str(), "wb");
+        if (file == nullptr || fwrite(source.data(), 1, source.size(), file) != source.size()) {
+            fprintf(stderr, "Could not write %s\n", sourceName.c_str());
+            return 1;
+        }
+        fclose(file);
+
+        Module compiled;
+        if (!launchSource(sourceName.c_str(), compiled)) {
+            printf("%-36s does not compile\n", spec);
+            continue;
+        }
+        ModuleImage written;
+        written.build(compiled);
+        if (written.write(imageName.c_str()) != 0)
+            return 1;
+
+        std::vector<double> fromSource, fromImage;
+        for (int rep = 0; rep < reps; rep++) {
+            double start = bench_now();
+            Module module;
+            launchSource(sourceName.c_str(), module);
+            fromSource.push_back(bench_now() - start);
+
+            start = bench_now();
+            ModuleImage image;
+            if (image.load(imageName.c_str()) != 0)
+                return 1;
+            fromImage.push_back(bench_now() - start);
+        }
+        double sourceTime = median(fromSource), imageTime = median(fromImage);
+        printf("%-36s %10zu %10zu %12.3f %12.4f %8.0fx\n", spec, source.size(), written.size(),
+               sourceTime * 1e3, imageTime * 1e3, sourceTime / imageTime);
+    }
+
+    remove(sourceName.c_str());
+    remove(imageName.c_str());
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "../include/ElfWriter.h"
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+
+// The sections after those symbols can be defined in
+enum {
+    section_rela = ElfWriter::section_rodata + 1,
+    section_symtab,
+    section_strtab,
+    section_shstrtab,
+    section_note,
+    NUM_SECTIONS
+};
+
+ElfWriter::ElfWriter() {
+    symbols.push_back(Symbol{"", section_undefined, 0, 0, false, false, false});
+    for (Section section : {section_text, section_data, section_rodata})
+        symbols.push_back(Symbol{"", section, 0, 0, false, false, true});
+}
+
+int ElfWriter::addSymbol(const std::string &name, Section section, uint64_t value,
+                         uint64_t size, bool global, bool function) {
+    symbols.push_back(Symbol{name, section, value, size,
+                             global || section == section_undefined, function, false});
+    return (int)symbols.size() - 1;
+}
+
+int ElfWriter::write(const char *fileName) const {
+    std::vector<int> order, number(symbols.size());
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < symbols.size(); i++) {
+            if (symbols[i].global == (pass == 1)) {
+                number[i] = (int)order.size();
+                order.push_back((int)i);
+            }
+        }
+    }
+    uint32_t firstGlobal = 0;
+    while (firstGlobal < order.size() && !symbols[order[firstGlobal]].global) firstGlobal++;
+
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> symtab;
+    for (int i : order) {
+        const Symbol &symbol = symbols[i];
+        Elf64_Sym entry;
+        memset(&entry, 0, sizeof(entry));
+        if (!symbol.name.empty()) {
+            entry.st_name = (uint32_t)strtab.size();
+            strtab += symbol.name;
+            strtab += '\0';
+        }
+        int type = symbol.isSection ? STT_SECTION : symbol.function ? STT_FUNC : STT_NOTYPE;
+        entry.st_info = ELF64_ST_INFO(symbol.global ? STB_GLOBAL : STB_LOCAL, type);
+        entry.st_shndx = (uint16_t)symbol.section;
+        entry.st_value = symbol.value;
+        entry.st_size = symbol.size;
+        symtab.push_back(entry);
+    }
+
+    std::vector<Elf64_Rela> rela;
+    for (const X86Relocation &relocation : relocations) {
+        Elf64_Rela entry;
+        entry.r_offset = relocation.offset;
+        entry.r_info = ELF64_R_INFO((uint64_t)number[relocation.symbol], relocation.type);
+        entry.r_addend = relocation.addend;
+        rela.push_back(entry);
+    }
+
+    static const char *names[NUM_SECTIONS] = {
+        "", ".text", ".data", ".rodata", ".rela.text", ".symtab", ".strtab", ".shstrtab",
+        ".note.GNU-stack",
+    };
+    std::string shstrtab;
+    Elf64_Shdr headers[NUM_SECTIONS];
+    memset(headers, 0, sizeof(headers));
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+        headers[s].sh_name = (uint32_t)shstrtab.size();
+        shstrtab += names[s];
+        shstrtab += '\0';
+    }
+    auto describe = [&](int s, uint32_t type, uint64_t flags, uint64_t align) {
+        headers[s].sh_type = type;
+        headers[s].sh_flags = flags;
+        headers[s].sh_addralign = align;
+    };
+    describe(section_text, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16);
+    describe(section_data, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8);
+    describe(section_rodata, SHT_PROGBITS, SHF_ALLOC, 1);
+    describe(section_rela, SHT_RELA, SHF_INFO_LINK, 8);
+    headers[section_rela].sh_link = section_symtab;
+    headers[section_rela].sh_info = section_text;
+    headers[section_rela].sh_entsize = sizeof(Elf64_Rela);
+    describe(section_symtab, SHT_SYMTAB, 0, 8);
+    headers[section_symtab].sh_link = section_strtab;
+    headers[section_symtab].sh_info = firstGlobal;
+    headers[section_symtab].sh_entsize = sizeof(Elf64_Sym);
+    describe(section_strtab, SHT_STRTAB, 0, 1);
+    describe(section_shstrtab, SHT_STRTAB, 0, 1);
+    describe(section_note, SHT_PROGBITS, 0, 1);
+
+    // The header, each section's contents at its alignment, then the
+    // section headers
+    std::vector<uint8_t> file(sizeof(Elf64_Ehdr));
+    auto place = [&](int s, const void *bytes, size_t size) {
+        uint64_t align = headers[s].sh_addralign;
+        file.resize((file.size() + align - 1) / align * align);
+        headers[s].sh_offset = file.size();
+        headers[s].sh_size = size;
+        const uint8_t *p = (const uint8_t *)bytes;
+        file.insert(file.end(), p, p + size);
+    };
+    place(section_text, text.data(), text.size());
+    place(section_data, data.data(), data.size());
+    place(section_rodata, rodata.data(), rodata.size());
+    place(section_rela, rela.data(), rela.size() * sizeof(Elf64_Rela));
+    place(section_symtab, symtab.data(), symtab.size() * sizeof(Elf64_Sym));
+    place(section_strtab, strtab.data(), strtab.size());
+    place(section_shstrtab, shstrtab.data(), shstrtab.size());
+    place(section_note, nullptr, 0);
+    file.resize((file.size() + 7) / 8 * 8);
+    uint64_t headerOffset = file.size();
+    const uint8_t *h = (const uint8_t *)headers;
+    file.insert(file.end(), h, h + sizeof(headers));
+
+    Elf64_Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = headerOffset;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = NUM_SECTIONS;
+    ehdr.e_shstrndx = section_shstrtab;
+    memcpy(file.data(), &ehdr, sizeof(ehdr));
+
+    FILE *fp = fopen(fileName, "wb");
+    bool ok = fp != nullptr && fwrite(file.data(), 1, file.size(), fp) == file.size();
+    if (fp != nullptr && fclose(fp) != 0)
+        ok = false;
+    if (!ok) {
+        fprintf(stderr, "Could not write %s\n", fileName);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,467 @@
+#include "../include/NativeCompiler.h"
+#include "../include/Runtime.h"
+#include "../include/stats.h"
+
+static const char *runtimeNames[] = {
+    "n23rt_read_integer", "n23rt_read_float", "n23rt_read_boolean", "n23rt_read_string",
+    "n23rt_write_integer", "n23rt_write_float", "n23rt_write_boolean", "n23rt_write_string",
+    "n23rt_same_string", "n23rt_fail",
+};
+
+static bool isRegister(const X86Operand &operand, int reg) {
+    return operand.kind == X86Operand::kind_register && operand.reg == reg;
+}
+
+int NativeCompiler::compile(const Module &module, const char *fileName) {
+    PhaseTimer timer(phase_codegen);
+    this->module = &module;
+    as = X86Assembler();
+    ElfWriter elf;
+    dataSymbol = elf.sectionSymbol(ElfWriter::section_data);
+    rodataSymbol = elf.sectionSymbol(ElfWriter::section_rodata);
+    for (int f = 0; f < NUM_RUNTIME_FUNCTIONS; f++)
+        runtime[f] = elf.addSymbol(runtimeNames[f], ElfWriter::section_undefined);
+
+    // .rodata holds the strings, then the failure messages; .data the
+    // globals, then the counts of frames and slots
+    auto constant = [&](const std::string &text) {
+        int32_t offset = (int32_t)elf.rodata.size();
+        elf.rodata.insert(elf.rodata.end(), text.begin(), text.end());
+        elf.rodata.push_back(0);
+        return offset;
+    };
+    stringOffsets.clear();
+    for (const std::string &text : module.strings) stringOffsets.push_back(constant(text));
+    overflowMessage = constant("stack overflow");
+    divisionMessage = constant("division by zero");
+    depthOffset = 8 * module.globals;
+    slotsOffset = depthOffset + 4;
+    elf.data.assign(8 * module.globals + 8, 0);
+
+    entries.clear();
+    for (size_t f = 0; f < module.functions.size(); f++) entries.push_back(as.newLabel());
+    std::vector<uint64_t> starts;
+    for (size_t f = 0; f < module.functions.size(); f++) {
+        starts.push_back(as.here());
+        compileFunction((int)f);
+    }
+    starts.push_back(as.here());
+    as.finish();
+
+    // Routines are n23_ and their names, which can't clash with the
+    // runtime's n23rt_; blocks are local, with a dot no name can have
+    for (size_t f = 0; f < module.functions.size(); f++) {
+        bool main = (int)f == module.main, routine = (int)f < module.routines;
+        std::string name = main ? "n23main" : (routine ? "n23_" : "n23.") + module.functions[f].name;
+        elf.addSymbol(name, ElfWriter::section_text, starts[f], starts[f + 1] - starts[f],
+                      main || routine, true);
+    }
+    elf.text = as.code;
+    elf.relocations = as.relocations;
+    codeBytes = as.code.size();
+    stats_count(count_code_bytes, codeBytes);
+    return elf.write(fileName);
+}
+
+bool NativeCompiler::placed(int reg) const {
+    return allocation.registerOf[reg] >= 0 || allocation.slotOf[reg] >= 0;
+}
+
+// A register that is never live has no place; what is written to it goes
+// to rax, which nothing reads
+X86Operand NativeCompiler::place(int reg) const {
+    if (allocation.registerOf[reg] >= 0)
+        return x86_reg(allocation.registerOf[reg]);
+    if (allocation.slotOf[reg] >= 0)
+        return x86_mem(reg_rbp, spillBase - 8 * allocation.slotOf[reg]);
+    return x86_reg(reg_rax);
+}
+
+// All 64 bits, through rax if both are in memory
+void NativeCompiler::move(const X86Operand &dst, const X86Operand &src) {
+    if (dst.kind == src.kind && dst.reg == src.reg && dst.offset == src.offset &&
+        dst.symbol == src.symbol)
+        return;
+    if (dst.kind == X86Operand::kind_register || src.kind == X86Operand::kind_register) {
+        as.mov(dst, src, true);
+    } else {
+        as.mov(x86_reg(reg_rax), src, true);
+        as.mov(dst, x86_reg(reg_rax), true);
+    }
+}
+
+// The register to compute a new value of dst in, holding src: dst's own,
+// or rax if it has none or it is avoid
+int NativeCompiler::load(const X86Operand &dst, const X86Operand &src, int avoid) {
+    int target = dst.kind == X86Operand::kind_register && dst.reg != avoid ? dst.reg : reg_rax;
+    if (!isRegister(src, target))
+        as.mov(x86_reg(target), src);
+    return target;
+}
+
+void NativeCompiler::store(const X86Operand &dst, int reg) {
+    if (!isRegister(dst, reg))
+        as.mov(dst, x86_reg(reg));
+}
+
+// The frame, down from rbp: the callee-saved registers the function uses,
+// a place for each caller-saved one it saves around calls, then its spill
+// slots, rounded to 16 bytes so calls find the stack aligned. Its
+// arguments are above the return address, the first at rbp + 16.
+void NativeCompiler::compileFunction(int index) {
+    function = &module->functions[index];
+    allocator.allocate(*module, *function, allocation);
+    const std::vector<Instruction> &code = function->code;
+
+    uint32_t saved = 0;
+    for (uint32_t bits : allocation.savedAt) saved |= bits;
+    int32_t size = 0;
+    for (int reg = 0; reg < NUM_X86_REGISTERS; reg++) {
+        calleeSlot[reg] = saveSlot[reg] = 0;
+        if (allocation.calleeSaved >> reg & 1)
+            calleeSlot[reg] = -(size += 8);
+        else if (saved >> reg & 1)
+            saveSlot[reg] = -(size += 8);
+    }
+    spillBase = -(size + 8);
+    size = (size + 8 * allocation.spillSlots + 15) & ~15;
+
+    labels.clear();
+    for (size_t i = 0; i <= code.size(); i++) labels.push_back(as.newLabel());
+    returnLabel = as.newLabel();
+    overflowLabel = as.newLabel();
+    divisionLabel = as.newLabel();
+    divides = false;
+
+    as.bind(entries[index]);
+    as.push(x86_reg(reg_rbp));
+    as.mov(x86_reg(reg_rbp), x86_reg(reg_rsp), true);
+    if (size > 0)
+        as.alu(alu_sub, x86_reg(reg_rsp), size, true);
+
+    // Runtime::pushFrame's checks
+    X86Operand depth = x86_symbol(dataSymbol, depthOffset);
+    X86Operand slots = x86_symbol(dataSymbol, slotsOffset);
+    as.mov(x86_reg(reg_rax), depth);
+    as.alu(alu_cmp, x86_reg(reg_rax), Runtime::MAX_CALL_DEPTH);
+    as.jcc(cc_ae, overflowLabel);
+    as.alu(alu_add, x86_reg(reg_rax), 1);
+    as.mov(depth, x86_reg(reg_rax));
+    as.mov(x86_reg(reg_rax), slots);
+    as.alu(alu_add, x86_reg(reg_rax), function->registers);
+    as.alu(alu_cmp, x86_reg(reg_rax), Runtime::STACK_SLOTS);
+    as.jcc(cc_a, overflowLabel);
+    as.mov(slots, x86_reg(reg_rax));
+
+    for (int reg = 0; reg < NUM_X86_REGISTERS; reg++) {
+        if (allocation.calleeSaved >> reg & 1)
+            as.mov(x86_mem(reg_rbp, calleeSlot[reg]), x86_reg(reg), true);
+    }
+    for (int k = 0; k < function->params; k++) {
+        if (placed(k))
+            move(place(k), x86_mem(reg_rbp, 16 + 8 * k));
+    }
+
+    for (size_t i = 0; i < code.size(); i++) {
+        as.bind(labels[i]);
+        instruction(i);
+    }
+    as.bind(labels[code.size()]);
+
+    // The result is in rax
+    as.bind(returnLabel);
+    as.alu(alu_sub, depth, 1);
+    as.alu(alu_sub, slots, function->registers);
+    for (int reg = 0; reg < NUM_X86_REGISTERS; reg++) {
+        if (allocation.calleeSaved >> reg & 1)
+            as.mov(x86_reg(reg), x86_mem(reg_rbp, calleeSlot[reg]), true);
+    }
+    as.leave();
+    as.ret();
+
+    fail(overflowLabel, overflowMessage);
+    if (divides)
+        fail(divisionLabel, divisionMessage);
+}
+
+void NativeCompiler::fail(int label, int32_t message) {
+    as.bind(label);
+    as.lea(reg_rdi, x86_symbol(rodataSymbol, message));
+    as.callSymbol(runtime[rt_fail]);
+}
+
+// Saves, or restores, the caller-saved registers live across the call at i
+void NativeCompiler::save(size_t i, bool restore) {
+    for (uint32_t bits = allocation.savedAt[i]; bits != 0; bits &= bits - 1) {
+        int reg = __builtin_ctz(bits);
+        X86Operand slot = x86_mem(reg_rbp, saveSlot[reg]);
+        if (restore)
+            as.mov(x86_reg(reg), slot, true);
+        else
+            as.mov(slot, x86_reg(reg), true);
+    }
+}
+
+// add, subtract or multiply
+void NativeCompiler::arithmetic(const Instruction &in) {
+    X86Operand a = place(in.a), c = place(in.c);
+    int avoid = c.kind == X86Operand::kind_register ? c.reg : -1;
+    int target = load(a, place(in.b), avoid);
+    if (in.op == op_multiply)
+        as.imul(target, c);
+    else
+        as.alu(in.op == op_add ? alu_add : alu_sub, target, c);
+    store(a, target);
+}
+
+void NativeCompiler::compare(int left, int right) {
+    X86Operand l = place(left);
+    if (l.kind != X86Operand::kind_register) {
+        as.mov(x86_reg(reg_rax), l);
+        l = x86_reg(reg_rax);
+    }
+    as.alu(alu_cmp, l.reg, place(right));
+}
+
+// dst := 1 if the flags meet cc, else 0
+void NativeCompiler::condition(int dst, X86Condition cc) {
+    X86Operand a = place(dst);
+    as.setcc(cc, reg_rax);
+    int target = a.kind == X86Operand::kind_register ? a.reg : reg_rax;
+    as.movzxByte(target, reg_rax);
+    store(a, target);
+}
+
+// Floats are moved to xmm0 and xmm1 and back
+void NativeCompiler::floating(const Instruction &in, X86Sse op) {
+    as.movd(0, place(in.b));
+    X86Operand c = place(in.c);
+    if (c.kind == X86Operand::kind_register) {
+        as.movd(1, c);
+        c = x86_reg(1);
+    }
+    as.sse(op, 0, c);
+    as.movd(place(in.a), 0);
+}
+
+// ucomiss sets the flags as an unsigned comparison would, and sets ZF, PF
+// and CF when either operand is NaN. So less and less or equal are tested
+// as above and above or equal with the operands swapped, which are false
+// for NaN; equal also needs PF clear, and not equal is true when it is set.
+void NativeCompiler::floatCompare(const Instruction &in) {
+    as.movd(0, place(in.b));
+    as.movd(1, place(in.c));
+    bool swap = in.op == op_flt || in.op == op_fle;
+    as.ucomiss(swap ? 1 : 0, x86_reg(swap ? 0 : 1));
+    X86Condition cc = in.op == op_feq ? cc_e : in.op == op_fne ? cc_ne
+                    : in.op == op_flt || in.op == op_fgt ? cc_a : cc_ae;
+    if (in.op != op_feq && in.op != op_fne) {
+        condition(in.a, cc);
+        return;
+    }
+    as.setcc(cc, reg_rax);
+    as.setcc(in.op == op_feq ? cc_np : cc_p, reg_rdx);
+    as.movzxByte(reg_rax, reg_rax);
+    as.movzxByte(reg_rdx, reg_rdx);
+    as.alu(in.op == op_feq ? alu_and : alu_or, reg_rax, x86_reg(reg_rdx));
+    store(place(in.a), reg_rax);
+}
+
+static X86Condition integerCondition(int op) {
+    switch (op) {
+        case op_eq: case op_beq: case op_jump_eq: return cc_e;
+        case op_ne: case op_bne: case op_jump_ne: return cc_ne;
+        case op_lt: case op_jump_lt: return cc_l;
+        case op_le: case op_jump_le: return cc_le;
+        case op_gt: case op_jump_gt: return cc_g;
+        default: return cc_ge;
+    }
+}
+
+void NativeCompiler::instruction(size_t i) {
+    const Instruction &in = function->code[i];
+    bool last = i + 1 == function->code.size();
+    switch (in.op) {
+        case op_nop:
+            break;
+        case op_const: {
+            // All 8 bytes in memory, as a string's null must be
+            X86Operand a = place(in.a);
+            as.mov(a, in.b, a.kind != X86Operand::kind_register);
+            break;
+        }
+        case op_string: {
+            X86Operand a = place(in.a);
+            int target = a.kind == X86Operand::kind_register ? a.reg : reg_rax;
+            as.lea(target, x86_symbol(rodataSymbol, stringOffsets[in.b]));
+            if (target != a.reg || a.kind != X86Operand::kind_register)
+                as.mov(a, x86_reg(target), true);
+            break;
+        }
+        case op_move:
+            move(place(in.a), place(in.b));
+            break;
+        case op_load_global:
+            move(place(in.a), x86_symbol(dataSymbol, 8 * in.b));
+            break;
+        case op_store_global:
+            move(x86_symbol(dataSymbol, 8 * in.a), place(in.b));
+            break;
+
+        case op_add:
+        case op_subtract:
+        case op_multiply:
+            arithmetic(in);
+            break;
+        case op_divide: {
+            // Runtime::divide: by zero fails, and by -1 negates, which
+            // idiv would trap on for the smallest integer
+            int negate = as.newLabel(), done = as.newLabel();
+            as.mov(x86_reg(reg_r11), place(in.c));
+            as.test(x86_reg(reg_r11), reg_r11);
+            as.jcc(cc_e, divisionLabel);
+            divides = true;
+            as.mov(x86_reg(reg_rax), place(in.b));
+            as.alu(alu_cmp, x86_reg(reg_r11), -1);
+            as.jcc(cc_e, negate);
+            as.cdq();
+            as.idiv(x86_reg(reg_r11));
+            as.jmp(done);
+            as.bind(negate);
+            as.neg(x86_reg(reg_rax));
+            as.bind(done);
+            store(place(in.a), reg_rax);
+            break;
+        }
+        case op_add_immediate: {
+            X86Operand a = place(in.a);
+            int target = load(a, place(in.b));
+            as.alu(alu_add, x86_reg(target), in.c);
+            store(a, target);
+            break;
+        }
+        case op_negate:
+        case op_not:
+        case op_fnegate: {
+            X86Operand a = place(in.a);
+            int target = load(a, place(in.b));
+            if (in.op == op_negate)
+                as.neg(x86_reg(target));
+            else
+                as.alu(alu_xor, x86_reg(target), in.op == op_not ? 1 : INT32_MIN);
+            store(a, target);
+            break;
+        }
+        case op_eq: case op_ne: case op_lt: case op_le: case op_gt: case op_ge:
+        case op_beq: case op_bne:
+            compare(in.b, in.c);
+            condition(in.a, integerCondition(in.op));
+            break;
+
+        case op_fadd: floating(in, sse_add); break;
+        case op_fsubtract: floating(in, sse_subtract); break;
+        case op_fmultiply: floating(in, sse_multiply); break;
+        case op_fdivide: floating(in, sse_divide); break;
+        case op_feq: case op_fne: case op_flt: case op_fle: case op_fgt: case op_fge:
+            floatCompare(in);
+            break;
+        case op_itof:
+            as.sse(sse_cvtsi2ss, 0, place(in.b));
+            as.movd(place(in.a), 0);
+            break;
+
+        case op_seq:
+        case op_sne:
+            save(i, false);
+            as.mov(x86_reg(reg_rax), place(in.b), true);
+            as.mov(x86_reg(reg_r11), place(in.c), true);
+            as.mov(x86_reg(reg_rdi), x86_reg(reg_rax), true);
+            as.mov(x86_reg(reg_rsi), x86_reg(reg_r11), true);
+            as.callSymbol(runtime[rt_same_string]);
+            save(i, true);
+            if (in.op == op_sne)
+                as.alu(alu_xor, x86_reg(reg_rax), 1);
+            store(place(in.a), reg_rax);
+            break;
+
+        case op_jump:
+            if (in.a != (int)i + 1)
+                as.jmp(labels[in.a]);
+            break;
+        case op_jump_if_true:
+        case op_jump_if_false: {
+            X86Operand b = place(in.b);
+            if (b.kind == X86Operand::kind_register)
+                as.test(b, b.reg);
+            else
+                as.alu(alu_cmp, b, 0);
+            as.jcc(in.op == op_jump_if_true ? cc_ne : cc_e, labels[in.a]);
+            break;
+        }
+        case op_jump_eq: case op_jump_ne: case op_jump_lt:
+        case op_jump_le: case op_jump_gt: case op_jump_ge:
+            compare(in.b, in.c);
+            as.jcc(integerCondition(in.op), labels[in.a]);
+            break;
+
+        case op_call: {
+            // The stack stays 16-byte aligned at the call
+            int params = module->functions[in.c].params;
+            save(i, false);
+            if (params % 2 != 0)
+                as.alu(alu_sub, x86_reg(reg_rsp), 8, true);
+            for (int k = params; k-- > 0;) as.push(place(in.b + k));
+            as.call(entries[in.c]);
+            if (params > 0)
+                as.alu(alu_add, x86_reg(reg_rsp), 8 * (params + params % 2), true);
+            save(i, true);
+            move(place(in.a), x86_reg(reg_rax));
+            break;
+        }
+        case op_return:
+            move(x86_reg(reg_rax), place(in.b));
+            if (!last)
+                as.jmp(returnLabel);
+            break;
+        case op_return_none:
+            as.alu(alu_xor, reg_rax, x86_reg(reg_rax));
+            if (!last)
+                as.jmp(returnLabel);
+            break;
+        case op_clear:
+            for (int reg = in.a; reg < in.a + in.b; reg++) {
+                X86Operand r = place(reg);
+                if (!placed(reg))
+                    continue;
+                if (r.kind == X86Operand::kind_register)
+                    as.alu(alu_xor, r.reg, r);
+                else
+                    as.mov(r, 0, true);
+            }
+            break;
+
+        case op_read: {
+            static const RuntimeFunction reads[] = {rt_read_integer, rt_read_float,
+                                                    rt_read_boolean, rt_read_string};
+            save(i, false);
+            as.callSymbol(runtime[reads[in.b - type_integer]]);
+            if (in.b == type_float)
+                as.movd(x86_reg(reg_rax), 0);
+            save(i, true);
+            move(place(in.a), x86_reg(reg_rax));
+            break;
+        }
+        case op_write: {
+            static const RuntimeFunction writes[] = {rt_write_integer, rt_write_float,
+                                                     rt_write_boolean, rt_write_string};
+            save(i, false);
+            if (in.b == type_float)
+                as.movd(0, place(in.a));
+            else
+                move(x86_reg(reg_rdi), place(in.a));
+            as.callSymbol(runtime[writes[in.b - type_integer]]);
+            save(i, true);
+            break;
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#include "../include/RegisterAllocator.h"
+#include <algorithm>
+
+const char *x86_register_name(int reg) {
+    static const char *names[NUM_X86_REGISTERS] = {
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+        "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15",
+    };
+    return reg >= 0 && reg < NUM_X86_REGISTERS ? names[reg] : "?";
+}
+
+// Liveness by the usual backward dataflow over basic blocks, with a bit
+// set of registers per block, then one walk back through each block to
+// find where each register is live
+void RegisterAllocator::computeIntervals(const Module &module, const Function &function) {
+    const std::vector<Instruction> &code = function.code;
+    int n = (int)code.size();
+    live.assign(function.registers, Interval{-1, -1});
+    if (n == 0)
+        return;
+
+    // A block starts at the function's start, at a jump target, and after
+    // a jump or a return
+    std::vector<bool> leader(n + 1);
+    leader[0] = true;
+    for (int i = 0; i < n; i++) {
+        if (is_jump(code[i].op)) {
+            leader[code[i].a] = true;
+            leader[i + 1] = true;
+        } else if (ends_flow(code[i].op)) {
+            leader[i + 1] = true;
+        }
+    }
+    std::vector<int> first, blockOf(n + 1);
+    for (int i = 0; i < n; i++) {
+        if (leader[i])
+            first.push_back(i);
+        blockOf[i] = (int)first.size() - 1;
+    }
+    int blocks = (int)first.size();
+    first.push_back(n);
+    blockOf[n] = blocks;
+
+    size_t words = (function.registers + 63) / 64;
+    std::vector<uint64_t> use(blocks * words), def(blocks * words);
+    std::vector<uint64_t> in(blocks * words), out(blocks * words);
+    auto has = [&](std::vector<uint64_t> &set, int block, int reg) {
+        return set[block * words + reg / 64] >> (reg % 64) & 1;
+    };
+    auto add = [&](std::vector<uint64_t> &set, int block, int reg) {
+        set[block * words + reg / 64] |= 1ull << (reg % 64);
+    };
+    for (int b = 0; b < blocks; b++) {
+        for (int i = first[b]; i < first[b + 1]; i++) {
+            for_each_use(module, code[i], [&](int reg) {
+                if (!has(def, b, reg))
+                    add(use, b, reg);
+            });
+            for_each_def(code[i], [&](int reg) { add(def, b, reg); });
+        }
+    }
+
+    // out is the union of the successors' in; in is use, and out less def
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = blocks - 1; b >= 0; b--) {
+            const Instruction &last = code[first[b + 1] - 1];
+            int successors[2], count = 0;
+            if (!ends_flow(last.op) && b + 1 < blocks)
+                successors[count++] = b + 1;
+            if (is_jump(last.op) && blockOf[last.a] < blocks)
+                successors[count++] = blockOf[last.a];
+            for (size_t w = 0; w < words; w++) {
+                uint64_t bits = 0;
+                for (int s = 0; s < count; s++) bits |= in[successors[s] * words + w];
+                out[b * words + w] = bits;
+                uint64_t entry = use[b * words + w] | (bits & ~def[b * words + w]);
+                if (entry != in[b * words + w]) {
+                    in[b * words + w] = entry;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    auto extend = [&](int reg, int point) {
+        Interval &interval = live[reg];
+        if (interval.start < 0 || point < interval.start)
+            interval.start = point;
+        if (point > interval.end)
+            interval.end = point;
+    };
+    for (int b = 0; b < blocks; b++) {
+        int start = first[b], end = first[b + 1] - 1;
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t bits = out[b * words + w]; bits != 0; bits &= bits - 1)
+                extend((int)(w * 64 + __builtin_ctzll(bits)), 2 * end + 1);
+            for (uint64_t bits = in[b * words + w]; bits != 0; bits &= bits - 1)
+                extend((int)(w * 64 + __builtin_ctzll(bits)), 2 * start);
+        }
+        for (int i = end; i >= start; i--) {
+            for_each_def(code[i], [&](int reg) { extend(reg, 2 * i + 1); });
+            for_each_use(module, code[i], [&](int reg) { extend(reg, 2 * i); });
+        }
+    }
+}
+
+void RegisterAllocator::allocate(const Module &module, const Function &function,
+                                 Allocation &allocation) {
+    computeIntervals(module, function);
+    const std::vector<Instruction> &code = function.code;
+    allocation.registerOf.assign(function.registers, -1);
+    allocation.slotOf.assign(function.registers, -1);
+    allocation.spillSlots = 0;
+    allocation.calleeSaved = 0;
+    allocation.savedAt.assign(code.size(), 0);
+    allocation.intervals = 0;
+    allocation.spilled = 0;
+    allocation.spillAccesses = 0;
+    allocation.callSaves = 0;
+
+    std::vector<int> calls;
+    for (size_t i = 0; i < code.size(); i++) {
+        if (x86_calls_out(code[i].op))
+            calls.push_back((int)i);
+    }
+    // The first call that reads its operands at or after the interval's
+    // start, if the interval is still live after it, or calls.end()
+    auto firstCallAcross = [&](const Interval &interval) {
+        auto call = std::lower_bound(calls.begin(), calls.end(), (interval.start + 1) / 2);
+        return call != calls.end() && 2 * *call + 1 < interval.end ? call : calls.end();
+    };
+
+    std::vector<int> order;
+    for (int reg = 0; reg < function.registers; reg++) {
+        if (live[reg].start >= 0)
+            order.push_back(reg);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return live[a].start < live[b].start; });
+    allocation.intervals = (int)order.size();
+
+    uint32_t callee = 0;
+    for (int reg = 0; reg < NUM_X86_REGISTERS; reg++) {
+        if (x86_callee_saved(reg))
+            callee |= 1u << reg;
+    }
+    uint32_t available = allocatable;
+    std::vector<int> active;            // holding registers
+    auto spill = [&](int reg) {
+        allocation.registerOf[reg] = -1;
+        allocation.slotOf[reg] = allocation.spillSlots++;
+        allocation.spilled++;
+    };
+    for (int reg : order) {
+        const Interval &interval = live[reg];
+        for (size_t i = 0; i < active.size();) {
+            if (live[active[i]].end < interval.start) {
+                available |= 1u << allocation.registerOf[active[i]];
+                active[i] = active.back();
+                active.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        uint32_t kept = available & callee, clobbered = available & ~callee;
+        uint32_t choice = firstCallAcross(interval) != calls.end() ? (kept ? kept : clobbered)
+                                                                  : (clobbered ? clobbered : kept);
+        if (choice != 0) {
+            int physical = __builtin_ctz(choice);
+            available &= ~(1u << physical);
+            allocation.registerOf[reg] = physical;
+            active.push_back(reg);
+            continue;
+        }
+        if (active.empty()) {
+            spill(reg);
+            continue;
+        }
+        size_t victim = 0;
+        for (size_t i = 1; i < active.size(); i++) {
+            if (live[active[i]].end > live[active[victim]].end)
+                victim = i;
+        }
+        if (live[active[victim]].end > interval.end) {
+            allocation.registerOf[reg] = allocation.registerOf[active[victim]];
+            spill(active[victim]);
+            active[victim] = reg;
+        } else {
+            spill(reg);
+        }
+    }
+
+    for (int reg : order) {
+        int physical = allocation.registerOf[reg];
+        if (physical < 0)
+            continue;
+        if (x86_callee_saved(physical)) {
+            allocation.calleeSaved |= 1u << physical;
+            continue;
+        }
+        for (auto call = firstCallAcross(live[reg]);
+             call != calls.end() && 2 * *call + 1 < live[reg].end; ++call) {
+            allocation.savedAt[*call] |= 1u << physical;
+            allocation.callSaves++;
+        }
+    }
+    for (const Instruction &in : code) {
+        auto count = [&](int reg) {
+            if (allocation.slotOf[reg] >= 0)
+                allocation.spillAccesses++;
+        };
+        for_each_use(module, in, count);
+        for_each_def(in, count);
+    }
+}
+
+void print_allocation(FILE *fp, const Function &function, const Allocation &allocation) {
+    fprintf(fp, "%s: %d live, %d spilled to %d slots, %d saves at calls\n",
+            function.name.c_str(), allocation.intervals, allocation.spilled,
+            allocation.spillSlots, allocation.callSaves);
+    for (int reg = 0; reg < function.registers; reg++) {
+        if (allocation.registerOf[reg] >= 0)
+            fprintf(fp, "  r%-5d %s\n", reg, x86_register_name(allocation.registerOf[reg]));
+        else if (allocation.slotOf[reg] >= 0)
+            fprintf(fp, "  r%-5d slot %d\n", reg, allocation.slotOf[reg]);
+    }
+}
@@ -0,0 +1,194 @@
+#include "../include/X86Assembler.h"
+#include <elf.h>
+
+int X86Assembler::newLabel() {
+    labels.push_back(-1);
+    return (int)labels.size() - 1;
+}
+
+void X86Assembler::bind(int label) {
+    labels[label] = (int64_t)here();
+}
+
+void X86Assembler::finish() {
+    for (const Patch &patch : patches) {
+        uint32_t rel = (uint32_t)(labels[patch.label] - (int64_t)(patch.offset + 4));
+        for (int i = 0; i < 4; i++) code[patch.offset + i] = (uint8_t)(rel >> (8 * i));
+    }
+    patches.clear();
+}
+
+void X86Assembler::dword(uint32_t value) {
+    for (int i = 0; i < 4; i++) byte((uint8_t)(value >> (8 * i)));
+}
+
+void X86Assembler::rel32(int label) {
+    patches.push_back(Patch{here(), label});
+    dword(0);
+}
+
+// A REX prefix is needed for 64 bits, for r8 to r15, and to name the low
+// bytes of rsp, rbp, rsi and rdi rather than ah, ch, dh and bh. A base of
+// rsp or r12 needs a SIB byte; one of rbp or r13 needs a displacement,
+// which is always given.
+void X86Assembler::encode(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode,
+                          int reg, const X86Operand &rm, int immediate, bool byteRegister) {
+    if (prefix)
+        byte(prefix);
+    int base = rm.kind == X86Operand::kind_symbol ? 0 : rm.reg;
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg >> 3 & 1) << 2 | (base >> 3 & 1);
+    bool lowByte = byteRegister && rm.kind == X86Operand::kind_register && rm.reg >= 4;
+    if (rex != 0x40 || lowByte)
+        byte(rex);
+    for (uint8_t b : opcode) byte(b);
+    switch (rm.kind) {
+        case X86Operand::kind_register:
+            byte(0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+            break;
+        case X86Operand::kind_memory: {
+            bool small = rm.offset >= -128 && rm.offset <= 127;
+            byte((small ? 0x40 : 0x80) | (reg & 7) << 3 | (rm.reg & 7));
+            if ((rm.reg & 7) == reg_rsp)
+                byte(0x24);
+            if (small)
+                byte((uint8_t)rm.offset);
+            else
+                dword((uint32_t)rm.offset);
+            break;
+        }
+        case X86Operand::kind_symbol:
+            // The address is relative to the end of the instruction
+            byte(0x05 | (reg & 7) << 3);
+            relocations.push_back(X86Relocation{here(), rm.symbol, R_X86_64_PC32,
+                                                (int64_t)rm.offset - 4 - immediate});
+            dword(0);
+            break;
+    }
+}
+
+void X86Assembler::mov(const X86Operand &dst, const X86Operand &src, bool wide) {
+    if (dst.kind == X86Operand::kind_register)
+        encode(0, wide, {0x8B}, dst.reg, src);
+    else
+        encode(0, wide, {0x89}, src.reg, dst);
+}
+
+// Into a register, 32 bits are zero-extended; wide, they are sign-extended
+void X86Assembler::mov(const X86Operand &dst, int32_t immediate, bool wide) {
+    if (dst.kind == X86Operand::kind_register && !wide) {
+        if (dst.reg >= 8)
+            byte(0x41);
+        byte(0xB8 + (dst.reg & 7));
+    } else {
+        encode(0, wide, {0xC7}, 0, dst, 4);
+    }
+    dword((uint32_t)immediate);
+}
+
+void X86Assembler::lea(int dst, const X86Operand &src) {
+    encode(0, true, {0x8D}, dst, src);
+}
+
+void X86Assembler::alu(X86Alu op, int dst, const X86Operand &src, bool wide) {
+    encode(0, wide, {(uint8_t)(op * 8 + 3)}, dst, src);
+}
+
+void X86Assembler::alu(X86Alu op, const X86Operand &dst, int32_t immediate, bool wide) {
+    if (immediate >= -128 && immediate <= 127) {
+        encode(0, wide, {0x83}, op, dst, 1);
+        byte((uint8_t)immediate);
+    } else {
+        encode(0, wide, {0x81}, op, dst, 4);
+        dword((uint32_t)immediate);
+    }
+}
+
+void X86Assembler::imul(int dst, const X86Operand &src) {
+    encode(0, false, {0x0F, 0xAF}, dst, src);
+}
+
+void X86Assembler::neg(const X86Operand &operand) {
+    encode(0, false, {0xF7}, 3, operand);
+}
+
+void X86Assembler::idiv(const X86Operand &divisor) {
+    encode(0, false, {0xF7}, 7, divisor);
+}
+
+void X86Assembler::cdq() {
+    byte(0x99);
+}
+
+void X86Assembler::test(const X86Operand &left, int right) {
+    encode(0, false, {0x85}, right, left);
+}
+
+void X86Assembler::setcc(X86Condition cc, int reg) {
+    encode(0, false, {0x0F, (uint8_t)(0x90 + cc)}, 0, x86_reg(reg), 0, true);
+}
+
+void X86Assembler::movzxByte(int dst, int src) {
+    encode(0, false, {0x0F, 0xB6}, dst, x86_reg(src), 0, true);
+}
+
+void X86Assembler::push(const X86Operand &operand) {
+    if (operand.kind != X86Operand::kind_register) {
+        encode(0, false, {0xFF}, 6, operand);
+        return;
+    }
+    if (operand.reg >= 8)
+        byte(0x41);
+    byte(0x50 + (operand.reg & 7));
+}
+
+void X86Assembler::pop(int reg) {
+    if (reg >= 8)
+        byte(0x41);
+    byte(0x58 + (reg & 7));
+}
+
+void X86Assembler::call(int label) {
+    byte(0xE8);
+    rel32(label);
+}
+
+void X86Assembler::callSymbol(int symbol) {
+    byte(0xE8);
+    relocations.push_back(X86Relocation{here(), symbol, R_X86_64_PLT32, -4});
+    dword(0);
+}
+
+void X86Assembler::ret() {
+    byte(0xC3);
+}
+
+void X86Assembler::leave() {
+    byte(0xC9);
+}
+
+void X86Assembler::jmp(int label) {
+    byte(0xE9);
+    rel32(label);
+}
+
+void X86Assembler::jcc(X86Condition cc, int label) {
+    byte(0x0F);
+    byte(0x80 + cc);
+    rel32(label);
+}
+
+void X86Assembler::movd(int xmm, const X86Operand &src) {
+    encode(0x66, false, {0x0F, 0x6E}, xmm, src);
+}
+
+void X86Assembler::movd(const X86Operand &dst, int xmm) {
+    encode(0x66, false, {0x0F, 0x7E}, xmm, dst);
+}
+
+void X86Assembler::sse(X86Sse op, int xmm, const X86Operand &src) {
+    encode(0xF3, false, {0x0F, (uint8_t)op}, xmm, src);
+}
+
+void X86Assembler::ucomiss(int xmm, const X86Operand &src) {
+    encode(0, false, {0x0F, 0x2E}, xmm, src);
+}
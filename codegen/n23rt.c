@@ -0,0 +1,99 @@
+/* n23rt.c
+ * The runtime of programs NativeCompiler compiles: main, which runs the
+ * program, and the input, output and failures its code calls, with the
+ * messages and formats of interpreter/Runtime.cpp, so a compiled program
+ * behaves as the interpreters do.
+ *
+ * Link it with the object the compiler writes:
+ *     cc program.o n23rt.c -pthread -o program
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The program, compiled */
+extern long n23main(void);
+
+/* Up to 10000 frames, holding up to 2^20 slots; more than the usual 8 MB */
+#define STACK_BYTES (64L << 20)
+
+void n23rt_fail(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "Runtime Error: %s\n", message);
+    exit(1);
+}
+
+int n23rt_read_integer(void) {
+    int value;
+    if (scanf("%d", &value) != 1)
+        n23rt_fail("no integer to read");
+    return value;
+}
+
+float n23rt_read_float(void) {
+    float value;
+    if (scanf("%f", &value) != 1)
+        n23rt_fail("no number to read");
+    return value;
+}
+
+int n23rt_read_boolean(void) {
+    char word[1024];
+    if (scanf("%1023s", word) != 1)
+        n23rt_fail("no boolean to read");
+    if (strcmp(word, "true") == 0 || strcmp(word, "1") == 0)
+        return 1;
+    if (strcmp(word, "false") == 0 || strcmp(word, "0") == 0)
+        return 0;
+    n23rt_fail("no boolean to read");
+    return 0;
+}
+
+/* Strings read live until the program exits */
+const char *n23rt_read_string(void) {
+    char word[1024];
+    if (scanf("%1023s", word) != 1)
+        n23rt_fail("no string to read");
+    return strdup(word);
+}
+
+void n23rt_write_integer(int value) {
+    printf("%d\n", value);
+}
+
+void n23rt_write_float(float value) {
+    printf("%g\n", value);
+}
+
+void n23rt_write_boolean(int value) {
+    fputs(value ? "true\n" : "false\n", stdout);
+}
+
+/* The empty string is null */
+void n23rt_write_string(const char *value) {
+    printf("%s\n", value ? value : "");
+}
+
+int n23rt_same_string(const char *left, const char *right) {
+    return strcmp(left ? left : "", right ? right : "") == 0;
+}
+
+static void *run(void *unused) {
+    (void)unused;
+    n23main();
+    return NULL;
+}
+
+int main(void) {
+    pthread_attr_t attributes;
+    pthread_t thread;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, STACK_BYTES);
+    if (pthread_create(&thread, &attributes, run, NULL) != 0)
+        run(NULL);
+    else
+        pthread_join(thread, NULL);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,300 @@
+// Compiles programs to objects with NativeCompiler, links each with the
+// runtime in codegen/n23rt.c by the system's cc, runs it, and checks its
+// output and exit status against BytecodeInterpreter running the same
+// module: small programs with input and failures, float arithmetic written
+// out as bytecode (the parser has no float syntax), and generated
+// programs, with all the registers and with three, so values spill and are
+// saved around calls.
+// Usage: native_test [generated programs]   (run from codegen/: the parser
+// writes ../tests/output; needs cc)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include "../../include/BytecodeInterpreter.h"
+#include "../../include/NativeCompiler.h"
+#include "../../tests/test_util.h"
+
+struct Case {
+    const char *name;
+    const char *source;
+    const char *input;
+};
+
+static const Case cases[] = {
+    {"recursion",
+     "program\n"
+     "function fib(n : integer) : integer\n"
+     "begin\n"
+     "    if n < 2 then return(n) fi;\n"
+     "    return(fib(n - 1) + fib(n - 2));\n"
+     "end;\n"
+     "begin var r : integer; r := fib(20); write(r); end;\n",
+     ""},
+
+    {"arithmetic",
+     "program\n"
+     "constant k = 7;\n"
+     "var x : integer;\n"
+     "begin\n"
+     "    var y : integer;\n"
+     "    var z : integer;\n"
+     "    x := 2147483647;\n"
+     "    x := x + 1;\n"
+     "    write(x);\n"
+     "    y := -(k) / 2 * 3 - k;\n"
+     "    write(y);\n"
+     "    z := -(1);\n"
+     "    y := x / z;\n"
+     "    write(y);\n"
+     "    y := x * z - 5 / (-(2));\n"
+     "    write(y);\n"
+     "    read(z);\n"
+     "    y := 100 / z;\n"
+     "    write(y);\n"
+     "    y := z / z * z - z;\n"
+     "    write(y);\n"
+     "end;\n",
+     "-7"},
+
+    {"booleans",
+     "program\n"
+     "var b : boolean;\n"
+     "function odd(n : integer) : boolean\n"
+     "begin return(n / 2 * 2 != n); end;\n"
+     "begin\n"
+     "    var c : boolean;\n"
+     "    b := odd(3) and not (odd(4));\n"
+     "    write(b);\n"
+     "    c := b = false or 1 > 2;\n"
+     "    write(c);\n"
+     "    read(c);\n"
+     "    write(c);\n"
+     "    c := c != b;\n"
+     "    write(c);\n"
+     "end;\n",
+     "true"},
+
+    {"strings",
+     "program\n"
+     "var s : string;\n"
+     "procedure greet(t : string)\n"
+     "begin\n"
+     "    if t = \"hi\" then s := \"matched\" else s := t fi;\n"
+     "end;\n"
+     "begin\n"
+     "    var u : string;\n"
+     "    var b : boolean;\n"
+     "    write(u);\n"
+     "    b := u = \"\";\n"
+     "    write(b);\n"
+     "    greet(\"hi\");\n"
+     "    write(s);\n"
+     "    read(u);\n"
+     "    greet(u);\n"
+     "    write(s);\n"
+     "    b := s != u;\n"
+     "    write(b);\n"
+     "end;\n",
+     "hello"},
+
+    {"loops and calls",
+     "program\n"
+     "var total : integer;\n"
+     "function f(a : integer, b : integer, c : integer) : integer\n"
+     "begin return(a * b - c); end;\n"
+     "function g(a : integer, b : integer) : integer\n"
+     "begin return(f(a, b, a + b) + f(b, a, 1)); end;\n"
+     "begin\n"
+     "    var i : integer;\n"
+     "    var j : integer;\n"
+     "    var k : integer;\n"
+     "    for i := 1 to 10 do\n"
+     "    begin\n"
+     "        j := i * 2 + f(i, i + 1, i + 2) * (i - 1);\n"
+     "        k := j / 3 + f(j, g(i, j), total) - i;\n"
+     "        while j > 0 do begin total := total + j - k + i; j := j - 3; end od;\n"
+     "    end\n"
+     "    od;\n"
+     "    write(total);\n"
+     "    k := g(total, i);\n"
+     "    write(k);\n"
+     "end;\n",
+     ""},
+
+    {"frames",
+     "program\n"
+     "var g : integer;\n"
+     "function nothing() : integer\n"
+     "begin g := g + 1; end;\n"
+     "function sum(a : integer, b : integer) : integer\n"
+     "begin\n"
+     "    var c : integer;\n"
+     "    begin var d : integer; d := a; c := d; end;\n"
+     "    begin var e : integer; c := c + e + b; end;\n"
+     "    return(c);\n"
+     "end;\n"
+     "begin var r : integer; r := sum(nothing(), sum(2, 3)); write(r); write(g); end;\n"
+     "begin var r : integer; write(r); read(r); r := r + nothing(); write(r); end;\n",
+     "41"},
+
+    {"no input",
+     "program\n"
+     "begin var r : integer; r := 1; write(r); read(r); write(r); end;\n",
+     ""},
+
+    {"division by zero",
+     "program\n"
+     "var x : integer;\n"
+     "begin\n"
+     "    write(x);\n"
+     "    x := 1 / x;\n"
+     "    write(x);\n"
+     "end;\n",
+     ""},
+
+    {"stack overflow",
+     "program\n"
+     "function down(n : integer) : integer\n"
+     "begin return(down(n + 1)); end;\n"
+     "begin var r : integer; write(r); r := down(0); end;\n",
+     ""},
+};
+
+static int failures = 0;
+static std::string directory;
+
+// Runs module both ways on input and compares; returns whether they agree
+static bool check(const char *name, const Module &module, const char *input,
+                  uint32_t registers) {
+    std::string in = directory + "/input", out = directory + "/output";
+    FILE *file = fopen(in.c_str(), "w");
+    fprintf(file, "%s\n", input);
+    fclose(file);
+
+    FILE *inputFile = fopen(in.c_str(), "r");
+    FILE *outputFile = tmpfile();
+    Runtime runtime(inputFile, outputFile);
+    int expectedStatus = BytecodeInterpreter(runtime).run(module);
+    std::string expected = test_contents(outputFile);
+    fclose(inputFile);
+    fclose(outputFile);
+
+    std::string object = directory + "/program.o", program = directory + "/program";
+    NativeCompiler compiler(registers);
+    bool ok = compiler.compile(module, object.c_str()) == 0;
+    std::string link = "cc -o " + program + " " + object + " n23rt.c -pthread";
+    ok = ok && system(link.c_str()) == 0;
+    int status = -1;
+    std::string text;
+    if (ok) {
+        std::string run = program + " < " + in + " > " + out + " 2>/dev/null";
+        int result = system(run.c_str());
+        status = WIFEXITED(result) ? WEXITSTATUS(result) : -1;
+        text = test_contents(out.c_str());
+    }
+    ok = ok && status == expectedStatus && text == expected;
+    printf("%-22s %-9s %s\n", name, registers == RegisterAllocator::DEFAULT_REGISTERS ? "all" : "three",
+           ok ? "ok" : "FAILED");
+    if (!ok) {
+        printf("  status %d, expected %d, output:\n%s  expected:\n%s", status, expectedStatus,
+               text.c_str(), expected.c_str());
+        failures++;
+    }
+    return ok;
+}
+
+static const uint32_t THREE = 1u << reg_rcx | 1u << reg_rbx | 1u << reg_rsi;
+
+static void checkSource(const char *name, const std::string &source, const char *input) {
+    Module module;
+    if (!test_compile(source, module)) {
+        printf("%-22s does not compile\n", name);
+        failures++;
+        return;
+    }
+    for (uint32_t registers : {RegisterAllocator::DEFAULT_REGISTERS, THREE})
+        check(name, module, input, registers);
+}
+
+static int32_t bits(float f) {
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+// Every float instruction, on numbers read and written, with NaN among
+// the values compared
+static void checkFloats() {
+    Module module;
+    module.functions.resize(2);
+    module.routines = 1;
+    Function &scale = module.functions[0];
+    scale.name = "scale";
+    scale.params = scale.slots = 2;
+    scale.registers = 4;
+    scale.code = {
+        I(op_fmultiply, 2, 0, 1),
+        I(op_fnegate, 3, 2),
+        I(op_return, 0, 3),
+    };
+    Function &main = module.functions[1];
+    module.main = 1;
+    main.name = "main";
+    std::vector<Instruction> &code = main.code;
+    code = {
+        I(op_read, 0, type_float),
+        I(op_read, 1, type_float),
+        I(op_const, 2, 7),
+        I(op_itof, 3, 2),
+        I(op_fadd, 4, 0, 3),
+        I(op_write, 4, type_float),
+        I(op_fsubtract, 4, 0, 1),
+        I(op_write, 4, type_float),
+        I(op_fdivide, 4, 0, 1),
+        I(op_write, 4, type_float),
+        I(op_call, 5, 0, 0),
+        I(op_write, 5, type_float),
+        I(op_const, 6, 0),
+        I(op_itof, 6, 6),
+        I(op_fdivide, 7, 6, 6),         // NaN
+    };
+    int compares[] = {op_feq, op_fne, op_flt, op_fle, op_fgt, op_fge};
+    int pairs[][2] = {{0, 1}, {1, 0}, {0, 0}, {0, 7}, {7, 7}};
+    for (int op : compares) {
+        for (auto &pair : pairs) {
+            code.push_back(I(op, 8, pair[0], pair[1]));
+            code.push_back(I(op_write, 8, type_boolean));
+        }
+    }
+    code.push_back(I(op_const, 9, bits(2.5f)));
+    code.push_back(I(op_fmultiply, 9, 9, 9));
+    code.push_back(I(op_write, 9, type_float));
+    code.push_back(I(op_return_none));
+    main.registers = 10;
+    for (uint32_t registers : {RegisterAllocator::DEFAULT_REGISTERS, THREE})
+        check("floats", module, "1.5 -0.25", registers);
+}
+
+int main(int argc, char **argv) {
+    int generated = argc > 1 ? atoi(argv[1]) : 12;
+    char pattern[] = "/tmp/native_test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        printf("cannot make a directory\n");
+        return 1;
+    }
+    directory = pattern;
+
+    for (const Case &test : cases) checkSource(test.name, test.source, test.input);
+    checkFloats();
+    test_generated(generated, [](const char *name, const std::string &source) {
+        checkSource(name, source, "");
+    });
+
+    std::string clean = "rm -rf " + directory;
+    if (system(clean.c_str()) != 0)
+        printf("cannot remove %s\n", directory.c_str());
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+// Runs the register allocator on small functions written out as bytecode,
+// and on programs lowered by BytecodeCompiler, and checks every allocation
+// against liveness computed here one instruction at a time: values live at
+// the same point are in different registers, a value live across a call,
+// a runtime call included, is in a callee-saved register or saved around
+// it, and only the registers allowed are used.
+// Usage: regalloc_test   (run from codegen/: the parser writes ../tests/output)
+#include <stdio.h>
+#include <string>
+#include "../../include/RegisterAllocator.h"
+#include "../../tests/test_util.h"
+
+static int failures = 0;
+
+static void expect(bool ok, const char *test, const char *what) {
+    if (!ok) {
+        printf("%-18s FAILED: %s\n", test, what);
+        failures++;
+    }
+}
+
+// Checks allocation of the function, and returns whether it is valid
+static bool verify(const char *test, const Module &module, const Function &function,
+                   const Allocation &allocation, uint32_t allowed) {
+    const std::vector<Instruction> &code = function.code;
+    size_t n = code.size();
+    typedef std::vector<bool> Set;
+    std::vector<Set> in(n, Set(function.registers)), out(n, Set(function.registers));
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = n; i-- > 0;) {
+            Set after(function.registers);
+            auto join = [&](size_t next) {
+                for (int reg = 0; reg < function.registers; reg++)
+                    if (next < n && in[next][reg]) after[reg] = true;
+            };
+            if (!ends_flow(code[i].op))
+                join(i + 1);
+            if (is_jump(code[i].op))
+                join(code[i].a);
+            Set before = after;
+            for_each_def(code[i], [&](int reg) { before[reg] = false; });
+            for_each_use(module, code[i], [&](int reg) { before[reg] = true; });
+            if (after != out[i] || before != in[i]) {
+                out[i] = after;
+                in[i] = before;
+                changed = true;
+            }
+        }
+    }
+
+    bool ok = true;
+    auto fail = [&](size_t i, int reg, const char *what) {
+        if (ok)
+            printf("%-18s FAILED in %s at %zu, r%d: %s\n", test, function.name.c_str(), i, reg,
+                   what);
+        ok = false;
+    };
+    // No two of a set of values share a register
+    auto distinct = [&](size_t i, const Set &values) {
+        int holder[NUM_X86_REGISTERS];
+        for (int &h : holder) h = -1;
+        for (int reg = 0; reg < function.registers; reg++) {
+            if (!values[reg])
+                continue;
+            int physical = allocation.registerOf[reg];
+            if (physical < 0 && allocation.slotOf[reg] < 0)
+                fail(i, reg, "live without a place");
+            if (physical < 0)
+                continue;
+            if (!(allowed >> physical & 1))
+                fail(i, reg, "in a register not allowed");
+            if (holder[physical] >= 0)
+                fail(i, reg, "shares a register with a live value");
+            holder[physical] = reg;
+        }
+    };
+    for (size_t i = 0; i < n; i++) {
+        distinct(i, in[i]);
+        Set written = out[i];
+        for_each_def(code[i], [&](int reg) { written[reg] = true; });
+        distinct(i, written);
+        if (!x86_calls_out(code[i].op))
+            continue;
+        for (int reg = 0; reg < function.registers; reg++) {
+            int physical = allocation.registerOf[reg];
+            bool result = false;
+            for_each_def(code[i], [&](int def) { result |= def == reg; });
+            if (out[i][reg] && !result && physical >= 0 &&
+                !x86_callee_saved(physical) && !(allocation.savedAt[i] >> physical & 1))
+                fail(i, reg, "clobbered by a call");
+        }
+    }
+    if (!ok)
+        failures++;
+    return ok;
+}
+
+// A module of the function to test, and a routine of one parameter for it
+// to call, function 1
+static Module snippet(int params, int registers, std::vector<Instruction> code) {
+    Module module;
+    module.functions.resize(2);
+    Function &f = module.functions[0];
+    f.name = "snippet";
+    f.params = params;
+    f.slots = params;
+    f.registers = registers;
+    f.code = code;
+    Function &callee = module.functions[1];
+    callee.name = "callee";
+    callee.params = callee.slots = callee.registers = 1;
+    callee.code = {I(op_return, 0, 0)};
+    module.main = 0;
+    return module;
+}
+
+static void straightLine() {
+    const char *test = "straight line";
+    Module module = snippet(1, 4, {
+        I(op_const, 1, 5),
+        I(op_add, 2, 0, 1),
+        I(op_multiply, 3, 2, 2),
+        I(op_return, 0, 3),
+    });
+    RegisterAllocator allocator;
+    Allocation allocation;
+    allocator.allocate(module, module.functions[0], allocation);
+    verify(test, module, module.functions[0], allocation, RegisterAllocator::DEFAULT_REGISTERS);
+    const std::vector<RegisterAllocator::Interval> &live = allocator.intervals();
+    expect(live[0].start == 0 && live[0].end == 2, test, "interval of r0");
+    expect(live[1].start == 1 && live[1].end == 2, test, "interval of r1");
+    expect(live[2].start == 3 && live[2].end == 4, test, "interval of r2");
+    expect(live[3].start == 5 && live[3].end == 6, test, "interval of r3");
+    expect(allocation.spilled == 0 && allocation.calleeSaved == 0, test, "no spills");
+    // r2 is written after r0 and r1 are last read, so it reuses one
+    expect(allocation.registerOf[2] == allocation.registerOf[0] ||
+               allocation.registerOf[2] == allocation.registerOf[1],
+           test, "register reused");
+}
+
+// Twenty constants, all live at once, then summed
+static void pressure() {
+    const char *test = "pressure";
+    std::vector<Instruction> code;
+    for (int i = 0; i < 20; i++) code.push_back(I(op_const, i, i));
+    code.push_back(I(op_add, 20, 0, 1));
+    for (int i = 2; i < 20; i++) code.push_back(I(op_add, 20, 20, i));
+    code.push_back(I(op_return, 0, 20));
+    Module module = snippet(0, 21, code);
+    for (uint32_t allowed : {RegisterAllocator::DEFAULT_REGISTERS,
+                             1u << reg_rcx | 1u << reg_rbx | 1u << reg_rsi}) {
+        RegisterAllocator allocator(allowed);
+        Allocation allocation;
+        allocator.allocate(module, module.functions[0], allocation);
+        verify(test, module, module.functions[0], allocation, allowed);
+        int registers = __builtin_popcount(allowed);
+        expect(allocation.spilled == 20 - registers, test, "spilled as many as don't fit");
+        expect(allocation.spillSlots == allocation.spilled, test, "a slot each");
+        expect(allocation.spillAccesses == 2 * allocation.spilled, test, "spill accesses");
+    }
+}
+
+// A value read only before the loop's back edge stays live all through it
+static void loop() {
+    const char *test = "loop";
+    Module module = snippet(1, 3, {
+        I(op_const, 1, 0),
+        I(op_jump_ge, 5, 1, 0),
+        I(op_add_immediate, 1, 1, 1),
+        I(op_const, 2, 7),
+        I(op_jump, 1),
+        I(op_return, 0, 1),
+    });
+    RegisterAllocator allocator(1u << reg_rcx | 1u << reg_rsi);
+    Allocation allocation;
+    allocator.allocate(module, module.functions[0], allocation);
+    verify(test, module, module.functions[0], allocation, 1u << reg_rcx | 1u << reg_rsi);
+    expect(allocator.intervals()[0].end >= 2 * 4 + 1, test, "live over the back edge");
+    // Of r0, r1 and r2, r1 lives longest
+    expect(allocation.spilled == 1 && allocation.slotOf[1] >= 0, test, "r1 spilled");
+}
+
+// A value live across a call
+static void call() {
+    const char *test = "call";
+    Module module = snippet(1, 3, {
+        I(op_call, 1, 0, 1),
+        I(op_add, 2, 0, 1),
+        I(op_return, 0, 2),
+    });
+    RegisterAllocator allocator;
+    Allocation allocation;
+    allocator.allocate(module, module.functions[0], allocation);
+    verify(test, module, module.functions[0], allocation, RegisterAllocator::DEFAULT_REGISTERS);
+    expect(x86_callee_saved(allocation.registerOf[0]), test, "callee-saved register");
+    expect(allocation.callSaves == 0, test, "nothing to save");
+
+    uint32_t allowed = 1u << reg_rcx | 1u << reg_rsi;
+    RegisterAllocator callerSaved(allowed);
+    callerSaved.allocate(module, module.functions[0], allocation);
+    verify(test, module, module.functions[0], allocation, allowed);
+    expect(allocation.savedAt[0] == 1u << allocation.registerOf[0], test, "saved at the call");
+    expect(allocation.callSaves == 1, test, "one save");
+}
+
+static const char *programs[] = {
+    "program\n"
+    "function fib(n : integer) : integer\n"
+    "begin\n"
+    "    if n < 2 then return(n) fi;\n"
+    "    return(fib(n - 1) + fib(n - 2));\n"
+    "end;\n"
+    "begin var r : integer; r := fib(15); write(r); end;\n",
+
+    "program\n"
+    "var total : integer;\n"
+    "function f(a : integer, b : integer, c : integer) : integer\n"
+    "begin return(a * b - c); end;\n"
+    "begin\n"
+    "    var i : integer;\n"
+    "    var j : integer;\n"
+    "    var k : integer;\n"
+    "    for i := 1 to 10 do\n"
+    "    begin\n"
+    "        j := i * 2 + f(i, i + 1, i + 2) * (i - 1);\n"
+    "        k := j / 3 + f(j, f(i, j, k), total) - i;\n"
+    "        while j > 0 do begin total := total + j - k + i; j := j - 3; end od;\n"
+    "    end\n"
+    "    od;\n"
+    "    write(total);\n"
+    "end;\n",
+};
+
+// Whole programs, lowered and optimized, with all the registers and with
+// three
+static void lowered() {
+    for (const char *text : programs) {
+        Module module;
+        if (!test_compile(text, module)) {
+            expect(false, "lowered", "does not compile");
+            continue;
+        }
+        for (uint32_t allowed : {RegisterAllocator::DEFAULT_REGISTERS,
+                                 1u << reg_rcx | 1u << reg_rbx | 1u << reg_rsi}) {
+            RegisterAllocator allocator(allowed);
+            for (const Function &function : module.functions) {
+                Allocation allocation;
+                allocator.allocate(module, function, allocation);
+                verify("lowered", module, function, allocation, allowed);
+            }
+        }
+    }
+}
+
+int main() {
+    straightLine();
+    pressure();
+    loop();
+    call();
+    lowered();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// Memory for what an execution engine builds from a program: allocated by
+// bumping a pointer through large chunks, and freed all at once when the
+// arena is destroyed. Nothing in it is ever destroyed on its own, so only
+// trivially destructible objects belong there.
+class Arena {
+public:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    Arena() : next(nullptr), left(0) {}
+    ~Arena() { clear(); }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t alignment);
+
+    // count value-initialized Ts
+    template <typename T> T *allocateArray(int count) {
+        T *array = (T *)allocate(sizeof(T) * (count > 0 ? count : 1), alignof(T));
+        for (int i = 0; i < count; i++) new (&array[i]) T();
+        return array;
+    }
+
+    // Frees everything
+    void clear();
+
+private:
+    std::vector<char *> chunks;
+    char *next;
+    size_t left;
+};
+
+#endif // ARENA_H
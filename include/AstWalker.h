@@ -0,0 +1,729 @@
+#ifndef ASTWALKER_H
+#define ASTWALKER_H
+
+#include "ast.h"
+#include <vector>
+
+// Depth-first traversal of an AST with an explicit work stack instead of
+// recursion, so a tree of any depth or a list of any length is walked in
+// constant machine stack.
+//
+// A pass derives from AstWalker<Pass, Context> (CRTP) and overrides the
+// hooks it needs. The walker switches on a node's kind once, when it
+// enters the node, and calls that kind's hooks directly, without virtual
+// calls; the hooks of an ast_if node, for example, are:
+//
+//   bool visitIf(AST *node, Context &context)
+//       Before node's children. Returning false skips the children;
+//       leaveIf is still called.
+//   bool childIf(AST *node, int index, AST *child, Context &context, Context &childContext)
+//       Before child number index of node, which may be NULL. childContext
+//       starts as a copy of context and is what the child is walked with.
+//       Returning false skips the child. Only kinds with children have it.
+//   void leaveIf(AST *node, Context &context)
+//       After node's children.
+//
+// The hooks of a binary operator default to visitBinary, childBinary and
+// leaveBinary, those of not and unary minus to visitUnary, childUnary and
+// leaveUnary, and all of them in the end to visit, child and leave, which
+// walk everything and do nothing. A pass can so handle a group of kinds,
+// or every kind it has no hook for, in one place.
+//
+// Context is state a node hands down to its children, such as an
+// indentation; a pass with none can use AstWalker<Pass>. The walker knows
+// the children of every kind of node, in source order: the list of a
+// block, call or program counts as that node's children. NULL children are
+// passed to the child hook but not walked.
+struct NoContext {};
+
+template <typename Pass, typename Context = NoContext>
+class AstWalker {
+public:
+    void walk(AST *root, Context context = Context());
+
+    bool visit(AST *, Context &) { return true; }
+    bool child(AST *, int, AST *, Context &, Context &) { return true; }
+    void leave(AST *, Context &) {}
+
+    bool visitBinary(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childBinary(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveBinary(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitUnary(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childUnary(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveUnary(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitVarDecl(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveVarDecl(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitConstDecl(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childConstDecl(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveConstDecl(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitRoutineDecl(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childRoutineDecl(AST *node, int index, AST *child, Context &context,
+                          Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveRoutineDecl(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitAssign(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childAssign(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveAssign(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitIf(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childIf(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveIf(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitWhile(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childWhile(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveWhile(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitFor(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childFor(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveFor(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitRead(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveRead(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitWrite(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveWrite(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitCall(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childCall(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveCall(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitBlock(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childBlock(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveBlock(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitReturn(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childReturn(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveReturn(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitVar(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveVar(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitInteger(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveInteger(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitFloat(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveFloat(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitString(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveString(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitBoolean(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveBoolean(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitTimes(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childTimes(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveTimes(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitDivide(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childDivide(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveDivide(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitPlus(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childPlus(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leavePlus(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitMinus(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childMinus(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveMinus(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitEq(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childEq(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveEq(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitNeq(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childNeq(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveNeq(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitLt(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childLt(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveLt(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitLe(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childLe(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveLe(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitGt(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childGt(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveGt(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitGe(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childGe(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveGe(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitAnd(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childAnd(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveAnd(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitOr(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childOr(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveOr(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitCand(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childCand(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveCand(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitCor(AST *node, Context &context) { return pass().visitBinary(node, context); }
+    bool childCor(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childBinary(node, index, child, context, childContext);
+    }
+    void leaveCor(AST *node, Context &context) { pass().leaveBinary(node, context); }
+
+    bool visitNot(AST *node, Context &context) { return pass().visitUnary(node, context); }
+    bool childNot(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childUnary(node, index, child, context, childContext);
+    }
+    void leaveNot(AST *node, Context &context) { pass().leaveUnary(node, context); }
+
+    bool visitUminus(AST *node, Context &context) { return pass().visitUnary(node, context); }
+    bool childUminus(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().childUnary(node, index, child, context, childContext);
+    }
+    void leaveUminus(AST *node, Context &context) { pass().leaveUnary(node, context); }
+
+    bool visitItof(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childItof(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveItof(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitEof(AST *node, Context &context) { return pass().visit(node, context); }
+    void leaveEof(AST *node, Context &context) { pass().leave(node, context); }
+
+    bool visitProgram(AST *node, Context &context) { return pass().visit(node, context); }
+    bool childProgram(AST *node, int index, AST *child, Context &context, Context &childContext) {
+        return pass().child(node, index, child, context, childContext);
+    }
+    void leaveProgram(AST *node, Context &context) { pass().leave(node, context); }
+
+private:
+    struct Frame {
+        AST *node;
+        AST *children[3];   // fixed children
+        ast_list *list;     // rest of the list, for list nodes
+        int count;          // fixed children
+        int index;          // children visited so far
+        Context context;
+    };
+    std::vector<Frame> stack;
+
+    // The memory of the last finished walk's stack, for the next walk on
+    // the thread to reuse. A walk started from a hook gets a stack of its own.
+    static std::vector<Frame> &spareStack() {
+        static thread_local std::vector<Frame> spare;
+        return spare;
+    }
+
+    Pass &pass() { return static_cast<Pass &>(*this); }
+
+    void enter(AST *node, Context &context);
+    void push(AST *node, Context &context, int count, AST *first, AST *second = nullptr,
+              AST *third = nullptr);
+    void pushList(AST *node, Context &context, ast_list *list);
+    bool childOf(AST *node, int index, AST *child, Context &context, Context &childContext);
+    void leaveOf(AST *node, Context &context);
+};
+
+template <typename Pass, typename Context>
+void AstWalker<Pass, Context>::walk(AST *root, Context context) {
+    if (root == nullptr)
+        return;
+    stack.swap(spareStack());
+    stack.clear();
+    enter(root, context);
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        AST *child;
+        if (frame.index < frame.count) {
+            child = frame.children[frame.index];
+        } else if (frame.list != nullptr) {
+            child = frame.list->head;
+            frame.list = frame.list->tail;
+        } else {
+            leaveOf(frame.node, frame.context);
+            stack.pop_back();
+            continue;
+        }
+        int index = frame.index++;
+        Context childContext = frame.context;
+        if (childOf(frame.node, index, child, frame.context, childContext) && child != nullptr)
+            enter(child, childContext);
+    }
+    stack.swap(spareStack());
+}
+
+// Calls the node's visit hook, then pushes a frame for its children; a
+// node without children, or whose children are skipped, is left at once
+template <typename Pass, typename Context>
+void AstWalker<Pass, Context>::enter(AST *node, Context &context) {
+    Pass &pass = this->pass();
+    switch (node->type) {
+        case ast_var_decl:
+            pass.visitVarDecl(node, context);
+            pass.leaveVarDecl(node, context);
+            return;
+        case ast_const_decl:
+            if (!pass.visitConstDecl(node, context)) {
+                pass.leaveConstDecl(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_const_decl.value);
+            return;
+        case ast_routine_decl:
+            if (!pass.visitRoutineDecl(node, context)) {
+                pass.leaveRoutineDecl(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_routine_decl.body);
+            return;
+        case ast_assign:
+            if (!pass.visitAssign(node, context)) {
+                pass.leaveAssign(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_assign.rhs);
+            return;
+        case ast_if:
+            if (!pass.visitIf(node, context)) {
+                pass.leaveIf(node, context);
+                return;
+            }
+            push(node, context, 3, node->f.a_if.predicate, node->f.a_if.conseq,
+                 node->f.a_if.altern);
+            return;
+        case ast_while:
+            if (!pass.visitWhile(node, context)) {
+                pass.leaveWhile(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_while.predicate, node->f.a_while.body);
+            return;
+        case ast_for:
+            if (!pass.visitFor(node, context)) {
+                pass.leaveFor(node, context);
+                return;
+            }
+            push(node, context, 3, node->f.a_for.lower_bound, node->f.a_for.upper_bound,
+                 node->f.a_for.body);
+            return;
+        case ast_read:
+            pass.visitRead(node, context);
+            pass.leaveRead(node, context);
+            return;
+        case ast_write:
+            pass.visitWrite(node, context);
+            pass.leaveWrite(node, context);
+            return;
+        case ast_call:
+            if (!pass.visitCall(node, context) || node->f.a_call.arg_list == nullptr) {
+                pass.leaveCall(node, context);
+                return;
+            }
+            pushList(node, context, node->f.a_call.arg_list);
+            return;
+        case ast_block:
+            if (!pass.visitBlock(node, context) || node->f.a_block.stmts == nullptr) {
+                pass.leaveBlock(node, context);
+                return;
+            }
+            pushList(node, context, node->f.a_block.stmts);
+            return;
+        case ast_return:
+            if (!pass.visitReturn(node, context)) {
+                pass.leaveReturn(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_return.expr);
+            return;
+        case ast_var:
+            pass.visitVar(node, context);
+            pass.leaveVar(node, context);
+            return;
+        case ast_integer:
+            pass.visitInteger(node, context);
+            pass.leaveInteger(node, context);
+            return;
+        case ast_float:
+            pass.visitFloat(node, context);
+            pass.leaveFloat(node, context);
+            return;
+        case ast_string:
+            pass.visitString(node, context);
+            pass.leaveString(node, context);
+            return;
+        case ast_boolean:
+            pass.visitBoolean(node, context);
+            pass.leaveBoolean(node, context);
+            return;
+        case ast_times:
+            if (!pass.visitTimes(node, context)) {
+                pass.leaveTimes(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_divide:
+            if (!pass.visitDivide(node, context)) {
+                pass.leaveDivide(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_plus:
+            if (!pass.visitPlus(node, context)) {
+                pass.leavePlus(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_minus:
+            if (!pass.visitMinus(node, context)) {
+                pass.leaveMinus(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_eq:
+            if (!pass.visitEq(node, context)) {
+                pass.leaveEq(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_neq:
+            if (!pass.visitNeq(node, context)) {
+                pass.leaveNeq(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_lt:
+            if (!pass.visitLt(node, context)) {
+                pass.leaveLt(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_le:
+            if (!pass.visitLe(node, context)) {
+                pass.leaveLe(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_gt:
+            if (!pass.visitGt(node, context)) {
+                pass.leaveGt(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_ge:
+            if (!pass.visitGe(node, context)) {
+                pass.leaveGe(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_and:
+            if (!pass.visitAnd(node, context)) {
+                pass.leaveAnd(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_or:
+            if (!pass.visitOr(node, context)) {
+                pass.leaveOr(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_cand:
+            if (!pass.visitCand(node, context)) {
+                pass.leaveCand(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_cor:
+            if (!pass.visitCor(node, context)) {
+                pass.leaveCor(node, context);
+                return;
+            }
+            push(node, context, 2, node->f.a_binary_op.larg, node->f.a_binary_op.rarg);
+            return;
+        case ast_not:
+            if (!pass.visitNot(node, context)) {
+                pass.leaveNot(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_unary_op.arg);
+            return;
+        case ast_uminus:
+            if (!pass.visitUminus(node, context)) {
+                pass.leaveUminus(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_unary_op.arg);
+            return;
+        case ast_itof:
+            if (!pass.visitItof(node, context)) {
+                pass.leaveItof(node, context);
+                return;
+            }
+            push(node, context, 1, node->f.a_itof.arg);
+            return;
+        case ast_eof:
+            pass.visitEof(node, context);
+            pass.leaveEof(node, context);
+            return;
+        case ast_program:
+            if (!pass.visitProgram(node, context) || node->f.a_program.statements == nullptr) {
+                pass.leaveProgram(node, context);
+                return;
+            }
+            pushList(node, context, node->f.a_program.statements);
+            return;
+        default:
+            pass.visit(node, context);
+            pass.leave(node, context);
+            return;
+    }
+}
+
+template <typename Pass, typename Context>
+void AstWalker<Pass, Context>::push(AST *node, Context &context, int count, AST *first,
+                                    AST *second, AST *third) {
+    stack.emplace_back();
+    Frame &frame = stack.back();
+    frame.node = node;
+    frame.children[0] = first;
+    frame.children[1] = second;
+    frame.children[2] = third;
+    frame.list = nullptr;
+    frame.count = count;
+    frame.index = 0;
+    frame.context = context;
+}
+
+template <typename Pass, typename Context>
+void AstWalker<Pass, Context>::pushList(AST *node, Context &context, ast_list *list) {
+    stack.emplace_back();
+    Frame &frame = stack.back();
+    frame.node = node;
+    frame.list = list;
+    frame.count = 0;
+    frame.index = 0;
+    frame.context = context;
+}
+
+// The child hook of node's kind
+template <typename Pass, typename Context>
+bool AstWalker<Pass, Context>::childOf(AST *node, int index, AST *child, Context &context,
+                                       Context &childContext) {
+    Pass &pass = this->pass();
+    switch (node->type) {
+        case ast_const_decl:
+            return pass.childConstDecl(node, index, child, context, childContext);
+        case ast_routine_decl:
+            return pass.childRoutineDecl(node, index, child, context, childContext);
+        case ast_assign:
+            return pass.childAssign(node, index, child, context, childContext);
+        case ast_if:
+            return pass.childIf(node, index, child, context, childContext);
+        case ast_while:
+            return pass.childWhile(node, index, child, context, childContext);
+        case ast_for:
+            return pass.childFor(node, index, child, context, childContext);
+        case ast_call:
+            return pass.childCall(node, index, child, context, childContext);
+        case ast_block:
+            return pass.childBlock(node, index, child, context, childContext);
+        case ast_return:
+            return pass.childReturn(node, index, child, context, childContext);
+        case ast_times:
+            return pass.childTimes(node, index, child, context, childContext);
+        case ast_divide:
+            return pass.childDivide(node, index, child, context, childContext);
+        case ast_plus:
+            return pass.childPlus(node, index, child, context, childContext);
+        case ast_minus:
+            return pass.childMinus(node, index, child, context, childContext);
+        case ast_eq:
+            return pass.childEq(node, index, child, context, childContext);
+        case ast_neq:
+            return pass.childNeq(node, index, child, context, childContext);
+        case ast_lt:
+            return pass.childLt(node, index, child, context, childContext);
+        case ast_le:
+            return pass.childLe(node, index, child, context, childContext);
+        case ast_gt:
+            return pass.childGt(node, index, child, context, childContext);
+        case ast_ge:
+            return pass.childGe(node, index, child, context, childContext);
+        case ast_and:
+            return pass.childAnd(node, index, child, context, childContext);
+        case ast_or:
+            return pass.childOr(node, index, child, context, childContext);
+        case ast_cand:
+            return pass.childCand(node, index, child, context, childContext);
+        case ast_cor:
+            return pass.childCor(node, index, child, context, childContext);
+        case ast_not:
+            return pass.childNot(node, index, child, context, childContext);
+        case ast_uminus:
+            return pass.childUminus(node, index, child, context, childContext);
+        case ast_itof:
+            return pass.childItof(node, index, child, context, childContext);
+        case ast_program:
+            return pass.childProgram(node, index, child, context, childContext);
+        default:
+            return pass.child(node, index, child, context, childContext);
+    }
+}
+
+// The leave hook of node's kind, for nodes that were pushed
+template <typename Pass, typename Context>
+void AstWalker<Pass, Context>::leaveOf(AST *node, Context &context) {
+    Pass &pass = this->pass();
+    switch (node->type) {
+        case ast_const_decl:
+            pass.leaveConstDecl(node, context);
+            return;
+        case ast_routine_decl:
+            pass.leaveRoutineDecl(node, context);
+            return;
+        case ast_assign:
+            pass.leaveAssign(node, context);
+            return;
+        case ast_if:
+            pass.leaveIf(node, context);
+            return;
+        case ast_while:
+            pass.leaveWhile(node, context);
+            return;
+        case ast_for:
+            pass.leaveFor(node, context);
+            return;
+        case ast_call:
+            pass.leaveCall(node, context);
+            return;
+        case ast_block:
+            pass.leaveBlock(node, context);
+            return;
+        case ast_return:
+            pass.leaveReturn(node, context);
+            return;
+        case ast_times:
+            pass.leaveTimes(node, context);
+            return;
+        case ast_divide:
+            pass.leaveDivide(node, context);
+            return;
+        case ast_plus:
+            pass.leavePlus(node, context);
+            return;
+        case ast_minus:
+            pass.leaveMinus(node, context);
+            return;
+        case ast_eq:
+            pass.leaveEq(node, context);
+            return;
+        case ast_neq:
+            pass.leaveNeq(node, context);
+            return;
+        case ast_lt:
+            pass.leaveLt(node, context);
+            return;
+        case ast_le:
+            pass.leaveLe(node, context);
+            return;
+        case ast_gt:
+            pass.leaveGt(node, context);
+            return;
+        case ast_ge:
+            pass.leaveGe(node, context);
+            return;
+        case ast_and:
+            pass.leaveAnd(node, context);
+            return;
+        case ast_or:
+            pass.leaveOr(node, context);
+            return;
+        case ast_cand:
+            pass.leaveCand(node, context);
+            return;
+        case ast_cor:
+            pass.leaveCor(node, context);
+            return;
+        case ast_not:
+            pass.leaveNot(node, context);
+            return;
+        case ast_uminus:
+            pass.leaveUminus(node, context);
+            return;
+        case ast_itof:
+            pass.leaveItof(node, context);
+            return;
+        case ast_program:
+            pass.leaveProgram(node, context);
+            return;
+        default:
+            pass.leave(node, context);
+            return;
+    }
+}
+
+#endif // ASTWALKER_H
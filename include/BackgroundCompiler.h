@@ -0,0 +1,47 @@
+#ifndef BACKGROUNDCOMPILER_H
+#define BACKGROUNDCOMPILER_H
+
+#include "ClosureCompiler.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Compiles routines of a program with a ClosureCompiler on a thread of its
+// own, while another engine goes on running the program. Each request
+// names where to publish the routine's code; the engine loads it from
+// there and calls it instead of running the routine itself. The code
+// shares the engine's Runtime and global frame, and calls the routines it
+// calls as compiled code too.
+class BackgroundCompiler {
+public:
+    typedef std::atomic<const Code<bool> *> Slot;
+
+    BackgroundCompiler(Runtime &runtime, AST *program, Value *globals);
+    // Finishes the compilation under way and drops the other requests
+    ~BackgroundCompiler();
+
+    // Queues routine for compiling; its code will be stored in *slot. A
+    // routine that fails to compile is left as it was.
+    void request(STEntry *routine, Slot *slot);
+
+private:
+    struct Request {
+        STEntry *routine;
+        Slot *slot;
+    };
+
+    ClosureCompiler compiler;
+    AST *program;
+    Value *globals;
+    std::mutex lock;                // guards queue and stopping
+    std::condition_variable wake;
+    std::deque<Request> queue;
+    bool stopping;
+    std::thread worker;
+
+    void work();
+};
+
+#endif // BACKGROUNDCOMPILER_H
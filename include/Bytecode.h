@@ -0,0 +1,158 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// A program lowered to linear code, by BytecodeCompiler. Each routine, each
+// top-level block and the program itself become a Function: a list of
+// three-address instructions over virtual registers. A function's first
+// registers are its frame slots, as layout_frames gave them (formals
+// first), and the rest are temporaries; a call pushes a frame with one
+// Value per register. Jumps name instruction indexes.
+
+typedef enum {
+    op_nop,
+    op_const,           // a := the bits b (an integer, float or boolean)
+    op_string,          // a := strings[b]
+    op_move,            // a := b
+    op_load_global,     // a := global b
+    op_store_global,    // global a := b
+
+    op_add,             // integers: a := b op c, wrapping around
+    op_subtract,
+    op_multiply,
+    op_divide,
+    op_add_immediate,   // a := b + the constant c
+    op_negate,          // a := -b
+    op_eq,              // integers: a := b op c
+    op_ne,
+    op_lt,
+    op_le,
+    op_gt,
+    op_ge,
+
+    op_fadd,            // floats
+    op_fsubtract,
+    op_fmultiply,
+    op_fdivide,
+    op_fnegate,
+    op_feq,
+    op_fne,
+    op_flt,
+    op_fle,
+    op_fgt,
+    op_fge,
+    op_itof,            // a := b as a float
+
+    op_not,             // booleans
+    op_beq,
+    op_bne,
+    op_seq,             // strings
+    op_sne,
+
+    op_jump,            // go to a
+    op_jump_if_true,    // if b, go to a
+    op_jump_if_false,
+    op_jump_eq,         // integers: if b op c, go to a
+    op_jump_ne,
+    op_jump_lt,
+    op_jump_le,
+    op_jump_gt,
+    op_jump_ge,
+
+    op_call,            // a := function c, with its arguments in b, b+1, ...
+    op_return,          // return b
+    op_return_none,     // return the zero Value
+    op_clear,           // a, a+1, ..., a+b-1 := the zero Value
+    op_read,            // read a, of type b
+    op_write,           // write a, of type b
+    NUM_OPCODES
+} Opcode;
+
+// What each field of an instruction holds
+typedef enum {
+    field_none,
+    field_def,          // a register written
+    field_use,          // a register read
+    field_args,         // the first of a call's argument registers
+    field_range,        // the first register cleared
+    field_constant,     // a number
+    field_label,        // an instruction index
+    field_function,     // a function index
+    field_string,       // a string pool index
+    field_global,       // a global slot
+    field_type,         // a j_type
+} FieldKind;
+
+struct OpcodeInfo {
+    const char *name;
+    FieldKind a, b, c;
+};
+
+extern const OpcodeInfo opcode_info[NUM_OPCODES];
+
+struct Instruction {
+    int32_t op;         // an Opcode
+    int32_t a, b, c;
+};
+
+struct Function {
+    std::string name;
+    int params;         // formals, in registers 0 ...
+    int slots;          // frame slots; registers from here on are temporaries
+    int registers;      // frame slots and temporaries
+    std::vector<Instruction> code;
+};
+
+struct Module {
+    std::vector<Function> functions;    // routines, then top-level blocks
+    int routines;       // the first functions
+    int main;           // the function that runs the program
+    int globals;        // slots of the global frame
+    std::vector<std::string> strings;
+
+    Module() : routines(0), main(-1), globals(0) {}
+};
+
+static inline bool is_jump(int op) {
+    return opcode_info[op].a == field_label;
+}
+
+// Control does not go on to the next instruction
+static inline bool ends_flow(int op) {
+    return op == op_jump || op == op_return || op == op_return_none;
+}
+
+// Calls f(register) for each register the instruction reads, or writes;
+// a call's arguments are as many as the callee's params
+template <typename F>
+void for_each_use(const Module &module, const Instruction &in, F f) {
+    const OpcodeInfo &info = opcode_info[in.op];
+    const int32_t fields[3] = {in.a, in.b, in.c};
+    const FieldKind kinds[3] = {info.a, info.b, info.c};
+    for (int i = 0; i < 3; i++) {
+        if (kinds[i] == field_use)
+            f(fields[i]);
+        else if (kinds[i] == field_args) {
+            for (int j = 0; j < module.functions[in.c].params; j++) f(fields[i] + j);
+        }
+    }
+}
+
+template <typename F>
+void for_each_def(const Instruction &in, F f) {
+    const OpcodeInfo &info = opcode_info[in.op];
+    if (info.a == field_def)
+        f(in.a);
+    else if (info.a == field_range) {
+        for (int j = 0; j < in.b; j++) f(in.a + j);
+    }
+}
+
+// Prints a function's code, one instruction a line
+void print_function(FILE *fp, const Module &module, const Function &function);
+
+#endif // BYTECODE_H
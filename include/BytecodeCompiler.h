@@ -0,0 +1,43 @@
+#ifndef BYTECODECOMPILER_H
+#define BYTECODECOMPILER_H
+
+#include "Bytecode.h"
+#include "ast.h"
+#include <unordered_map>
+
+// Lowers a program to a Module. Every expression's value goes into a
+// fresh temporary, except a local variable's, which is read in its slot;
+// an assignment moves the value into the variable. The code is naive on
+// purpose: PeepholeOptimizer cleans it up.
+class BytecodeCompiler {
+public:
+    // Lowers program, which has passed check_types and been laid out by
+    // layout_frames, into module. Returns 0, or 1 after an error, which is
+    // reported on stderr.
+    int compile(AST *program, Module &module);
+
+private:
+    Module *module;
+    Function *function;             // being lowered
+    std::unordered_map<STEntry *, int> functions;
+    std::unordered_map<std::string, int> strings;
+
+    int emit(Opcode op, int a = 0, int b = 0, int c = 0);
+    int here() const { return (int)function->code.size(); }
+    void patch(int jump, int target) { function->code[jump].a = target; }
+    int temporary() { return function->registers++; }
+    int functionOf(STEntry *routine);
+    int stringOf(const char *string);
+
+    int expr(AST *node);
+    int binary(AST *node);
+    int call(AST *node);
+    int load(STEntry *var);
+    void store(STEntry *var, int value);
+    void stmt(AST *node);
+    void loop(AST *node);
+    Function &begin(const char *name, int params, int slots);
+    void lowerProgram(AST *program);
+};
+
+#endif // BYTECODECOMPILER_H
@@ -0,0 +1,29 @@
+#ifndef BYTECODEINTERPRETER_H
+#define BYTECODEINTERPRETER_H
+
+#include "Bytecode.h"
+#include "ModuleImage.h"
+#include "Runtime.h"
+
+// Executes a Module, laid out as a ModuleImage: one loop that switches on
+// each instruction's opcode, with the current function's registers in its
+// frame on the Runtime's stack. A call recurses into the loop for the callee.
+class BytecodeInterpreter {
+public:
+    explicit BytecodeInterpreter(Runtime &runtime) : runtime(runtime), image(nullptr) {}
+
+    // Return 0, or 1 after a runtime error, which is reported on stderr. A
+    // Module is built into an image first; an image, loaded or built, runs
+    // where it is.
+    int run(const Module &module);
+    int run(const ModuleImage &image);
+
+private:
+    Runtime &runtime;
+    const ModuleImage *image;
+    std::vector<Value> globals;
+
+    Value execute(const ImageFunction &function, Value *frame);
+};
+
+#endif // BYTECODEINTERPRETER_H
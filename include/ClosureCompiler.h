@@ -0,0 +1,102 @@
+#ifndef CLOSURECOMPILER_H
+#define CLOSURECOMPILER_H
+
+#include "Arena.h"
+#include "Runtime.h"
+#include <unordered_map>
+#include <vector>
+
+// A compiled piece of a program: a function object made once from an AST
+// node, with everything the node needs bound into it, and the function
+// that calls it. R is the value of an expression, or for a statement
+// whether it executed a return. Calling one costs an indirect call.
+template <typename R>
+class Code {
+public:
+    Code() : invoke(nullptr), body(nullptr) {}
+    R operator()(Value *frame) const { return invoke(body, frame); }
+
+private:
+    friend class ClosureCompiler;
+    R (*invoke)(const void *body, Value *frame);
+    const void *body;
+};
+
+// Executes a program by compiling it first into a tree of Code: each node
+// becomes a lambda specialized for its AST_type, for the type the type
+// pass gave it, and for the kind of its operands. A variable is read with
+// one load from its frame slot; an integer operator whose operand is a
+// variable or a literal reads it in place instead of calling code for it.
+// Running the program then does no dispatch on node or value types.
+//
+// The code refers to the program's symbol table entries and frame layout
+// only while it is compiled, and lives as long as the compiler.
+class ClosureCompiler {
+public:
+    explicit ClosureCompiler(Runtime &runtime);
+
+    // Compiles program, which has passed check_types and been laid out by
+    // layout_frames, so it can be run any number of times. Returns 0, or 1
+    // after an error, which is reported on stderr.
+    int compile(AST *program);
+
+    // Returns 0, or 1 after a runtime error, which is reported on stderr
+    int run();
+
+    // Compiles just the routine name and what it calls, for a program
+    // another engine is running with the given global frame, instead of
+    // compiling the whole program. Routines compiled before are reused.
+    // Returns the routine's code, to call with its frame, or nullptr after
+    // an error, which is reported on stderr; after one, every later call
+    // fails too. Use a compiler for one program only, and from one thread
+    // at a time; the code may run on another thread.
+    const Code<bool> *compileRoutine(AST *program, STEntry *name, Value *globals);
+
+private:
+    struct Routine {
+        Code<bool> body;
+        int slots;      // of its frame
+        AST *decl;
+        bool queued;    // to be compiled, or compiled
+    };
+    // A call: the routine, and code for each argument
+    struct CallSite {
+        Routine *routine;
+        Code<Value> *args;
+        int count;
+        Runtime *runtime;
+    };
+
+    Runtime &runtime;
+    Value *globals;
+    int globalSlots;
+    std::vector<Code<bool>> steps;  // constants and top-level blocks, in order
+    std::unordered_map<STEntry *, Routine *> routines;
+    std::vector<Routine *> pending;     // queued, not yet compiled
+    bool failed;
+
+    Arena arena;    // the code and its data
+    template <typename F> auto bind(F f) -> Code<decltype(f((Value *)nullptr))>;
+
+    Routine *routineOf(STEntry *entry);
+    Value *globalOf(STEntry *var);
+    static void invoke(const CallSite *site, Value *frame);
+
+    template <typename T> Code<T> expr(AST *node);
+    template <typename T> bool common(AST *node, Code<T> &code);
+    Code<Value> value(AST *node);
+    template <typename R, typename T, typename Op> Code<R> binary(AST *node);
+    template <typename R, typename T, typename Op, typename Left>
+    Code<R> binaryWith(Left left, AST *right);
+    template <typename T> Code<bool> assign(STEntry *var, AST *rhs);
+    template <typename T, typename Source> Code<bool> store(STEntry *var, Source source);
+    CallSite *callSite(AST *node);
+    template <typename T> Code<T> callFor(AST *node);
+    Code<bool> stmt(AST *node);
+    Code<bool> block(AST *node);
+    void declareRoutines(AST *program);
+    void compilePending();
+    void compileProgram(AST *program);
+};
+
+#endif // CLOSURECOMPILER_H
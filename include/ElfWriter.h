@@ -0,0 +1,46 @@
+#ifndef ELFWRITER_H
+#define ELFWRITER_H
+
+#include "X86Assembler.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Writes a relocatable x86-64 ELF object, as a compiler's .o is, for the
+// system linker: code in .text with its relocations in .rela.text,
+// writable data in .data, constants in .rodata, and a symbol table.
+//
+// Symbols are numbered as they are added, and relocations refer to those
+// numbers; the file lists the local symbols first, as ELF requires, and
+// write renumbers the relocations to match.
+class ElfWriter {
+public:
+    // The sections symbols can be defined in, by their index in the file
+    enum Section { section_undefined = 0, section_text = 1, section_data, section_rodata };
+
+    std::vector<uint8_t> text, data, rodata;
+    std::vector<X86Relocation> relocations;     // in text
+
+    ElfWriter();
+
+    // Returns the symbol's number. An undefined symbol is global, left to
+    // the linker.
+    int addSymbol(const std::string &name, Section section, uint64_t value = 0,
+                  uint64_t size = 0, bool global = false, bool function = false);
+    // The symbol of a section's start
+    int sectionSymbol(Section section) const { return section; }
+
+    // Returns 0, or 1 after an error, which is reported on stderr
+    int write(const char *fileName) const;
+
+private:
+    struct Symbol {
+        std::string name;
+        Section section;
+        uint64_t value, size;
+        bool global, function, isSection;
+    };
+    std::vector<Symbol> symbols;
+};
+
+#endif // ELFWRITER_H
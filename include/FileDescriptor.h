@@ -11,6 +11,14 @@
 #include <cstdlib>
 using namespace std;
 
+// Debug trace of the scanner/parser internals. It is printed for every
+// character and token, so it is compiled in only with -DN23_TRACE.
+#ifdef N23_TRACE
+#define TRACE(msg) (std::cout << msg << std::endl)
+#else
+#define TRACE(msg) ((void)0)
+#endif
+
 class FileDescriptor {
 public:
     FILE *fp;
@@ -18,13 +26,21 @@ public:
     int char_number;    // character number in the line
     int flag;           // to prevent two ungets in a row
     int buf_size;       // stores the buffer size
+    int line_length;    // length of the line in the buffer
     char *buffer;       // buffer to store a line
     char *file;         // file name, allocate memory for this
     int flag2;          // additional flag
+    const char *mem;    // in-memory source, nullptr when reading fp
+    long mem_length;    // length of the in-memory source
+    long mem_pos;       // offset of the next line in the in-memory source
+    std::ostream *messages; // where ReportError writes; std::cout by default
 
     // Constructor for opening a specific file
     FileDescriptor(const char *FileName);
 
+    // Constructor for an in-memory source starting at line first_line
+    FileDescriptor(const char *data, long length, int first_line = 1);
+
     // Default constructor - opens stdin
     FileDescriptor();
 
@@ -57,6 +73,21 @@ public:
 
     // Puts back one character - can't do consecutive ungets
     void UngetChar(char c);
+
+    // The rest of the current line, from the next character on. The scanner
+    // finds the end of a run of characters here and then skips over it.
+    const char* Cursor() { return buffer + char_number; }
+    int Remaining() { return line_length - char_number; }
+    void Advance(int n) {
+        char_number += n;
+        if (n > 0) flag = UNSET;   // a pending unget was consumed
+    }
+
+    // Reads a whole file into memory, for the in-memory constructor
+    static char* LoadFile(const char *FileName, long *length);
+
+private:
+    bool ReadMemLine();
 };
 
 #endif // FILEDESCRIPTOR_H
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef FLEXSCANNER_H
+#define FLEXSCANNER_H
+
+#include "Scanner.h"
+
+// Lexer backed by the flex-generated DFA in scanner/flex_scanner. The source
+// is copied into a buffer that flex scans in place (yy_scan_buffer), and
+// tokens are built from the matched text.
+//
+// The scanner is generated reentrant from flex_scanner.l, and every
+// FlexScanner has its own flex scanner and buffer, so scanners on different
+// threads are independent and several can be used in turn on one thread.
+//
+// Tokens and their line numbers are the same as Scanner's on valid input.
+// Malformed input can be split or reported differently, and strings can't
+// contain escaped quotes.
+class FlexScanner : public Lexer {
+public:
+    FlexScanner(const char *data, long length);
+
+    // Scans a whole file; nullptr if it can't be read
+    static FlexScanner* FromFile(const char *fileName);
+
+    ~FlexScanner();
+
+    TOKEN* Scan() override;
+    void ScanInto(TOKEN &token) override;
+    TOKEN* Peek() override;
+    int getLineNum() override;
+    int getCharNum() override;
+    void ReportError(char *msg) override;
+
+private:
+    char *buffer;           // source followed by the two NULs flex needs
+    long length;            // length of the source
+    void *state;            // flex scanner (yyscan_t)
+    bool atEnd;             // end of file was returned
+    TOKEN *peeked;          // token returned by Peek() and not yet by Scan()
+
+    int line;               // line of the last token, as Scanner counts them
+    const char *lineStart;  // start of that line
+    const char *counted;    // newlines before this are counted in line
+    const char *tokenEnd;   // end of the last token
+
+    void moveTo(const char *tokenStart, const char *end);
+};
+
+#endif // FLEXSCANNER_H
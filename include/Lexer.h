@@ -0,0 +1,32 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+class TOKEN;
+
+// What the parser needs from a token source. Scanner is the hand-written
+// implementation, FlexScanner the flex-generated one.
+class Lexer {
+public:
+    virtual ~Lexer() {}
+
+    // Returns the next token, consuming it. Every call returns a newly
+    // allocated token, so earlier tokens stay valid.
+    virtual TOKEN* Scan() = 0;
+
+    // Scans the next token into token, reusing its storage: Scan() without
+    // the allocation
+    virtual void ScanInto(TOKEN &token) = 0;
+
+    // Returns the next token without consuming it; the following Scan()
+    // returns the same token
+    virtual TOKEN* Peek() = 0;
+
+    // Position of the last token scanned (or peeked at)
+    virtual int getLineNum() = 0;
+    virtual int getCharNum() = 0;
+
+    // Prints an error message at the current position
+    virtual void ReportError(char *msg) = 0;
+};
+
+#endif // LEXER_H
@@ -0,0 +1,98 @@
+#ifndef MODULEIMAGE_H
+#define MODULEIMAGE_H
+
+#include "Bytecode.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A Module flattened into one block of memory, laid out as
+// BytecodeInterpreter executes it, so an image written to a file runs where
+// it is mapped, with nothing to parse, copy or relocate. Offsets are from
+// the start of the image, every table is 8-byte aligned, and every field is
+// a fixed-width little-endian integer, with no pointers:
+//
+//   ImageHeader
+//   ImageFunction[functions]   names, frame sizes and where the code is
+//   Instruction[instructions]  all the code, one function after another;
+//                              jumps are relative to the function's start
+//   uint32_t[strings]          each string literal's offset in the pool
+//   char pool[poolBytes]       function names and string literals, each
+//                              ending in a NUL
+//
+// Loading checks the header, the tables and every instruction's operands,
+// so a truncated, foreign or damaged file is refused rather than run. The
+// code's meaning is trusted as the compiler wrote it, as an executable's
+// would be.
+struct ImageHeader {
+    char magic[8];              // IMAGE_MAGIC
+    uint32_t version;           // IMAGE_VERSION
+    uint32_t byteOrder;         // 0x01020304, as the writer stored it
+    uint32_t functions, routines, main, globals, strings;
+    uint32_t reserved;
+    uint64_t functionTable, code, instructions, stringTable, pool, poolBytes;
+    uint64_t size;              // of the whole image
+};
+
+struct ImageFunction {
+    uint32_t name;              // in the pool
+    int32_t params, slots, registers;
+    uint64_t code;              // its first instruction
+    uint64_t length;            // in instructions
+};
+
+static_assert(sizeof(Instruction) == 16, "Instruction is four int32_ts");
+static_assert(sizeof(ImageHeader) == 96 && sizeof(ImageFunction) == 32,
+              "image records have no padding");
+
+class ModuleImage {
+public:
+    static const char IMAGE_MAGIC[8];
+    static const uint32_t IMAGE_VERSION = 1;
+
+    ModuleImage();
+    ~ModuleImage();
+    ModuleImage(const ModuleImage &) = delete;
+    ModuleImage &operator=(const ModuleImage &) = delete;
+
+    // Lays module out in memory
+    void build(const Module &module);
+
+    // Returns 0, or 1 after an error, which is reported on stderr
+    int write(const char *fileName) const;
+
+    // Maps an image written by write, read-only, and checks it. Returns 0,
+    // or 1 after an error, which is reported on stderr.
+    int load(const char *fileName);
+
+    // The Module the image was built from
+    void toModule(Module &module) const;
+
+    const ImageHeader &header() const { return *(const ImageHeader *)base; }
+    size_t size() const { return bytes; }
+    bool mapped() const { return mapping != nullptr; }
+
+    const ImageFunction *functions() const { return functionTable; }
+    const Instruction *instructions() const { return instructionBase; }
+    const Instruction *code(const ImageFunction &function) const {
+        return instructionBase + function.code;
+    }
+    const char *name(const ImageFunction &function) const { return pool + function.name; }
+    const char *string(int index) const { return pool + stringTable[index]; }
+
+private:
+    const uint8_t *base;
+    size_t bytes;
+    void *mapping;                      // if loaded
+    std::vector<uint64_t> owned;        // if built
+    const ImageFunction *functionTable;
+    const Instruction *instructionBase;
+    const uint32_t *stringTable;
+    const char *pool;
+
+    void release();
+    bool check(const char *fileName);
+    void locate();
+};
+
+#endif // MODULEIMAGE_H
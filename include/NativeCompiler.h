@@ -0,0 +1,84 @@
+#ifndef NATIVECOMPILER_H
+#define NATIVECOMPILER_H
+
+#include "Bytecode.h"
+#include "ElfWriter.h"
+#include "RegisterAllocator.h"
+#include "X86Assembler.h"
+
+// Compiles a Module ahead of time to x86-64 machine code, written as a
+// relocatable ELF object for the system linker. Linked with the runtime in
+// codegen/n23rt.c, which holds main and does input and output, it makes a
+// program that behaves as BytecodeInterpreter running the module does.
+//
+// Each Function becomes a function of the System V ABI, its virtual
+// registers placed by RegisterAllocator. A routine has a global symbol,
+// n23_ and its name; the program, n23main, calls the blocks, which are
+// local. Arguments are pushed, the first last, and the result comes back
+// in rax. Integers, booleans and floats live in the low 32 bits of a
+// register, strings as 64-bit pointers into .rodata or to strings read;
+// arithmetic is done in 32 bits, so integers wrap as Runtime's do, and
+// floats in xmm0 and xmm1. Globals are 8 bytes each in .data.
+//
+// Each function counts the frames active and the slots they would hold,
+// and fails with a stack overflow where the interpreter would. Failures
+// and everything the runtime does are calls of n23rt_ functions.
+class NativeCompiler {
+public:
+    explicit NativeCompiler(uint32_t registers = RegisterAllocator::DEFAULT_REGISTERS)
+        : allocator(registers) {}
+
+    // Writes module, optimized or not, to fileName. Returns 0, or 1 after
+    // an error, which is reported on stderr.
+    int compile(const Module &module, const char *fileName);
+
+    // Of the object last written
+    size_t codeSize() const { return codeBytes; }
+
+private:
+    enum RuntimeFunction {
+        rt_read_integer, rt_read_float, rt_read_boolean, rt_read_string,
+        rt_write_integer, rt_write_float, rt_write_boolean, rt_write_string,
+        rt_same_string, rt_fail,
+        NUM_RUNTIME_FUNCTIONS
+    };
+
+    RegisterAllocator allocator;
+    Allocation allocation;
+    X86Assembler as;
+    const Module *module;
+    const Function *function;
+    size_t codeBytes = 0;
+
+    int dataSymbol, rodataSymbol;
+    int runtime[NUM_RUNTIME_FUNCTIONS];         // symbols
+    std::vector<int> entries;                   // by function: its label
+    std::vector<int32_t> stringOffsets;         // by string, in .rodata
+    int32_t depthOffset, slotsOffset;           // of the counters, in .data
+    int32_t overflowMessage, divisionMessage;   // in .rodata
+
+    // Of the function being compiled
+    std::vector<int> labels;                    // by instruction
+    int32_t calleeSlot[NUM_X86_REGISTERS];      // offsets from rbp
+    int32_t saveSlot[NUM_X86_REGISTERS];
+    int32_t spillBase;
+    int returnLabel, overflowLabel, divisionLabel;
+    bool divides;
+
+    bool placed(int reg) const;
+    X86Operand place(int reg) const;
+    void move(const X86Operand &dst, const X86Operand &src);
+    int load(const X86Operand &dst, const X86Operand &src, int avoid = -1);
+    void store(const X86Operand &dst, int reg);
+    void compileFunction(int index);
+    void instruction(size_t i);
+    void arithmetic(const Instruction &in);
+    void compare(int left, int right);
+    void condition(int dst, X86Condition cc);
+    void floating(const Instruction &in, X86Sse op);
+    void floatCompare(const Instruction &in);
+    void save(size_t i, bool restore);
+    void fail(int label, int32_t message);
+};
+
+#endif // NATIVECOMPILER_H
@@ -0,0 +1,79 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include "Runtime.h"
+
+// What the execution engines that specialize code share: the member of a
+// Value that holds a T, the kinds of operand an integer operator is worth
+// specializing for, and N23's operators as function objects, so a template
+// can be instantiated for each operator.
+
+// The member of a Value that holds a T
+template <typename T> struct Member;
+template <> struct Member<int> {
+    static int &of(Value &value) { return value.i; }
+};
+template <> struct Member<float> {
+    static float &of(Value &value) { return value.f; }
+};
+template <> struct Member<bool> {
+    static bool &of(Value &value) { return value.b; }
+};
+template <> struct Member<const char *> {
+    static const char *&of(Value &value) { return value.s; }
+};
+
+// The kinds of operand an integer operator is specialized for
+enum OperandKind { operand_local, operand_global, operand_literal, operand_computed };
+
+inline OperandKind kindOf(AST *node) {
+    if (node->type == ast_var)
+        return node->f.a_var.var->Depth == 0 ? operand_global : operand_local;
+    if (node->type == ast_integer)
+        return operand_literal;
+    return operand_computed;
+}
+
+// Operators, for operands of one type
+struct Add {
+    int operator()(int left, int right) const { return Runtime::add(left, right); }
+    float operator()(float left, float right) const { return left + right; }
+};
+struct Subtract {
+    int operator()(int left, int right) const { return Runtime::subtract(left, right); }
+    float operator()(float left, float right) const { return left - right; }
+};
+struct Multiply {
+    int operator()(int left, int right) const { return Runtime::multiply(left, right); }
+    float operator()(float left, float right) const { return left * right; }
+};
+struct Divide {
+    int operator()(int left, int right) const { return Runtime::divide(left, right); }
+    float operator()(float left, float right) const { return left / right; }
+};
+struct Equal {
+    template <typename T> bool operator()(T left, T right) const { return left == right; }
+    bool operator()(const char *left, const char *right) const {
+        return Runtime::sameString(left, right);
+    }
+};
+struct NotEqual {
+    template <typename T> bool operator()(T left, T right) const { return left != right; }
+    bool operator()(const char *left, const char *right) const {
+        return !Runtime::sameString(left, right);
+    }
+};
+struct Less {
+    template <typename T> bool operator()(T left, T right) const { return left < right; }
+};
+struct LessEqual {
+    template <typename T> bool operator()(T left, T right) const { return left <= right; }
+};
+struct Greater {
+    template <typename T> bool operator()(T left, T right) const { return left > right; }
+};
+struct GreaterEqual {
+    template <typename T> bool operator()(T left, T right) const { return left >= right; }
+};
+
+#endif // OPERATORS_H
@@ -0,0 +1,30 @@
+#ifndef PARALLELSCANNER_H
+#define PARALLELSCANNER_H
+
+#include "Scanner.h"
+#include <vector>
+
+// Scans an in-memory source on several threads.
+//
+// N23 strings and comments can't span lines, and no token does, so the
+// scanner is always in its initial state at the start of a line. The source
+// is cut into one chunk per thread at line starts, a cheap first pass counts
+// the lines of each chunk to find the line number every chunk starts at,
+// and then each chunk is scanned by its own Scanner. The token arrays are
+// joined in order with a single end of file token at the end, and each
+// chunk's lexical errors are printed after the chunk before it.
+class ParallelScanner {
+public:
+    // The source isn't copied and must outlive ScanAll()
+    ParallelScanner(const char *data, long length, int num_threads);
+
+    // Returns all tokens in source order, ending with lx_eof
+    std::vector<TOKEN*> ScanAll();
+
+private:
+    const char *data;
+    long length;
+    int num_threads;
+};
+
+#endif // PARALLELSCANNER_H
@@ -0,0 +1,64 @@
+#ifndef PEEPHOLEOPTIMIZER_H
+#define PEEPHOLEOPTIMIZER_H
+
+#include "Bytecode.h"
+#include <stdint.h>
+#include <vector>
+
+// Cleans up the code BytecodeCompiler writes, in two steps.
+//
+// optimize rewrites each function with a table of patterns, each matching
+// one instruction or two adjacent ones, such as a move of a value that was
+// just computed, a not feeding a branch, a comparison feeding a branch, or
+// a jump to a jump. Patterns apply in sweeps over the code until none
+// does. A pattern never matches two instructions with a jump target
+// between them, and only forwards a temporary that is written once and
+// read once.
+//
+// schedule then reorders the instructions between jump targets, calls and
+// input or output, by list scheduling: of the instructions whose operands
+// are ready, it takes the one with the longest chain of latencies after
+// it, so a slow divide starts early.
+//
+// The optimizer counts, for each pattern, how often it applied and how
+// many instructions it removed, summed over every function it was given.
+class PeepholeOptimizer {
+public:
+    PeepholeOptimizer();
+
+    void optimize(Module &module);      // every function
+    void optimize(const Module &module, Function &function);
+    void schedule(Module &module);
+    void schedule(const Module &module, Function &function);
+
+    // The counts, a pattern a line
+    void report(FILE *fp) const;
+
+    long before() const { return instructionsBefore; }  // given to optimize
+    long after() const { return instructionsAfter; }    // left by it
+    long moved() const { return instructionsMoved; }    // by schedule
+
+private:
+    struct Count {
+        long applied;
+        long removed;
+    };
+    std::vector<Count> counts;          // by pattern
+    std::vector<std::vector<int>> byOpcode;     // patterns that can start at each
+    long instructionsBefore;
+    long instructionsAfter;
+    long instructionsMoved;
+
+    // Scratch space, kept between functions
+    std::vector<int> uses, defs;        // by register
+    std::vector<bool> targets;          // by instruction
+    std::vector<int> writer;            // by register: the last in a region
+    std::vector<uint64_t> readers;      // since then, as a bit set
+    std::vector<int> storer;            // by global
+    std::vector<uint64_t> loaders;
+
+    bool sweep(const Module &module, Function &function);
+    void scheduleRegion(const Module &module, Function &function, size_t first, size_t end);
+};
+
+#endif // PEEPHOLEOPTIMIZER_H
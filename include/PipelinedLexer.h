@@ -0,0 +1,62 @@
+#ifndef PIPELINEDLEXER_H
+#define PIPELINEDLEXER_H
+
+#include "Scanner.h"
+#include <atomic>
+#include <thread>
+
+// Runs another Lexer on a thread of its own, so that reading and scanning
+// the source overlap with parsing.
+//
+// The scanner thread fills batches of tokens and passes them to the
+// consumer through a lock-free single-producer, single-consumer ring of
+// QUEUE_SIZE batches. The consumer is the thread calling Scan or ScanInto.
+// Each side waits only when the ring is full or empty, by spinning briefly
+// and then yielding.
+//
+// The lexer runs ahead of the consumer. Because of that, ReportError gives
+// only the line of the last token handed out, and the lexer's own error
+// messages can appear before reports about earlier tokens.
+class PipelinedLexer : public Lexer {
+public:
+    static const int BATCH_SIZE = 256;  // tokens per batch
+    static const int QUEUE_SIZE = 8;    // batches in the ring, a power of two
+
+    // Takes ownership of the lexer and starts scanning
+    explicit PipelinedLexer(Lexer *lexer);
+    ~PipelinedLexer();
+
+    TOKEN* Scan() override;
+    void ScanInto(TOKEN &token) override;
+    TOKEN* Peek() override;
+    int getLineNum() override;
+    int getCharNum() override;  // not known; always 0
+    void ReportError(char *msg) override;
+
+private:
+    struct Batch {
+        TOKEN tokens[BATCH_SIZE];
+        int count;
+    };
+
+    Lexer *lexer;
+    Batch *batches;
+    std::thread producer;
+
+    // Written by the producer, read by the consumer, and the other way
+    // round; on separate cache lines so the two sides don't contend
+    alignas(64) std::atomic<long> produced;     // batches filled
+    alignas(64) std::atomic<long> consumed;     // batches given back
+    std::atomic<bool> stopping;                 // destructor called
+
+    // Consumer side
+    alignas(64) long reading;   // batch being read
+    int position;               // next token in it
+    bool ended;                 // lx_eof handed out
+    int line;                   // line of the last token handed out
+    TOKEN *peeked;              // token returned by Peek() and not yet by Scan()
+
+    void produce();
+};
+
+#endif // PIPELINEDLEXER_H
@@ -0,0 +1,145 @@
+#ifndef PROGRAMGENERATOR_H
+#define PROGRAMGENERATOR_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Operators of the generated expressions, everything in
+// tests/test5_all_operators.txt. GEN_NEG is unary minus.
+enum GEN_OPERATOR {
+    GEN_PLUS, GEN_MINUS, GEN_TIMES, GEN_DIVIDE, GEN_NEG,
+    GEN_EQ, GEN_NE, GEN_LT, GEN_LE, GEN_GT, GEN_GE,
+    GEN_AND, GEN_OR, GEN_NOT,
+    NUM_GEN_OPERATORS
+};
+
+extern const char* const genOperatorNames[NUM_GEN_OPERATORS];
+
+// Size and shape of a generated program
+struct GeneratorConfig {
+    unsigned long long seed = 1;
+    long targetBytes = 0;   // add routines until the program is this big; 0 => routines
+    int routines = 8;       // functions and procedures
+    int globals = 8;        // global variables
+    int constants = 2;      // global constants
+    int maxParams = 3;      // parameters per routine
+    int locals = 3;         // variables declared per block
+    int statements = 6;     // statements per block
+    int nestingDepth = 3;   // nested if / while / for / begin statements
+    int exprDepth = 3;      // nested operators in an expression
+    int loopTrips = 4;      // loops run 1..loopTrips times
+    long workBudget = 100000; // statements a routine may execute per call
+    double reuse = 0.5;     // chance a reference reuses a recently used name
+    int weights[NUM_GEN_OPERATORS]; // relative frequency of each operator
+    bool reads = false;     // emit read() statements (running then needs input)
+    bool comments = true;   // emit ## comments
+
+    GeneratorConfig() {
+        for (int i = 0; i < NUM_GEN_OPERATORS; i++) weights[i] = 1;
+    }
+
+    // Parses "op=weight,op=weight..." (e.g. "+=4,/=0,and=2") into weights.
+    // Operators not named keep their weight. Returns false on a bad spec.
+    bool SetWeights(const char *spec);
+};
+
+// Writes random N23 programs that parse without errors and, when run,
+// terminate without reading input or dividing by zero:
+// - routines call only routines declared before them, so there is no
+//   recursion, and calls are only placed where the callee's cost fits in
+//   the caller's work budget
+// - loops count a reserved counter up to a small literal bound
+// - divisors are nonzero literals
+// - expressions are well typed, and unary operators take a parenthesized
+//   operand as the grammar requires
+//
+// The output depends only on the config, so a seed names a program.
+// Programs are written as they are generated, so their size is not limited
+// by memory.
+class ProgramGenerator {
+public:
+    ProgramGenerator(const GeneratorConfig &config);
+
+    // Writes a program; returns the number of bytes written
+    long Generate(FILE *file);
+
+    // Returns a program as a string
+    std::string Generate();
+
+private:
+    enum { GEN_INTEGER, GEN_BOOLEAN, GEN_STRING, NUM_GEN_TYPES };
+
+    struct Variable {
+        std::string name;
+        int type;
+    };
+
+    struct Routine {
+        std::string name;
+        int returnType;            // -1 for a procedure
+        std::vector<int> params;   // parameter types
+        long cost;                 // statements executed per call, at most
+    };
+
+    // Visible variables, per type: readable ones include constants and loop
+    // counters, which are never assigned
+    struct Scope {
+        size_t readable[NUM_GEN_TYPES];
+        size_t assignable[NUM_GEN_TYPES];
+    };
+
+    GeneratorConfig config;
+    unsigned long long state;   // splitmix64 state
+    FILE *file;                 // destination, or nullptr for the string
+    std::string out;            // pending output
+    long written;               // bytes flushed so far
+
+    std::vector<Variable> readable[NUM_GEN_TYPES];
+    std::vector<Variable> assignable[NUM_GEN_TYPES];
+    std::vector<Scope> scopes;
+    std::vector<std::string> recent[NUM_GEN_TYPES]; // last names referenced
+    size_t recentNext[NUM_GEN_TYPES];
+
+    std::vector<Routine> routines;
+    int indent;
+    int loopDepth;      // enclosing loops; loop n uses counter n<n>
+    long multiplier;    // times the current statement runs per call
+    long work;          // statements charged to the current routine
+    int localCount;     // names for block locals
+
+    unsigned long long next();
+    int below(int n);
+    bool chance(double p);
+    int pickOperator(int first, int last);
+
+    void emit(const char *text);
+    void emit(const std::string &text);
+    void emitNumber(long value);
+    void newline();
+    void flush();
+    long size() const;
+
+    void enterScope();
+    void exitScope();
+    void declare(const std::string &name, int type, bool isAssignable);
+    const std::string* pickVariable(int type, bool toAssign);
+
+    const Routine* pickRoutine(int returnType);
+    void call(const Routine &routine, int depth);
+    void expr(int type, int depth);
+    void intExpr(int depth, int precedence);
+    void boolExpr(int depth, int precedence);
+    void relation(int depth, int precedence);
+    void constantExpr(int depth);
+
+    void declareLocals(int count, const char *prefix);
+    void block(int depth, bool outermost, int returnType, int counter);
+    void body(int depth, int counter);
+    void statement(int depth, bool single);
+    void routine(int index);
+    void header();
+    void generate();
+};
+
+#endif // PROGRAMGENERATOR_H
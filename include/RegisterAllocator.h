@@ -0,0 +1,97 @@
+#ifndef REGISTERALLOCATOR_H
+#define REGISTERALLOCATOR_H
+
+#include "Bytecode.h"
+#include <stdint.h>
+#include <vector>
+
+// The x86-64 integer registers, numbered as the instruction encoding
+// numbers them
+enum X86Register {
+    reg_rax, reg_rcx, reg_rdx, reg_rbx, reg_rsp, reg_rbp, reg_rsi, reg_rdi,
+    reg_r8, reg_r9, reg_r10, reg_r11, reg_r12, reg_r13, reg_r14, reg_r15,
+    NUM_X86_REGISTERS
+};
+
+const char *x86_register_name(int reg);
+
+// Kept across calls by the System V ABI: rbx, rbp and r12 to r15
+static inline bool x86_callee_saved(int reg) {
+    return reg == reg_rbx || reg == reg_rbp || (reg >= reg_r12 && reg <= reg_r15);
+}
+
+// Instructions that are calls in native code: calls of routines, and of
+// the C runtime, which reads, writes and compares strings
+static inline bool x86_calls_out(int op) {
+    return op == op_call || op == op_read || op == op_write || op == op_seq || op == op_sne;
+}
+
+// Where each virtual register of a Function lives in native code
+struct Allocation {
+    std::vector<int> registerOf;    // by virtual register: an X86Register, or -1
+    std::vector<int> slotOf;        // by virtual register: a spill slot, or -1
+    int spillSlots;
+    uint32_t calleeSaved;           // callee-saved registers used, as a bit set
+    // By instruction: for a call (x86_calls_out), the caller-saved
+    // registers holding values live across it, which must be saved before
+    // it and restored after
+    std::vector<uint32_t> savedAt;
+
+    int intervals;                  // virtual registers that are ever live
+    int spilled;                    // of those, the ones given a slot
+    int spillAccesses;              // reads and writes of spilled ones
+    int callSaves;                  // saves around calls, each with a restore
+};
+
+// A linear-scan register allocator (Poletto and Sarkar) for the virtual
+// registers of a Function: its formals, locals and temporaries.
+//
+// Liveness is computed over the function's basic blocks, and each virtual
+// register gets one live interval, from the first point it is live to the
+// last, holes included. An instruction reads its operands at 2i and
+// writes its result at 2i + 1, so a result can take the register of an
+// operand that dies there.
+//
+// The intervals are taken in order of their start. An interval that is
+// live across a call is given a free callee-saved register if there is
+// one; any other prefers a caller-saved register, and leaves the
+// callee-saved ones for values that need them. When no register is free,
+// whichever of the interval and those holding registers ends last goes to
+// a stack slot. A value in a caller-saved register that is live across a
+// call is saved around it.
+//
+// rax and rdx are never allocated, as division and returns need them, nor
+// r11, which code generation keeps as scratch for spilled operands, nor
+// rsp and rbp.
+class RegisterAllocator {
+public:
+    static const uint32_t DEFAULT_REGISTERS =
+        1u << reg_rcx | 1u << reg_rbx | 1u << reg_rsi | 1u << reg_rdi | 1u << reg_r8 |
+        1u << reg_r9 | 1u << reg_r10 | 1u << reg_r12 | 1u << reg_r13 | 1u << reg_r14 |
+        1u << reg_r15;
+
+    // allocatable is a bit set of X86Registers; fewer registers make
+    // spilling easy to test
+    explicit RegisterAllocator(uint32_t allocatable = DEFAULT_REGISTERS)
+        : allocatable(allocatable) {}
+
+    void allocate(const Module &module, const Function &function, Allocation &allocation);
+
+    // The live interval of each virtual register of the function last
+    // allocated, in the points above; start is -1 if it is never live
+    struct Interval {
+        int start, end;
+    };
+    const std::vector<Interval> &intervals() const { return live; }
+
+private:
+    uint32_t allocatable;
+    std::vector<Interval> live;         // by virtual register
+
+    void computeIntervals(const Module &module, const Function &function);
+};
+
+// Prints an allocation a line a virtual register
+void print_allocation(FILE *fp, const Function &function, const Allocation &allocation);
+
+#endif // REGISTERALLOCATOR_H
@@ -0,0 +1,94 @@
+#ifndef REWRITINGINTERPRETER_H
+#define REWRITINGINTERPRETER_H
+
+#include "Arena.h"
+#include "ClosureCompiler.h"
+#include "Runtime.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+struct RewriteNode;
+class BackgroundCompiler;
+
+// Executes a program on a tree of nodes that specialize themselves as they
+// run. Every node starts out generic: the first time it executes, it looks
+// at its AST node and the kinds of its operands and rewrites its handler
+// into a variant for exactly that case, such as an integer + of two locals,
+// a while loop fused with its integer comparison, or x := x + 1 on a local.
+// A node's children are made only when the node first runs, so code that
+// never runs costs nothing, and there is no compile step before the first
+// statement executes.
+//
+// An if speculates that it keeps taking the arm it took first, and only
+// makes the other arm when that turns out wrong; the rewrite back to the
+// general form is a deoptimization. The nodes stay specialized across runs
+// of the same program.
+//
+// With a threshold, execution is tiered. Each routine counts its calls and
+// the back edges its loops take. Once the sum reaches the threshold, a
+// BackgroundCompiler compiles the routine with a ClosureCompiler while the
+// interpreter keeps running it; the routine's next call, from anywhere,
+// runs the compiled code. Loops report their back edges when they finish,
+// and a routine already running is not replaced, so a loop in a top-level
+// block, or one that never ends, stays in the interpreter.
+class RewritingInterpreter {
+public:
+    static const long HOT_THRESHOLD = 1000;    // a good threshold to tier at
+
+    // Without a threshold, every routine stays in the interpreter
+    explicit RewritingInterpreter(Runtime &runtime, long threshold = 0);
+    ~RewritingInterpreter();
+
+    // Runs program, which has passed check_types and been laid out by
+    // layout_frames. Returns 0, or 1 after a runtime error, which is
+    // reported on stderr.
+    int run(AST *program);
+
+    long rewrites() const { return rewriteCount; }  // nodes specialized
+    long deopts() const { return deoptCount; }      // speculations given up
+    long promotions() const { return promotionCount; }  // routines sent to compile
+
+    // Each routine's calls and back edges, and whether it was compiled
+    void printProfile(FILE *fp) const;
+
+private:
+    friend struct RewriteNode;
+    struct Routine {
+        STEntry *name;
+        RewriteNode *body;
+        int slots;      // of its frame
+        long calls;     // interpreted
+        long backEdges; // taken by its loops, interpreted
+        bool requested; // promoted
+        std::atomic<const Code<bool> *> compiled;  // set once compiled
+    };
+
+    Runtime &runtime;
+    long threshold;
+    AST *program;                   // the nodes were made for
+    RewriteNode *root;
+    Value *globals;
+    int globalSlots;
+    std::unordered_map<STEntry *, Routine *> routines;
+    long rewriteCount;
+    long deoptCount;
+    long promotionCount;
+
+    Arena arena;    // the nodes and their data
+    std::unique_ptr<BackgroundCompiler> compiler;   // with a threshold
+    RewriteNode *child(RewriteNode *parent, AST *ast);
+    Value *globalOf(STEntry *var);
+    void operand(RewriteNode *node, int side, AST *ast);
+    bool variable(RewriteNode *node, STEntry *var);
+    void specialize(RewriteNode *node);
+    void specializeBinary(RewriteNode *node);
+    void specializeStore(RewriteNode *node, STEntry *var, AST *rhs);
+    void specializeStatement(RewriteNode *node);
+    void commit(RewriteNode *node, bool taken);
+    void deoptimize(RewriteNode *node);
+    void heat(Routine *routine);
+    void prepare(AST *program);
+};
+
+#endif // REWRITINGINTERPRETER_H
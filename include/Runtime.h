@@ -0,0 +1,94 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "ast.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// A variable's value. Which member is live follows from the variable's
+// type, fixed by the type pass, so values carry no tag. Value() is all
+// zero bits: 0, 0.0, false or the empty string.
+union Value {
+    int i;
+    float f;
+    bool b;
+    const char *s;  // nullptr for the empty string
+};
+
+// Thrown by Runtime::fail and caught where the engine's run began
+struct RuntimeError {
+    const char *message;
+};
+
+// What the execution engines share: the stack of activation frames, the
+// value being returned, the program's input and output, and the meaning
+// of the operations that can fail or overflow, so every engine computes
+// the same results.
+//
+// A frame is an array of Values indexed by the Slot layout_frames gave each
+// variable. Each routine call and each top-level block pushes one; the
+// global frame belongs to the engine.
+class Runtime {
+public:
+    static const int STACK_SLOTS = 1 << 20;     // slots of all active frames
+    static const int MAX_CALL_DEPTH = 10000;    // frames active at once
+
+    Runtime(FILE *input, FILE *output);
+    ~Runtime();
+
+    // Empties the stack and frees strings read, for a new run
+    void reset();
+
+    // A frame on top of the stack. Its slots are not cleared: arguments
+    // are stored in the formals', and each block clears its variables'
+    // when it is entered. Frames are popped in the reverse order; a run
+    // that fails leaves them for reset.
+    Value *pushFrame(int slots) {
+        if (slots > limit - top || depth == MAX_CALL_DEPTH)
+            fail("stack overflow");
+        Value *frame = top;
+        top += slots;
+        depth++;
+        return frame;
+    }
+    void popFrame(Value *frame) {
+        top = frame;
+        depth--;
+    }
+
+    // read(x) and write(x) for a variable of the given type
+    void read(Value &var, j_type type);
+    void write(Value value, j_type type);
+    void flush() { fflush(output); }
+
+    // Stops the program
+    [[noreturn]] static void fail(const char *message);
+
+    // Integer arithmetic wraps around; division by zero fails
+    static int add(int left, int right) { return (int)((unsigned)left + (unsigned)right); }
+    static int subtract(int left, int right) { return (int)((unsigned)left - (unsigned)right); }
+    static int multiply(int left, int right) { return (int)((unsigned)left * (unsigned)right); }
+    static int negate(int value) { return (int)(0u - (unsigned)value); }
+    static int divide(int left, int right) {
+        if (right == 0)
+            fail("division by zero");
+        return right == -1 ? negate(left) : left / right;
+    }
+    static bool sameString(const char *left, const char *right) {
+        return strcmp(left ? left : "", right ? right : "") == 0;
+    }
+
+    Value result;   // set by return, read by the call it returns from
+
+private:
+    FILE *input;
+    FILE *output;
+    Value *stack;
+    Value *top;
+    Value *limit;
+    int depth;
+    std::vector<char *> strings;    // strings read
+};
+
+#endif // RUNTIME_H
@@ -0,0 +1,35 @@
+#ifndef SCANKERNELS_H
+#define SCANKERNELS_H
+
+#include <stddef.h>
+
+// Kernels that find the end of a run of characters 16 or 32 bytes at a
+// time, used by the scanner for whitespace, comments and identifiers.
+// Every kernel looks at p[0..n) only and returns an index in [0, n].
+struct ScanKernels {
+    const char *name;
+
+    // Length of the leading run of whitespace (isspace in the C locale)
+    size_t (*span_space)(const char *p, size_t n);
+
+    // Index of the first '#' or '\n', n if there is none
+    size_t (*find_comment_stop)(const char *p, size_t n);
+
+    // Length of the leading run of identifier characters [A-Za-z0-9_]
+    size_t (*span_ident)(const char *p, size_t n);
+
+    // Length of the leading run of decimal digits
+    size_t (*span_digits)(const char *p, size_t n);
+};
+
+// Portable one-character-at-a-time kernels
+extern const ScanKernels scan_kernels_scalar;
+
+// SSE2 and AVX2 kernels; nullptr when not compiled in or not supported by the CPU
+extern const ScanKernels *scan_kernels_sse2;
+extern const ScanKernels *scan_kernels_avx2;
+
+// The best kernels for this CPU, selected at startup
+extern const ScanKernels *scan_kernels;
+
+#endif // SCANKERNELS_H
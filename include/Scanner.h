@@ -2,8 +2,10 @@
 #define COMPILERPARSER_SCANNER_H
 
 #include "FileDescriptor.h"
-#include <unordered_map>
+#include "Lexer.h"
+#include "stats.h"
 #include <string>
+#include <string.h>
 
 #define LETTER_CHAR 1
 #define NUMERIC_DIGIT 2
@@ -30,6 +32,93 @@ typedef enum {
 
 } LEXEME_TYPE;
 
+// Character flags, for the tests that cut across the classes below
+#define CHAR_SPACE 1    // isspace() in the C locale
+#define CHAR_DIGIT 2    // 0-9
+#define CHAR_IDENT 4    // letters, digits and '_'
+
+// 256-entry tables indexed by the unsigned value of a character, built at
+// compile time so every lookup is a single load
+struct CharTables {
+    unsigned char cls[256];     // getClass() of the character, 0 if it has none
+    unsigned char flags[256];   // CHAR_* bits
+    unsigned char op[256];      // LEXEME_TYPE of the character as an operator on its own
+    unsigned char op_eq[256];   // LEXEME_TYPE of the character followed by '=',
+                                // illegal_token if that isn't an operator
+};
+
+constexpr CharTables makeCharTables() {
+    CharTables t{};
+    for (int c = 0; c < 256; c++) {
+        t.op[c] = illegal_token;
+        t.op_eq[c] = illegal_token;
+    }
+
+    for (int c = 'a'; c <= 'z'; c++) {
+        t.cls[c] = LETTER_CHAR;
+        t.cls[c - 'a' + 'A'] = LETTER_CHAR;
+        t.flags[c] = CHAR_IDENT;
+        t.flags[c - 'a' + 'A'] = CHAR_IDENT;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        t.cls[c] = NUMERIC_DIGIT;
+        t.flags[c] = CHAR_DIGIT | CHAR_IDENT;
+    }
+    t.cls['_'] = SPECIAL_CHAR;
+    t.flags['_'] = CHAR_IDENT;
+
+    // Whitespace, ';' and EOF (read back as the char 0xFF) separate tokens
+    const char spaces[] = " \t\n\v\f\r";
+    for (int i = 0; spaces[i]; i++) {
+        t.cls[(unsigned char)spaces[i]] = SEPARATOR;
+        t.flags[(unsigned char)spaces[i]] = CHAR_SPACE;
+    }
+    t.cls[';'] = SEPARATOR;
+    t.cls[0xFF] = SEPARATOR;
+
+    t.cls['.'] = lx_dot;
+    t.cls['#'] = COMMENT_MARKER;
+
+    // Operators, with '!' only valid as the start of "!="
+    const char ops[] = "()+*/=[]{},:><-!";
+    for (int i = 0; ops[i]; i++) {
+        t.cls[(unsigned char)ops[i]] = OPERATOR;
+    }
+    t.op['+'] = lx_plus;
+    t.op['-'] = lx_minus;
+    t.op['*'] = lx_star;
+    t.op['/'] = lx_slash;
+    t.op['='] = lx_eq;
+    t.op['('] = lx_lparen;
+    t.op[')'] = lx_rparen;
+    t.op['{'] = lx_lbracket;
+    t.op['}'] = lx_rbracket;
+    t.op['['] = lx_lsbracket;
+    t.op[']'] = lx_rsbracket;
+    t.op[','] = lx_comma;
+    t.op[';'] = lx_semicolon;
+    t.op[':'] = lx_colon;
+    t.op['<'] = lx_lt;
+    t.op['>'] = lx_gt;
+
+    t.op_eq[':'] = lx_colon_eq;
+    t.op_eq['!'] = lx_neq;
+    t.op_eq['<'] = lx_le;
+    t.op_eq['>'] = lx_ge;
+    return t;
+}
+
+static constexpr CharTables char_tables = makeCharTables();
+
+inline bool isSpaceChar(char c) { return char_tables.flags[(unsigned char)c] & CHAR_SPACE; }
+inline bool isDigitChar(char c) { return char_tables.flags[(unsigned char)c] & CHAR_DIGIT; }
+inline bool isIdentChar(char c) { return char_tables.flags[(unsigned char)c] & CHAR_IDENT; }
+
+// Keyword spellings and their token types, in the same order
+#define NUM_KEYWORDS 30
+extern const char* const keywords[NUM_KEYWORDS];
+extern const LEXEME_TYPE lexTypes[NUM_KEYWORDS];
+
 class TOKEN
         {
 public:
@@ -37,45 +126,100 @@ public:
     int value;  // can be used instead of the str_ptr for IDs and strings
     float float_value;
     char *str_ptr;
+    int line;   // source line the token was scanned on
+    int capacity;   // size of the str_ptr buffer
 
     TOKEN(){
-        str_ptr = new char[1024];
+        line = 0;
+        capacity = 1024;
+        str_ptr = new char[capacity];
+        stats_count(count_bytes_allocated, sizeof(TOKEN) + capacity);
         str_ptr[0] = '\0';
     }
     ~TOKEN() {
         delete[] str_ptr;
     }
+    TOKEN(const TOKEN&) = delete;
+    TOKEN& operator=(const TOKEN&) = delete;
+
+    // Clears the token so it can be scanned into again; the buffer is kept
+    void reset() {
+        value = 0;
+        float_value = 0;
+        str_ptr[0] = '\0';
+        line = 0;
+    }
+
+    // Sets str_ptr to text, growing the buffer only if it is too small
+    void setText(const char *text, size_t length) {
+        if (length >= (size_t)capacity) {
+            delete[] str_ptr;
+            capacity = (int)length + 1;
+            str_ptr = new char[capacity];
+            stats_count(count_bytes_allocated, capacity);
+        }
+        memcpy(str_ptr, text, length);
+        str_ptr[length] = '\0';
+    }
+
+    // Shrinks the buffer to the text, for tokens that are kept
+    void fitText() {
+        size_t length = strlen(str_ptr);
+        if (length + 1 == (size_t)capacity)
+            return;
+        char *text = new char[length + 1];
+        stats_count(count_bytes_allocated, length + 1);
+        memcpy(text, str_ptr, length + 1);
+        delete[] str_ptr;
+        str_ptr = text;
+        capacity = (int)length + 1;
+    }
+
+    void copyFrom(const TOKEN &other) {
+        type = other.type;
+        value = other.value;
+        float_value = other.float_value;
+        setText(other.str_ptr, strlen(other.str_ptr));
+        line = other.line;
+    }
 };
 
-class Scanner{
+class Scanner : public Lexer {
 public:
     int privousType;
     bool readMore;
     TOKEN* lastToken;
     FileDescriptor *fd;
-    
-    // Static hashmap for keyword lookup
-    static std::unordered_map<std::string, int> keywordMap;
 
     Scanner(FileDescriptor *fd){
         this->fd = fd;
+        privousType = 0;
+        readMore = true;
+        lastToken = nullptr;
+        peeked = nullptr;
     }
 
     ~Scanner();
-    TOKEN* Scan();
-    TOKEN* getId(char c);
-    TOKEN* getString(char c);
-    TOKEN* getInt(char c);
-    int checkKeyword(char* key);
+    TOKEN* Scan() override;
+    void ScanInto(TOKEN &token) override;
+    TOKEN* Peek() override;
+    int getLineNum() override;
+    int getCharNum() override;
+    void ReportError(char *msg) override;
+    TOKEN* getId(char c, TOKEN *token);
+    TOKEN* getString(char c, TOKEN *token);
+    TOKEN* getInt(char c, TOKEN *token);
+    static int checkKeyword(const char* word, int len);
     void skipComments(char &c);
     void skipSpaces(char &c);
     TOKEN* getLastToken();
-    int getLineNum();
-    int getClass(char c);
-    TOKEN *getOperator(char c);
+    int getClass(char c) { return char_tables.cls[(unsigned char)c]; }
+    TOKEN *getOperator(char c, TOKEN *token);
     FileDescriptor* Get_fd();
 
 private:
+    TOKEN* peeked;      // token returned by Peek() and not yet by Scan()
+    TOKEN* scanToken(TOKEN *token);
 };
 
 #endif //COMPILERPARSER_SCANNER_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include "Scanner.h"
+
+// The tokens of a Lexer, held in a fixed ring of TOKENs that are scanned
+// into again and again, so token memory doesn't grow with the source.
+//
+// The ring is filled a batch of tokens at a time. next() returns the tokens
+// in order, and peek(k) looks k tokens ahead without consuming them: peek(1)
+// is the token the next call to next() returns. After end of file, both
+// keep returning the lx_eof token.
+//
+// A token stays valid until RETAINED more tokens have been returned by
+// next(), so a parser can keep the last few tokens it matched.
+class TokenStream {
+public:
+    static const int CAPACITY = 64;     // power of two
+    static const int RETAINED = 16;
+    static const int MAX_PEEK = CAPACITY - RETAINED;
+
+    // Doesn't take ownership of the lexer. batch is the number of tokens
+    // scanned when the ring runs out, at most MAX_PEEK.
+    explicit TokenStream(Lexer *lexer, int batch = 32);
+
+    TOKEN* next();
+    TOKEN* peek(int k);
+
+    // Tokens scanned but not yet returned by next()
+    int buffered() const { return (int)(tail - head); }
+
+private:
+    static const long MASK = CAPACITY - 1;
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    Lexer *lexer;
+    int batch;
+    bool ended;         // lx_eof has been scanned
+    long head;          // number of tokens returned by next()
+    long tail;          // number of tokens scanned
+    TOKEN ring[CAPACITY];
+
+    bool fill(int wanted);
+};
+
+#endif // TOKENSTREAM_H
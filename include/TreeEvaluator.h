@@ -0,0 +1,32 @@
+#ifndef TREEEVALUATOR_H
+#define TREEEVALUATOR_H
+
+#include "Runtime.h"
+#include <unordered_map>
+
+// Executes a program by walking its AST recursively: every node visited
+// is dispatched on its AST_type, and every operator on its operands' type,
+// each time it runs. The baseline the other engines are measured against.
+class TreeEvaluator {
+public:
+    explicit TreeEvaluator(Runtime &runtime) : runtime(runtime), frame(nullptr) {}
+
+    // Runs program, which has passed check_types and been laid out by
+    // layout_frames. Returns 0, or 1 after a runtime error, which is
+    // reported on stderr.
+    int run(AST *program);
+
+private:
+    Runtime &runtime;
+    Value *frame;                   // the current activation's
+    std::vector<Value> globals;
+    std::unordered_map<STEntry *, AST *> routines;
+
+    Value &variable(STEntry *var);
+    Value eval(AST *expr);
+    Value binary(AST *node);
+    Value call(AST *node);
+    bool exec(AST *stmt);           // true if a return was executed
+};
+
+#endif // TREEEVALUATOR_H
@@ -0,0 +1,118 @@
+#ifndef X86ASSEMBLER_H
+#define X86ASSEMBLER_H
+
+#include "RegisterAllocator.h"
+#include <initializer_list>
+#include <stdint.h>
+#include <vector>
+
+// An operand an instruction reads or writes: a register, memory at a
+// displacement from a base register, or memory at an offset from a symbol,
+// addressed relative to the instruction pointer
+struct X86Operand {
+    enum Kind { kind_register, kind_memory, kind_symbol };
+    Kind kind;
+    int reg;            // the register, or the base
+    int32_t offset;     // from the base or the symbol
+    int symbol;         // chosen by the caller, for its relocations
+};
+
+static inline X86Operand x86_reg(int reg) {
+    return X86Operand{X86Operand::kind_register, reg, 0, -1};
+}
+static inline X86Operand x86_mem(int base, int32_t offset) {
+    return X86Operand{X86Operand::kind_memory, base, offset, -1};
+}
+static inline X86Operand x86_symbol(int symbol, int32_t offset) {
+    return X86Operand{X86Operand::kind_symbol, -1, offset, symbol};
+}
+
+// Condition codes, numbered as jcc and setcc encode them
+enum X86Condition {
+    cc_o, cc_no, cc_b, cc_ae, cc_e, cc_ne, cc_be, cc_a,
+    cc_s, cc_ns, cc_p, cc_np, cc_l, cc_ge, cc_le, cc_g
+};
+
+// The arithmetic instructions sharing one encoding, numbered as it does
+enum X86Alu {
+    alu_add = 0, alu_or = 1, alu_and = 4, alu_sub = 5, alu_xor = 6, alu_cmp = 7
+};
+
+// Scalar single-precision instructions, by their second opcode byte
+enum X86Sse {
+    sse_cvtsi2ss = 0x2A, sse_add = 0x58, sse_multiply = 0x59,
+    sse_subtract = 0x5C, sse_divide = 0x5E
+};
+
+// A reference to a symbol that the linker resolves: R_X86_64_PC32 for data,
+// R_X86_64_PLT32 for a call
+struct X86Relocation {
+    uint64_t offset;    // of the four bytes to patch
+    int symbol;
+    uint32_t type;
+    int64_t addend;
+};
+
+// Encodes x86-64 instructions into a code buffer. Integer instructions work
+// on 32 bits, or 64 if wide; xmm registers are numbered 0 to 15 like the
+// others. Jumps and calls within the code name labels, which may be bound
+// after they are used and are resolved by finish; references to symbols
+// become relocations.
+class X86Assembler {
+public:
+    std::vector<uint8_t> code;
+    std::vector<X86Relocation> relocations;
+
+    int newLabel();
+    void bind(int label);
+    bool bound(int label) const { return labels[label] >= 0; }
+    uint64_t here() const { return code.size(); }
+
+    // Patches every jump to its label; all must be bound
+    void finish();
+
+    void mov(const X86Operand &dst, const X86Operand &src, bool wide = false);
+    void mov(const X86Operand &dst, int32_t immediate, bool wide = false);
+    void lea(int dst, const X86Operand &src);
+    void alu(X86Alu op, int dst, const X86Operand &src, bool wide = false);
+    void alu(X86Alu op, const X86Operand &dst, int32_t immediate, bool wide = false);
+    void imul(int dst, const X86Operand &src);
+    void neg(const X86Operand &operand);
+    void idiv(const X86Operand &divisor);   // edx:eax by it
+    void cdq();                             // edx := the sign of eax
+    void test(const X86Operand &left, int right);
+    void setcc(X86Condition cc, int reg);   // the register's low byte
+    void movzxByte(int dst, int src);
+
+    void push(const X86Operand &operand);
+    void pop(int reg);
+    void call(int label);
+    void callSymbol(int symbol);
+    void ret();
+    void leave();
+    void jmp(int label);
+    void jcc(X86Condition cc, int label);
+
+    void movd(int xmm, const X86Operand &src);
+    void movd(const X86Operand &dst, int xmm);
+    void sse(X86Sse op, int xmm, const X86Operand &src);
+    void ucomiss(int xmm, const X86Operand &src);
+
+private:
+    std::vector<int64_t> labels;        // by label: its offset, or -1
+    struct Patch {
+        uint64_t offset;
+        int label;
+    };
+    std::vector<Patch> patches;
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void dword(uint32_t value);
+    void rel32(int label);
+    // Emits [prefix] [REX] opcode ModRM [SIB] [displacement], with
+    // immediate bytes still to follow, which a relative address must skip
+    void encode(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg,
+                const X86Operand &rm, int immediate = 0, bool byteRegister = false);
+};
+
+#endif // X86ASSEMBLER_H
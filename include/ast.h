@@ -4,6 +4,7 @@
 
 #include "symbol_table_entry.h"
 #include "FileDescriptor.h"
+#include "Lexer.h"
 #include <stdio.h>
 
 /* Definitions of list datatypes */
@@ -72,6 +73,7 @@ typedef enum
 typedef struct ast_node
 {
  AST_type type; /* Type of the AST node */
+ j_type value_type; /* Type of an expression's value, set by check_types */
  union /* The fields depend on a node's type */
 	{
 	 struct{
@@ -130,6 +132,8 @@ typedef struct ast_node
 	 struct{
 		   ste_list *vars; /* Symbol table entries of local variables */
 		   ast_list *stmts; /* Statements in block */
+		   int frame_size; /* Bytes of the frame in use up to the end of the block, set by layout_frames */
+		   int frame_slots; /* Slots of the frame in use likewise */
 	 } a_block;
 
 	 struct{
@@ -173,6 +177,8 @@ typedef struct ast_node
 
 	 struct {
 		ast_list *statements; /* List of statements in the program */
+		int frame_size; /* Bytes of the global frame, set by layout_frames */
+		int frame_slots; /* Slots of the global frame */
 	 } a_program; 
   
  } f;  // union 
@@ -181,8 +187,9 @@ typedef struct ast_node
 /* Externally-visible functions: */
 ast_list *cons_ast(AST *head, ast_list *tail);
 ste_list *cons_ste(symbol_table_entry *head, ste_list *tail);
-int eval_ast_expr(FileDescriptor *fd, AST *node);
+int eval_ast_expr(Lexer *lexer, AST *node);
 AST *make_ast_node(AST_type type, ...);
 void print_ast_node(FILE *fp, AST *node);
+long print_ast_file(const char *path, AST *node);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef FRAME_LAYOUT_H
+#define FRAME_LAYOUT_H
+// frame_layout.h
+
+#include "ast.h"
+
+// Frames are aligned, and sized in multiples of, this many bytes
+#define FRAME_ALIGNMENT 8
+
+// The frame layout pass. Gives every global, constant, formal and local
+// variable a place in a frame, so an executor reaches any variable with one
+// indexed load from the frame's base instead of a symbol lookup.
+//
+// N23 routines don't nest, so there are two depths: the global frame
+// (Depth 0) holds the top-level variables and constants, and each routine
+// and each top-level begin-end block has a frame of its own (Depth 1). A
+// reference resolves by its entry alone: Depth 0 is the global frame,
+// Depth 1 the current activation.
+//
+// In a frame, a routine's formals come first, in order, then the variables
+// of its body, then those of the blocks inside: a nested block's variables
+// follow its enclosing block's, and sibling blocks share the same space.
+// Each variable gets a Slot, its index for executors that keep one value
+// per slot, and an Offset in bytes, aligned to its Size, for those that
+// keep a frame in memory.
+//
+// A block's frame_size and frame_slots cover the frame from its start to
+// the last variable of the block or of any block inside it; those of a
+// routine's body are the routine's frame. The program's are those of the
+// global frame. Sizes are rounded up to FRAME_ALIGNMENT.
+void layout_frames(AST *program);
+
+#endif // FRAME_LAYOUT_H
@@ -2,9 +2,12 @@
 #define PARSER_H
 
 #include "Scanner.h"
+#include "TokenStream.h"
 #include "ast.h"
 #include "symbol.h"
 #include <fstream>
+#include <sstream>
+#include <vector>
 
 struct had_error {
     bool error;
@@ -18,18 +21,40 @@ struct had_error {
 class Parser {
 private:
     std::ofstream errorFile;
+    std::ostringstream deferredErrors;  // errorFile text of a token-array parser
+    std::ostringstream deferredOutput;  // ReportError text of a token-array parser
+    std::vector<TOKEN*> tokenBuffer;    // tokens scanned up front by start_parallel_parsing
 
 public:
     bool had_error;
     AST* programAST;
     SymbolTable* table;
     TOKEN* currentToken;
-    Scanner* scanner;
-    FileDescriptor* fd;    TOKEN* match(LEXEME_TYPE expected);
+    Lexer* scanner;         // token source: a Scanner over fd, or any other Lexer
+    TokenStream* stream;    // scanner's tokens, with lookahead; nullptr in token-array mode
+    FileDescriptor* fd;     // nullptr unless the parser reads through a Scanner
+
+    // Token-array mode: tokens come from tokens[tokenPos..tokenEnd) instead
+    // of the scanner. tokens is nullptr when reading from the scanner.
+    TOKEN** tokens;
+    int tokenPos;
+    int tokenEnd;
+    // Globals declared at or after this token are not visible yet, as they
+    // wouldn't be to the sequential parser. A worker's body starts here.
+    int visibleBefore;
+
+    // Thrown by match in token-array mode instead of exiting, so the
+    // messages kept until the caller collects them are not lost
+    struct SyntaxAbort {};
+
+    TOKEN* match(LEXEME_TYPE expected);
+    // The k-th token after currentToken, without consuming it (k >= 1)
+    TOKEN* peekToken(int k);
     const char* getTokenTypeName(LEXEME_TYPE type);
     
     void scan_and_check_illegal_token();
     AST* start_parsing();
+    AST* start_parallel_parsing(int num_threads);
     ast_list* parseProgram();
     ast_list* parseDeclList();
     AST* parseDecl();
@@ -44,17 +69,14 @@ public:
     ast_list* parseStmtList();
     AST* parsePrimaryExprTail(AST* idNode);
     AST* parseExpr();
-    AST* parseExprTail(AST* leftNode);
-    AST* parseExpr2();
-    AST* parseExpr2Tail(AST* leftNode);
-    AST* parseExpr3();
-    AST* parseExpr3Tail(AST* leftNode);
-    AST* parseExpr4();
-    AST* parseExpr4Tail(AST* leftNode);
-    AST* parseExpr5();
+    AST* parseBinaryExpr(int minPower);
+    AST* parseUnaryExpr();
     AST* parsePrimaryExpr();
 
-    void printParsedAST(AST* node);
+    // Writes the program printed from the AST to path
+    void printParsedAST(AST* node, const char* path = "../tests/output/output_program.txt");
+    std::string deferredErrorText() { return deferredErrors.str(); }
+    std::string deferredOutputText() { return deferredOutput.str(); }
     void checkForRedeclaration(TOKEN* idToken);
 
     bool noVariableDecl();
@@ -63,10 +85,19 @@ public:
         return (currentToken->type == kw_end || currentToken->type == lx_eof);
     }
     Parser(FileDescriptor* fd);
+    Parser(Lexer* lexer);
+    Parser(TOKEN** tokens, int begin, int end, SymbolTable* scope);
     ~Parser();
 
 private:
     STEntry* checkAndAddSymbol(TOKEN* idToken, STE_TYPE steType);
+    STEntry* addSymbol(char* name, STE_TYPE steType);
+    STEntry* lookupSymbol(TOKEN* idToken);
+    TOKEN* nextToken();
+    int lineNum();
+    void reportError(char* msg);
+    std::ostream& errorOut();
+    int findDeclEnd(int start);
 };
 
 #endif // PARSER_H
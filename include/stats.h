@@ -0,0 +1,94 @@
+#ifndef STATS_H
+#define STATS_H
+// stats.h
+// Compiler instrumentation for --stats: time spent in each phase and
+// counts of the work done. Nothing is recorded unless stats_enabled is set,
+// so when it is off every hook costs one test of a global flag.
+
+#include <stdio.h>
+
+// Phases of a compilation. Phase times are exclusive: while the parser calls
+// into the scanner, the time is charged to the scanner, not the parser.
+typedef enum {
+    phase_other,    // outside every other phase
+    phase_io,       // reading the source or loading an image
+    phase_scan,     // Lexer::Scan
+    phase_parse,    // recursive descent
+    phase_symbol,   // symbol table lookups, insertions and scopes
+    phase_print,    // printing the AST
+    phase_wait,     // waiting for tokens from another thread
+    phase_types,    // the type pass
+    phase_layout,   // the frame layout pass
+    phase_compile,  // compiling for an execution engine
+    phase_optimize, // optimizing compiled code
+    phase_codegen,  // generating machine code
+    phase_run,      // running the program
+    NUM_PHASES
+} STATS_PHASE;
+
+typedef enum {
+    count_source_bytes,     // bytes of source read
+    count_lines,            // lines of source read
+    count_tokens,           // tokens scanned
+    count_ast_nodes,        // AST nodes made
+    count_list_cells,       // ast_list and ste_list cells made
+    count_symbol_lookups,   // lookups through the scope chain
+    count_symbol_probes,    // single-scope hash table probes
+    count_symbol_hits,      // lookups that found the symbol
+    count_symbols_added,    // symbol table entries added
+    count_scopes,           // scopes created
+    count_bytes_allocated,  // bytes allocated for tokens, nodes, tables and buffers
+    count_output_bytes,     // bytes of printed AST
+    count_rewrites,         // nodes the rewriting interpreter specialized
+    count_deopts,           // speculations it gave up
+    count_promotions,       // routines it sent to be compiled
+    count_code_bytes,       // bytes of machine code generated
+    count_image_bytes,      // bytes of module images loaded
+    NUM_COUNTERS
+} STATS_COUNTER;
+
+// Room for every AST_type (checked in stats.cpp)
+#define STATS_AST_TYPES 40
+
+extern bool stats_enabled;
+
+// Turns recording on and starts the clock for the total time. With
+// counters, each thread also opens hardware performance counters (cycles,
+// instructions, branch and cache misses) and charges them to phases like
+// time; if the kernel won't provide them, the report says why and the rest
+// of the statistics are unaffected.
+void stats_start(bool counters = false);
+
+// Records that the calling thread enters a phase; returns the phase to
+// restore with stats_leave, or -1 if the thread is already in it
+int stats_enter(STATS_PHASE phase);
+void stats_leave(int saved);
+
+void stats_add(STATS_COUNTER counter, long amount);
+void stats_add_node(int ast_type);
+
+// Prints everything recorded so far, as a table or as JSON. Threads that
+// have exited are included; time is summed over threads.
+void stats_report(FILE *fp, bool json);
+
+static inline void stats_count(STATS_COUNTER counter, long amount = 1) {
+    if (stats_enabled) stats_add(counter, amount);
+}
+
+// Charges the time until the end of the enclosing block to a phase
+class PhaseTimer {
+public:
+    explicit PhaseTimer(STATS_PHASE phase) : saved(-1) {
+        if (stats_enabled) saved = stats_enter(phase);
+    }
+    ~PhaseTimer() {
+        if (saved >= 0) stats_leave(saved);
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    int saved;
+};
+
+#endif // STATS_H
@@ -18,6 +18,7 @@ public:
     int number_probes;        // Number of probes into table
     int number_hits;          // Number of hits (entries found)
     int max_search_dist;      // Maximum entries searched
+    int frozen;               // Non-zero => read-only, shared between threads
     SymbolTable *next;        // To be used to create a stack of symbol table
     
     // Hash function
@@ -36,6 +37,7 @@ public:
     bool AddEntry(char *str, STE_TYPE type, int line); // Similar to PutSymbol but returns bool
     void PrintSymbolStats(FILE *fp);
     void Reset(int new_size);  // Reset the symbol table with a new size
+    void Freeze();             // Make the table read-only so threads can share it
     
     // Additional helper functions
     void PrintAll(FILE *fp);
@@ -50,7 +52,8 @@ public:
 };
 
 // Global symbol table management functions
-extern SymbolTable* current_scope; // The current active scope
+// Each thread has its own scope chain; chains may share a frozen global scope
+extern thread_local SymbolTable* current_scope; // The current active scope
 
 // Global scope management functions
 SymbolTable* enter_scope(); // Create a new scope and return it
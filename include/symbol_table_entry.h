@@ -44,6 +44,12 @@ public:
     j_type ResultType;  // Return type for functions
     ste_list* Formals;  // Formal parameters for functions
     int IsConstant;     // Flag indicating if entry is a constant
+    // Storage of a variable, set by layout_frames; -1 for entries without any
+    int Depth;          // Frame: 0 for globals, 1 for a routine or main block
+    int Slot;           // Index of the variable in its frame
+    int Offset;         // Byte offset of the variable in its frame
+    int Token;          // For a global parsed from a token array, the index of its
+                        // declaring token; -1 otherwise
     
     STEntry();
     STEntry(const char* name, STE_TYPE type, int line = 0);
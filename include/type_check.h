@@ -0,0 +1,25 @@
+#ifndef TYPE_CHECK_H
+#define TYPE_CHECK_H
+// type_check.h
+
+#include "ast.h"
+#include <ostream>
+
+// The type pass. Stores the j_type of every expression in its value_type,
+// and for operators also in a_unary_op.type (the result) or
+// a_binary_op.rel_type (the operands), so later stages can pick an
+// operation for the types without checking them again.
+//
+// Arithmetic takes integers or floats; an integer meeting a float, and an
+// integer assigned, passed or returned where a float is expected, is
+// wrapped in an ast_itof node. Comparisons take two numbers, or for = and
+// != two values of the same type; and, or and not take booleans.
+// Conditions are boolean, for loops count with integers, and calls must
+// match their routine's formals.
+//
+// Each mismatch is written to errors as a "Type Error" line; the
+// expression gets type_none, and doesn't cause further errors. Returns the
+// number of errors.
+int check_types(AST *program, std::ostream &errors);
+
+#endif // TYPE_CHECK_H
@@ -0,0 +1,32 @@
+#include "../include/Arena.h"
+#include "../include/stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void *Arena::allocate(size_t size, size_t alignment) {
+    size_t skip = next ? (alignment - (uintptr_t)next % alignment) % alignment : 0;
+    if (next == nullptr || skip + size > left) {
+        size_t chunk = size + alignment > CHUNK_SIZE ? size + alignment : CHUNK_SIZE;
+        next = (char *)malloc(chunk);
+        if (next == nullptr) {
+            fprintf(stderr, "FATAL ERROR: Out of memory in Arena\n");
+            exit(1);
+        }
+        stats_count(count_bytes_allocated, chunk);
+        chunks.push_back(next);
+        left = chunk;
+        skip = (alignment - (uintptr_t)next % alignment) % alignment;
+    }
+    void *memory = next + skip;
+    next += skip + size;
+    left -= skip + size;
+    return memory;
+}
+
+void Arena::clear() {
+    for (char *chunk : chunks) free(chunk);
+    chunks.clear();
+    next = nullptr;
+    left = 0;
+}
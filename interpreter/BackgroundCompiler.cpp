@@ -0,0 +1,40 @@
+#include "../include/BackgroundCompiler.h"
+
+BackgroundCompiler::BackgroundCompiler(Runtime &runtime, AST *program, Value *globals)
+    : compiler(runtime), program(program), globals(globals), stopping(false),
+      worker(&BackgroundCompiler::work, this) {}
+
+BackgroundCompiler::~BackgroundCompiler() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void BackgroundCompiler::request(STEntry *routine, Slot *slot) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(Request{routine, slot});
+    }
+    wake.notify_one();
+}
+
+void BackgroundCompiler::work() {
+    for (;;) {
+        Request next;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            next = queue.front();
+            queue.pop_front();
+        }
+        // The code is complete before it is published
+        const Code<bool> *code = compiler.compileRoutine(program, next.routine, globals);
+        if (code != nullptr)
+            next.slot->store(code, std::memory_order_release);
+    }
+}
@@ -0,0 +1,110 @@
+#include "../include/Bytecode.h"
+
+#define U field_use
+#define D field_def
+#define N field_none
+
+const OpcodeInfo opcode_info[NUM_OPCODES] = {
+    {"nop", N, N, N},
+    {"const", D, field_constant, N},
+    {"string", D, field_string, N},
+    {"move", D, U, N},
+    {"load_global", D, field_global, N},
+    {"store_global", field_global, U, N},
+
+    {"add", D, U, U},
+    {"subtract", D, U, U},
+    {"multiply", D, U, U},
+    {"divide", D, U, U},
+    {"add_immediate", D, U, field_constant},
+    {"negate", D, U, N},
+    {"eq", D, U, U},
+    {"ne", D, U, U},
+    {"lt", D, U, U},
+    {"le", D, U, U},
+    {"gt", D, U, U},
+    {"ge", D, U, U},
+
+    {"fadd", D, U, U},
+    {"fsubtract", D, U, U},
+    {"fmultiply", D, U, U},
+    {"fdivide", D, U, U},
+    {"fnegate", D, U, N},
+    {"feq", D, U, U},
+    {"fne", D, U, U},
+    {"flt", D, U, U},
+    {"fle", D, U, U},
+    {"fgt", D, U, U},
+    {"fge", D, U, U},
+    {"itof", D, U, N},
+
+    {"not", D, U, N},
+    {"beq", D, U, U},
+    {"bne", D, U, U},
+    {"seq", D, U, U},
+    {"sne", D, U, U},
+
+    {"jump", field_label, N, N},
+    {"jump_if_true", field_label, U, N},
+    {"jump_if_false", field_label, U, N},
+    {"jump_eq", field_label, U, U},
+    {"jump_ne", field_label, U, U},
+    {"jump_lt", field_label, U, U},
+    {"jump_le", field_label, U, U},
+    {"jump_gt", field_label, U, U},
+    {"jump_ge", field_label, U, U},
+
+    {"call", D, field_args, field_function},
+    {"return", N, U, N},
+    {"return_none", N, N, N},
+    {"clear", field_range, field_constant, N},
+    {"read", D, field_type, N},
+    {"write", U, field_type, N},
+};
+
+#undef U
+#undef D
+#undef N
+
+static void print_field(FILE *fp, const Module &module, FieldKind kind, int32_t value) {
+    switch (kind) {
+        case field_def:
+        case field_use:
+        case field_args:
+        case field_range:
+            fprintf(fp, " r%d", value);
+            break;
+        case field_label:
+            fprintf(fp, " @%d", value);
+            break;
+        case field_function:
+            fprintf(fp, " %s", module.functions[value].name.c_str());
+            break;
+        case field_string:
+            fprintf(fp, " \"%s\"", module.strings[value].c_str());
+            break;
+        case field_global:
+            fprintf(fp, " g%d", value);
+            break;
+        case field_constant:
+        case field_type:
+            fprintf(fp, " %d", value);
+            break;
+        default:
+            break;
+    }
+}
+
+void print_function(FILE *fp, const Module &module, const Function &function) {
+    fprintf(fp, "%s: %d params, %d slots, %d registers\n", function.name.c_str(),
+            function.params, function.slots, function.registers);
+    for (size_t i = 0; i < function.code.size(); i++) {
+        const Instruction &in = function.code[i];
+        const OpcodeInfo &info = opcode_info[in.op];
+        fprintf(fp, "%5zu  %s", i, info.name);
+        print_field(fp, module, info.a, in.a);
+        print_field(fp, module, info.b, in.b);
+        print_field(fp, module, info.c, in.c);
+        fprintf(fp, "\n");
+    }
+}
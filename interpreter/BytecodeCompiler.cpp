@@ -0,0 +1,351 @@
+#include "../include/BytecodeCompiler.h"
+#include "../include/Runtime.h"
+#include "../include/stats.h"
+#include <string.h>
+
+int BytecodeCompiler::emit(Opcode op, int a, int b, int c) {
+    function->code.push_back(Instruction{op, a, b, c});
+    return here() - 1;
+}
+
+int BytecodeCompiler::functionOf(STEntry *routine) {
+    auto index = functions.find(routine);
+    if (index == functions.end())
+        Runtime::fail("call of an unknown routine");
+    return index->second;
+}
+
+int BytecodeCompiler::stringOf(const char *string) {
+    std::string text = string ? string : "";
+    auto index = strings.find(text);
+    if (index != strings.end())
+        return index->second;
+    module->strings.push_back(text);
+    strings[text] = (int)module->strings.size() - 1;
+    return (int)module->strings.size() - 1;
+}
+
+// A variable's value: a local is read in its slot
+int BytecodeCompiler::load(STEntry *var) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    if (var->Depth > 0)
+        return var->Slot;
+    int value = temporary();
+    emit(op_load_global, value, var->Slot);
+    return value;
+}
+
+void BytecodeCompiler::store(STEntry *var, int value) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    if (var->Depth > 0)
+        emit(op_move, var->Slot, value);
+    else
+        emit(op_store_global, var->Slot, value);
+}
+
+int BytecodeCompiler::expr(AST *node) {
+    switch (node->type) {
+        case ast_var:
+            return load(node->f.a_var.var);
+
+        case ast_integer: {
+            int value = temporary();
+            emit(op_const, value, node->f.a_integer.value);
+            return value;
+        }
+        case ast_float: {
+            int value = temporary(), bits;
+            memcpy(&bits, &node->f.a_float.value, sizeof(bits));
+            emit(op_const, value, bits);
+            return value;
+        }
+        case ast_boolean: {
+            int value = temporary();
+            emit(op_const, value, node->f.a_boolean.value != 0);
+            return value;
+        }
+        case ast_string: {
+            int value = temporary();
+            emit(op_string, value, stringOf(node->f.a_string.string));
+            return value;
+        }
+
+        case ast_call:
+            return call(node);
+
+        case ast_itof:
+        case ast_not:
+        case ast_uminus: {
+            AST *arg = node->type == ast_itof ? node->f.a_itof.arg : node->f.a_unary_op.arg;
+            int operand = expr(arg);
+            int value = temporary();
+            if (node->type == ast_itof)
+                emit(op_itof, value, operand);
+            else if (node->type == ast_not)
+                emit(op_not, value, operand);
+            else
+                emit(node->f.a_unary_op.type == type_float ? op_fnegate : op_negate, value,
+                     operand);
+            return value;
+        }
+
+        case ast_and:
+        case ast_cand:
+        case ast_or:
+        case ast_cor: {
+            // The right operand is skipped when the left decides
+            bool isAnd = node->type == ast_and || node->type == ast_cand;
+            int value = temporary();
+            emit(op_move, value, expr(node->f.a_binary_op.larg));
+            int skip = emit(isAnd ? op_jump_if_false : op_jump_if_true, 0, value);
+            emit(op_move, value, expr(node->f.a_binary_op.rarg));
+            patch(skip, here());
+            return value;
+        }
+
+        default:
+            return binary(node);
+    }
+}
+
+int BytecodeCompiler::binary(AST *node) {
+    static const Opcode integer[] = {op_multiply, op_divide, op_add, op_subtract,
+                                     op_eq, op_ne, op_lt, op_le, op_gt, op_ge};
+    static const Opcode floating[] = {op_fmultiply, op_fdivide, op_fadd, op_fsubtract,
+                                      op_feq, op_fne, op_flt, op_fle, op_fgt, op_fge};
+    int index;
+    switch (node->type) {
+        case ast_times:  index = 0; break;
+        case ast_divide: index = 1; break;
+        case ast_plus:   index = 2; break;
+        case ast_minus:  index = 3; break;
+        case ast_eq:     index = 4; break;
+        case ast_neq:    index = 5; break;
+        case ast_lt:     index = 6; break;
+        case ast_le:     index = 7; break;
+        case ast_gt:     index = 8; break;
+        case ast_ge:     index = 9; break;
+        default:         Runtime::fail("unknown expression");
+    }
+
+    Opcode op;
+    switch (node->f.a_binary_op.rel_type) {
+        case type_integer: op = integer[index]; break;
+        case type_float:   op = floating[index]; break;
+        case type_boolean: op = index == 4 ? op_beq : op_bne; break;
+        case type_string:  op = index == 4 ? op_seq : op_sne; break;
+        default:           Runtime::fail("operands without a type");
+    }
+    if ((node->f.a_binary_op.rel_type == type_boolean ||
+         node->f.a_binary_op.rel_type == type_string) && index != 4 && index != 5)
+        Runtime::fail("unknown operator");
+
+    int left = expr(node->f.a_binary_op.larg);
+    int right = expr(node->f.a_binary_op.rarg);
+    int value = temporary();
+    emit(op, value, left, right);
+    return value;
+}
+
+// The arguments go into consecutive temporaries, which the call copies into
+// the callee's frame
+int BytecodeCompiler::call(AST *node) {
+    int callee = functionOf(node->f.a_call.callee);
+    int count = 0;
+    for (ast_list *arg = node->f.a_call.arg_list; arg; arg = arg->tail) count++;
+    if (count != module->functions[callee].params)
+        Runtime::fail("wrong number of arguments");
+    int first = function->registers;
+    function->registers += count;
+    int index = 0;
+    for (ast_list *arg = node->f.a_call.arg_list; arg; arg = arg->tail)
+        emit(op_move, first + index++, expr(arg->head));
+    int value = temporary();
+    emit(op_call, value, first, callee);
+    return value;
+}
+
+// The bounds are evaluated once; the body may change the variable
+void BytecodeCompiler::loop(AST *node) {
+    STEntry *var = node->f.a_for.var;
+    int lower = expr(node->f.a_for.lower_bound);
+    int upper = temporary();
+    emit(op_move, upper, expr(node->f.a_for.upper_bound));
+    store(var, lower);
+    int skip = emit(op_jump_gt, 0, load(var), upper);
+    int top = here();
+    stmt(node->f.a_for.body);
+    int done = emit(op_jump_ge, 0, load(var), upper);
+    int one = temporary();
+    emit(op_const, one, 1);
+    int next = temporary();
+    emit(op_add, next, load(var), one);
+    store(var, next);
+    emit(op_jump, top);
+    patch(skip, here());
+    patch(done, here());
+}
+
+void BytecodeCompiler::stmt(AST *node) {
+    switch (node->type) {
+        case ast_assign:
+            store(node->f.a_assign.lhs, expr(node->f.a_assign.rhs));
+            break;
+
+        case ast_if: {
+            int skip = emit(op_jump_if_false, 0, expr(node->f.a_if.predicate));
+            stmt(node->f.a_if.conseq);
+            if (node->f.a_if.altern != nullptr) {
+                int over = emit(op_jump);
+                patch(skip, here());
+                stmt(node->f.a_if.altern);
+                patch(over, here());
+            } else {
+                patch(skip, here());
+            }
+            break;
+        }
+
+        case ast_while: {
+            int top = here();
+            int exit = emit(op_jump_if_false, 0, expr(node->f.a_while.predicate));
+            stmt(node->f.a_while.body);
+            emit(op_jump, top);
+            patch(exit, here());
+            break;
+        }
+
+        case ast_for:
+            loop(node);
+            break;
+
+        case ast_read: {
+            STEntry *var = node->f.a_read.var;
+            if (var->Slot < 0)
+                Runtime::fail("variable without storage");
+            if (var->Depth > 0) {
+                emit(op_read, var->Slot, var->VarType);
+            } else {
+                int value = temporary();
+                emit(op_read, value, var->VarType);
+                store(var, value);
+            }
+            break;
+        }
+
+        case ast_write:
+            emit(op_write, load(node->f.a_write.var), node->f.a_write.var->VarType);
+            break;
+
+        case ast_call:
+            call(node);
+            break;
+
+        case ast_block: {
+            // A block clears its variables; layout_frames gave them
+            // consecutive slots
+            int first = -1, vars = 0;
+            for (ste_list *var = node->f.a_block.vars; var; var = var->tail) {
+                if (var->head == nullptr)
+                    continue;
+                if (first < 0)
+                    first = var->head->Slot;
+                vars++;
+            }
+            if (vars > 0)
+                emit(op_clear, first, vars);
+            for (ast_list *s = node->f.a_block.stmts; s; s = s->tail) stmt(s->head);
+            break;
+        }
+
+        case ast_return:
+            emit(op_return, 0, expr(node->f.a_return.expr));
+            break;
+
+        default:
+            Runtime::fail("unknown statement");
+    }
+}
+
+Function &BytecodeCompiler::begin(const char *name, int params, int slots) {
+    module->functions.push_back(Function());
+    Function &f = module->functions.back();
+    f.name = name;
+    f.params = params;
+    f.slots = slots;
+    f.registers = slots;
+    return f;
+}
+
+int BytecodeCompiler::compile(AST *program, Module &module) {
+    PhaseTimer timer(phase_compile);
+    this->module = &module;
+    module = Module();
+    functions.clear();
+    strings.clear();
+    try {
+        lowerProgram(program);
+    } catch (RuntimeError &error) {
+        fprintf(stderr, "Compile Error: %s\n", error.message);
+        return 1;
+    }
+    return 0;
+}
+
+void BytecodeCompiler::lowerProgram(AST *program) {
+    ast_list *decls = program->f.a_program.statements;
+    module->globals = program->f.a_program.frame_slots;
+
+    // Every routine has its index before any is lowered, so calls can
+    // refer to it. Each top-level block becomes a function of its own, and
+    // the program a function that calls them in order.
+    for (ast_list *d = decls; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type != ast_routine_decl)
+            continue;
+        int params = 0;
+        for (ste_list *f = decl->f.a_routine_decl.formals; f; f = f->tail) {
+            if (f->head != nullptr)
+                params++;
+        }
+        functions[decl->f.a_routine_decl.name] = (int)module->functions.size();
+        begin(decl->f.a_routine_decl.name->Name, params,
+              decl->f.a_routine_decl.body->f.a_block.frame_slots);
+    }
+    module->routines = (int)module->functions.size();
+    int index = 0;
+    for (ast_list *d = decls; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type != ast_routine_decl)
+            continue;
+        function = &module->functions[index++];
+        stmt(decl->f.a_routine_decl.body);
+        emit(op_return_none);
+    }
+
+    std::vector<int> blocks;
+    for (ast_list *d = decls; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type != ast_block)
+            continue;
+        std::string name = "block" + std::to_string(blocks.size() + 1);
+        blocks.push_back((int)module->functions.size());
+        function = &begin(name.c_str(), 0, decl->f.a_block.frame_slots);
+        stmt(decl);
+        emit(op_return_none);
+    }
+
+    module->main = (int)module->functions.size();
+    function = &begin("main", 0, 0);
+    index = 0;
+    for (ast_list *d = decls; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type == ast_const_decl)
+            store(decl->f.a_const_decl.name, expr(decl->f.a_const_decl.value));
+        else if (decl->type == ast_block)
+            emit(op_call, temporary(), 0, blocks[index++]);
+    }
+    emit(op_return_none);
+}
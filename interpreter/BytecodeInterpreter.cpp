@@ -0,0 +1,155 @@
+#include "../include/BytecodeInterpreter.h"
+#include "../include/stats.h"
+
+Value BytecodeInterpreter::execute(const ImageFunction &function, Value *r) {
+    const Instruction *code = image->code(function);
+    const Instruction *in = code;
+    Value *g = globals.data();
+    for (;; in++) {
+        switch (in->op) {
+            case op_nop:
+                break;
+            case op_const:
+                r[in->a] = Value();
+                r[in->a].i = in->b;
+                break;
+            case op_string:
+                r[in->a].s = image->string(in->b);
+                break;
+            case op_move:
+                r[in->a] = r[in->b];
+                break;
+            case op_load_global:
+                r[in->a] = g[in->b];
+                break;
+            case op_store_global:
+                g[in->a] = r[in->b];
+                break;
+
+            case op_add:
+                r[in->a].i = Runtime::add(r[in->b].i, r[in->c].i);
+                break;
+            case op_subtract:
+                r[in->a].i = Runtime::subtract(r[in->b].i, r[in->c].i);
+                break;
+            case op_multiply:
+                r[in->a].i = Runtime::multiply(r[in->b].i, r[in->c].i);
+                break;
+            case op_divide:
+                r[in->a].i = Runtime::divide(r[in->b].i, r[in->c].i);
+                break;
+            case op_add_immediate:
+                r[in->a].i = Runtime::add(r[in->b].i, in->c);
+                break;
+            case op_negate:
+                r[in->a].i = Runtime::negate(r[in->b].i);
+                break;
+            case op_eq: r[in->a].b = r[in->b].i == r[in->c].i; break;
+            case op_ne: r[in->a].b = r[in->b].i != r[in->c].i; break;
+            case op_lt: r[in->a].b = r[in->b].i < r[in->c].i; break;
+            case op_le: r[in->a].b = r[in->b].i <= r[in->c].i; break;
+            case op_gt: r[in->a].b = r[in->b].i > r[in->c].i; break;
+            case op_ge: r[in->a].b = r[in->b].i >= r[in->c].i; break;
+
+            case op_fadd:      r[in->a].f = r[in->b].f + r[in->c].f; break;
+            case op_fsubtract: r[in->a].f = r[in->b].f - r[in->c].f; break;
+            case op_fmultiply: r[in->a].f = r[in->b].f * r[in->c].f; break;
+            case op_fdivide:   r[in->a].f = r[in->b].f / r[in->c].f; break;
+            case op_fnegate:   r[in->a].f = -r[in->b].f; break;
+            case op_feq: r[in->a].b = r[in->b].f == r[in->c].f; break;
+            case op_fne: r[in->a].b = r[in->b].f != r[in->c].f; break;
+            case op_flt: r[in->a].b = r[in->b].f < r[in->c].f; break;
+            case op_fle: r[in->a].b = r[in->b].f <= r[in->c].f; break;
+            case op_fgt: r[in->a].b = r[in->b].f > r[in->c].f; break;
+            case op_fge: r[in->a].b = r[in->b].f >= r[in->c].f; break;
+            case op_itof:
+                r[in->a].f = (float)r[in->b].i;
+                break;
+
+            case op_not: r[in->a].b = !r[in->b].b; break;
+            case op_beq: r[in->a].b = r[in->b].b == r[in->c].b; break;
+            case op_bne: r[in->a].b = r[in->b].b != r[in->c].b; break;
+            case op_seq: r[in->a].b = Runtime::sameString(r[in->b].s, r[in->c].s); break;
+            case op_sne: r[in->a].b = !Runtime::sameString(r[in->b].s, r[in->c].s); break;
+
+            // A jump goes to the instruction before its target, for in++
+            case op_jump:
+                in = code + in->a - 1;
+                break;
+            case op_jump_if_true:
+                if (r[in->b].b) in = code + in->a - 1;
+                break;
+            case op_jump_if_false:
+                if (!r[in->b].b) in = code + in->a - 1;
+                break;
+            case op_jump_eq:
+                if (r[in->b].i == r[in->c].i) in = code + in->a - 1;
+                break;
+            case op_jump_ne:
+                if (r[in->b].i != r[in->c].i) in = code + in->a - 1;
+                break;
+            case op_jump_lt:
+                if (r[in->b].i < r[in->c].i) in = code + in->a - 1;
+                break;
+            case op_jump_le:
+                if (r[in->b].i <= r[in->c].i) in = code + in->a - 1;
+                break;
+            case op_jump_gt:
+                if (r[in->b].i > r[in->c].i) in = code + in->a - 1;
+                break;
+            case op_jump_ge:
+                if (r[in->b].i >= r[in->c].i) in = code + in->a - 1;
+                break;
+
+            case op_call: {
+                const ImageFunction &callee = image->functions()[in->c];
+                Value *frame = runtime.pushFrame(callee.registers);
+                for (int i = 0; i < callee.params; i++) frame[i] = r[in->b + i];
+                Value result = execute(callee, frame);
+                runtime.popFrame(frame);
+                r[in->a] = result;
+                break;
+            }
+            case op_return:
+                return r[in->b];
+            case op_return_none:
+                return Value();
+            case op_clear:
+                for (int i = 0; i < in->b; i++) r[in->a + i] = Value();
+                break;
+            case op_read:
+                runtime.read(r[in->a], (j_type)in->b);
+                break;
+            case op_write:
+                runtime.write(r[in->a], (j_type)in->b);
+                break;
+            default:
+                Runtime::fail("unknown instruction");
+        }
+    }
+}
+
+int BytecodeInterpreter::run(const Module &module) {
+    ModuleImage image;
+    image.build(module);
+    return run(image);
+}
+
+int BytecodeInterpreter::run(const ModuleImage &image) {
+    PhaseTimer timer(phase_run);
+    runtime.reset();
+    this->image = &image;
+    globals.assign(image.header().globals, Value());
+    try {
+        const ImageFunction &main = image.functions()[image.header().main];
+        Value *frame = runtime.pushFrame(main.registers);
+        execute(main, frame);
+        runtime.popFrame(frame);
+    } catch (RuntimeError &error) {
+        runtime.flush();
+        fprintf(stderr, "Runtime Error: %s\n", error.message);
+        return 1;
+    }
+    runtime.flush();
+    return 0;
+}
@@ -0,0 +1,708 @@
+#include "../include/ClosureCompiler.h"
+#include "../include/Operators.h"
+#include "../include/stats.h"
+#include <type_traits>
+#include <unordered_map>
+
+template <typename T> struct Local {
+    int slot;
+    T operator()(Value *frame) const { return Member<T>::of(frame[slot]); }
+};
+template <typename T> struct Global {
+    Value *var;
+    T operator()(Value *) const { return Member<T>::of(*var); }
+};
+template <typename T> struct Literal {
+    T value;
+    T operator()(Value *) const { return value; }
+};
+template <typename T> struct Computed {
+    Code<T> code;
+    T operator()(Value *frame) const { return code(frame); }
+};
+
+// Pushes the callee's frame, evaluates the arguments in the caller's frame
+// into it, and runs the body; the value is left in runtime->result
+inline void ClosureCompiler::invoke(const CallSite *site, Value *frame) {
+    Runtime *runtime = site->runtime;
+    Value *callee = runtime->pushFrame(site->routine->slots);
+    for (int i = 0; i < site->count; i++)
+        callee[i] = site->args[i](frame);
+    if (!site->routine->body(callee))
+        runtime->result = Value();
+    runtime->popFrame(callee);
+}
+
+ClosureCompiler::ClosureCompiler(Runtime &runtime)
+    : runtime(runtime), globals(nullptr), globalSlots(0), failed(false) {}
+
+// Moves f into the compiler's memory and returns the code that calls it
+template <typename F>
+auto ClosureCompiler::bind(F f) -> Code<decltype(f((Value *)nullptr))> {
+    static_assert(std::is_trivially_destructible<F>::value, "compiled code is never destroyed");
+    typedef decltype(f((Value *)nullptr)) R;
+    Code<R> code;
+    code.body = new (arena.allocate(sizeof(F), alignof(F))) F(f);
+    code.invoke = [](const void *body, Value *frame) -> R {
+        return (*static_cast<const F *>(body))(frame);
+    };
+    return code;
+}
+
+// A routine is compiled once something refers to it
+ClosureCompiler::Routine *ClosureCompiler::routineOf(STEntry *entry) {
+    auto routine = routines.find(entry);
+    if (routine == routines.end())
+        Runtime::fail("call of an unknown routine");
+    if (!routine->second->queued) {
+        routine->second->queued = true;
+        pending.push_back(routine->second);
+    }
+    return routine->second;
+}
+
+Value *ClosureCompiler::globalOf(STEntry *var) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    return &globals[var->Slot];
+}
+
+template <> Code<int> ClosureCompiler::expr<int>(AST *node);
+template <> Code<float> ClosureCompiler::expr<float>(AST *node);
+template <> Code<bool> ClosureCompiler::expr<bool>(AST *node);
+template <> Code<const char *> ClosureCompiler::expr<const char *>(AST *node);
+
+// Variables, calls and literals
+template <typename T>
+bool ClosureCompiler::common(AST *node, Code<T> &code) {
+    switch (node->type) {
+        case ast_var: {
+            STEntry *var = node->f.a_var.var;
+            if (var->Depth == 0)
+                code = bind(Global<T>{globalOf(var)});
+            else if (var->Slot >= 0)
+                code = bind(Local<T>{var->Slot});
+            else
+                Runtime::fail("variable without storage");
+            return true;
+        }
+        case ast_call:
+            code = callFor<T>(node);
+            return true;
+        default:
+            break;
+    }
+    if constexpr (std::is_same<T, int>::value) {
+        if (node->type == ast_integer) {
+            code = bind(Literal<int>{node->f.a_integer.value});
+            return true;
+        }
+    } else if constexpr (std::is_same<T, float>::value) {
+        if (node->type == ast_float) {
+            code = bind(Literal<float>{node->f.a_float.value});
+            return true;
+        }
+    } else if constexpr (std::is_same<T, bool>::value) {
+        if (node->type == ast_boolean) {
+            code = bind(Literal<bool>{node->f.a_boolean.value != 0});
+            return true;
+        }
+    } else {
+        if (node->type == ast_string) {
+            code = bind(Literal<const char *>{node->f.a_string.string});
+            return true;
+        }
+    }
+    return false;
+}
+
+template <>
+Code<int> ClosureCompiler::expr<int>(AST *node) {
+    Code<int> code;
+    if (common(node, code))
+        return code;
+    switch (node->type) {
+        case ast_uminus: {
+            Code<int> arg = expr<int>(node->f.a_unary_op.arg);
+            return bind([arg](Value *frame) { return Runtime::negate(arg(frame)); });
+        }
+        case ast_times:  return binary<int, int, Multiply>(node);
+        case ast_divide: return binary<int, int, Divide>(node);
+        case ast_plus:   return binary<int, int, Add>(node);
+        case ast_minus:  return binary<int, int, Subtract>(node);
+        default:         Runtime::fail("not an integer expression");
+    }
+}
+
+template <>
+Code<float> ClosureCompiler::expr<float>(AST *node) {
+    Code<float> code;
+    if (common(node, code))
+        return code;
+    switch (node->type) {
+        case ast_itof: {
+            Code<int> arg = expr<int>(node->f.a_itof.arg);
+            return bind([arg](Value *frame) { return (float)arg(frame); });
+        }
+        case ast_uminus: {
+            Code<float> arg = expr<float>(node->f.a_unary_op.arg);
+            return bind([arg](Value *frame) { return -arg(frame); });
+        }
+        case ast_times:  return binary<float, float, Multiply>(node);
+        case ast_divide: return binary<float, float, Divide>(node);
+        case ast_plus:   return binary<float, float, Add>(node);
+        case ast_minus:  return binary<float, float, Subtract>(node);
+        default:         Runtime::fail("not a float expression");
+    }
+}
+
+template <>
+Code<bool> ClosureCompiler::expr<bool>(AST *node) {
+    Code<bool> code;
+    if (common(node, code))
+        return code;
+    switch (node->type) {
+        case ast_not: {
+            Code<bool> arg = expr<bool>(node->f.a_unary_op.arg);
+            return bind([arg](Value *frame) { return !arg(frame); });
+        }
+        case ast_and:
+        case ast_cand: {
+            Code<bool> left = expr<bool>(node->f.a_binary_op.larg);
+            Code<bool> right = expr<bool>(node->f.a_binary_op.rarg);
+            return bind([left, right](Value *frame) { return left(frame) && right(frame); });
+        }
+        case ast_or:
+        case ast_cor: {
+            Code<bool> left = expr<bool>(node->f.a_binary_op.larg);
+            Code<bool> right = expr<bool>(node->f.a_binary_op.rarg);
+            return bind([left, right](Value *frame) { return left(frame) || right(frame); });
+        }
+        default:
+            break;
+    }
+
+    j_type operands = node->f.a_binary_op.rel_type;
+    switch (node->type) {
+        case ast_eq:
+            switch (operands) {
+                case type_integer: return binary<bool, int, Equal>(node);
+                case type_float:   return binary<bool, float, Equal>(node);
+                case type_boolean: return binary<bool, bool, Equal>(node);
+                case type_string:  return binary<bool, const char *, Equal>(node);
+                default:           break;
+            }
+            break;
+        case ast_neq:
+            switch (operands) {
+                case type_integer: return binary<bool, int, NotEqual>(node);
+                case type_float:   return binary<bool, float, NotEqual>(node);
+                case type_boolean: return binary<bool, bool, NotEqual>(node);
+                case type_string:  return binary<bool, const char *, NotEqual>(node);
+                default:           break;
+            }
+            break;
+        case ast_lt:
+            if (operands == type_integer) return binary<bool, int, Less>(node);
+            if (operands == type_float) return binary<bool, float, Less>(node);
+            break;
+        case ast_le:
+            if (operands == type_integer) return binary<bool, int, LessEqual>(node);
+            if (operands == type_float) return binary<bool, float, LessEqual>(node);
+            break;
+        case ast_gt:
+            if (operands == type_integer) return binary<bool, int, Greater>(node);
+            if (operands == type_float) return binary<bool, float, Greater>(node);
+            break;
+        case ast_ge:
+            if (operands == type_integer) return binary<bool, int, GreaterEqual>(node);
+            if (operands == type_float) return binary<bool, float, GreaterEqual>(node);
+            break;
+        default:
+            break;
+    }
+    Runtime::fail("not a boolean expression");
+}
+
+template <>
+Code<const char *> ClosureCompiler::expr<const char *>(AST *node) {
+    Code<const char *> code;
+    if (!common(node, code))
+        Runtime::fail("not a string expression");
+    return code;
+}
+
+// An expression's value as a whole Value, for arguments and constants
+Code<Value> ClosureCompiler::value(AST *node) {
+    if (node->type == ast_var) {
+        STEntry *var = node->f.a_var.var;
+        if (var->Depth == 0) {
+            Value *global = globalOf(var);
+            return bind([global](Value *) { return *global; });
+        }
+        int slot = var->Slot;
+        return bind([slot](Value *frame) { return frame[slot]; });
+    }
+    switch (node->value_type) {
+        case type_integer: {
+            Code<int> code = expr<int>(node);
+            return bind([code](Value *frame) {
+                Value value = Value();
+                value.i = code(frame);
+                return value;
+            });
+        }
+        case type_float: {
+            Code<float> code = expr<float>(node);
+            return bind([code](Value *frame) {
+                Value value = Value();
+                value.f = code(frame);
+                return value;
+            });
+        }
+        case type_boolean: {
+            Code<bool> code = expr<bool>(node);
+            return bind([code](Value *frame) {
+                Value value = Value();
+                value.b = code(frame);
+                return value;
+            });
+        }
+        case type_string: {
+            Code<const char *> code = expr<const char *>(node);
+            return bind([code](Value *frame) {
+                Value value = Value();
+                value.s = code(frame);
+                return value;
+            });
+        }
+        default:
+            Runtime::fail("expression without a type");
+    }
+}
+
+// An operator, specialized for the kinds of its operands if they are
+// integers, and called generically otherwise. The left operand is read
+// first, as the right one can be a call that changes it.
+template <typename R, typename T, typename Op>
+Code<R> ClosureCompiler::binary(AST *node) {
+    AST *left = node->f.a_binary_op.larg;
+    AST *right = node->f.a_binary_op.rarg;
+    if constexpr (std::is_same<T, int>::value) {
+        switch (kindOf(left)) {
+            case operand_local:
+                return binaryWith<R, T, Op>(Local<int>{left->f.a_var.var->Slot}, right);
+            case operand_global:
+                return binaryWith<R, T, Op>(Global<int>{globalOf(left->f.a_var.var)}, right);
+            case operand_literal:
+                return binaryWith<R, T, Op>(Literal<int>{left->f.a_integer.value}, right);
+            default:
+                break;
+        }
+    }
+    return binaryWith<R, T, Op>(Computed<T>{expr<T>(left)}, right);
+}
+
+template <typename R, typename T, typename Op, typename Left>
+Code<R> ClosureCompiler::binaryWith(Left left, AST *right) {
+    if constexpr (std::is_same<T, int>::value) {
+        switch (kindOf(right)) {
+            case operand_local: {
+                Local<int> r{right->f.a_var.var->Slot};
+                return bind([left, r](Value *frame) -> R {
+                    auto l = left(frame);
+                    return Op()(l, r(frame));
+                });
+            }
+            case operand_global: {
+                Global<int> r{globalOf(right->f.a_var.var)};
+                return bind([left, r](Value *frame) -> R {
+                    auto l = left(frame);
+                    return Op()(l, r(frame));
+                });
+            }
+            case operand_literal: {
+                Literal<int> r{right->f.a_integer.value};
+                return bind([left, r](Value *frame) -> R {
+                    auto l = left(frame);
+                    return Op()(l, r(frame));
+                });
+            }
+            default:
+                break;
+        }
+    }
+    Computed<T> r{expr<T>(right)};
+    return bind([left, r](Value *frame) -> R {
+        auto l = left(frame);
+        return Op()(l, r(frame));
+    });
+}
+
+template <typename T, typename Source>
+Code<bool> ClosureCompiler::store(STEntry *var, Source source) {
+    if (var->Depth == 0) {
+        Value *global = globalOf(var);
+        return bind([global, source](Value *frame) {
+            Member<T>::of(*global) = source(frame);
+            return false;
+        });
+    }
+    int slot = var->Slot;
+    return bind([slot, source](Value *frame) {
+        Member<T>::of(frame[slot]) = source(frame);
+        return false;
+    });
+}
+
+template <typename T>
+Code<bool> ClosureCompiler::assign(STEntry *var, AST *rhs) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    if constexpr (std::is_same<T, int>::value) {
+        switch (kindOf(rhs)) {
+            case operand_local:
+                return store<int>(var, Local<int>{rhs->f.a_var.var->Slot});
+            case operand_global:
+                return store<int>(var, Global<int>{globalOf(rhs->f.a_var.var)});
+            case operand_literal:
+                return store<int>(var, Literal<int>{rhs->f.a_integer.value});
+            default:
+                break;
+        }
+    }
+    return store<T>(var, Computed<T>{expr<T>(rhs)});
+}
+
+ClosureCompiler::CallSite *ClosureCompiler::callSite(AST *node) {
+    CallSite *site = arena.allocateArray<CallSite>(1);
+    site->routine = routineOf(node->f.a_call.callee);
+    site->count = 0;
+    for (ast_list *arg = node->f.a_call.arg_list; arg; arg = arg->tail) site->count++;
+    site->args = arena.allocateArray<Code<Value>>(site->count);
+    int index = 0;
+    for (ast_list *arg = node->f.a_call.arg_list; arg; arg = arg->tail)
+        site->args[index++] = value(arg->head);
+    site->runtime = &runtime;
+    return site;
+}
+
+template <typename T>
+Code<T> ClosureCompiler::callFor(AST *node) {
+    CallSite *site = callSite(node);
+    return bind([site](Value *frame) {
+        invoke(site, frame);
+        return Member<T>::of(site->runtime->result);
+    });
+}
+
+// A variable for read, write and for; only the loop's is worth
+// specializing for where the variable lives
+struct LocalVar {
+    int slot;
+    Value &operator()(Value *frame) const { return frame[slot]; }
+};
+struct GlobalVar {
+    Value *var;
+    Value &operator()(Value *) const { return *var; }
+};
+struct AnyVar {
+    int slot;
+    Value *global;  // nullptr for a local
+    Value &operator()(Value *frame) const { return global ? *global : frame[slot]; }
+};
+
+template <typename Var>
+static auto loopOver(Var var, Code<int> lower, Code<int> upper, Code<bool> body) {
+    // The bounds are evaluated once; the body may change the variable
+    return [var, lower, upper, body](Value *frame) {
+        int &i = var(frame).i;
+        int first = lower(frame);
+        int last = upper(frame);
+        i = first;
+        if (first > last)
+            return false;
+        for (;;) {
+            if (body(frame))
+                return true;
+            if (i >= last)
+                return false;
+            i++;
+        }
+    };
+}
+
+Code<bool> ClosureCompiler::stmt(AST *node) {
+    Runtime *rt = &runtime;
+    switch (node->type) {
+        case ast_assign: {
+            STEntry *lhs = node->f.a_assign.lhs;
+            switch (lhs->VarType) {
+                case type_integer: return assign<int>(lhs, node->f.a_assign.rhs);
+                case type_float:   return assign<float>(lhs, node->f.a_assign.rhs);
+                case type_boolean: return assign<bool>(lhs, node->f.a_assign.rhs);
+                case type_string:  return assign<const char *>(lhs, node->f.a_assign.rhs);
+                default:           Runtime::fail("assignment without a type");
+            }
+        }
+
+        case ast_if: {
+            Code<bool> predicate = expr<bool>(node->f.a_if.predicate);
+            Code<bool> conseq = stmt(node->f.a_if.conseq);
+            if (node->f.a_if.altern == nullptr)
+                return bind([predicate, conseq](Value *frame) {
+                    return predicate(frame) && conseq(frame);
+                });
+            Code<bool> altern = stmt(node->f.a_if.altern);
+            return bind([predicate, conseq, altern](Value *frame) {
+                return predicate(frame) ? conseq(frame) : altern(frame);
+            });
+        }
+
+        case ast_while: {
+            Code<bool> predicate = expr<bool>(node->f.a_while.predicate);
+            Code<bool> body = stmt(node->f.a_while.body);
+            return bind([predicate, body](Value *frame) {
+                while (predicate(frame)) {
+                    if (body(frame))
+                        return true;
+                }
+                return false;
+            });
+        }
+
+        case ast_for: {
+            STEntry *var = node->f.a_for.var;
+            Code<int> lower = expr<int>(node->f.a_for.lower_bound);
+            Code<int> upper = expr<int>(node->f.a_for.upper_bound);
+            Code<bool> body = stmt(node->f.a_for.body);
+            if (var->Depth == 0)
+                return bind(loopOver(GlobalVar{globalOf(var)}, lower, upper, body));
+            if (var->Slot < 0)
+                Runtime::fail("variable without storage");
+            return bind(loopOver(LocalVar{var->Slot}, lower, upper, body));
+        }
+
+        case ast_read:
+        case ast_write: {
+            STEntry *entry = node->type == ast_read ? node->f.a_read.var : node->f.a_write.var;
+            if (entry->Slot < 0)
+                Runtime::fail("variable without storage");
+            AnyVar var{entry->Slot, entry->Depth == 0 ? globalOf(entry) : nullptr};
+            j_type type = entry->VarType;
+            if (node->type == ast_read)
+                return bind([rt, var, type](Value *frame) {
+                    rt->read(var(frame), type);
+                    return false;
+                });
+            return bind([rt, var, type](Value *frame) {
+                rt->write(var(frame), type);
+                return false;
+            });
+        }
+
+        case ast_call: {
+            CallSite *site = callSite(node);
+            return bind([site](Value *frame) {
+                invoke(site, frame);
+                return false;
+            });
+        }
+
+        case ast_block:
+            return block(node);
+
+        case ast_return: {
+            AST *value = node->f.a_return.expr;
+            switch (value->value_type) {
+                case type_integer: {
+                    Code<int> code = expr<int>(value);
+                    return bind([rt, code](Value *frame) {
+                        rt->result.i = code(frame);
+                        return true;
+                    });
+                }
+                case type_float: {
+                    Code<float> code = expr<float>(value);
+                    return bind([rt, code](Value *frame) {
+                        rt->result.f = code(frame);
+                        return true;
+                    });
+                }
+                case type_boolean: {
+                    Code<bool> code = expr<bool>(value);
+                    return bind([rt, code](Value *frame) {
+                        rt->result.b = code(frame);
+                        return true;
+                    });
+                }
+                case type_string: {
+                    Code<const char *> code = expr<const char *>(value);
+                    return bind([rt, code](Value *frame) {
+                        rt->result.s = code(frame);
+                        return true;
+                    });
+                }
+                default:
+                    Runtime::fail("return without a type");
+            }
+        }
+
+        default:
+            Runtime::fail("unknown statement");
+    }
+}
+
+// A block shares the frame of the block around it. It clears its
+// variables when entered; layout_frames gave them consecutive slots.
+Code<bool> ClosureCompiler::block(AST *node) {
+    int first = -1, vars = 0;
+    for (ste_list *var = node->f.a_block.vars; var; var = var->tail) {
+        if (var->head == nullptr)
+            continue;
+        if (first < 0)
+            first = var->head->Slot;
+        vars++;
+    }
+    int count = 0;
+    for (ast_list *s = node->f.a_block.stmts; s; s = s->tail) count++;
+
+    if (count == 0)
+        return bind([](Value *) { return false; });
+    if (count == 1 && vars == 0)
+        return stmt(node->f.a_block.stmts->head);
+    Code<bool> *stmts = arena.allocateArray<Code<bool>>(count);
+    int index = 0;
+    for (ast_list *s = node->f.a_block.stmts; s; s = s->tail)
+        stmts[index++] = stmt(s->head);
+    if (vars == 0)
+        return bind([stmts, count](Value *frame) {
+            for (int i = 0; i < count; i++) {
+                if (stmts[i](frame))
+                    return true;
+            }
+            return false;
+        });
+    return bind([stmts, count, first, vars](Value *frame) {
+        for (int i = 0; i < vars; i++) frame[first + i] = Value();
+        for (int i = 0; i < count; i++) {
+            if (stmts[i](frame))
+                return true;
+        }
+        return false;
+    });
+}
+
+int ClosureCompiler::compile(AST *program) {
+    PhaseTimer timer(phase_compile);
+    steps.clear();
+    routines.clear();
+    pending.clear();
+    globalSlots = program->f.a_program.frame_slots;
+    globals = arena.allocateArray<Value>(globalSlots);
+    try {
+        compileProgram(program);
+    } catch (RuntimeError &error) {
+        fprintf(stderr, "Compile Error: %s\n", error.message);
+        return 1;
+    }
+    return 0;
+}
+
+// Every routine exists before any body is compiled, so calls, even
+// recursive ones, can refer to it
+void ClosureCompiler::declareRoutines(AST *program) {
+    for (ast_list *d = program->f.a_program.statements; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type == ast_routine_decl) {
+            Routine *routine = arena.allocateArray<Routine>(1);
+            routine->slots = decl->f.a_routine_decl.body->f.a_block.frame_slots;
+            routine->decl = decl;
+            routines[decl->f.a_routine_decl.name] = routine;
+        }
+    }
+}
+
+void ClosureCompiler::compilePending() {
+    while (!pending.empty()) {
+        Routine *routine = pending.back();
+        pending.pop_back();
+        routine->body = block(routine->decl->f.a_routine_decl.body);
+    }
+}
+
+void ClosureCompiler::compileProgram(AST *program) {
+    declareRoutines(program);
+    ast_list *decls = program->f.a_program.statements;
+    Runtime *rt = &runtime;
+    for (ast_list *d = decls; d; d = d->tail) {
+        AST *decl = d->head;
+        switch (decl->type) {
+            case ast_routine_decl:
+                routineOf(decl->f.a_routine_decl.name);
+                break;
+
+            case ast_const_decl: {
+                Value *var = globalOf(decl->f.a_const_decl.name);
+                Code<Value> code = value(decl->f.a_const_decl.value);
+                steps.push_back(bind([var, code](Value *frame) {
+                    *var = code(frame);
+                    return false;
+                }));
+                break;
+            }
+
+            case ast_block: {
+                Code<bool> body = block(decl);
+                int slots = decl->f.a_block.frame_slots;
+                steps.push_back(bind([rt, body, slots](Value *) {
+                    Value *frame = rt->pushFrame(slots);
+                    body(frame);
+                    rt->popFrame(frame);
+                    return false;
+                }));
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    compilePending();
+}
+
+const Code<bool> *ClosureCompiler::compileRoutine(AST *program, STEntry *name, Value *globals) {
+    PhaseTimer timer(phase_compile);
+    if (failed)
+        return nullptr;
+    try {
+        if (this->globals == nullptr) {
+            this->globals = globals;
+            globalSlots = program->f.a_program.frame_slots;
+            declareRoutines(program);
+        }
+        Routine *routine = routineOf(name);
+        compilePending();
+        return &routine->body;
+    } catch (RuntimeError &error) {
+        // Routines queued with the one that failed were left without code
+        fprintf(stderr, "Compile Error: %s\n", error.message);
+        failed = true;
+        return nullptr;
+    }
+}
+
+int ClosureCompiler::run() {
+    PhaseTimer timer(phase_run);
+    runtime.reset();
+    for (int i = 0; i < globalSlots; i++) globals[i] = Value();
+    try {
+        for (Code<bool> &step : steps) step(nullptr);
+    } catch (RuntimeError &error) {
+        runtime.flush();
+        fprintf(stderr, "Runtime Error: %s\n", error.message);
+        return 1;
+    }
+    runtime.flush();
+    return 0;
+}
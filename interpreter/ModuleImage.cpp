@@ -0,0 +1,268 @@
+#include "../include/ModuleImage.h"
+#include "../include/Runtime.h"
+#include "../include/stats.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char ModuleImage::IMAGE_MAGIC[8] = {'N', '2', '3', 'I', 'M', 'A', 'G', 'E'};
+
+static const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+ModuleImage::ModuleImage()
+    : base(nullptr), bytes(0), mapping(nullptr), functionTable(nullptr),
+      instructionBase(nullptr),
+      stringTable(nullptr), pool(nullptr) {}
+
+ModuleImage::~ModuleImage() {
+    release();
+}
+
+void ModuleImage::release() {
+    if (mapping != nullptr)
+        munmap(mapping, bytes);
+    mapping = nullptr;
+    owned.clear();
+    base = nullptr;
+    bytes = 0;
+}
+
+void ModuleImage::locate() {
+    const ImageHeader &h = header();
+    functionTable = (const ImageFunction *)(base + h.functionTable);
+    instructionBase = (const Instruction *)(base + h.code);
+    stringTable = (const uint32_t *)(base + h.stringTable);
+    pool = (const char *)(base + h.pool);
+}
+
+void ModuleImage::build(const Module &module) {
+    release();
+    uint64_t instructions = 0, poolBytes = 0;
+    for (const Function &function : module.functions) {
+        instructions += function.code.size();
+        poolBytes += function.name.size() + 1;
+    }
+    for (const std::string &string : module.strings) poolBytes += string.size() + 1;
+
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+    h.version = IMAGE_VERSION;
+    h.byteOrder = IMAGE_BYTE_ORDER;
+    h.functions = module.functions.size();
+    h.routines = module.routines;
+    h.main = module.main;
+    h.globals = module.globals;
+    h.strings = module.strings.size();
+    h.functionTable = sizeof(ImageHeader);
+    h.code = align8(h.functionTable + h.functions * sizeof(ImageFunction));
+    h.instructions = instructions;
+    h.stringTable = align8(h.code + instructions * sizeof(Instruction));
+    h.pool = align8(h.stringTable + h.strings * sizeof(uint32_t));
+    h.poolBytes = poolBytes;
+    h.size = align8(h.pool + poolBytes);
+
+    owned.assign(h.size / 8, 0);
+    uint8_t *image = (uint8_t *)owned.data();
+    memcpy(image, &h, sizeof(h));
+    ImageFunction *functions = (ImageFunction *)(image + h.functionTable);
+    Instruction *instruction = (Instruction *)(image + h.code);
+    uint32_t *strings = (uint32_t *)(image + h.stringTable);
+    char *text = (char *)(image + h.pool);
+    uint32_t offset = 0;
+    uint64_t first = 0;
+    for (const Function &function : module.functions) {
+        ImageFunction &f = *functions++;
+        f.name = offset;
+        memcpy(text + offset, function.name.c_str(), function.name.size() + 1);
+        offset += function.name.size() + 1;
+        f.params = function.params;
+        f.slots = function.slots;
+        f.registers = function.registers;
+        f.code = first;
+        f.length = function.code.size();
+        if (!function.code.empty())
+            memcpy(instruction + first, function.code.data(), f.length * sizeof(Instruction));
+        first += f.length;
+    }
+    for (const std::string &string : module.strings) {
+        *strings++ = offset;
+        memcpy(text + offset, string.c_str(), string.size() + 1);
+        offset += string.size() + 1;
+    }
+
+    base = image;
+    bytes = h.size;
+    locate();
+}
+
+int ModuleImage::write(const char *fileName) const {
+    FILE *fp = fopen(fileName, "wb");
+    bool ok = fp != nullptr && fwrite(base, 1, bytes, fp) == bytes;
+    if (fp != nullptr)
+        ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Could not write %s\n", fileName);
+        return 1;
+    }
+    return 0;
+}
+
+int ModuleImage::load(const char *fileName) {
+    PhaseTimer timer(phase_io);
+    release();
+    int fd = open(fileName, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0)
+            close(fd);
+        fprintf(stderr, "Could not read %s\n", fileName);
+        return 1;
+    }
+    if ((size_t)status.st_size < sizeof(ImageHeader)) {
+        close(fd);
+        fprintf(stderr, "%s is not an N23 image\n", fileName);
+        return 1;
+    }
+    bytes = status.st_size;
+    mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        bytes = 0;
+        fprintf(stderr, "Could not map %s\n", fileName);
+        return 1;
+    }
+    base = (const uint8_t *)mapping;
+    if (!check(fileName)) {
+        release();
+        return 1;
+    }
+    locate();
+    stats_count(count_image_bytes, bytes);
+    return 0;
+}
+
+// Whether each operand of in, an instruction of f, names something that
+// exists: a register of f's frame, an instruction of f, or a function,
+// string or global of the image
+static bool validOperands(const ImageHeader &h, const ImageFunction *functions,
+                          const ImageFunction &f, const Instruction &in) {
+    if (in.op < 0 || in.op >= NUM_OPCODES)
+        return false;
+    const OpcodeInfo &info = opcode_info[in.op];
+    const int32_t fields[3] = {in.a, in.b, in.c};
+    const FieldKind kinds[3] = {info.a, info.b, info.c};
+    for (int i = 0; i < 3; i++) {
+        int64_t x = fields[i];
+        bool ok = true;
+        switch (kinds[i]) {
+            case field_def:
+            case field_use:
+                ok = x >= 0 && x < f.registers;
+                break;
+            case field_args:
+                // As many as the callee's params; the callee is field c
+                ok = in.c >= 0 && (uint32_t)in.c < h.functions && x >= 0 &&
+                     x + functions[in.c].params <= f.registers;
+                break;
+            case field_range:
+                ok = x >= 0 && in.b >= 0 && x + in.b <= f.registers;
+                break;
+            case field_label:
+                ok = x >= 0 && (uint64_t)x < f.length;
+                break;
+            case field_function:
+                ok = x >= 0 && x < h.functions;
+                break;
+            case field_string:
+                ok = x >= 0 && x < h.strings;
+                break;
+            case field_global:
+                ok = x >= 0 && x < h.globals;
+                break;
+            default:
+                break;
+        }
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// Everything the interpreter trusts to find the code and the strings: the
+// tables lie within the image, the functions and strings within them, and
+// each instruction's operands within its frame, its function and the tables
+bool ModuleImage::check(const char *fileName) {
+    const ImageHeader &h = header();
+    if (memcmp(h.magic, IMAGE_MAGIC, sizeof(h.magic)) != 0) {
+        fprintf(stderr, "%s is not an N23 image\n", fileName);
+        return false;
+    }
+    if (h.byteOrder != IMAGE_BYTE_ORDER || h.version != IMAGE_VERSION) {
+        fprintf(stderr, "%s is an image of another version or machine\n", fileName);
+        return false;
+    }
+    // Each table is aligned and ends before the next begins; counts are
+    // bounded first, so the sizes cannot overflow
+    bool ok = h.size == bytes && h.functions > 0 && h.main < h.functions &&
+              h.routines <= h.functions && h.globals <= (uint32_t)Runtime::STACK_SLOTS &&
+              h.functionTable == sizeof(ImageHeader) &&
+              h.code % 8 == 0 && h.stringTable % 8 == 0 && h.pool % 8 == 0 &&
+              h.code <= bytes && h.stringTable <= bytes && h.pool <= bytes &&
+              h.instructions <= bytes && h.poolBytes > 0 && h.poolBytes <= bytes &&
+              h.code >= h.functionTable + h.functions * sizeof(ImageFunction) &&
+              h.stringTable >= h.code + h.instructions * sizeof(Instruction) &&
+              h.pool >= h.stringTable + h.strings * (uint64_t)sizeof(uint32_t) &&
+              h.pool + h.poolBytes <= bytes;
+    const char *text = (const char *)base + h.pool;
+    ok = ok && text[h.poolBytes - 1] == '\0';
+    const ImageFunction *functions = (const ImageFunction *)(base + h.functionTable);
+    for (uint32_t i = 0; ok && i < h.functions; i++) {
+        const ImageFunction &f = functions[i];
+        ok = f.name < h.poolBytes && f.code <= h.instructions &&
+             f.length > 0 && f.length <= h.instructions - f.code &&
+             f.params >= 0 && f.params <= f.slots && f.slots <= f.registers &&
+             f.registers <= Runtime::STACK_SLOTS;
+    }
+    const uint32_t *strings = (const uint32_t *)(base + h.stringTable);
+    for (uint32_t i = 0; ok && i < h.strings; i++) ok = strings[i] < h.poolBytes;
+    // Then the code, in one pass, once every function's frame is known; no
+    // function runs off its end
+    const Instruction *code = (const Instruction *)(base + h.code);
+    for (uint32_t i = 0; ok && i < h.functions; i++) {
+        const ImageFunction &f = functions[i];
+        for (uint64_t j = 0; ok && j < f.length; j++)
+            ok = validOperands(h, functions, f, code[f.code + j]);
+        ok = ok && ends_flow(code[f.code + f.length - 1].op);
+    }
+    if (!ok)
+        fprintf(stderr, "%s is damaged\n", fileName);
+    return ok;
+}
+
+void ModuleImage::toModule(Module &module) const {
+    const ImageHeader &h = header();
+    module.functions.assign(h.functions, Function());
+    for (uint32_t i = 0; i < h.functions; i++) {
+        const ImageFunction &f = functionTable[i];
+        Function &function = module.functions[i];
+        function.name = name(f);
+        function.params = f.params;
+        function.slots = f.slots;
+        function.registers = f.registers;
+        function.code.assign(code(f), code(f) + f.length);
+    }
+    module.routines = h.routines;
+    module.main = h.main;
+    module.globals = h.globals;
+    module.strings.clear();
+    for (uint32_t i = 0; i < h.strings; i++) module.strings.push_back(string(i));
+}
@@ -0,0 +1,487 @@
+#include "../include/PeepholeOptimizer.h"
+#include "../include/Runtime.h"
+#include "../include/stats.h"
+#include <limits.h>
+#include <algorithm>
+
+// What a pattern is shown: the instructions it matched and facts about the
+// function. A pattern that forwards a value keeps uses up to date.
+struct Window {
+    Function *function;
+    size_t at;                      // of first
+    Instruction *first;
+    Instruction *second;            // nullptr for a pattern of one
+    std::vector<int> *uses;         // reads of each register
+    std::vector<int> *defs;         // writes of each register
+    const std::vector<bool> *targets;
+
+    // A temporary written once and read once, so the two instructions that
+    // touch it can be rewritten freely
+    bool single(int reg) const {
+        return reg >= function->slots && (*uses)[reg] == 1 && (*defs)[reg] == 1;
+    }
+};
+
+// A pattern, with the opcodes it matches. apply returns the number of
+// instructions it removed, by making them op_nop, or -1 if it doesn't
+// apply after all.
+struct Pattern {
+    const char *name;
+    bool (*first)(int op);
+    bool (*second)(int op);         // nullptr for a pattern of one
+    int (*apply)(Window &w);
+};
+
+static bool anyOp(int) { return true; }
+static bool isMove(int op) { return op == op_move; }
+static bool isConst(int op) { return op == op_const; }
+static bool isNot(int op) { return op == op_not; }
+static bool isLoadGlobal(int op) { return op == op_load_global; }
+static bool isStoreGlobal(int op) { return op == op_store_global; }
+static bool isCompare(int op) { return op >= op_eq && op <= op_ge; }
+static bool isAddOrSubtract(int op) { return op == op_add || op == op_subtract; }
+static bool isJump(int op) { return is_jump(op); }
+static bool isGoto(int op) { return op == op_jump; }
+static bool isBranch(int op) { return is_jump(op) && op != op_jump; }
+static bool isBoolBranch(int op) { return op == op_jump_if_true || op == op_jump_if_false; }
+static bool endsFlow(int op) { return ends_flow(op); }
+static bool definesOne(int op) { return opcode_info[op].a == field_def; }
+
+static void remove(Instruction *in) {
+    *in = Instruction{op_nop, 0, 0, 0};
+}
+
+// The branch taken exactly when the given one is not
+static int inverse(int op) {
+    switch (op) {
+        case op_jump_if_true:  return op_jump_if_false;
+        case op_jump_if_false: return op_jump_if_true;
+        case op_jump_eq:       return op_jump_ne;
+        case op_jump_ne:       return op_jump_eq;
+        case op_jump_lt:       return op_jump_ge;
+        case op_jump_le:       return op_jump_gt;
+        case op_jump_gt:       return op_jump_le;
+        default:               return op_jump_lt;   // op_jump_ge
+    }
+}
+
+// move r, r
+static int selfMove(Window &w) {
+    if (w.first->a != w.first->b)
+        return -1;
+    remove(w.first);
+    return 1;
+}
+
+// A jump to a jump goes straight to where that one goes
+static int jumpChain(Window &w) {
+    std::vector<Instruction> &code = w.function->code;
+    int target = w.first->a;
+    for (int hops = 0; hops < 16 && (size_t)target < code.size() &&
+                              code[target].op == op_jump && code[target].a != target; hops++)
+        target = code[target].a;
+    if (target == w.first->a)
+        return -1;
+    w.first->a = target;
+    return 0;
+}
+
+// A jump to the next instruction; a branch has no effects either
+static int jumpToNext(Window &w) {
+    if ((size_t)w.first->a != w.at + 1)
+        return -1;
+    remove(w.first);
+    return 1;
+}
+
+// Code no jump goes to, after a jump or a return
+static int unreachable(Window &w) {
+    if (w.second->op == op_nop)
+        return -1;
+    remove(w.second);
+    return 1;
+}
+
+// A branch over a jump, as an if with an else leaves: branch the other
+// way, to where the jump goes
+static int branchOverJump(Window &w) {
+    if ((size_t)w.first->a != w.at + 2)
+        return -1;
+    w.first->op = inverse(w.first->op);
+    w.first->a = w.second->a;
+    remove(w.second);
+    return 1;
+}
+
+// t := ...; x := t: compute into x
+static int forwardTemporary(Window &w) {
+    if (w.second->b != w.first->a || !w.single(w.first->a))
+        return -1;
+    w.first->a = w.second->a;
+    remove(w.second);
+    return 1;
+}
+
+// t := s, then a read of t: read s
+static int copyPropagate(Window &w) {
+    int t = w.first->a;
+    if (!w.single(t))
+        return -1;
+    const OpcodeInfo &info = opcode_info[w.second->op];
+    if (info.a == field_use && w.second->a == t)
+        w.second->a = w.first->b;
+    else if (info.b == field_use && w.second->b == t)
+        w.second->b = w.first->b;
+    else if (info.c == field_use && w.second->c == t)
+        w.second->c = w.first->b;
+    else
+        return -1;
+    remove(w.first);
+    return 1;
+}
+
+// a := b; b := a
+static int moveBack(Window &w) {
+    if (w.second->a != w.first->b || w.second->b != w.first->a)
+        return -1;
+    remove(w.second);
+    return 1;
+}
+
+// A global read right after it was stored: use the value stored
+static int storeThenLoad(Window &w) {
+    if (w.second->b != w.first->a)
+        return -1;
+    int value = w.first->b;
+    *w.second = Instruction{op_move, w.second->a, value, 0};
+    (*w.uses)[value]++;
+    return 0;
+}
+
+// A global stored right after it was read
+static int loadThenStore(Window &w) {
+    if (w.second->a != w.first->b || w.second->b != w.first->a)
+        return -1;
+    (*w.uses)[w.first->a]--;
+    remove(w.second);
+    return 1;
+}
+
+// not (not x)
+static int doubleNot(Window &w) {
+    if (w.second->b != w.first->a || !w.single(w.first->a))
+        return -1;
+    *w.second = Instruction{op_move, w.second->a, w.first->b, 0};
+    remove(w.first);
+    return 1;
+}
+
+// A branch on not x: branch the other way on x
+static int branchOnNot(Window &w) {
+    if (w.second->b != w.first->a || !w.single(w.first->a))
+        return -1;
+    w.second->op = inverse(w.second->op);
+    w.second->b = w.first->b;
+    remove(w.first);
+    return 1;
+}
+
+// A branch on an integer comparison: compare and branch at once
+static int compareAndBranch(Window &w) {
+    if (w.second->b != w.first->a || !w.single(w.first->a))
+        return -1;
+    int branch = op_jump_eq + (w.first->op - op_eq);
+    if (w.second->op == op_jump_if_false)
+        branch = inverse(branch);
+    *w.second = Instruction{branch, w.second->a, w.first->b, w.first->c};
+    remove(w.first);
+    return 1;
+}
+
+// x + k or x - k with a constant k
+static int immediateOperand(Window &w) {
+    int t = w.first->a;
+    if (!w.single(t))
+        return -1;
+    int k = w.first->b;
+    int x;
+    if (w.second->c == t)
+        x = w.second->b;
+    else if (w.second->op == op_add && w.second->b == t)
+        x = w.second->c;
+    else
+        return -1;
+    if (w.second->op == op_subtract)
+        k = Runtime::negate(k);
+    *w.second = Instruction{op_add_immediate, w.second->a, x, k};
+    remove(w.first);
+    return 1;
+}
+
+static const Pattern patterns[] = {
+    {"self-move", isMove, nullptr, selfMove},
+    {"jump-chain", isJump, nullptr, jumpChain},
+    {"jump-to-next", isJump, nullptr, jumpToNext},
+    {"unreachable", endsFlow, anyOp, unreachable},
+    {"branch-over-jump", isBranch, isGoto, branchOverJump},
+    {"forward-temporary", definesOne, isMove, forwardTemporary},
+    {"move-back", isMove, isMove, moveBack},
+    {"copy-propagate", isMove, anyOp, copyPropagate},
+    {"store-then-load", isStoreGlobal, isLoadGlobal, storeThenLoad},
+    {"load-then-store", isLoadGlobal, isStoreGlobal, loadThenStore},
+    {"double-not", isNot, isNot, doubleNot},
+    {"branch-on-not", isNot, isBoolBranch, branchOnNot},
+    {"compare-and-branch", isCompare, isBoolBranch, compareAndBranch},
+    {"immediate-operand", isConst, isAddOrSubtract, immediateOperand},
+};
+static const int NUM_PATTERNS = sizeof(patterns) / sizeof(patterns[0]);
+
+PeepholeOptimizer::PeepholeOptimizer()
+    : counts(NUM_PATTERNS, Count{0, 0}), byOpcode(NUM_OPCODES), instructionsBefore(0),
+      instructionsAfter(0), instructionsMoved(0) {
+    for (int op = 0; op < NUM_OPCODES; op++) {
+        for (int p = 0; p < NUM_PATTERNS; p++) {
+            if (op != op_nop && patterns[p].first(op))
+                byOpcode[op].push_back(p);
+        }
+    }
+}
+
+// Drops the op_nops, and points each jump at the instruction that followed
+// its target
+static void compact(Function &function) {
+    std::vector<Instruction> &code = function.code;
+    std::vector<int> index(code.size() + 1);
+    size_t live = 0;
+    for (size_t i = 0; i < code.size(); i++) {
+        index[i] = (int)live;
+        if (code[i].op != op_nop)
+            code[live++] = code[i];
+    }
+    index[code.size()] = (int)live;
+    code.resize(live);
+    for (Instruction &in : code) {
+        if (is_jump(in.op))
+            in.a = index[in.a];
+    }
+}
+
+// One pass of the patterns over the code; returns whether any applied
+bool PeepholeOptimizer::sweep(const Module &module, Function &function) {
+    compact(function);
+    std::vector<Instruction> &code = function.code;
+    uses.assign(function.registers, 0);
+    defs.assign(function.registers, 0);
+    targets.assign(code.size() + 1, false);
+    for (const Instruction &in : code) {
+        for_each_use(module, in, [&](int reg) { uses[reg]++; });
+        for_each_def(in, [&](int reg) { defs[reg]++; });
+        if (is_jump(in.op))
+            targets[in.a] = true;
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); i++) {
+        for (int p : byOpcode[code[i].op]) {
+            const Pattern &pattern = patterns[p];
+            Window w = {&function, i, &code[i], nullptr, &uses, &defs, &targets};
+            if (pattern.second != nullptr) {
+                if (i + 1 >= code.size() || targets[i + 1] || code[i + 1].op == op_nop ||
+                    !pattern.second(code[i + 1].op))
+                    continue;
+                w.second = &code[i + 1];
+            }
+            int removed = pattern.apply(w);
+            if (removed < 0)
+                continue;
+            counts[p].applied++;
+            counts[p].removed += removed;
+            changed = true;
+            // What the instruction became may match patterns of its own,
+            // on the next sweep
+            break;
+        }
+    }
+    return changed;
+}
+
+void PeepholeOptimizer::optimize(const Module &module, Function &function) {
+    // Every pattern shrinks the code or moves a jump further on, so the
+    // sweeps stop; the limit is a guard against a cycle of jumps
+    const int MAX_SWEEPS = 100;
+    instructionsBefore += function.code.size();
+    for (int sweeps = 0; sweeps < MAX_SWEEPS && sweep(module, function); sweeps++) {}
+    compact(function);
+    instructionsAfter += function.code.size();
+}
+
+void PeepholeOptimizer::optimize(Module &module) {
+    PhaseTimer timer(phase_optimize);
+    for (Function &function : module.functions) optimize(module, function);
+}
+
+// Cycles before an instruction's result can be used, roughly, on a
+// current x86-64
+static int latency(int op) {
+    switch (op) {
+        case op_multiply:    return 3;
+        case op_divide:      return 20;
+        case op_fadd:
+        case op_fsubtract:   return 3;
+        case op_fmultiply:   return 4;
+        case op_fdivide:     return 12;
+        case op_load_global: return 4;
+        default:             return 1;
+    }
+}
+
+// Instructions that stay where they are: jumps, calls, returns, input and
+// output, and clears, which write many registers
+static bool isBarrier(int op) {
+    return is_jump(op) || op == op_call || op == op_return || op == op_return_none ||
+           op == op_clear || op == op_read || op == op_write;
+}
+
+// Orders the instructions from first to end, none of them a barrier, by
+// list scheduling. Each instruction depends on the last one before it that
+// wrote a register it reads or writes, and on the ones that read a register
+// it writes since that was last written; the same for globals, loads and
+// stores. A region has at most 64 instructions, so the dependences are bit
+// sets.
+void PeepholeOptimizer::scheduleRegion(const Module &module, Function &function, size_t first,
+                                       size_t end) {
+    int n = (int)(end - first);
+    if (n < 2)
+        return;
+    Instruction region[64];
+    uint64_t before[64] = {}, after[64] = {};
+    for (int j = 0; j < n; j++) {
+        const Instruction &in = function.code[first + j];
+        region[j] = in;
+        uint64_t &depends = before[j];
+        for_each_use(module, in, [&](int reg) {
+            if (writer[reg] >= 0)
+                depends |= 1ull << writer[reg];
+        });
+        if (in.op == op_load_global && storer[in.b] >= 0)
+            depends |= 1ull << storer[in.b];
+        for_each_def(in, [&](int reg) {
+            if (writer[reg] >= 0)
+                depends |= 1ull << writer[reg];
+            depends |= readers[reg];
+        });
+        if (in.op == op_store_global) {
+            if (storer[in.a] >= 0)
+                depends |= 1ull << storer[in.a];
+            depends |= loaders[in.a];
+        }
+
+        for_each_use(module, in, [&](int reg) { readers[reg] |= 1ull << j; });
+        for_each_def(in, [&](int reg) {
+            writer[reg] = j;
+            readers[reg] = 0;
+        });
+        if (in.op == op_load_global)
+            loaders[in.b] |= 1ull << j;
+        if (in.op == op_store_global) {
+            storer[in.a] = j;
+            loaders[in.a] = 0;
+        }
+        for (uint64_t bits = depends; bits != 0; bits &= bits - 1)
+            after[__builtin_ctzll(bits)] |= 1ull << j;
+    }
+    // Clean for the next region
+    for (int j = 0; j < n; j++) {
+        auto reset = [&](int reg) {
+            writer[reg] = -1;
+            readers[reg] = 0;
+        };
+        for_each_use(module, region[j], reset);
+        for_each_def(region[j], reset);
+        if (region[j].op == op_load_global || region[j].op == op_store_global) {
+            int global = region[j].op == op_load_global ? region[j].b : region[j].a;
+            storer[global] = -1;
+            loaders[global] = 0;
+        }
+    }
+
+    // The height of an instruction is the longest chain of latencies from
+    // it to the end of the region
+    int height[64], waiting[64], ready[64];
+    uint64_t unblocked = 0;             // waiting for no instruction
+    for (int j = n - 1; j >= 0; j--) {
+        int tallest = 0;
+        for (uint64_t bits = after[j]; bits != 0; bits &= bits - 1)
+            tallest = std::max(tallest, height[__builtin_ctzll(bits)]);
+        height[j] = latency(region[j].op) + tallest;
+        waiting[j] = __builtin_popcountll(before[j]);
+        ready[j] = 0;
+        if (waiting[j] == 0)
+            unblocked |= 1ull << j;
+    }
+
+    // Each cycle, issue the ready instruction with the greatest height, or
+    // skip ahead to the cycle the first one is ready
+    for (int count = 0, cycle = 0; count < n; cycle++) {
+        int best = -1, next = INT_MAX;
+        for (uint64_t bits = unblocked; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            if (ready[i] > cycle)
+                next = std::min(next, ready[i]);
+            else if (best < 0 || height[i] > height[best])
+                best = i;
+        }
+        if (best < 0) {
+            cycle = next - 1;
+            continue;
+        }
+        unblocked &= ~(1ull << best);
+        int done = cycle + latency(region[best].op);
+        for (uint64_t bits = after[best]; bits != 0; bits &= bits - 1) {
+            int k = __builtin_ctzll(bits);
+            ready[k] = std::max(ready[k], done);
+            if (--waiting[k] == 0)
+                unblocked |= 1ull << k;
+        }
+        if (count != best)
+            instructionsMoved++;
+        function.code[first + count++] = region[best];
+    }
+}
+
+void PeepholeOptimizer::schedule(const Module &module, Function &function) {
+    std::vector<Instruction> &code = function.code;
+    targets.assign(code.size() + 1, false);
+    for (const Instruction &in : code) {
+        if (is_jump(in.op))
+            targets[in.a] = true;
+    }
+    writer.assign(function.registers, -1);
+    readers.assign(function.registers, 0);
+    storer.assign(module.globals, -1);
+    loaders.assign(module.globals, 0);
+    // Regions are kept short, as scheduling one takes quadratic time
+    const size_t MAX_REGION = 64;
+    size_t first = 0;
+    for (size_t i = 0; i <= code.size(); i++) {
+        bool ends = i == code.size() || isBarrier(code[i].op) || targets[i] ||
+                    i - first == MAX_REGION;
+        if (!ends)
+            continue;
+        scheduleRegion(module, function, first, i);
+        first = i < code.size() && isBarrier(code[i].op) ? i + 1 : i;
+    }
+}
+
+void PeepholeOptimizer::schedule(Module &module) {
+    PhaseTimer timer(phase_optimize);
+    for (Function &function : module.functions) schedule(module, function);
+}
+
+void PeepholeOptimizer::report(FILE *fp) const {
+    fprintf(fp, "%-20s %10s %10s\n", "pattern", "applied", "removed");
+    for (int p = 0; p < NUM_PATTERNS; p++)
+        fprintf(fp, "%-20s %10ld %10ld\n", patterns[p].name, counts[p].applied, counts[p].removed);
+    fprintf(fp, "%-20s %10ld -> %ld\n", "instructions", instructionsBefore, instructionsAfter);
+    fprintf(fp, "%-20s %10ld\n", "moved by schedule", instructionsMoved);
+}
@@ -0,0 +1,825 @@
+#include "../include/RewritingInterpreter.h"
+#include "../include/BackgroundCompiler.h"
+#include "../include/Operators.h"
+#include "../include/stats.h"
+#include <type_traits>
+
+// A node of the executing tree. What it does is its handler; the fields
+// are whatever that handler needs, filled in when the node specialized.
+// An expression's handler returns its value, a statement's whether it
+// executed a return, in .b.
+struct RewriteNode {
+    typedef Value (*Handler)(RewriteNode *node, Value *frame);
+
+    Handler execute;
+    AST *ast;
+    RewritingInterpreter *owner;
+    Runtime *runtime;
+    RewriteNode *kids[3];   // operands or predicate, then arms or body
+    RewriteNode **list;     // a block's statements or a call's arguments
+    int count;
+    int operand[2];         // an integer operand's slot or value
+    Value *global[2];       // or its global
+    int slot;               // the variable read or written, if a local
+    Value *target;          // or if a global
+    Value constant;         // a literal's value
+    RewritingInterpreter::Routine *routine;     // a call's
+    RewritingInterpreter::Routine *within;      // the routine the node is in
+    long trips;             // back edges a loop took
+
+    Value run(Value *frame) { return execute(this, frame); }
+    bool returns(Value *frame) { return execute(this, frame).b; }
+
+    static Value uninitialized(RewriteNode *node, Value *frame);
+    static bool entered(RewritingInterpreter::Routine *routine, Value *frame);
+    static void loopedBack(RewriteNode *loop, long trips);
+    static Value ifFirst(RewriteNode *node, Value *frame);
+    static Value ifThen(RewriteNode *node, Value *frame);
+    static Value ifElse(RewriteNode *node, Value *frame);
+};
+
+typedef RewriteNode::Handler Handler;
+
+static Value valueOf(int i) {
+    Value value = Value();
+    value.i = i;
+    return value;
+}
+static Value valueOf(float f) {
+    Value value = Value();
+    value.f = f;
+    return value;
+}
+static Value valueOf(bool b) {
+    Value value = Value();
+    value.b = b;
+    return value;
+}
+
+// What a statement returns
+static const Value completed = Value();
+static Value returned() { return valueOf(true); }
+
+// Operands of an integer operator, on the left (Side 0) or the right
+template <int Side> struct FromLocal {
+    static int read(RewriteNode *node, Value *frame) { return frame[node->operand[Side]].i; }
+};
+template <int Side> struct FromGlobal {
+    static int read(RewriteNode *node, Value *) { return node->global[Side]->i; }
+};
+template <int Side> struct FromLiteral {
+    static int read(RewriteNode *node, Value *) { return node->operand[Side]; }
+};
+template <int Side> struct FromNode {
+    static int read(RewriteNode *node, Value *frame) { return node->kids[Side]->run(frame).i; }
+};
+
+// Instantiates Make::handler for the kinds of the operands
+template <typename Make, typename Left>
+static Handler withRight(OperandKind right) {
+    switch (right) {
+        case operand_local:   return Make::template handler<Left, FromLocal<1>>;
+        case operand_global:  return Make::template handler<Left, FromGlobal<1>>;
+        case operand_literal: return Make::template handler<Left, FromLiteral<1>>;
+        default:              return Make::template handler<Left, FromNode<1>>;
+    }
+}
+
+template <typename Make>
+static Handler forOperands(OperandKind left, OperandKind right) {
+    switch (left) {
+        case operand_local:   return withRight<Make, FromLocal<0>>(right);
+        case operand_global:  return withRight<Make, FromGlobal<0>>(right);
+        case operand_literal: return withRight<Make, FromLiteral<0>>(right);
+        default:              return withRight<Make, FromNode<0>>(right);
+    }
+}
+
+// ... and for the operator, if it is one Make is made for
+template <template <typename> class Make>
+static Handler forArithmetic(int op, OperandKind left, OperandKind right) {
+    switch (op) {
+        case ast_times:  return forOperands<Make<Multiply>>(left, right);
+        case ast_divide: return forOperands<Make<Divide>>(left, right);
+        case ast_plus:   return forOperands<Make<Add>>(left, right);
+        case ast_minus:  return forOperands<Make<Subtract>>(left, right);
+        default:         return nullptr;
+    }
+}
+
+template <template <typename> class Make>
+static Handler forComparison(int op, OperandKind left, OperandKind right) {
+    switch (op) {
+        case ast_eq:  return forOperands<Make<Equal>>(left, right);
+        case ast_neq: return forOperands<Make<NotEqual>>(left, right);
+        case ast_lt:  return forOperands<Make<Less>>(left, right);
+        case ast_le:  return forOperands<Make<LessEqual>>(left, right);
+        case ast_gt:  return forOperands<Make<Greater>>(left, right);
+        case ast_ge:  return forOperands<Make<GreaterEqual>>(left, right);
+        default:      return nullptr;
+    }
+}
+
+// An integer operator. Its left operand is read first, as the right one
+// can be a call that changes it.
+template <typename Op> struct Arithmetic {
+    template <typename L, typename R>
+    static Value handler(RewriteNode *node, Value *frame) {
+        int left = L::read(node, frame);
+        return valueOf(Op()(left, R::read(node, frame)));
+    }
+};
+
+// x := l op r on a local x of integer type
+template <typename Op> struct StoreArithmetic {
+    template <typename L, typename R>
+    static Value handler(RewriteNode *node, Value *frame) {
+        int left = L::read(node, frame);
+        frame[node->slot].i = Op()(left, R::read(node, frame));
+        return completed;
+    }
+};
+
+// A while loop whose predicate is an integer comparison, tested in place
+template <typename Op> struct WhileCompare {
+    template <typename L, typename R>
+    static Value handler(RewriteNode *node, Value *frame) {
+        RewriteNode *body = node->kids[2];
+        long trips = 0;
+        for (;;) {
+            int left = L::read(node, frame);
+            if (!Op()(left, R::read(node, frame)))
+                break;
+            if (body->returns(frame)) {
+                RewriteNode::loopedBack(node, trips);
+                return returned();
+            }
+            trips++;
+        }
+        RewriteNode::loopedBack(node, trips);
+        return completed;
+    }
+};
+
+// Operators on other types, on values their operands' nodes compute
+template <typename T, typename Op>
+static Value combine(RewriteNode *node, Value *frame) {
+    Value left = node->kids[0]->run(frame);
+    Value right = node->kids[1]->run(frame);
+    return valueOf(Op()(Member<T>::of(left), Member<T>::of(right)));
+}
+
+template <typename T>
+static Handler combineFor(int op) {
+    switch (op) {
+        case ast_eq:  return combine<T, Equal>;
+        case ast_neq: return combine<T, NotEqual>;
+        default:      break;
+    }
+    if constexpr (std::is_same<T, float>::value) {
+        switch (op) {
+            case ast_times:  return combine<T, Multiply>;
+            case ast_divide: return combine<T, Divide>;
+            case ast_plus:   return combine<T, Add>;
+            case ast_minus:  return combine<T, Subtract>;
+            case ast_lt:     return combine<T, Less>;
+            case ast_le:     return combine<T, LessEqual>;
+            case ast_gt:     return combine<T, Greater>;
+            case ast_ge:     return combine<T, GreaterEqual>;
+            default:         break;
+        }
+    }
+    return nullptr;
+}
+
+static Value literal(RewriteNode *node, Value *) {
+    return node->constant;
+}
+
+static Value negateInteger(RewriteNode *node, Value *frame) {
+    return valueOf(Runtime::negate(node->kids[0]->run(frame).i));
+}
+
+static Value negateFloat(RewriteNode *node, Value *frame) {
+    return valueOf(-node->kids[0]->run(frame).f);
+}
+
+static Value integerToFloat(RewriteNode *node, Value *frame) {
+    return valueOf((float)node->kids[0]->run(frame).i);
+}
+
+static Value logicalNot(RewriteNode *node, Value *frame) {
+    return valueOf(!node->kids[0]->run(frame).b);
+}
+
+static Value logicalAnd(RewriteNode *node, Value *frame) {
+    return valueOf(node->kids[0]->run(frame).b && node->kids[1]->run(frame).b);
+}
+
+static Value logicalOr(RewriteNode *node, Value *frame) {
+    return valueOf(node->kids[0]->run(frame).b || node->kids[1]->run(frame).b);
+}
+
+// Pushes the callee's frame, evaluates the arguments in the caller's frame
+// into it, and runs the body
+static Value call(RewriteNode *node, Value *frame) {
+    Runtime *runtime = node->runtime;
+    Value *callee = runtime->pushFrame(node->routine->slots);
+    for (int i = 0; i < node->count; i++)
+        callee[i] = node->list[i]->run(frame);
+    if (!RewriteNode::entered(node->routine, callee))
+        runtime->result = Value();
+    runtime->popFrame(callee);
+    return runtime->result;
+}
+
+// The variable a node reads or stores into
+struct LocalVar {
+    static Value &at(RewriteNode *node, Value *frame) { return frame[node->slot]; }
+};
+struct GlobalVar {
+    static Value &at(RewriteNode *node, Value *) { return *node->target; }
+};
+
+template <typename Var>
+static Value load(RewriteNode *node, Value *frame) {
+    return Var::at(node, frame);
+}
+
+// Whole values to store, of any type
+struct ValueLocal {
+    static Value read(RewriteNode *node, Value *frame) { return frame[node->operand[0]]; }
+};
+struct ValueGlobal {
+    static Value read(RewriteNode *node, Value *) { return *node->global[0]; }
+};
+struct ValueLiteral {
+    static Value read(RewriteNode *node, Value *) { return node->constant; }
+};
+struct ValueNode {
+    static Value read(RewriteNode *node, Value *frame) { return node->kids[0]->run(frame); }
+};
+
+template <typename Var, typename Source>
+static Value store(RewriteNode *node, Value *frame) {
+    Var::at(node, frame) = Source::read(node, frame);
+    return completed;
+}
+
+template <typename Var>
+static Value readVariable(RewriteNode *node, Value *frame) {
+    node->runtime->read(Var::at(node, frame), node->ast->f.a_read.var->VarType);
+    return completed;
+}
+
+template <typename Var>
+static Value writeVariable(RewriteNode *node, Value *frame) {
+    node->runtime->write(Var::at(node, frame), node->ast->f.a_write.var->VarType);
+    return completed;
+}
+
+// Loops count the back edges they take, but only when they finish, so
+// counting costs nothing per iteration; a routine is promoted at its next
+// call anyway
+static Value whileLoop(RewriteNode *node, Value *frame) {
+    long trips = 0;
+    while (node->kids[0]->run(frame).b) {
+        if (node->kids[2]->returns(frame)) {
+            RewriteNode::loopedBack(node, trips);
+            return returned();
+        }
+        trips++;
+    }
+    RewriteNode::loopedBack(node, trips);
+    return completed;
+}
+
+template <typename Var>
+static Value forLoop(RewriteNode *node, Value *frame) {
+    // The bounds are evaluated once; the body may change the variable
+    int &i = Var::at(node, frame).i;
+    int first = node->kids[0]->run(frame).i;
+    int last = node->kids[1]->run(frame).i;
+    i = first;
+    if (first > last)
+        return completed;
+    RewriteNode *body = node->kids[2];
+    for (long trips = 0;; trips++) {
+        if (body->returns(frame)) {
+            RewriteNode::loopedBack(node, trips);
+            return returned();
+        }
+        if (i >= last) {
+            RewriteNode::loopedBack(node, trips);
+            return completed;
+        }
+        i++;
+    }
+}
+
+// An if that has deoptimized: either arm may run
+static Value ifBoth(RewriteNode *node, Value *frame) {
+    RewriteNode *arm = node->kids[0]->run(frame).b ? node->kids[1] : node->kids[2];
+    return arm ? arm->run(frame) : completed;
+}
+
+static Value sequence(RewriteNode *node, Value *frame) {
+    for (int i = 0; i < node->count; i++) {
+        if (node->list[i]->returns(frame))
+            return returned();
+    }
+    return completed;
+}
+
+// A block with variables clears them first; layout_frames gave them
+// consecutive slots
+static Value block(RewriteNode *node, Value *frame) {
+    for (int i = 0; i < node->operand[1]; i++) frame[node->operand[0] + i] = Value();
+    return sequence(node, frame);
+}
+
+// A top-level block, which runs in a frame of its own
+static Value topLevel(RewriteNode *node, Value *) {
+    Value *frame = node->runtime->pushFrame(node->count);
+    node->kids[0]->run(frame);
+    node->runtime->popFrame(frame);
+    return completed;
+}
+
+static Value returnValue(RewriteNode *node, Value *frame) {
+    node->runtime->result = node->kids[0]->run(frame);
+    return returned();
+}
+
+static Value nothing(RewriteNode *, Value *) {
+    return completed;
+}
+
+// Every node's first handler: specializes the node, then runs it as it
+// now is
+Value RewriteNode::uninitialized(RewriteNode *node, Value *frame) {
+    node->owner->rewriteCount++;
+    stats_count(count_rewrites);
+    node->owner->specialize(node);
+    return node->run(frame);
+}
+
+// Runs a routine's body in its frame: the compiled code, if the routine has
+// been promoted and compiled, and otherwise its nodes. Returns whether the
+// body executed a return.
+bool RewriteNode::entered(RewritingInterpreter::Routine *routine, Value *frame) {
+    const Code<bool> *code = routine->compiled.load(std::memory_order_acquire);
+    if (code != nullptr)
+        return (*code)(frame);
+    routine->calls++;
+    routine->body->owner->heat(routine);
+    return routine->body->returns(frame);
+}
+
+void RewriteNode::loopedBack(RewriteNode *loop, long trips) {
+    loop->trips += trips;
+    if (loop->within != nullptr) {
+        loop->within->backEdges += trips;
+        loop->owner->heat(loop->within);
+    }
+}
+
+// The first time an if runs, it commits to the arm it takes; the other
+// is not made unless it is needed
+Value RewriteNode::ifFirst(RewriteNode *node, Value *frame) {
+    bool taken = node->kids[0]->run(frame).b;
+    node->owner->commit(node, taken);
+    RewriteNode *arm = taken ? node->kids[1] : node->kids[2];
+    return arm ? arm->run(frame) : completed;
+}
+
+Value RewriteNode::ifThen(RewriteNode *node, Value *frame) {
+    if (node->kids[0]->run(frame).b)
+        return node->kids[1]->run(frame);
+    node->owner->deoptimize(node);
+    return node->kids[2] ? node->kids[2]->run(frame) : completed;
+}
+
+Value RewriteNode::ifElse(RewriteNode *node, Value *frame) {
+    if (!node->kids[0]->run(frame).b)
+        return node->kids[2] ? node->kids[2]->run(frame) : completed;
+    node->owner->deoptimize(node);
+    return node->kids[1]->run(frame);
+}
+
+RewritingInterpreter::RewritingInterpreter(Runtime &runtime, long threshold)
+    : runtime(runtime), threshold(threshold), program(nullptr), root(nullptr), globals(nullptr),
+      globalSlots(0), rewriteCount(0), deoptCount(0), promotionCount(0) {}
+
+RewritingInterpreter::~RewritingInterpreter() {}
+
+// A node for ast, in the routine its parent is in
+RewriteNode *RewritingInterpreter::child(RewriteNode *parent, AST *ast) {
+    if (ast == nullptr)
+        return nullptr;
+    RewriteNode *node = arena.allocateArray<RewriteNode>(1);
+    node->execute = RewriteNode::uninitialized;
+    node->ast = ast;
+    node->owner = this;
+    node->runtime = &runtime;
+    node->within = parent ? parent->within : nullptr;
+    return node;
+}
+
+Value *RewritingInterpreter::globalOf(STEntry *var) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    return &globals[var->Slot];
+}
+
+// Where a node finds an integer operand
+void RewritingInterpreter::operand(RewriteNode *node, int side, AST *ast) {
+    switch (kindOf(ast)) {
+        case operand_local:
+            node->operand[side] = ast->f.a_var.var->Slot;
+            break;
+        case operand_global:
+            node->global[side] = globalOf(ast->f.a_var.var);
+            break;
+        case operand_literal:
+            node->operand[side] = ast->f.a_integer.value;
+            break;
+        default:
+            node->kids[side] = child(node, ast);
+            break;
+    }
+}
+
+// Points the node at var; returns whether it is a global
+bool RewritingInterpreter::variable(RewriteNode *node, STEntry *var) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    if (var->Depth == 0) {
+        node->target = &globals[var->Slot];
+        return true;
+    }
+    node->slot = var->Slot;
+    return false;
+}
+
+static bool isLiteral(AST *ast) {
+    return ast->type == ast_integer || ast->type == ast_float || ast->type == ast_boolean ||
+           ast->type == ast_string;
+}
+
+static Value literalOf(AST *ast) {
+    switch (ast->type) {
+        case ast_integer: return valueOf(ast->f.a_integer.value);
+        case ast_float:   return valueOf(ast->f.a_float.value);
+        case ast_boolean: return valueOf(ast->f.a_boolean.value != 0);
+        default: {
+            Value value = Value();
+            value.s = ast->f.a_string.string;
+            return value;
+        }
+    }
+}
+
+void RewritingInterpreter::specialize(RewriteNode *node) {
+    AST *ast = node->ast;
+    switch (ast->type) {
+        case ast_integer:
+        case ast_float:
+        case ast_boolean:
+        case ast_string:
+            node->constant = literalOf(ast);
+            node->execute = literal;
+            return;
+
+        case ast_var:
+            node->execute = variable(node, ast->f.a_var.var) ? load<GlobalVar> : load<LocalVar>;
+            return;
+
+        case ast_call: {
+            auto routine = routines.find(ast->f.a_call.callee);
+            if (routine == routines.end())
+                Runtime::fail("call of an unknown routine");
+            node->routine = routine->second;
+            for (ast_list *arg = ast->f.a_call.arg_list; arg; arg = arg->tail) node->count++;
+            node->list = arena.allocateArray<RewriteNode *>(node->count);
+            int index = 0;
+            for (ast_list *arg = ast->f.a_call.arg_list; arg; arg = arg->tail)
+                node->list[index++] = child(node, arg->head);
+            node->execute = call;
+            return;
+        }
+
+        case ast_itof:
+            node->kids[0] = child(node, ast->f.a_itof.arg);
+            node->execute = integerToFloat;
+            return;
+
+        case ast_not:
+            node->kids[0] = child(node, ast->f.a_unary_op.arg);
+            node->execute = logicalNot;
+            return;
+
+        case ast_uminus:
+            node->kids[0] = child(node, ast->f.a_unary_op.arg);
+            node->execute = ast->f.a_unary_op.type == type_float ? negateFloat : negateInteger;
+            return;
+
+        case ast_and:
+        case ast_cand:
+        case ast_or:
+        case ast_cor:
+            node->kids[0] = child(node, ast->f.a_binary_op.larg);
+            node->kids[1] = child(node, ast->f.a_binary_op.rarg);
+            node->execute = ast->type == ast_and || ast->type == ast_cand ? logicalAnd : logicalOr;
+            return;
+
+        case ast_times:
+        case ast_divide:
+        case ast_plus:
+        case ast_minus:
+        case ast_eq:
+        case ast_neq:
+        case ast_lt:
+        case ast_le:
+        case ast_gt:
+        case ast_ge:
+            specializeBinary(node);
+            return;
+
+        default:
+            specializeStatement(node);
+            return;
+    }
+}
+
+// An integer operator reads its operands in place if they are variables
+// or literals; other operators compute both operands with their nodes
+void RewritingInterpreter::specializeBinary(RewriteNode *node) {
+    AST *ast = node->ast;
+    AST *left = ast->f.a_binary_op.larg;
+    AST *right = ast->f.a_binary_op.rarg;
+    Handler handler = nullptr;
+    switch (ast->f.a_binary_op.rel_type) {
+        case type_integer:
+            operand(node, 0, left);
+            operand(node, 1, right);
+            handler = forArithmetic<Arithmetic>(ast->type, kindOf(left), kindOf(right));
+            if (handler == nullptr)
+                handler = forComparison<Arithmetic>(ast->type, kindOf(left), kindOf(right));
+            break;
+        case type_float:
+            handler = combineFor<float>(ast->type);
+            break;
+        case type_boolean:
+            handler = combineFor<bool>(ast->type);
+            break;
+        case type_string:
+            handler = combineFor<const char *>(ast->type);
+            break;
+        default:
+            Runtime::fail("operands without a type");
+    }
+    if (handler == nullptr)
+        Runtime::fail("unknown operator");
+    if (ast->f.a_binary_op.rel_type != type_integer) {
+        node->kids[0] = child(node, left);
+        node->kids[1] = child(node, right);
+    }
+    node->execute = handler;
+}
+
+// var := rhs, or a constant's declaration
+void RewritingInterpreter::specializeStore(RewriteNode *node, STEntry *var, AST *rhs) {
+    bool global = variable(node, var);
+    bool arithmetic = rhs->type == ast_times || rhs->type == ast_divide ||
+                      rhs->type == ast_plus || rhs->type == ast_minus;
+    if (!global && arithmetic && rhs->f.a_binary_op.rel_type == type_integer) {
+        AST *left = rhs->f.a_binary_op.larg;
+        AST *right = rhs->f.a_binary_op.rarg;
+        operand(node, 0, left);
+        operand(node, 1, right);
+        node->execute = forArithmetic<StoreArithmetic>(rhs->type, kindOf(left), kindOf(right));
+        return;
+    }
+
+    if (rhs->type == ast_var && rhs->f.a_var.var->Depth > 0) {
+        node->operand[0] = rhs->f.a_var.var->Slot;
+        node->execute = global ? store<GlobalVar, ValueLocal> : store<LocalVar, ValueLocal>;
+    } else if (rhs->type == ast_var) {
+        node->global[0] = globalOf(rhs->f.a_var.var);
+        node->execute = global ? store<GlobalVar, ValueGlobal> : store<LocalVar, ValueGlobal>;
+    } else if (isLiteral(rhs)) {
+        node->constant = literalOf(rhs);
+        node->execute = global ? store<GlobalVar, ValueLiteral> : store<LocalVar, ValueLiteral>;
+    } else {
+        node->kids[0] = child(node, rhs);
+        node->execute = global ? store<GlobalVar, ValueNode> : store<LocalVar, ValueNode>;
+    }
+}
+
+void RewritingInterpreter::specializeStatement(RewriteNode *node) {
+    AST *ast = node->ast;
+    switch (ast->type) {
+        case ast_assign:
+            specializeStore(node, ast->f.a_assign.lhs, ast->f.a_assign.rhs);
+            return;
+
+        case ast_const_decl:
+            specializeStore(node, ast->f.a_const_decl.name, ast->f.a_const_decl.value);
+            return;
+
+        case ast_if:
+            node->kids[0] = child(node, ast->f.a_if.predicate);
+            node->execute = RewriteNode::ifFirst;
+            return;
+
+        case ast_while: {
+            AST *predicate = ast->f.a_while.predicate;
+            node->kids[2] = child(node, ast->f.a_while.body);
+            if (predicate->type >= ast_eq && predicate->type <= ast_ge &&
+                predicate->f.a_binary_op.rel_type == type_integer) {
+                AST *left = predicate->f.a_binary_op.larg;
+                AST *right = predicate->f.a_binary_op.rarg;
+                operand(node, 0, left);
+                operand(node, 1, right);
+                node->execute = forComparison<WhileCompare>(predicate->type, kindOf(left),
+                                                            kindOf(right));
+                return;
+            }
+            node->kids[0] = child(node, predicate);
+            node->execute = whileLoop;
+            return;
+        }
+
+        case ast_for:
+            node->kids[0] = child(node, ast->f.a_for.lower_bound);
+            node->kids[1] = child(node, ast->f.a_for.upper_bound);
+            node->kids[2] = child(node, ast->f.a_for.body);
+            node->execute = variable(node, ast->f.a_for.var) ? forLoop<GlobalVar> : forLoop<LocalVar>;
+            return;
+
+        case ast_read:
+            node->execute = variable(node, ast->f.a_read.var) ? readVariable<GlobalVar>
+                                                              : readVariable<LocalVar>;
+            return;
+
+        case ast_write:
+            node->execute = variable(node, ast->f.a_write.var) ? writeVariable<GlobalVar>
+                                                               : writeVariable<LocalVar>;
+            return;
+
+        case ast_block: {
+            int first = -1, vars = 0;
+            for (ste_list *var = ast->f.a_block.vars; var; var = var->tail) {
+                if (var->head == nullptr)
+                    continue;
+                if (first < 0)
+                    first = var->head->Slot;
+                vars++;
+            }
+            for (ast_list *s = ast->f.a_block.stmts; s; s = s->tail) node->count++;
+
+            // A block of one statement becomes the statement
+            if (node->count == 1 && vars == 0) {
+                node->ast = ast->f.a_block.stmts->head;
+                node->count = 0;
+                specialize(node);
+                return;
+            }
+            node->list = arena.allocateArray<RewriteNode *>(node->count);
+            int index = 0;
+            for (ast_list *s = ast->f.a_block.stmts; s; s = s->tail)
+                node->list[index++] = child(node, s->head);
+            node->operand[0] = first;
+            node->operand[1] = vars;
+            node->execute = node->count == 0 ? nothing : vars == 0 ? sequence : block;
+            return;
+        }
+
+        case ast_return:
+            node->kids[0] = child(node, ast->f.a_return.expr);
+            node->execute = returnValue;
+            return;
+
+        case ast_program: {
+            // Constants and top-level blocks, in order
+            for (ast_list *d = ast->f.a_program.statements; d; d = d->tail) {
+                if (d->head->type == ast_const_decl || d->head->type == ast_block)
+                    node->count++;
+            }
+            node->list = arena.allocateArray<RewriteNode *>(node->count);
+            int index = 0;
+            for (ast_list *d = ast->f.a_program.statements; d; d = d->tail) {
+                AST *decl = d->head;
+                if (decl->type == ast_const_decl) {
+                    node->list[index++] = child(node, decl);
+                } else if (decl->type == ast_block) {
+                    RewriteNode *step = child(node, decl);
+                    step->kids[0] = child(step, decl);
+                    step->count = decl->f.a_block.frame_slots;
+                    step->execute = topLevel;
+                    node->list[index++] = step;
+                }
+            }
+            node->execute = sequence;
+            return;
+        }
+
+        default:
+            Runtime::fail("unknown statement");
+    }
+}
+
+// A routine that has been called and gone round its loops often enough is
+// compiled in the background. The compiler's thread starts with the first
+// promotion, so a short run doesn't wait for it.
+void RewritingInterpreter::heat(Routine *routine) {
+    if (threshold <= 0 || routine->requested || routine->calls + routine->backEdges < threshold)
+        return;
+    if (compiler == nullptr)
+        compiler.reset(new BackgroundCompiler(runtime, program, globals));
+    routine->requested = true;
+    promotionCount++;
+    stats_count(count_promotions);
+    compiler->request(routine->name, &routine->compiled);
+}
+
+void RewritingInterpreter::commit(RewriteNode *node, bool taken) {
+    rewriteCount++;
+    stats_count(count_rewrites);
+    if (taken)
+        node->kids[1] = child(node, node->ast->f.a_if.conseq);
+    else
+        node->kids[2] = child(node, node->ast->f.a_if.altern);
+    node->execute = taken ? RewriteNode::ifThen : RewriteNode::ifElse;
+}
+
+// An if took the arm it had not: it makes that arm too, and from now on
+// tests which to take
+void RewritingInterpreter::deoptimize(RewriteNode *node) {
+    deoptCount++;
+    stats_count(count_deopts);
+    if (node->kids[1] == nullptr)
+        node->kids[1] = child(node, node->ast->f.a_if.conseq);
+    if (node->kids[2] == nullptr)
+        node->kids[2] = child(node, node->ast->f.a_if.altern);
+    node->execute = ifBoth;
+}
+
+// Makes the nodes for a program the interpreter has not run before. Every
+// routine's body exists before any node runs, so calls can refer to it.
+void RewritingInterpreter::prepare(AST *program) {
+    compiler.reset();   // its code uses the old nodes' globals
+    arena.clear();
+    routines.clear();
+    this->program = program;
+    globalSlots = program->f.a_program.frame_slots;
+    globals = arena.allocateArray<Value>(globalSlots);
+    for (ast_list *d = program->f.a_program.statements; d; d = d->tail) {
+        AST *decl = d->head;
+        if (decl->type == ast_routine_decl) {
+            Routine *routine = arena.allocateArray<Routine>(1);
+            routine->name = decl->f.a_routine_decl.name;
+            routine->body = child(nullptr, decl->f.a_routine_decl.body);
+            routine->body->within = routine;
+            routine->slots = decl->f.a_routine_decl.body->f.a_block.frame_slots;
+            routines[decl->f.a_routine_decl.name] = routine;
+        }
+    }
+    root = child(nullptr, program);
+}
+
+void RewritingInterpreter::printProfile(FILE *fp) const {
+    if (program == nullptr)
+        return;
+    fprintf(fp, "%-24s %12s %12s  %s\n", "routine", "calls", "back edges", "tier");
+    for (ast_list *d = program->f.a_program.statements; d; d = d->tail) {
+        if (d->head->type != ast_routine_decl)
+            continue;
+        Routine *routine = routines.at(d->head->f.a_routine_decl.name);
+        const char *tier = routine->compiled.load() ? "compiled"
+                           : routine->requested     ? "compiling"
+                                                    : "interpreted";
+        fprintf(fp, "%-24s %12ld %12ld  %s\n", routine->name->Name, routine->calls,
+                routine->backEdges, tier);
+    }
+}
+
+int RewritingInterpreter::run(AST *program) {
+    PhaseTimer timer(phase_run);
+    runtime.reset();
+    if (program != this->program)
+        prepare(program);
+    for (int i = 0; i < globalSlots; i++) globals[i] = Value();
+    try {
+        root->run(nullptr);
+    } catch (RuntimeError &error) {
+        // A node may have failed halfway through specializing
+        this->program = nullptr;
+        runtime.flush();
+        fprintf(stderr, "Runtime Error: %s\n", error.message);
+        return 1;
+    }
+    runtime.flush();
+    return 0;
+}
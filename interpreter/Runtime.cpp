@@ -0,0 +1,91 @@
+#include "../include/Runtime.h"
+#include "../include/stats.h"
+#include <stdlib.h>
+
+Runtime::Runtime(FILE *input, FILE *output) : input(input), output(output) {
+    stack = (Value *)malloc(sizeof(Value) * STACK_SLOTS);
+    if (stack == nullptr) {
+        fprintf(stderr, "FATAL ERROR: Out of memory for the runtime stack\n");
+        exit(1);
+    }
+    stats_count(count_bytes_allocated, sizeof(Value) * STACK_SLOTS);
+    top = stack;
+    limit = stack + STACK_SLOTS;
+    depth = 0;
+    result = Value();
+}
+
+Runtime::~Runtime() {
+    reset();
+    free(stack);
+}
+
+void Runtime::reset() {
+    top = stack;
+    depth = 0;
+    result = Value();
+    for (char *s : strings) free(s);
+    strings.clear();
+}
+
+void Runtime::fail(const char *message) {
+    throw RuntimeError{message};
+}
+
+// Reads a word: the next run of characters that aren't white space
+static bool readWord(FILE *input, char *word, int size) {
+    char format[16];
+    snprintf(format, sizeof(format), "%%%ds", size - 1);
+    return fscanf(input, format, word) == 1;
+}
+
+void Runtime::read(Value &var, j_type type) {
+    char word[1024];
+    switch (type) {
+        case type_integer:
+            if (fscanf(input, "%d", &var.i) != 1)
+                fail("no integer to read");
+            break;
+        case type_float:
+            if (fscanf(input, "%f", &var.f) != 1)
+                fail("no number to read");
+            break;
+        case type_boolean:
+            if (!readWord(input, word, sizeof(word)))
+                fail("no boolean to read");
+            if (strcmp(word, "true") == 0 || strcmp(word, "1") == 0)
+                var.b = true;
+            else if (strcmp(word, "false") == 0 || strcmp(word, "0") == 0)
+                var.b = false;
+            else
+                fail("no boolean to read");
+            break;
+        case type_string:
+            if (!readWord(input, word, sizeof(word)))
+                fail("no string to read");
+            strings.push_back(strdup(word));
+            var.s = strings.back();
+            break;
+        default:
+            fail("cannot read a value without a type");
+    }
+}
+
+void Runtime::write(Value value, j_type type) {
+    switch (type) {
+        case type_integer:
+            fprintf(output, "%d\n", value.i);
+            break;
+        case type_float:
+            fprintf(output, "%g\n", value.f);
+            break;
+        case type_boolean:
+            fputs(value.b ? "true\n" : "false\n", output);
+            break;
+        case type_string:
+            fprintf(output, "%s\n", value.s ? value.s : "");
+            break;
+        default:
+            fail("cannot write a value without a type");
+    }
+}
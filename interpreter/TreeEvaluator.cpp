@@ -0,0 +1,227 @@
+#include "../include/TreeEvaluator.h"
+#include "../include/stats.h"
+
+Value &TreeEvaluator::variable(STEntry *var) {
+    if (var->Slot < 0)
+        Runtime::fail("variable without storage");
+    return var->Depth == 0 ? globals[var->Slot] : frame[var->Slot];
+}
+
+Value TreeEvaluator::eval(AST *expr) {
+    Value value = Value();
+    switch (expr->type) {
+        case ast_integer:
+            value.i = expr->f.a_integer.value;
+            break;
+        case ast_float:
+            value.f = expr->f.a_float.value;
+            break;
+        case ast_boolean:
+            value.b = expr->f.a_boolean.value != 0;
+            break;
+        case ast_string:
+            value.s = expr->f.a_string.string;
+            break;
+        case ast_var:
+            value = variable(expr->f.a_var.var);
+            break;
+        case ast_call:
+            value = call(expr);
+            break;
+        case ast_itof:
+            value.f = (float)eval(expr->f.a_itof.arg).i;
+            break;
+        case ast_not:
+            value.b = !eval(expr->f.a_unary_op.arg).b;
+            break;
+        case ast_uminus: {
+            Value arg = eval(expr->f.a_unary_op.arg);
+            if (expr->f.a_unary_op.type == type_float)
+                value.f = -arg.f;
+            else
+                value.i = Runtime::negate(arg.i);
+            break;
+        }
+        case ast_and:
+        case ast_cand:
+            value.b = eval(expr->f.a_binary_op.larg).b && eval(expr->f.a_binary_op.rarg).b;
+            break;
+        case ast_or:
+        case ast_cor:
+            value.b = eval(expr->f.a_binary_op.larg).b || eval(expr->f.a_binary_op.rarg).b;
+            break;
+        default:
+            value = binary(expr);
+            break;
+    }
+    return value;
+}
+
+// Arithmetic and comparisons, on operands of the type the type pass chose
+Value TreeEvaluator::binary(AST *node) {
+    Value left = eval(node->f.a_binary_op.larg);
+    Value right = eval(node->f.a_binary_op.rarg);
+    Value value = Value();
+    switch (node->f.a_binary_op.rel_type) {
+        case type_integer:
+            switch (node->type) {
+                case ast_times:  value.i = Runtime::multiply(left.i, right.i); break;
+                case ast_divide: value.i = Runtime::divide(left.i, right.i); break;
+                case ast_plus:   value.i = Runtime::add(left.i, right.i); break;
+                case ast_minus:  value.i = Runtime::subtract(left.i, right.i); break;
+                case ast_eq:     value.b = left.i == right.i; break;
+                case ast_neq:    value.b = left.i != right.i; break;
+                case ast_lt:     value.b = left.i < right.i; break;
+                case ast_le:     value.b = left.i <= right.i; break;
+                case ast_gt:     value.b = left.i > right.i; break;
+                case ast_ge:     value.b = left.i >= right.i; break;
+                default:         Runtime::fail("unknown operator");
+            }
+            break;
+        case type_float:
+            switch (node->type) {
+                case ast_times:  value.f = left.f * right.f; break;
+                case ast_divide: value.f = left.f / right.f; break;
+                case ast_plus:   value.f = left.f + right.f; break;
+                case ast_minus:  value.f = left.f - right.f; break;
+                case ast_eq:     value.b = left.f == right.f; break;
+                case ast_neq:    value.b = left.f != right.f; break;
+                case ast_lt:     value.b = left.f < right.f; break;
+                case ast_le:     value.b = left.f <= right.f; break;
+                case ast_gt:     value.b = left.f > right.f; break;
+                case ast_ge:     value.b = left.f >= right.f; break;
+                default:         Runtime::fail("unknown operator");
+            }
+            break;
+        case type_boolean:
+            value.b = (left.b == right.b) == (node->type == ast_eq);
+            break;
+        case type_string:
+            value.b = Runtime::sameString(left.s, right.s) == (node->type == ast_eq);
+            break;
+        default:
+            Runtime::fail("operands without a type");
+    }
+    return value;
+}
+
+Value TreeEvaluator::call(AST *node) {
+    auto routine = routines.find(node->f.a_call.callee);
+    if (routine == routines.end())
+        Runtime::fail("call of an unknown routine");
+    AST *body = routine->second->f.a_routine_decl.body;
+
+    // The arguments are evaluated in the caller's frame, into the callee's
+    Value *callee = runtime.pushFrame(body->f.a_block.frame_slots);
+    int index = 0;
+    for (ast_list *arg = node->f.a_call.arg_list; arg; arg = arg->tail)
+        callee[index++] = eval(arg->head);
+
+    Value *caller = frame;
+    frame = callee;
+    if (!exec(body))
+        runtime.result = Value();
+    frame = caller;
+    runtime.popFrame(callee);
+    return runtime.result;
+}
+
+bool TreeEvaluator::exec(AST *stmt) {
+    switch (stmt->type) {
+        case ast_assign:
+            variable(stmt->f.a_assign.lhs) = eval(stmt->f.a_assign.rhs);
+            return false;
+
+        case ast_if:
+            if (eval(stmt->f.a_if.predicate).b)
+                return exec(stmt->f.a_if.conseq);
+            return stmt->f.a_if.altern != nullptr && exec(stmt->f.a_if.altern);
+
+        case ast_while:
+            while (eval(stmt->f.a_while.predicate).b) {
+                if (exec(stmt->f.a_while.body))
+                    return true;
+            }
+            return false;
+
+        case ast_for: {
+            // The bounds are evaluated once; the body may change the variable
+            Value &var = variable(stmt->f.a_for.var);
+            int lower = eval(stmt->f.a_for.lower_bound).i;
+            int upper = eval(stmt->f.a_for.upper_bound).i;
+            var.i = lower;
+            if (lower > upper)
+                return false;
+            for (;;) {
+                if (exec(stmt->f.a_for.body))
+                    return true;
+                if (var.i >= upper)
+                    return false;
+                var.i++;
+            }
+        }
+
+        case ast_read:
+            runtime.read(variable(stmt->f.a_read.var), stmt->f.a_read.var->VarType);
+            return false;
+
+        case ast_write:
+            runtime.write(variable(stmt->f.a_write.var), stmt->f.a_write.var->VarType);
+            return false;
+
+        case ast_call:
+            call(stmt);
+            return false;
+
+        case ast_block:
+            for (ste_list *var = stmt->f.a_block.vars; var; var = var->tail) {
+                if (var->head != nullptr)
+                    frame[var->head->Slot] = Value();
+            }
+            for (ast_list *s = stmt->f.a_block.stmts; s; s = s->tail) {
+                if (exec(s->head))
+                    return true;
+            }
+            return false;
+
+        case ast_return:
+            runtime.result = eval(stmt->f.a_return.expr);
+            return true;
+
+        default:
+            Runtime::fail("unknown statement");
+    }
+}
+
+int TreeEvaluator::run(AST *program) {
+    PhaseTimer timer(phase_run);
+    runtime.reset();
+    globals.assign(program->f.a_program.frame_slots, Value());
+    routines.clear();
+    ast_list *decls = program->f.a_program.statements;
+    for (ast_list *d = decls; d; d = d->tail) {
+        if (d->head->type == ast_routine_decl)
+            routines[d->head->f.a_routine_decl.name] = d->head;
+    }
+
+    try {
+        for (ast_list *d = decls; d; d = d->tail) {
+            AST *decl = d->head;
+            if (decl->type == ast_const_decl) {
+                variable(decl->f.a_const_decl.name) = eval(decl->f.a_const_decl.value);
+            } else if (decl->type == ast_block) {
+                frame = runtime.pushFrame(decl->f.a_block.frame_slots);
+                exec(decl);
+                runtime.popFrame(frame);
+                frame = nullptr;
+            }
+        }
+    } catch (RuntimeError &error) {
+        runtime.flush();
+        fprintf(stderr, "Runtime Error: %s\n", error.message);
+        frame = nullptr;
+        return 1;
+    }
+    runtime.flush();
+    return 0;
+}
@@ -0,0 +1,245 @@
+// Builds images of programs, writes them, maps them back, and checks that
+// each loaded image holds the module it was built from and runs as the
+// module does: small programs with strings, calls and input, and generated
+// programs. Then damages an image in each way the loader checks for (and
+// truncates it, and names a missing file) and checks that it is refused.
+// Usage: image_test [generated programs]   (run from interpreter/: the parser
+// writes ../tests/output)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include "../../include/BytecodeInterpreter.h"
+#include "../../include/ModuleImage.h"
+#include "../../tests/test_util.h"
+
+struct Case {
+    const char *name;
+    const char *source;
+    const char *input;
+};
+
+static const Case cases[] = {
+    {"recursion",
+     "program\n"
+     "function fib(n : integer) : integer\n"
+     "begin\n"
+     "    if n < 2 then return(n) fi;\n"
+     "    return(fib(n - 1) + fib(n - 2));\n"
+     "end;\n"
+     "begin var r : integer; r := fib(15); write(r); end;\n",
+     ""},
+
+    {"strings",
+     "program\n"
+     "var s : string;\n"
+     "procedure greet(t : string)\n"
+     "begin\n"
+     "    if t = \"hi\" then s := \"matched\" else s := t fi;\n"
+     "end;\n"
+     "begin\n"
+     "    var u : string;\n"
+     "    greet(\"hi\");\n"
+     "    write(s);\n"
+     "    read(u);\n"
+     "    greet(u);\n"
+     "    write(s);\n"
+     "    s := \"\";\n"
+     "    write(s);\n"
+     "end;\n",
+     "hello"},
+
+    {"blocks",
+     "program\n"
+     "var g : integer;\n"
+     "begin var r : integer; read(r); g := r * 2; write(g); end;\n"
+     "begin var r : integer; r := g / 0; write(r); end;\n",
+     "21"},
+};
+
+static int failures = 0;
+static std::string directory;
+
+static void report(const char *name, const char *what, bool ok) {
+    printf("%-22s %-24s %s\n", name, what, ok ? "ok" : "FAILED");
+    if (!ok)
+        failures++;
+}
+
+static bool sameModule(const Module &a, const Module &b) {
+    if (a.functions.size() != b.functions.size() || a.routines != b.routines ||
+        a.main != b.main || a.globals != b.globals || a.strings != b.strings)
+        return false;
+    for (size_t i = 0; i < a.functions.size(); i++) {
+        const Function &f = a.functions[i], &g = b.functions[i];
+        if (f.name != g.name || f.params != g.params || f.slots != g.slots ||
+            f.registers != g.registers || f.code.size() != g.code.size() ||
+            memcmp(f.code.data(), g.code.data(), f.code.size() * sizeof(Instruction)) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Runs run on input, returning its status and setting output
+static int capture(const char *input, std::string &output,
+                   const std::function<int(Runtime &)> &run) {
+    std::string in = directory + "/input";
+    FILE *file = fopen(in.c_str(), "w");
+    fprintf(file, "%s\n", input);
+    fclose(file);
+    FILE *inputFile = fopen(in.c_str(), "r");
+    FILE *outputFile = tmpfile();
+    Runtime runtime(inputFile, outputFile);
+    int status = run(runtime);
+    output = test_contents(outputFile);
+    fclose(inputFile);
+    fclose(outputFile);
+    return status;
+}
+
+static void checkSource(const char *name, const std::string &source, const char *input) {
+    Module module;
+    if (!test_compile(source, module)) {
+        report(name, "compiles", false);
+        return;
+    }
+
+    std::string fileName = directory + "/image";
+    ModuleImage written;
+    written.build(module);
+    ModuleImage loaded;
+    bool ok = written.write(fileName.c_str()) == 0 && loaded.load(fileName.c_str()) == 0;
+    report(name, "written and loaded", ok && loaded.mapped() && loaded.size() == written.size());
+    if (!ok)
+        return;
+    Module copy;
+    loaded.toModule(copy);
+    report(name, "holds the module", sameModule(module, copy));
+
+    std::string expected, output;
+    int expectedStatus = capture(input, expected, [&](Runtime &runtime) {
+        return BytecodeInterpreter(runtime).run(module);
+    });
+    int status = capture(input, output, [&](Runtime &runtime) {
+        return BytecodeInterpreter(runtime).run(loaded);
+    });
+    report(name, "runs as the module", status == expectedStatus && output == expected);
+}
+
+// Writes the image of a small program with a routine, a global and a string,
+// changed by damage, and checks that loading it fails, or, if it is whole,
+// works
+static void checkDamaged(const char *what, const std::function<void(std::string &)> &damage,
+                         bool whole = false) {
+    static const char *source =
+        "program\n"
+        "var g : integer;\n"
+        "function f(n : integer) : integer\n"
+        "begin if n < 0 then return(0) fi; return(n + 1); end;\n"
+        "begin var s : string; s := \"x\"; g := f(1); write(s); end;\n";
+    Module module;
+    if (!test_compile(source, module)) {
+        report("damaged", what, false);
+        return;
+    }
+    ModuleImage image;
+    image.build(module);
+    std::string bytes((const char *)&image.header(), image.size());
+    damage(bytes);
+    std::string fileName = directory + "/damaged";
+    FILE *file = fopen(fileName.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    ModuleImage loaded;
+    bool refused = loaded.load(fileName.c_str()) != 0;
+    report(whole ? "whole" : "damaged", what, refused != whole && loaded.mapped() == whole);
+}
+
+// The header and the records, to damage in place
+static ImageHeader &header(std::string &bytes) {
+    return *(ImageHeader *)&bytes[0];
+}
+
+static ImageFunction &record(std::string &bytes, int index) {
+    return ((ImageFunction *)&bytes[header(bytes).functionTable])[index];
+}
+
+// The first instruction whose opcode matches, to damage in place
+static Instruction &instruction(std::string &bytes, bool (*matches)(int op)) {
+    Instruction *code = (Instruction *)&bytes[header(bytes).code];
+    uint64_t i = 0;
+    while (!matches(code[i].op)) i++;
+    return code[i];
+}
+
+int main(int argc, char **argv) {
+    int generated = argc > 1 ? atoi(argv[1]) : 12;
+    char pattern[] = "/tmp/image_test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        printf("cannot make a directory\n");
+        return 1;
+    }
+    directory = pattern;
+
+    for (const Case &test : cases) checkSource(test.name, test.source, test.input);
+    test_generated(generated, [](const char *name, const std::string &source) {
+        checkSource(name, source, "");
+    });
+
+    printf("\n");
+    checkDamaged("as built", [](std::string &) {}, true);
+    checkDamaged("magic", [](std::string &b) { b[0] = 'X'; });
+    checkDamaged("version", [](std::string &b) { header(b).version++; });
+    checkDamaged("byte order", [](std::string &b) { header(b).byteOrder = 0x04030201; });
+    checkDamaged("truncated", [](std::string &b) { b.resize(b.size() - 8); });
+    checkDamaged("header only", [](std::string &b) { b.resize(sizeof(ImageHeader) - 1); });
+    checkDamaged("empty", [](std::string &b) { b.clear(); });
+    checkDamaged("main", [](std::string &b) { header(b).main = header(b).functions; });
+    checkDamaged("table offset", [](std::string &b) { header(b).code = ~(uint64_t)7; });
+    checkDamaged("instructions", [](std::string &b) { header(b).instructions += 1000; });
+    checkDamaged("function code", [](std::string &b) { record(b, 0).code = header(b).instructions; });
+    checkDamaged("function length", [](std::string &b) { record(b, 0).length = ~(uint64_t)0; });
+    checkDamaged("frame", [](std::string &b) { record(b, 0).slots = record(b, 0).registers + 1; });
+    checkDamaged("function name", [](std::string &b) { record(b, 0).name = header(b).poolBytes; });
+    checkDamaged("string offset", [](std::string &b) {
+        ((uint32_t *)&b[header(b).stringTable])[0] = header(b).poolBytes;
+    });
+    checkDamaged("unterminated pool", [](std::string &b) {
+        b[header(b).pool + header(b).poolBytes - 1] = 'x';
+    });
+    checkDamaged("opcode", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_return; }).op = NUM_OPCODES;
+    });
+    checkDamaged("register", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_return; }).b = 100000;
+    });
+    checkDamaged("jump target", [](std::string &b) {
+        instruction(b, is_jump).a = record(b, 0).length;
+    });
+    checkDamaged("callee", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_call; }).c = 100000;
+    });
+    checkDamaged("call arguments", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_call; }).b = 100000;
+    });
+    checkDamaged("string index", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_string; }).b = header(b).strings;
+    });
+    checkDamaged("global index", [](std::string &b) {
+        instruction(b, [](int op) { return op == op_store_global; }).a = 50000000;
+    });
+    checkDamaged("runs off the end", [](std::string &b) {
+        const ImageFunction &f = record(b, 0);
+        ((Instruction *)&b[header(b).code])[f.code + f.length - 1].op = op_nop;
+    });
+    ModuleImage missing;
+    report("damaged", "missing file",
+           missing.load((directory + "/missing").c_str()) != 0 && !missing.mapped());
+
+    std::string clean = "rm -rf " + directory;
+    if (system(clean.c_str()) != 0)
+        printf("cannot remove %s\n", directory.c_str());
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
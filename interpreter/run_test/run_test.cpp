@@ -0,0 +1,230 @@
+// Runs small programs on every execution engine and checks their output,
+// and that a runtime error stops the program with the output so far.
+// Usage: run_test   (run from interpreter/: the parser writes ../tests/output)
+#include <stdio.h>
+#include <string>
+#include "../../include/parser.h"
+#include "../../include/TreeEvaluator.h"
+#include "../../include/ClosureCompiler.h"
+#include "../../include/RewritingInterpreter.h"
+#include "../../include/BytecodeCompiler.h"
+#include "../../include/BytecodeInterpreter.h"
+#include "../../include/PeepholeOptimizer.h"
+#include "../../tests/test_util.h"
+
+struct Case {
+    const char *name;
+    const char *source;
+    const char *input;
+    const char *output;     // expected
+    int status;             // expected from run
+};
+
+static const Case cases[] = {
+    {"recursion",
+     "program\n"
+     "function fib(n : integer) : integer\n"
+     "begin\n"
+     "    if n < 2 then return(n) fi;\n"
+     "    return(fib(n - 1) + fib(n - 2));\n"
+     "end;\n"
+     "begin var r : integer; r := fib(15); write(r); end;\n",
+     "", "610\n", 0},
+
+    {"loops",
+     "program\n"
+     "var total : integer;\n"
+     "begin\n"
+     "    var i : integer;\n"
+     "    var j : integer;\n"
+     "    for i := 1 to 10 do\n"
+     "    begin\n"
+     "        j := i;\n"
+     "        while j > 0 do begin total := total + j; j := j - 3; end od;\n"
+     "    end\n"
+     "    od;\n"
+     "    write(total);\n"
+     "    for i := 5 to 4 do total := 0 od;\n"
+     "    write(i);\n"
+     "    for i := 1 to 10 do i := i + 4 od;\n"
+     "    write(i);\n"
+     "end;\n",
+     "", "94\n5\n10\n", 0},
+
+    {"arithmetic",
+     "program\n"
+     "constant k = 7;\n"
+     "var x : integer;\n"
+     "begin\n"
+     "    var y : integer;\n"
+     "    x := 2147483647;\n"
+     "    x := x + 1;\n"
+     "    write(x);\n"
+     "    y := -(k) / 2 * 3 - k;\n"
+     "    write(y);\n"
+     "    write(k);\n"
+     "end;\n",
+     "", "-2147483648\n-16\n7\n", 0},
+
+    {"booleans",
+     "program\n"
+     "var b : boolean;\n"
+     "function odd(n : integer) : boolean\n"
+     "begin return(n / 2 * 2 != n); end;\n"
+     "begin\n"
+     "    var c : boolean;\n"
+     "    b := odd(3) and not (odd(4));\n"
+     "    write(b);\n"
+     "    c := b = false or 1 > 2;\n"
+     "    write(c);\n"
+     "    read(c);\n"
+     "    write(c);\n"
+     "end;\n",
+     "true", "true\nfalse\ntrue\n", 0},
+
+    {"strings",
+     "program\n"
+     "var s : string;\n"
+     "procedure greet(t : string)\n"
+     "begin\n"
+     "    if t = \"hi\" then s := \"matched\" else s := t fi;\n"
+     "end;\n"
+     "begin\n"
+     "    var u : string;\n"
+     "    write(u);\n"
+     "    greet(\"hi\");\n"
+     "    write(s);\n"
+     "    read(u);\n"
+     "    greet(u);\n"
+     "    write(s);\n"
+     "end;\n",
+     "hello", "\nmatched\nhello\n", 0},
+
+    {"frames",
+     "program\n"
+     "var g : integer;\n"
+     "function nothing() : integer\n"
+     "begin g := g + 1; end;\n"
+     "function sum(a : integer, b : integer) : integer\n"
+     "begin\n"
+     "    var c : integer;\n"
+     "    begin var d : integer; d := a; c := d; end;\n"
+     "    begin var e : integer; c := c + e + b; end;\n"
+     "    return(c);\n"
+     "end;\n"
+     "begin var r : integer; r := sum(nothing(), sum(2, 3)); write(r); write(g); end;\n"
+     "begin var r : integer; write(r); read(r); r := r + nothing(); write(r); end;\n",
+     "41", "5\n1\n0\n41\n", 0},
+
+    // The left operand is read before the right one, which here is a call
+    // that changes it
+    {"operand order",
+     "program\n"
+     "var g : integer;\n"
+     "function f() : integer\n"
+     "begin g := 100; return(1); end;\n"
+     "begin\n"
+     "    var b : boolean;\n"
+     "    var r : integer;\n"
+     "    var n : integer;\n"
+     "    g := 0 - 5;\n"
+     "    b := g > f();\n"
+     "    write(b);\n"
+     "    g := 0 - 5;\n"
+     "    r := g + f();\n"
+     "    write(r);\n"
+     "    g := 0 - 5;\n"
+     "    r := (g - f()) * 2;\n"
+     "    write(r);\n"
+     "    g := 0;\n"
+     "    while g < f() do begin n := n + 1; g := 5; end od;\n"
+     "    write(n);\n"
+     "end;\n",
+     "", "false\n-4\n-12\n1\n", 0},
+
+    {"division by zero",
+     "program\n"
+     "var x : integer;\n"
+     "begin\n"
+     "    write(x);\n"
+     "    x := 1 / x;\n"
+     "    write(x);\n"
+     "end;\n",
+     "", "0\n", 1},
+
+    {"stack overflow",
+     "program\n"
+     "function down(n : integer) : integer\n"
+     "begin return(down(n + 1)); end;\n"
+     "begin var r : integer; write(r); r := down(0); end;\n",
+     "", "0\n", 1},
+};
+
+static int failures = 0;
+
+static void check(const Case &test, const char *engine, int status, FILE *output,
+                  const std::string &expected) {
+    std::string text = test_contents(output);
+    bool ok = status == test.status && text == expected;
+    printf("%-18s %-9s %s\n", test.name, engine, ok ? "ok" : "FAILED");
+    if (!ok) {
+        printf("  status %d, output:\n%s", status, text.c_str());
+        failures++;
+    }
+}
+
+int main() {
+    for (const Case &test : cases) {
+        std::string source = test.source;
+        Parser parser(new Scanner(new FileDescriptor(source.data(), source.size())));
+        AST *program = parser.start_parsing();
+        if (parser.had_error) {
+            printf("%-18s does not compile\n", test.name);
+            failures++;
+            continue;
+        }
+
+        // The rewriting interpreter runs the program twice, the second time
+        // on the nodes the first specialized, and then twice tiered, with
+        // every routine promoted at its first call. The bytecode runs as
+        // lowered, and then optimized and scheduled.
+        static const char *engines[] = {"tree",   "closure", "rewriting", "rewritten",
+                                        "tiered", "bytecode", "optimized"};
+        for (int engine = 0; engine < 7; engine++) {
+            int runs = engine == 3 || engine == 4 ? 2 : 1;
+            FILE *input = tmpfile();
+            FILE *output = tmpfile();
+            std::string expected;
+            for (int i = 0; i < runs; i++) {
+                fprintf(input, "%s\n", test.input);
+                expected += test.output;
+            }
+            rewind(input);
+            Runtime runtime(input, output);
+            int status = 0;
+            if (engine == 0) {
+                status = TreeEvaluator(runtime).run(program);
+            } else if (engine == 1) {
+                ClosureCompiler compiler(runtime);
+                status = compiler.compile(program) != 0 ? -1 : compiler.run();
+            } else if (engine >= 5) {
+                Module module;
+                status = BytecodeCompiler().compile(program, module) != 0 ? -1 : 0;
+                if (status == 0 && engine == 6) {
+                    PeepholeOptimizer optimizer;
+                    optimizer.optimize(module);
+                    optimizer.schedule(module);
+                }
+                if (status == 0)
+                    status = BytecodeInterpreter(runtime).run(module);
+            } else {
+                RewritingInterpreter interpreter(runtime, engine == 4 ? 1 : 0);
+                for (int i = 0; i < runs; i++) status = interpreter.run(program);
+            }
+            check(test, engines[engine], status, output, expected);
+            fclose(input);
+            fclose(output);
+        }
+    }
+    return failures ? 1 : 0;
+}
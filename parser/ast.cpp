@@ -3,7 +3,12 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "../include/ast.h"
+#include "../include/AstWalker.h"
+#include "../include/stats.h"
 #include "../include/FileDescriptor.h"
 
 // Type name strings for printing
@@ -12,10 +17,9 @@ static const char* type_names[] = {
 };
 
 /* Internal routines: */
-static void nl_indent(FILE *fp, int indent);
-static void p_a_n(FILE *fp, AST *node, int indent);
-static void print_ast_list(FILE *fp, ast_list *list, const char *separator, int indent);
-static void print_ste_list(FILE *fp, ste_list *list, const char *prefix, const char *separator, int indent);
+struct printer;
+static void nl_indent(printer *out, int indent);
+static void print_ste_list(printer *out, ste_list *list, const char *prefix, const char *separator, int indent);
 
 // Error handling functions
 static void fatal_error(const char* message) {
@@ -44,6 +48,8 @@ ast_list *cons_ast(AST *head, ast_list *tail) {
     if (cell == NULL) {
         fatal_error("Out of memory in cons_ast");
     }
+    stats_count(count_list_cells);
+    stats_count(count_bytes_allocated, sizeof(ast_list));
     cell->head = head;
     cell->tail = tail;
     return cell;
@@ -55,6 +61,8 @@ ste_list *cons_ste(symbol_table_entry *head, ste_list *tail) {
     if (cell == NULL) {
         fatal_error("Out of memory in cons_ste");
     }
+    stats_count(count_list_cells);
+    stats_count(count_bytes_allocated, sizeof(ste_list));
     cell->head = head;
     cell->tail = tail;
     return cell;
@@ -66,11 +74,14 @@ AST *make_ast_node(AST_type type, ...) {
     if (node == NULL) {
         fatal_error("Out of memory in make_ast_node");
     }
+    stats_add_node(type);
+    stats_count(count_bytes_allocated, sizeof(AST));
     
     va_list args;
     va_start(args, type);
     
     node->type = type;
+    node->value_type = type_none;
     
     switch (type) {        
         case ast_var_decl:
@@ -131,6 +142,8 @@ AST *make_ast_node(AST_type type, ...) {
         case ast_block:
             node->f.a_block.vars = va_arg(args, ste_list *);
             node->f.a_block.stmts = va_arg(args, ast_list *);
+            node->f.a_block.frame_size = 0;
+            node->f.a_block.frame_slots = 0;
             break;
 
         case ast_return:
@@ -173,11 +186,13 @@ AST *make_ast_node(AST_type type, ...) {
         case ast_cor:
             node->f.a_binary_op.larg = va_arg(args, AST *);
             node->f.a_binary_op.rarg = va_arg(args, AST *);
+            node->f.a_binary_op.rel_type = type_none;
             break;
 
         case ast_not:
         case ast_uminus:
             node->f.a_unary_op.arg = va_arg(args, AST *);
+            node->f.a_unary_op.type = type_none;
             break;
 
         case ast_itof:
@@ -190,6 +205,8 @@ AST *make_ast_node(AST_type type, ...) {
 
         case ast_program:
             node->f.a_program.statements = va_arg(args, ast_list *);
+            node->f.a_program.frame_size = 0;
+            node->f.a_program.frame_slots = 0;
             break;
 
         default:
@@ -200,346 +217,595 @@ AST *make_ast_node(AST_type type, ...) {
     return node;
 }
 
+// Evaluates a constant expression in post-order, on a stack of values.
+// The context of an and/or node records whether its right operand was
+// skipped: as in C, it isn't evaluated when the left one decides.
+struct EvalContext {
+    bool skipped;
+};
+
+class ConstantEvaluator : public AstWalker<ConstantEvaluator, EvalContext> {
+public:
+    explicit ConstantEvaluator(Lexer *lexer) : lexer(lexer) {}
+
+    // Only operators have operands to walk; any other node is a leaf, or
+    // not allowed in a constant
+    bool visit(AST *, EvalContext &) { return false; }
+    bool visitBinary(AST *, EvalContext &context) {
+        context.skipped = false;
+        return true;
+    }
+    bool visitUnary(AST *, EvalContext &) { return true; }
+
+    bool child(AST *node, int index, AST *child, EvalContext &context, EvalContext &childContext);
+    bool childAnd(AST *, int index, AST *child, EvalContext &context, EvalContext &) {
+        return rightOperand(index, child, context, false);
+    }
+    bool childCand(AST *, int index, AST *child, EvalContext &context, EvalContext &) {
+        return rightOperand(index, child, context, false);
+    }
+    bool childOr(AST *, int index, AST *child, EvalContext &context, EvalContext &) {
+        return rightOperand(index, child, context, true);
+    }
+    bool childCor(AST *, int index, AST *child, EvalContext &context, EvalContext &) {
+        return rightOperand(index, child, context, true);
+    }
+
+    void leave(AST *node, EvalContext &context);
+    void leaveVar(AST *node, EvalContext &context);
+    void leaveInteger(AST *node, EvalContext &) { values.push_back(node->f.a_integer.value); }
+    void leaveString(AST *node, EvalContext &context);
+    void leaveBoolean(AST *node, EvalContext &) { values.push_back(node->f.a_boolean.value); }
+    void leaveNot(AST *, EvalContext &) { values.back() = !values.back(); }
+    void leaveUminus(AST *, EvalContext &) { values.back() = -values.back(); }
+
+    // Each binary operator replaces its left operand's value with its own
+    void leaveTimes(AST *, EvalContext &) {
+        int right = pop();
+        values.back() *= right;
+    }
+    void leaveDivide(AST *node, EvalContext &context);
+    void leavePlus(AST *, EvalContext &) {
+        int right = pop();
+        values.back() += right;
+    }
+    void leaveMinus(AST *, EvalContext &) {
+        int right = pop();
+        values.back() -= right;
+    }
+    void leaveEq(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() == right;
+    }
+    void leaveNeq(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() != right;
+    }
+    void leaveLt(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() < right;
+    }
+    void leaveLe(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() <= right;
+    }
+    void leaveGt(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() > right;
+    }
+    void leaveGe(AST *, EvalContext &) {
+        int right = pop();
+        values.back() = values.back() >= right;
+    }
+    void leaveAnd(AST *, EvalContext &context) {
+        int right = rightValue(context, 1);
+        values.back() = values.back() && right;
+    }
+    void leaveCand(AST *, EvalContext &context) {
+        int right = rightValue(context, 1);
+        values.back() = values.back() && right;
+    }
+    void leaveOr(AST *, EvalContext &context) {
+        int right = rightValue(context, 0);
+        values.back() = values.back() || right;
+    }
+    void leaveCor(AST *, EvalContext &context) {
+        int right = rightValue(context, 0);
+        values.back() = values.back() || right;
+    }
+
+    int result() { return values.back(); }
+
+private:
+    Lexer *lexer;
+    std::vector<int> values;
+
+    int pop() {
+        int value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+    bool rightOperand(int index, AST *child, EvalContext &context, bool decidesOn);
+    int rightValue(EvalContext &context, int skippedValue);
+};
+
+bool ConstantEvaluator::child(AST *, int, AST *child, EvalContext &, EvalContext &) {
+    if (child == NULL) {
+        fatal_error("NULL AST in eval_ast_expr");
+    }
+    return true;
+}
+
+// The right operand of an and/or is skipped when the left one's value is
+// decidesOn: false for and, true for or
+bool ConstantEvaluator::rightOperand(int index, AST *child, EvalContext &context, bool decidesOn) {
+    if (child == NULL) {
+        fatal_error("NULL AST in eval_ast_expr");
+    }
+    if (index == 1 && (values.back() != 0) == decidesOn) {
+        context.skipped = true;
+        return false;
+    }
+    return true;
+}
+
+// The right operand's value, or if it was skipped one that leaves the
+// left operand's deciding
+int ConstantEvaluator::rightValue(EvalContext &context, int skippedValue) {
+    return context.skipped ? skippedValue : pop();
+}
+
+void ConstantEvaluator::leave(AST *, EvalContext &) {
+    lexer->ReportError("Unknown AST node type in eval_ast_expr");
+    values.push_back(0);
+}
+
+void ConstantEvaluator::leaveVar(AST *node, EvalContext &) {
+    if (node->f.a_var.var->IsConstant) {
+        values.push_back(node->f.a_var.var->ConstValue);
+    } else {
+        lexer->ReportError("Cannot use variables in constant expressions");
+        values.push_back(0);
+    }
+}
+
+void ConstantEvaluator::leaveString(AST *, EvalContext &) {
+    lexer->ReportError("Cannot use strings in constant expressions");
+    values.push_back(0);
+}
+
+void ConstantEvaluator::leaveDivide(AST *, EvalContext &) {
+    int right = pop();
+    if (right == 0) {
+        lexer->ReportError("Division by zero in constant expression");
+        values.back() = 0;
+    } else {
+        values.back() /= right;
+    }
+}
+
 // Evaluate a constant expression
-int eval_ast_expr(FileDescriptor *fd, AST *node) {
+int eval_ast_expr(Lexer *lexer, AST *node) {
     if (node == NULL) {
         fatal_error("NULL AST in eval_ast_expr");
     }
-    
-    switch (node->type) {
-        case ast_var:
-            if (node->f.a_var.var->IsConstant) {
-                return node->f.a_var.var->ConstValue;
-            } else {
-                fd->ReportError("Cannot use variables in constant expressions");
-                return 0;
-            }
-            
-        case ast_integer:
-            return node->f.a_integer.value;
-            
-        case ast_string:
-            fd->ReportError("Cannot use strings in constant expressions");
-            return 0;
-            
-        case ast_boolean:
-            return node->f.a_boolean.value;
-            
-        case ast_times:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) * 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_divide:
-            {
-                int divisor = eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                if (divisor == 0) {
-                    fd->ReportError("Division by zero in constant expression");
-                    return 0;
-                }
-                return eval_ast_expr(fd, node->f.a_binary_op.larg) / divisor;
+    ConstantEvaluator evaluator(lexer);
+    evaluator.walk(node);
+    return evaluator.result();
+}
+
+// Printer output is gathered in a fixed buffer and handed to the file in
+// large chunks, with numbers and names formatted by hand, so printing a
+// big AST does no allocation and few library calls.
+struct printer {
+    FILE *fp;           // sink when fd < 0
+    int fd;
+    long written;       // bytes flushed so far
+    bool failed;
+    size_t used;
+    char buffer[64 * 1024];
+};
+
+static void flush_printer(printer *out) {
+    if (out->used == 0 || out->failed) {
+        out->used = 0;
+        return;
+    }
+    if (out->fd >= 0) {
+        for (size_t done = 0; done < out->used;) {
+            ssize_t n = write(out->fd, out->buffer + done, out->used - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                out->failed = true;
+                break;
             }
-            
-        case ast_plus:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) + 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_minus:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) - 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_eq:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) == 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_neq:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) != 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_lt:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) < 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_le:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) <= 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_gt:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) > 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_ge:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) >= 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_and:
-        case ast_cand:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) && 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_or:
-        case ast_cor:
-            return eval_ast_expr(fd, node->f.a_binary_op.larg) || 
-                   eval_ast_expr(fd, node->f.a_binary_op.rarg);
-                   
-        case ast_not:
-            return !eval_ast_expr(fd, node->f.a_unary_op.arg);
-            
-        case ast_uminus:
-            return -eval_ast_expr(fd, node->f.a_unary_op.arg);
-            
-        default:
-            fd->ReportError("Unknown AST node type in eval_ast_expr");
-            return 0;
+            done += n;
+        }
+    } else if (fwrite(out->buffer, 1, out->used, out->fp) != out->used) {
+        out->failed = true;
     }
+    out->written += out->used;
+    out->used = 0;
 }
 
-// Print an AST node
-void print_ast_node(FILE *fp, AST *node) {
-    p_a_n(fp, node, 0);
+static void put_bytes(printer *out, const char *text, size_t length) {
+    while (length > sizeof(out->buffer) - out->used) {
+        size_t room = sizeof(out->buffer) - out->used;
+        memcpy(out->buffer + out->used, text, room);
+        out->used += room;
+        text += room;
+        length -= room;
+        flush_printer(out);
+    }
+    memcpy(out->buffer + out->used, text, length);
+    out->used += length;
 }
 
-// Internal printing function with indentation
-static void p_a_n(FILE *fp, AST *node, int indent) {
-    if (node == NULL) return;
-    
-    switch (node->type) {
-        case ast_var_decl:
-            fprintf(fp, "var %s: %s;", ste_name(node->f.a_var_decl.name),
-                   type_names[node->f.a_var_decl.type]);
-                   
-            nl_indent(fp, indent);
-            
-            break;
-            
-        case ast_const_decl:
-            fprintf(fp, "constant %s = ", ste_name(node->f.a_const_decl.name));
-            p_a_n(fp, node->f.a_const_decl.value, indent);
-            fprintf(fp, ";");
-            nl_indent(fp, indent);
-            break;
-            
-        case ast_routine_decl:
-            if (node->f.a_routine_decl.result_type == type_none)
-                fprintf(fp, "procedure %s (", ste_name(node->f.a_routine_decl.name));
-            else
-                fprintf(fp, "function %s (", ste_name(node->f.a_routine_decl.name));
-                
-            print_ste_list(fp, node->f.a_routine_decl.formals, "", ", ", -1);
-            
-            if (node->f.a_routine_decl.result_type == type_none) {
-                fprintf(fp, ")");
-                nl_indent(fp, indent + 2);
-            } else {
-                fprintf(fp, ") : %s", type_names[node->f.a_routine_decl.result_type]);
-                nl_indent(fp, indent + 2);
-            }
-            
-            p_a_n(fp, node->f.a_routine_decl.body, indent + 2);
-            fprintf(fp, ";");
-            nl_indent(fp, indent);
-            break;
-            
-        case ast_assign:
-            fprintf(fp, "%s := ", ste_name(node->f.a_assign.lhs));
-            p_a_n(fp, node->f.a_assign.rhs, indent);
-            break;
-              case ast_if:
-            fprintf(fp, "if ");
-            p_a_n(fp, node->f.a_if.predicate, indent);
-            fprintf(fp, " then");
-            nl_indent(fp, indent + 2);
-            p_a_n(fp, node->f.a_if.conseq, indent + 2);
-            
-            if (node->f.a_if.altern != NULL) {
-                nl_indent(fp, indent);
-                fprintf(fp, "else");
-                nl_indent(fp, indent + 2);
-                p_a_n(fp, node->f.a_if.altern, indent + 2);
-            }
-            nl_indent(fp, indent);
-            fprintf(fp, "fi");
-            break;
-            
-        case ast_while:
-            fprintf(fp, "while ");
-            p_a_n(fp, node->f.a_while.predicate, indent);
-            fprintf(fp, " do");
-            nl_indent(fp, indent + 2);
-            p_a_n(fp, node->f.a_while.body, indent + 2);
-            nl_indent(fp, indent);
-            fprintf(fp, "od");
-            break;
-            
-        case ast_for:
-            fprintf(fp, "for %s := ", ste_name(node->f.a_for.var));
-            p_a_n(fp, node->f.a_for.lower_bound, indent);
-            fprintf(fp, " to ");
-            p_a_n(fp, node->f.a_for.upper_bound, indent);
-            fprintf(fp, " do");
-            nl_indent(fp, indent + 2);
-            p_a_n(fp, node->f.a_for.body, indent + 2);
-            nl_indent(fp, indent);
-            fprintf(fp, "od");
-            break;
-            
-        case ast_read:
-            fprintf(fp, "read(%s)", ste_name(node->f.a_read.var));
-            break;
-            
-        case ast_write:
-            fprintf(fp, "write(%s)", ste_name(node->f.a_write.var));
-            break;
-            
-        case ast_call:
-            fprintf(fp, "%s(", ste_name(node->f.a_call.callee));
-            print_ast_list(fp, node->f.a_call.arg_list, ", ", -1);
-            fprintf(fp, ")");
-            break;
-              case ast_block:
-            fprintf(fp, "begin");
-            nl_indent(fp, indent + 2);
-            print_ste_list(fp, node->f.a_block.vars, "var ", ";", indent + 2);
-            
-            // Only print the statement list with separator if it's not empty
-            if (node->f.a_block.stmts != NULL) {
-                print_ast_list(fp, node->f.a_block.stmts, ";\n", indent + 2);
-                // Only add semicolon if there are statements
-                fprintf(fp, ";");
-            }
-            
-            nl_indent(fp, indent);
-            fprintf(fp, "end");
-            break;
-            
-        case ast_return:
-            fprintf(fp, "return(");
-            p_a_n(fp, node->f.a_return.expr, indent);
-            fprintf(fp, ")");
-            break;
-            
-        case ast_var:
-            fprintf(fp, "%s", ste_name(node->f.a_var.var));
-            break;
-            
-        case ast_integer:
-            fprintf(fp, "%d", node->f.a_integer.value);
-            break;
-            
-        case ast_float:
-            fprintf(fp, "%f", node->f.a_float.value);
-            break;
-            
-        case ast_string:
-            fprintf(fp, "\"%s\"", node->f.a_string.string);
-            break;
-            
-        case ast_boolean:
-            fprintf(fp, node->f.a_boolean.value ? "true" : "false");
-            break;
-            
-        case ast_times:
-        case ast_divide:
-        case ast_plus:
-        case ast_minus:
-        case ast_eq:
-        case ast_neq:
-        case ast_lt:
-        case ast_le:
-        case ast_gt:
-        case ast_ge:
-        case ast_and:
-        case ast_or:
-        case ast_cand:
-        case ast_cor:
-            fprintf(fp, "(");
-            p_a_n(fp, node->f.a_binary_op.larg, indent);
-            
-            switch (node->type) {
-                case ast_times:   fprintf(fp, " * ");  break;
-                case ast_divide:  fprintf(fp, " / ");  break;
-                case ast_plus:    fprintf(fp, " + ");  break;
-                case ast_minus:   fprintf(fp, " - ");  break;
-                case ast_eq:      fprintf(fp, " = ");  break;
-                case ast_neq:     fprintf(fp, " != "); break;
-                case ast_lt:      fprintf(fp, " < ");  break;
-                case ast_le:      fprintf(fp, " <= "); break;
-                case ast_gt:      fprintf(fp, " > ");  break;
-                case ast_ge:      fprintf(fp, " >= "); break;
-                case ast_and:     fprintf(fp, " and "); break;
-                case ast_or:      fprintf(fp, " or ");  break;
-                case ast_cand:    fprintf(fp, " cand "); break;
-                case ast_cor:     fprintf(fp, " cor ");  break;
-                default: break;
-            }
-            
-            p_a_n(fp, node->f.a_binary_op.rarg, indent);
-            fprintf(fp, ")");
-            break;
-            
-        case ast_not:
-            fprintf(fp, "(not ");
-            p_a_n(fp, node->f.a_unary_op.arg, indent);
-            fprintf(fp, ")");
-            break;
-            
-        case ast_uminus:
-            fprintf(fp, "(-");
-            p_a_n(fp, node->f.a_unary_op.arg, indent);
-            fprintf(fp, ")");
-            break;
-              case ast_program:{
-            fprintf(fp, "program");
-            nl_indent(fp, indent + 2);
-            print_ast_list(fp, node->f.a_program.statements, "", indent + 2);  // Use empty separator
-            break;}
+// String literals are measured at compile time
+template <size_t N>
+static inline void put_str(printer *out, const char (&text)[N]) {
+    put_bytes(out, text, N - 1);
+}
 
-        case ast_eof:
-            fprintf(fp, "EOF");
-            break;
-            
-        default:
-            fprintf(fp, "Unknown AST node type: %d", node->type);
-            break;
+static inline void put_name(printer *out, const char *name) {
+    put_bytes(out, name, strlen(name));
+}
+
+static void put_int(printer *out, int value) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--p = '-';
+    put_bytes(out, p, digits + sizeof(digits) - p);
+}
+
+// Rare enough to leave to snprintf
+static void put_float(printer *out, double value) {
+    char text[512];
+    int length = snprintf(text, sizeof(text), "%f", value);
+    put_bytes(out, text, length < (int)sizeof(text) ? length : sizeof(text) - 1);
+}
+
+static void put_spaces(printer *out, int count) {
+    for (; count > 0; count -= 64) {
+        static const char spaces[] =
+            "                                                                ";
+        put_bytes(out, spaces, count < 64 ? count : 64);
     }
 }
 
-// Print a list of AST nodes
-static void print_ast_list(FILE *fp, ast_list *list, const char *separator, int indent) {
-    for (; list != NULL; list = list->tail) {
-        p_a_n(fp, list->head, indent);
-        // Only add separator, no newline needed as p_a_n already adds a newline for var_decl nodes
-        if (list->tail && (separator[0] != '\0')) {
-            fprintf(fp, "%s", separator);
-            
-            // If separator contains newline and indent is not negative, add proper indentation
-            if (strchr(separator, '\n') && indent >= 0) {
-                for (int i = 0; i < indent; i++) {
-                    fprintf(fp, " ");
-                }
-            }
-        }
+// Prints a node's text before, between and after its children. The
+// context is the indentation of the node's lines.
+class AstPrinter : public AstWalker<AstPrinter, int> {
+public:
+    explicit AstPrinter(printer *out) : out(out) {}
+
+    bool visit(AST *node, int &indent);
+
+    bool visitVarDecl(AST *node, int &indent);
+    bool visitConstDecl(AST *node, int &indent);
+    void leaveConstDecl(AST *, int &indent) { endDecl(indent); }
+    bool visitRoutineDecl(AST *node, int &indent);
+    bool childRoutineDecl(AST *, int, AST *, int &indent, int &childIndent) {
+        childIndent = indent + 2;
+        return true;
     }
+    void leaveRoutineDecl(AST *, int &indent) { endDecl(indent); }
+
+    bool visitAssign(AST *node, int &indent);
+    bool visitIf(AST *, int &) { return text("if "); }
+    bool childIf(AST *node, int index, AST *child, int &indent, int &childIndent);
+    void leaveIf(AST *, int &indent) { end(indent, "fi"); }
+    bool visitWhile(AST *, int &) { return text("while "); }
+    bool childWhile(AST *node, int index, AST *child, int &indent, int &childIndent);
+    void leaveWhile(AST *, int &indent) { end(indent, "od"); }
+    bool visitFor(AST *node, int &indent);
+    bool childFor(AST *node, int index, AST *child, int &indent, int &childIndent);
+    void leaveFor(AST *, int &indent) { end(indent, "od"); }
+    bool visitRead(AST *node, int &indent);
+    bool visitWrite(AST *node, int &indent);
+    bool visitCall(AST *node, int &indent);
+    bool childCall(AST *node, int index, AST *child, int &indent, int &childIndent);
+    void leaveCall(AST *, int &) { put_str(out, ")"); }
+    bool visitBlock(AST *node, int &indent);
+    bool childBlock(AST *node, int index, AST *child, int &indent, int &childIndent);
+    void leaveBlock(AST *node, int &indent);
+    bool visitReturn(AST *, int &) { return text("return("); }
+    void leaveReturn(AST *, int &) { put_str(out, ")"); }
+
+    bool visitVar(AST *node, int &indent);
+    bool visitInteger(AST *node, int &indent);
+    bool visitFloat(AST *node, int &indent);
+    bool visitString(AST *node, int &indent);
+    bool visitBoolean(AST *node, int &indent);
+
+    bool visitBinary(AST *, int &) { return text("("); }
+    bool childTimes(AST *, int index, AST *, int &, int &) { return between(index, " * "); }
+    bool childDivide(AST *, int index, AST *, int &, int &) { return between(index, " / "); }
+    bool childPlus(AST *, int index, AST *, int &, int &) { return between(index, " + "); }
+    bool childMinus(AST *, int index, AST *, int &, int &) { return between(index, " - "); }
+    bool childEq(AST *, int index, AST *, int &, int &) { return between(index, " = "); }
+    bool childNeq(AST *, int index, AST *, int &, int &) { return between(index, " != "); }
+    bool childLt(AST *, int index, AST *, int &, int &) { return between(index, " < "); }
+    bool childLe(AST *, int index, AST *, int &, int &) { return between(index, " <= "); }
+    bool childGt(AST *, int index, AST *, int &, int &) { return between(index, " > "); }
+    bool childGe(AST *, int index, AST *, int &, int &) { return between(index, " >= "); }
+    bool childAnd(AST *, int index, AST *, int &, int &) { return between(index, " and "); }
+    bool childOr(AST *, int index, AST *, int &, int &) { return between(index, " or "); }
+    bool childCand(AST *, int index, AST *, int &, int &) { return between(index, " cand "); }
+    bool childCor(AST *, int index, AST *, int &, int &) { return between(index, " cor "); }
+    void leaveBinary(AST *, int &) { put_str(out, ")"); }
+    bool visitNot(AST *, int &) { return text("(not "); }
+    bool visitUminus(AST *, int &) { return text("(-"); }
+    void leaveUnary(AST *, int &) { put_str(out, ")"); }
+
+    // Implicit in the source: print the integer
+    bool visitItof(AST *, int &) { return true; }
+    bool visitEof(AST *, int &) { return text("EOF"); }
+    bool visitProgram(AST *node, int &indent);
+    bool childProgram(AST *, int, AST *, int &indent, int &childIndent) {
+        childIndent = indent + 2;
+        return true;
+    }
+
+private:
+    printer *out;
+
+    template <size_t N>
+    bool text(const char (&text)[N]) {
+        put_str(out, text);
+        return true;
+    }
+
+    // Text between a binary operator's operands
+    template <size_t N>
+    bool between(int index, const char (&text)[N]) {
+        if (index == 1)
+            put_str(out, text);
+        return true;
+    }
+
+    void endDecl(int indent) {
+        put_str(out, ";");
+        nl_indent(out, indent);
+    }
+
+    // The closing keyword of a statement, on a line of its own
+    template <size_t N>
+    void end(int indent, const char (&text)[N]) {
+        nl_indent(out, indent);
+        put_str(out, text);
+    }
+};
+
+bool AstPrinter::visit(AST *node, int &) {
+    put_str(out, "Unknown AST node type: ");
+    put_int(out, node->type);
+    return false;
+}
+
+bool AstPrinter::visitVarDecl(AST *node, int &indent) {
+    put_str(out, "var ");
+    put_name(out, ste_name(node->f.a_var_decl.name));
+    put_str(out, ": ");
+    put_name(out, type_names[node->f.a_var_decl.type]);
+    put_str(out, ";");
+    nl_indent(out, indent);
+    return true;
+}
+
+bool AstPrinter::visitConstDecl(AST *node, int &) {
+    put_str(out, "constant ");
+    put_name(out, ste_name(node->f.a_const_decl.name));
+    put_str(out, " = ");
+    return true;
+}
+
+bool AstPrinter::visitRoutineDecl(AST *node, int &indent) {
+    if (node->f.a_routine_decl.result_type == type_none)
+        put_str(out, "procedure ");
+    else
+        put_str(out, "function ");
+    put_name(out, ste_name(node->f.a_routine_decl.name));
+    put_str(out, " (");
+
+    print_ste_list(out, node->f.a_routine_decl.formals, "", ", ", -1);
+
+    if (node->f.a_routine_decl.result_type == type_none) {
+        put_str(out, ")");
+    } else {
+        put_str(out, ") : ");
+        put_name(out, type_names[node->f.a_routine_decl.result_type]);
+    }
+    nl_indent(out, indent + 2);
+    return true;
+}
+
+bool AstPrinter::visitAssign(AST *node, int &) {
+    put_name(out, ste_name(node->f.a_assign.lhs));
+    put_str(out, " := ");
+    return true;
+}
+
+bool AstPrinter::childIf(AST *node, int index, AST *, int &indent, int &childIndent) {
+    if (index == 1) {
+        put_str(out, " then");
+        nl_indent(out, indent + 2);
+        childIndent = indent + 2;
+    } else if (index == 2 && node->f.a_if.altern != NULL) {
+        nl_indent(out, indent);
+        put_str(out, "else");
+        nl_indent(out, indent + 2);
+        childIndent = indent + 2;
+    }
+    return true;
+}
+
+bool AstPrinter::childWhile(AST *, int index, AST *, int &indent, int &childIndent) {
+    if (index == 1) {
+        put_str(out, " do");
+        nl_indent(out, indent + 2);
+        childIndent = indent + 2;
+    }
+    return true;
+}
+
+bool AstPrinter::visitFor(AST *node, int &) {
+    put_str(out, "for ");
+    put_name(out, ste_name(node->f.a_for.var));
+    put_str(out, " := ");
+    return true;
+}
+
+bool AstPrinter::childFor(AST *, int index, AST *, int &indent, int &childIndent) {
+    if (index == 1) {
+        put_str(out, " to ");
+    } else if (index == 2) {
+        put_str(out, " do");
+        nl_indent(out, indent + 2);
+        childIndent = indent + 2;
+    }
+    return true;
+}
+
+bool AstPrinter::visitRead(AST *node, int &) {
+    put_str(out, "read(");
+    put_name(out, ste_name(node->f.a_read.var));
+    put_str(out, ")");
+    return true;
+}
+
+bool AstPrinter::visitWrite(AST *node, int &) {
+    put_str(out, "write(");
+    put_name(out, ste_name(node->f.a_write.var));
+    put_str(out, ")");
+    return true;
+}
+
+bool AstPrinter::visitCall(AST *node, int &) {
+    put_name(out, ste_name(node->f.a_call.callee));
+    put_str(out, "(");
+    return true;
+}
+
+bool AstPrinter::childCall(AST *, int index, AST *, int &, int &childIndent) {
+    if (index > 0)
+        put_str(out, ", ");
+    childIndent = -1;
+    return true;
+}
+
+bool AstPrinter::visitBlock(AST *node, int &indent) {
+    put_str(out, "begin");
+    nl_indent(out, indent + 2);
+    print_ste_list(out, node->f.a_block.vars, "var ", ";", indent + 2);
+    return true;
+}
+
+bool AstPrinter::childBlock(AST *, int index, AST *, int &indent, int &childIndent) {
+    if (index > 0) {
+        put_str(out, ";\n");
+        put_spaces(out, indent + 2);
+    }
+    childIndent = indent + 2;
+    return true;
+}
+
+void AstPrinter::leaveBlock(AST *node, int &indent) {
+    // Only add semicolon if there are statements
+    if (node->f.a_block.stmts != NULL)
+        put_str(out, ";");
+    nl_indent(out, indent);
+    put_str(out, "end");
+}
+
+bool AstPrinter::visitVar(AST *node, int &) {
+    put_name(out, ste_name(node->f.a_var.var));
+    return true;
+}
+
+bool AstPrinter::visitInteger(AST *node, int &) {
+    put_int(out, node->f.a_integer.value);
+    return true;
+}
+
+bool AstPrinter::visitFloat(AST *node, int &) {
+    put_float(out, node->f.a_float.value);
+    return true;
+}
+
+bool AstPrinter::visitString(AST *node, int &) {
+    put_str(out, "\"");
+    put_name(out, node->f.a_string.string);
+    put_str(out, "\"");
+    return true;
+}
+
+bool AstPrinter::visitBoolean(AST *node, int &) {
+    if (node->f.a_boolean.value)
+        put_str(out, "true");
+    else
+        put_str(out, "false");
+    return true;
+}
+
+bool AstPrinter::visitProgram(AST *, int &indent) {
+    put_str(out, "program");
+    nl_indent(out, indent + 2);
+    return true;
+}
+
+static void print_to(printer *out, AST *node) {
+    out->used = 0;
+    out->written = 0;
+    out->failed = false;
+    AstPrinter(out).walk(node, 0);
+    flush_printer(out);
+}
+
+// Print an AST node
+void print_ast_node(FILE *fp, AST *node) {
+    printer out;
+    out.fp = fp;
+    out.fd = -1;
+    print_to(&out, node);
+}
+
+// Print an AST to a file, replacing it; returns the bytes written, or -1
+long print_ast_file(const char *path, AST *node) {
+    printer out;
+    out.fp = NULL;
+    out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out.fd < 0)
+        return -1;
+    print_to(&out, node);
+    if (close(out.fd) != 0)
+        out.failed = true;
+    return out.failed ? -1 : out.written;
 }
 
 // Print a list of symbol table entries
-static void print_ste_list(FILE *fp, ste_list *list, const char *prefix, const char *separator, int indent) {
+static void print_ste_list(printer *out, ste_list *list, const char *prefix, const char *separator, int indent) {
     for (; list != NULL; list = list->tail) {
-        fprintf(fp, "%s%s : %s", prefix, ste_name(list->head),
-               type_names[ste_var_type(list->head)]);
-                           //fprintf(fp, ";");
-
+        put_name(out, prefix);
+        put_name(out, ste_name(list->head));
+        put_str(out, " : ");
+        put_name(out, type_names[ste_var_type(list->head)]);
                
-        if (list->tail || indent >= 0) fprintf(fp, "%s", separator);
-        if (indent >= 0) nl_indent(fp, indent);
+        if (list->tail || indent >= 0) put_name(out, separator);
+        if (indent >= 0) nl_indent(out, indent);
     }
 }
 
 // Print a newline and indent
-static void nl_indent(FILE *fp, int indent) {
-    fprintf(fp, "\n");
-    for (int i = 0; i < indent; i++) {
-        fprintf(fp, " ");
-    }
+static void nl_indent(printer *out, int indent) {
+    put_str(out, "\n");
+    put_spaces(out, indent);
 }
 
 
@@ -2,6 +2,8 @@
 #include "../../include/ast.h"
 #include "../../include/symbol_table_entry.h"
 #include "../../include/FileDescriptor.h"
+#include "../../include/type_check.h"
+#include <iostream>
 
 int main() {    // Create an output file
     FILE *output_file = fopen("../../tests/output/ast_test.txt", "w");
@@ -45,6 +47,19 @@ int main() {    // Create an output file
     // Print the AST to the output file
     print_ast_node(output_file, block);
     fprintf(output_file, "\n");
+
+    // The type pass on f := x + 1.5, with f a float and x an integer: x is
+    // converted with an ast_itof node, and the sum is a float
+    STEntry *f_entry = new STEntry("f", STE_FLOAT);
+    AST *sum = make_ast_node(ast_plus, make_ast_node(ast_var, x_entry),
+                             make_ast_node(ast_float, 1.5));
+    AST *assign = make_ast_node(ast_assign, f_entry, sum);
+    int errors = check_types(assign, std::cerr);
+    fprintf(output_file, "\nTyped assignment: f := x + 1.5\n\n");
+    print_ast_node(output_file, assign);
+    fprintf(output_file, "\n%d type errors; x converted: %s; sum is float: %s\n", errors,
+            sum->f.a_binary_op.larg->type == ast_itof ? "yes" : "no",
+            sum->value_type == type_float ? "yes" : "no");
     
     // Close the output file
     fclose(output_file);
@@ -0,0 +1,112 @@
+// frame_layout.cpp
+#include "../include/frame_layout.h"
+#include "../include/AstWalker.h"
+#include "../include/stats.h"
+
+// Where the next variable of the frame goes. A block also keeps the high
+// water mark of the block around it, to restore when it is done.
+struct FramePosition {
+    int depth;
+    int slot;
+    int offset;
+    int outerSlots;
+    int outerBytes;
+};
+
+static int align(int offset, int alignment) {
+    return alignment > 1 ? (offset + alignment - 1) / alignment * alignment : offset;
+}
+
+class FrameLayout : public AstWalker<FrameLayout, FramePosition> {
+public:
+    FrameLayout() : highSlots(0), highBytes(0) {}
+
+    // Only statements that can hold blocks are walked into; expressions
+    // and the other statements have no variables to place
+    bool visit(AST *, FramePosition &) { return false; }
+    bool visitIf(AST *, FramePosition &) { return true; }
+    bool visitWhile(AST *, FramePosition &) { return true; }
+    bool visitFor(AST *, FramePosition &) { return true; }
+
+    bool visitProgram(AST *, FramePosition &position) {
+        position = FramePosition{0, 0, 0, 0, 0};
+        return true;
+    }
+    bool childProgram(AST *node, int index, AST *child, FramePosition &position,
+                      FramePosition &childPosition);
+    void leaveProgram(AST *node, FramePosition &position);
+    bool visitRoutineDecl(AST *node, FramePosition &position);
+    bool visitBlock(AST *node, FramePosition &position);
+    void leaveBlock(AST *node, FramePosition &position);
+
+private:
+    // The end of the furthest variable placed in the block being walked,
+    // nested blocks included
+    int highSlots;
+    int highBytes;
+
+    void place(STEntry *entry, FramePosition &position);
+};
+
+void FrameLayout::place(STEntry *entry, FramePosition &position) {
+    if (entry == nullptr)
+        return;
+    entry->Depth = position.depth;
+    entry->Slot = position.slot++;
+    entry->Offset = align(position.offset, entry->Size);
+    position.offset = entry->Offset + entry->Size;
+}
+
+bool FrameLayout::visitRoutineDecl(AST *node, FramePosition &position) {
+    position = FramePosition{1, 0, 0, 0, 0};
+    for (ste_list *formal = node->f.a_routine_decl.formals; formal; formal = formal->tail)
+        place(formal->head, position);
+    highSlots = position.slot;
+    highBytes = position.offset;
+    return true;
+}
+
+bool FrameLayout::visitBlock(AST *node, FramePosition &position) {
+    // A top-level block starts a frame, like a routine without formals
+    if (position.depth == 0) {
+        position = FramePosition{1, 0, 0, 0, 0};
+        highSlots = highBytes = 0;
+    }
+    position.outerSlots = highSlots;
+    position.outerBytes = highBytes;
+    for (ste_list *var = node->f.a_block.vars; var; var = var->tail)
+        place(var->head, position);
+    highSlots = position.slot;
+    highBytes = position.offset;
+    return true;
+}
+
+void FrameLayout::leaveBlock(AST *node, FramePosition &position) {
+    node->f.a_block.frame_slots = highSlots;
+    node->f.a_block.frame_size = align(highBytes, FRAME_ALIGNMENT);
+    if (position.outerSlots > highSlots) highSlots = position.outerSlots;
+    if (position.outerBytes > highBytes) highBytes = position.outerBytes;
+}
+
+// Top-level variables and constants go in the global frame, in order
+bool FrameLayout::childProgram(AST *, int, AST *child, FramePosition &position,
+                               FramePosition &) {
+    if (child == nullptr)
+        return true;
+    if (child->type == ast_var_decl)
+        place(child->f.a_var_decl.name, position);
+    else if (child->type == ast_const_decl)
+        place(child->f.a_const_decl.name, position);
+    return true;
+}
+
+void FrameLayout::leaveProgram(AST *node, FramePosition &position) {
+    node->f.a_program.frame_slots = position.slot;
+    node->f.a_program.frame_size = align(position.offset, FRAME_ALIGNMENT);
+}
+
+void layout_frames(AST *program) {
+    PhaseTimer timer(phase_layout);
+    FrameLayout layout;
+    layout.walk(program);
+}
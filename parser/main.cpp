@@ -1,19 +1,170 @@
+
 #include <iostream>
-#include "../include/Parser.h"
+#include <cstdlib>
+#include <cstring>
+#include "../include/parser.h"
+#include "../include/FlexScanner.h"
+#include "../include/PipelinedLexer.h"
+#include "../include/stats.h"
+#include "../include/TreeEvaluator.h"
+#include "../include/ClosureCompiler.h"
+#include "../include/RewritingInterpreter.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/BytecodeInterpreter.h"
+#include "../include/PeepholeOptimizer.h"
+#include "../include/NativeCompiler.h"
+#include "../include/ModuleImage.h"
 using namespace std;
 
-int main()
+// Usage: main [source file] [--parallel threads] [--lexer hand|flex] [--pipeline]
+//             [--output file] [--stats | --stats=json] [--perf]
+//             [--run tree|closure|rewriting|tiered|bytecode] [--object file.o]
+//             [--image file] [--load file]
+int main(int argc, char **argv)
 {
-        FileDescriptor *fd = new FileDescriptor("../tests/test1_isEven.txt");
-        Parser *parser = new Parser(fd);
-        AST* root = parser->start_parsing();
+        const char *fileName = "../tests/test1_isEven.txt";
+        const char *outputName = "../tests/output/output_program.txt";
+        int threads = 0;    // 0 => sequential parser
+        bool useFlex = false;
+        bool pipeline = false;  // scan on a thread of its own
+        int stats = 0;      // 1 => table, 2 => JSON, on stderr
+        bool perf = false;  // hardware counters in the statistics
+        const char *engine = nullptr;   // runs the program if set
+        const char *objectName = nullptr;   // compiles it to machine code if set
+        const char *imageName = nullptr;    // writes its bytecode image if set
+        const char *loadName = nullptr;     // runs an image instead of a source if set
+
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--parallel") == 0 && i + 1 < argc) {
+                threads = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--lexer") == 0 && i + 1 < argc) {
+                useFlex = strcmp(argv[++i], "flex") == 0;
+            } else if (strcmp(argv[i], "--pipeline") == 0) {
+                pipeline = true;
+            } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+                outputName = argv[++i];
+            } else if (strcmp(argv[i], "--stats") == 0) {
+                stats = 1;
+            } else if (strcmp(argv[i], "--stats=json") == 0) {
+                stats = 2;
+            } else if (strcmp(argv[i], "--perf") == 0) {
+                perf = true;
+            } else if (strcmp(argv[i], "--run") == 0 && i + 1 < argc) {
+                engine = argv[++i];
+                if (strcmp(engine, "tree") != 0 && strcmp(engine, "closure") != 0 &&
+                    strcmp(engine, "rewriting") != 0 && strcmp(engine, "tiered") != 0 &&
+                    strcmp(engine, "bytecode") != 0) {
+                    cout << "Unknown engine " << engine << endl;
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--object") == 0 && i + 1 < argc) {
+                objectName = argv[++i];
+            } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+                imageName = argv[++i];
+            } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+                loadName = argv[++i];
+            } else {
+                fileName = argv[i];
+            }
+        }
+
+        if (perf && !stats)
+            stats = 1;
+        if (stats)
+            stats_start(perf);
+
+        // Already compiled: nothing to read, parse or lower
+        if (loadName != nullptr) {
+            ModuleImage image;
+            int status = image.load(loadName);
+            if (status == 0) {
+                Runtime runtime(stdin, stdout);
+                status = BytecodeInterpreter(runtime).run(image);
+            }
+            if (stats)
+                stats_report(stderr, stats == 2);
+            return status;
+        }
+
+        Parser *parser;
+        if (useFlex) {
+            FlexScanner *lexer = FlexScanner::FromFile(fileName);
+            if (lexer == nullptr) {
+                cout << "Could not read " << fileName << endl;
+                return 1;
+            }
+            parser = new Parser(pipeline ? (Lexer*)new PipelinedLexer(lexer) : lexer);
+        } else if (pipeline) {
+            parser = new Parser(new PipelinedLexer(new Scanner(new FileDescriptor(fileName))));
+        } else {
+            parser = new Parser(new FileDescriptor(fileName));
+        }
+        AST* root = threads > 0 ? parser->start_parallel_parsing(threads)
+                                : parser->start_parsing();
         if (parser->had_error) {
             cout << "Parsing failed with errors." << endl;
         } else {
             cout << "Parsing succeeded." << endl;
-            parser->printParsedAST(root);
+            parser->printParsedAST(root, outputName);
+        }
+
+        // The program reads stdin and writes stdout
+        int status = 0;
+        if (engine != nullptr && !parser->had_error) {
+            Runtime runtime(stdin, stdout);
+            if (strcmp(engine, "tree") == 0) {
+                status = TreeEvaluator(runtime).run(root);
+            } else if (strcmp(engine, "rewriting") == 0 || strcmp(engine, "tiered") == 0) {
+                bool tiered = strcmp(engine, "tiered") == 0;
+                RewritingInterpreter interpreter(
+                    runtime, tiered ? RewritingInterpreter::HOT_THRESHOLD : 0);
+                status = interpreter.run(root);
+                if (stats == 1 && tiered)
+                    interpreter.printProfile(stderr);
+            } else if (strcmp(engine, "bytecode") == 0) {
+                Module module;
+                status = BytecodeCompiler().compile(root, module);
+                if (status == 0) {
+                    PeepholeOptimizer optimizer;
+                    optimizer.optimize(module);
+                    optimizer.schedule(module);
+                    if (stats == 1)
+                        optimizer.report(stderr);
+                    status = BytecodeInterpreter(runtime).run(module);
+                }
+            } else {
+                ClosureCompiler compiler(runtime);
+                status = compiler.compile(root) != 0 || compiler.run() != 0;
+            }
+        }
+
+        // Link the object with codegen/n23rt.c to run it
+        if (objectName != nullptr && !parser->had_error && status == 0) {
+            Module module;
+            status = BytecodeCompiler().compile(root, module);
+            if (status == 0) {
+                PeepholeOptimizer optimizer;
+                optimizer.optimize(module);
+                optimizer.schedule(module);
+                status = NativeCompiler().compile(module, objectName);
+            }
+        }
+
+        // Run it later with --load
+        if (imageName != nullptr && !parser->had_error && status == 0) {
+            Module module;
+            status = BytecodeCompiler().compile(root, module);
+            if (status == 0) {
+                PeepholeOptimizer optimizer;
+                optimizer.optimize(module);
+                optimizer.schedule(module);
+                ModuleImage image;
+                image.build(module);
+                status = image.write(imageName);
+            }
         }
-                    parser->printParsedAST(root);
 
-        return 0;
-}
\ No newline at end of file
+        if (stats)
+            stats_report(stderr, stats == 2);
+        return status;
+}
@@ -0,0 +1,255 @@
+//parallel_parser.cpp
+// Parallel parsing of the top-level declarations of a program.
+//
+// Top-level decls end with ';' at begin/end nesting depth zero, and routine
+// bodies are self-contained begin ... end blocks. The whole file is scanned
+// into a token array (by a ParallelScanner), then the declarations are
+// parsed in order on the calling thread, except that routine bodies (and the
+// main block) are only skipped over. Once every global is declared, the
+// global scope is frozen and the skipped bodies are parsed by worker
+// threads, each with its own token-array Parser and scope chain on top of
+// the shared global scope. The resulting decl list is in source order.
+//
+// Each global records the index of its declaring token, and a worker sees
+// only the globals declared before its body, as the sequential parser does.
+// Messages are kept per declaration and written in source order once the
+// workers are done. A syntax error that makes the sequential parser exit
+// throws Parser::SyntaxAbort instead, and the program's messages end with
+// it: those of the declarations before it are written, then the parse exits.
+#include "../include/parser.h"
+#include "../include/ParallelScanner.h"
+#include "../include/type_check.h"
+#include "../include/frame_layout.h"
+#include <thread>
+#include <atomic>
+
+// A routine body or main block whose parsing was deferred to a worker
+struct BodyJob {
+    int begin;              // index of the 'begin' token
+    int end;                // index of the ';' token ending the declaration
+    SymbolTable* scope;     // scope the body is parsed in
+    bool mainBlock;         // true for a top-level begin-end block
+    STEntry* routine;       // routine's symbol table entry
+    ste_list* formals;      // routine's formal parameters
+    j_type resultType;      // type_none for procedures
+    int slot;               // index of the decl in the decl list
+    bool had_error;
+    bool aborted;           // stopped at a syntax error
+    std::string errors;     // text for the error file
+    std::string output;     // text for stdout
+};
+
+// The messages of one top-level declaration, in the order they are written
+struct DeclMessages {
+    std::string errors;     // text for the error file
+    std::string output;     // text for stdout
+    int job;                // whose messages follow, if the decl has a body; or -1
+    bool aborted;           // the parse stops at this decl
+};
+
+static void parseBody(TOKEN** tokens, BodyJob& job, std::vector<AST*>& decls) {
+    PhaseTimer timer(phase_parse);
+    SymbolTable* savedScope = current_scope;
+    Parser worker(tokens, job.begin, job.end + 1, job.scope);
+    worker.currentToken = worker.tokens[worker.tokenPos++];
+
+    try {
+        AST* body;
+        if (job.mainBlock) {
+            enter_scope();
+            body = worker.parseBlock();
+            exit_scope();
+        } else {
+            body = worker.parseBlock();
+        }
+        worker.match(lx_semicolon);
+
+        if (job.mainBlock)
+            decls[job.slot] = body;
+        else
+            decls[job.slot] = make_ast_node(ast_routine_decl, job.routine, job.formals,
+                                            job.resultType, body);
+    } catch (Parser::SyntaxAbort&) {
+        job.aborted = true;
+    }
+
+    job.had_error = worker.had_error;
+    job.errors = worker.deferredErrorText();
+    job.output = worker.deferredOutputText();
+
+    current_scope = savedScope;
+}
+
+// Index of the ';' that ends the top-level declaration starting at start,
+// or of the end of file token if there is none
+int Parser::findDeclEnd(int start) {
+    int depth = 0;
+    for (int i = start; i < tokenEnd; i++) {
+        switch (tokens[i]->type) {
+            case kw_begin:
+                depth++;
+                break;
+            case kw_end:
+                depth--;
+                break;
+            case lx_semicolon:
+                if (depth <= 0)
+                    return i;
+                break;
+            case lx_eof:
+                return i;
+            default:
+                break;
+        }
+    }
+    return tokenEnd - 1;
+}
+
+AST* Parser::start_parallel_parsing(int num_threads) {
+    TRACE("Starting parallel parsing...");
+    PhaseTimer timer(phase_parse);
+
+    // Scan the whole file up front, in parallel when it can be read into memory
+    long length = 0;
+    char* source = (fd && fd->GetFileName()) ? FileDescriptor::LoadFile(fd->GetFileName(), &length) : nullptr;
+    if (source != nullptr) {
+        tokenBuffer = ParallelScanner(source, length, num_threads).ScanAll();
+        delete[] source;
+    } else {
+        TOKEN* token;
+        do {
+            token = scanner->Scan();
+            tokenBuffer.push_back(token);
+        } while (token->type != lx_eof);
+    }
+
+    tokens = tokenBuffer.data();
+    tokenPos = 0;
+    tokenEnd = (int)tokenBuffer.size();
+
+    // Declarations in order; routine bodies are left as jobs
+    std::vector<AST*> decls;
+    std::vector<BodyJob> jobs;
+    std::vector<DeclMessages> messages;
+
+    try {
+        currentToken = nextToken();
+        match(kw_program);
+    } catch (SyntaxAbort&) {
+        messages.push_back(DeclMessages{deferredErrors.str(), deferredOutput.str(), -1, true});
+    }
+
+    while (messages.empty() || !messages.back().aborted) {
+        if (currentToken->type == lx_eof)
+            break;
+        int declStart = tokenPos - 1;
+        int body = -1;
+        bool aborted = false;
+
+        try {
+            if (currentToken->type == kw_function || currentToken->type == kw_procedure ||
+                currentToken->type == kw_begin) {
+                BodyJob job = BodyJob();
+                job.mainBlock = (currentToken->type == kw_begin);
+                job.resultType = type_none;
+
+                if (job.mainBlock) {
+                    job.scope = current_scope;
+                } else {
+                    bool isFunction = (currentToken->type == kw_function);
+                    match(currentToken->type);
+                    TOKEN* idToken = match(lx_identifier);
+
+                    job.routine = checkAndAddSymbol(idToken, STE_ROUTINE);
+
+                    enter_scope();
+
+                    match(lx_lparen);
+                    job.formals = parseFormalList();
+                    if (isFunction) {
+                        match(lx_colon);
+                        job.resultType = parseType();
+                    }
+
+                    job.routine->Formals = job.formals;
+                    job.routine->ResultType = job.resultType;
+                    job.scope = current_scope;
+
+                    exit_scope();
+                }
+
+                // Skip the body, which starts at the current token, and the
+                // ';' after it, which the worker matches
+                job.begin = tokenPos - 1;
+                job.end = findDeclEnd(declStart);
+                job.slot = (int)decls.size();
+                body = (int)jobs.size();
+                jobs.push_back(job);
+                decls.push_back(nullptr);
+
+                tokenPos = job.end + 1;
+                currentToken = nextToken();
+            } else {
+                decls.push_back(parseDecl());
+                match(lx_semicolon);
+            }
+        } catch (SyntaxAbort&) {
+            aborted = true;
+        }
+        messages.push_back(DeclMessages{deferredErrors.str(), deferredOutput.str(), body, aborted});
+        deferredErrors.str("");
+        deferredOutput.str("");
+    }
+
+    // Every global is declared now; share the global scope read-only
+    table->Freeze();
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > (int)jobs.size())
+        num_threads = (int)jobs.size();
+
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nextJob.fetch_add(1)) < jobs.size())
+            parseBody(tokens, jobs[i], decls);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    // Report the errors in source order, up to a syntax error that stops
+    // the parse, as the sequential parser does
+    for (auto& decl : messages) {
+        errorFile << decl.errors;
+        std::cout << decl.output;
+        bool aborted = decl.aborted;
+        if (decl.job >= 0) {
+            BodyJob& job = jobs[decl.job];
+            errorFile << job.errors;
+            std::cout << job.output;
+            had_error = had_error || job.had_error;
+            aborted = aborted || job.aborted;
+        }
+        if (aborted) {
+            errorFile << std::flush;
+            exit(1);
+        }
+    }
+    errorFile << std::flush;
+
+    ast_list* declList = nullptr;
+    for (int i = (int)decls.size() - 1; i >= 0; i--)
+        declList = cons_ast(decls[i], declList);
+
+    AST* programAST = make_ast_node(ast_program, declList);
+    if (check_types(programAST, errorFile) > 0)
+        had_error = true;
+    layout_frames(programAST);
+    return programAST;
+}
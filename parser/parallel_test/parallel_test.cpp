@@ -0,0 +1,221 @@
+// Parses programs with errors sequentially and with --parallel's parser on
+// 1, 2 and 4 threads, and checks that each mode writes the same
+// parse_errors.txt and stops the same way: syntax errors inside routine
+// bodies, which make the parser exit, and bodies that use globals or call
+// routines declared after them, which neither mode can see. The lexical
+// errors the scanner threads print have to come out in source order too.
+// Each parse runs in a child process, since a syntax error exits.
+// Usage: parallel_test   (run from parser/: the parser writes ../tests/output)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../include/parser.h"
+#include "../../tests/test_util.h"
+
+struct Case {
+    const char *name;
+    const char *source;
+    const char *expected;   // in the sequential parser's messages
+    std::string (*generate)();  // the source, if source is nullptr
+};
+
+// Fifty bodies, each using an undefined name, so messages from many
+// workers have to come out in source order
+static std::string manyBodies() {
+    std::string program = "program\nvar x : integer;\n";
+    for (int i = 0; i < 50; i++)
+        program += "procedure p" + std::to_string(i) + "()\nbegin x := u" + std::to_string(i) +
+                   "; end;\n";
+    return program + "begin x := 1; end;\n";
+}
+
+// A bad character on each of 400 lines, so every scanner thread reports some
+static std::string manyLexicalErrors() {
+    std::string program = "program\nvar x : integer;\nbegin\n";
+    for (int i = 0; i < 400; i++)
+        program += "    x := " + std::to_string(i) + " @ " + std::to_string(i) + ";\n";
+    return program + "end;\n";
+}
+
+static const Case cases[] = {
+    {"syntax error in body",
+     "program\n"
+     "var x : integer;\n"
+     "function f(n : integer) : integer\n"
+     "begin\n"
+     "    x := n\n"
+     "    return(n);\n"
+     "end;\n"
+     "begin x := 1; end;\n",
+     "Match Syntax Error: Expected token of type Semicolon but found Keyword return"},
+
+    {"syntax error in block",
+     "program\n"
+     "var x : integer;\n"
+     "begin write(y); end;\n"
+     "begin x := 1 end;\n"
+     "procedure p()\n"
+     "begin write(z); end;\n",
+     "Match Syntax Error"},
+
+    {"stops at the first",
+     "program\n"
+     "var x : integer;\n"
+     "procedure p()\n"
+     "begin x := a; end;\n"
+     "procedure q()\n"
+     "begin x := 1 x := 2; end;\n"
+     "procedure r()\n"
+     "begin x := b; end;\n"
+     "var x : integer;\n"
+     "begin x := 1 end;\n",
+     "Undefined identifier: a"},
+
+    {"syntax error in header",
+     "program\n"
+     "procedure p()\n"
+     "begin write(a); end;\n"
+     "function f(n integer) : integer\n"
+     "begin return(n); end;\n",
+     "Match Syntax Error"},
+
+    {"syntax error in global",
+     "program\n"
+     "procedure p()\n"
+     "begin write(a); end;\n"
+     "var x integer;\n"
+     "begin write(b); end;\n",
+     "Match Syntax Error"},
+
+    {"missing semicolon",
+     "program\n"
+     "var x : integer;\n"
+     "begin x := 1; end\n",
+     "Match Syntax Error"},
+
+    {"global declared later",
+     "program\n"
+     "function f(n : integer) : integer\n"
+     "begin\n"
+     "    return(n + later);\n"
+     "end;\n"
+     "begin write(later); end;\n"
+     "var later : integer;\n"
+     "begin later := 2; write(later); end;\n",
+     "Undefined identifier: later"},
+
+    {"routine declared later",
+     "program\n"
+     "var x : integer;\n"
+     "begin x := g(1); end;\n"
+     "function g(n : integer) : integer\n"
+     "begin return(g(n - 1)); end;\n",
+     "Undefined identifier: g"},
+
+    {"constant declared later",
+     "program\n"
+     "var x : integer;\n"
+     "procedure p()\n"
+     "begin x := k + m; end;\n"
+     "constant k = m + 1;\n"
+     "begin x := k + m; end;\n",
+     "Undefined identifier: m"},
+
+    {"redeclaration",
+     "program\n"
+     "var x : integer;\n"
+     "procedure p()\n"
+     "begin var y : integer; var y : integer; x := y; end;\n"
+     "var x : integer;\n",
+     "Redeclaration"},
+
+    {"many bodies", nullptr, "Undefined identifier: u49", manyBodies},
+
+    {"many lexical errors", nullptr, "found Illegal Token", manyLexicalErrors},
+
+    {"no errors",
+     "program\n"
+     "var x : integer;\n"
+     "function f(n : integer) : integer\n"
+     "begin if n < 2 then return(n) fi; return(f(n - 1) + x); end;\n"
+     "begin x := f(10); write(x); end;\n",
+     ""},
+};
+
+static int failures = 0;
+
+// Parses fileName in a child, with threads workers or sequentially if 0;
+// returns the exit status, 2 if the parse failed without exiting, and sets
+// errors to what it wrote to parse_errors.txt and output to its stdout
+static int parse(const char *fileName, int threads, std::string &errors, std::string &output) {
+    std::string outputName = std::string(fileName) + ".out";
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        if (freopen(outputName.c_str(), "w", stdout) == nullptr)
+            _exit(3);
+        Parser *parser = new Parser(new FileDescriptor(fileName));
+        if (threads > 0)
+            parser->start_parallel_parsing(threads);
+        else
+            parser->start_parsing();
+        int status = parser->had_error ? 2 : 0;
+        delete parser;
+        exit(status);
+    }
+    int status = -1;
+    waitpid(child, &status, 0);
+    errors = test_contents("../tests/output/parse_errors.txt");
+    output = test_contents(outputName.c_str());
+    remove(outputName.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main() {
+    char fileName[] = "/tmp/parallel_test.XXXXXX";
+    int fd = mkstemp(fileName);
+    if (fd < 0) {
+        printf("cannot make a file\n");
+        return 1;
+    }
+    close(fd);
+
+    for (const Case &test : cases) {
+        std::string source = test.source ? test.source : test.generate();
+        FILE *file = fopen(fileName, "w");
+        fputs(source.c_str(), file);
+        fclose(file);
+
+        std::string expected, output, oneThread;
+        int expectedStatus = parse(fileName, 0, expected, output);
+        bool ok = expected.find(test.expected) != std::string::npos &&
+                  (*test.expected != 0 || expected.empty());
+        printf("%-26s sequential  %s\n", test.name, ok ? "ok" : "FAILED");
+        if (!ok) {
+            printf("  status %d, messages:\n%s", expectedStatus, expected.c_str());
+            failures++;
+        }
+        for (int threads : {1, 2, 4}) {
+            // The scanner prints lexical errors as one chunk would
+            std::string errors;
+            int status = parse(fileName, threads, errors, output);
+            if (threads == 1)
+                oneThread = output;
+            ok = status == expectedStatus && errors == expected && output == oneThread;
+            printf("%-26s %d thread%s   %s\n", test.name, threads, threads == 1 ? " " : "s",
+                   ok ? "ok" : "FAILED");
+            if (!ok) {
+                printf("  status %d, expected %d, messages:\n%s  expected:\n%s", status,
+                       expectedStatus, errors.c_str(), expected.c_str());
+                failures++;
+            }
+        }
+    }
+
+    remove(fileName);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -1,13 +1,29 @@
 #include "../include/parser.h"
+#include "../include/type_check.h"
+#include "../include/frame_layout.h"
+#include <limits.h>
 #include <stdarg.h>
 #include <vector>
 #include <fstream>
 
-Parser::Parser(FileDescriptor* fd) {
-    scanner = new Scanner(fd);
+Parser::Parser(FileDescriptor* fd) : Parser(new Scanner(fd)) {
+    this->fd = fd;
+}
+
+// Parses the tokens of any lexer; the parser takes ownership of it
+Parser::Parser(Lexer* lexer) {
+    this->fd = nullptr;
+    scanner = lexer;
+    // One token at a time, so the lexer stays on currentToken and its error
+    // reports show that token's line; batches weren't measurably faster
+    stream = new TokenStream(lexer, 1);
+    tokens = nullptr;
+    tokenPos = 0;
+    tokenEnd = 0;
+    visibleBefore = INT_MAX;
     table = new SymbolTable();
     current_scope = table;
-    currentToken = new TOKEN();
+    currentToken = nullptr;
     programAST = nullptr;
     had_error = false;
     
@@ -17,13 +33,84 @@ Parser::Parser(FileDescriptor* fd) {
     }
 }
 
+// Token-array parser: parses tokens[begin..end) in the given scope. Used for
+// the worker parsers of start_parallel_parsing, so it doesn't own a scanner or
+// the global table, and it keeps its error messages until the caller collects them.
+// It sees only the globals declared before begin.
+Parser::Parser(TOKEN** tokens, int begin, int end, SymbolTable* scope) {
+    this->fd = nullptr;
+    scanner = nullptr;
+    stream = nullptr;
+    table = nullptr;
+    this->tokens = tokens;
+    tokenPos = begin;
+    tokenEnd = end;
+    visibleBefore = begin;
+    current_scope = scope;
+    currentToken = nullptr;
+    programAST = nullptr;
+    had_error = false;
+}
+
 Parser::~Parser() {
     if (errorFile.is_open()) {
         errorFile.close();
     }
+    // currentToken belongs to the stream or the token array
+    delete stream;
     delete scanner;
     delete table;
-    delete currentToken;
+}
+
+// Returned past the end of a token array's range
+static TOKEN* eofToken() {
+    static TOKEN* token = []() {
+        TOKEN* token = new TOKEN();
+        token->type = lx_eof;
+        return token;
+    }();
+    return token;
+}
+
+TOKEN* Parser::nextToken() {
+    if (tokens == nullptr)
+        return stream->next();
+
+    if (tokenPos < tokenEnd)
+        return tokens[tokenPos++];
+    return eofToken();
+}
+
+TOKEN* Parser::peekToken(int k) {
+    if (tokens == nullptr)
+        return stream->peek(k);
+
+    if (k >= 1 && tokenPos + k - 1 < tokenEnd)
+        return tokens[tokenPos + k - 1];
+    return eofToken();
+}
+
+int Parser::lineNum() {
+    // The scanner may have read ahead of this token
+    return currentToken ? currentToken->line : 0;
+}
+
+void Parser::reportError(char* msg) {
+    if (tokens == nullptr && stream->buffered() == 0) {
+        scanner->ReportError(msg);
+        return;
+    }
+    // The scanner has already read past this token, so only its line is
+    // known. Token-array parsers keep the text for start_parallel_parsing
+    // to print in source order.
+    std::ostream& out = (tokens == nullptr) ? std::cout : deferredOutput;
+    out << msg << " on line: " << lineNum() << '\n';
+}
+
+std::ostream& Parser::errorOut() {
+    if (tokens == nullptr)
+        return errorFile;
+    return deferredErrors;
 }
 
 const char* Parser::getTokenTypeName(LEXEME_TYPE type) {
@@ -89,16 +176,18 @@ const char* Parser::getTokenTypeName(LEXEME_TYPE type) {
 TOKEN* Parser::match(LEXEME_TYPE expected) {
     if (currentToken->type == expected) {
         TOKEN* matchedToken = currentToken;
-        std::cout << "Matched token: " << getTokenTypeName(currentToken->type) << std::endl;
-        currentToken = scanner->Scan();
+        TRACE("Matched token: " << getTokenTypeName(currentToken->type));
+        currentToken = nextToken();
         return matchedToken;
     } else {
         had_error = true;
-        errorFile << "Match Syntax Error: Expected token of type " 
+        errorOut() << "Match Syntax Error: Expected token of type " 
                   << getTokenTypeName(expected) 
                   << " but found " 
                   << getTokenTypeName(currentToken->type) 
-                  << "." << "on line:" << scanner->getLineNum() << std::endl;
+                  << "." << "on line:" << lineNum() << std::endl;
+        if (tokens != nullptr)
+            throw SyntaxAbort();
         exit(1);
         return nullptr;
     }
@@ -109,8 +198,8 @@ void Parser::checkForRedeclaration(TOKEN* idToken) {
     if (STE != nullptr){
         had_error = true;
         char error_msg[] = "Syntax Error: Redeclaration of identifier2";
-        scanner->fd->ReportError(error_msg);
-        errorFile << error_msg << std::endl;
+        reportError(error_msg);
+        errorOut() << error_msg << std::endl;
         return;
     }
 }
@@ -120,43 +209,67 @@ STEntry* Parser::checkAndAddSymbol(TOKEN* idToken, STE_TYPE steType) {
     if (STE != nullptr){
         had_error = true;
         char error_msg[] = "Syntax Error: Redeclaration of identifier1";
-        scanner->fd->ReportError(error_msg);
-        errorFile << error_msg << std::endl;
+        reportError(error_msg);
+        errorOut() << error_msg << std::endl;
         return nullptr;
     }
-    return current_scope->PutSymbol(idToken->str_ptr, steType, scanner->getLineNum());
+    return addSymbol(idToken->str_ptr, steType);
+}
+
+// A global parsed from a token array records where it was declared, for
+// lookupSymbol
+STEntry* Parser::addSymbol(char* name, STE_TYPE steType) {
+    STEntry* STE = current_scope->PutSymbol(name, steType, lineNum());
+    if (STE != nullptr && tokens != nullptr && current_scope->next == nullptr)
+        STE->Token = tokenPos - 1;
+    return STE;
+}
+
+STEntry* Parser::lookupSymbol(TOKEN* idToken) {
+    STEntry* STE = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+    if (STE != nullptr && STE->Token >= visibleBefore)
+        return nullptr;
+    return STE;
 }
 
 void Parser::scan_and_check_illegal_token() {
-    currentToken = scanner->Scan();
+    currentToken = nextToken();
     
     if (currentToken->type == illegal_token) {
         had_error = true;
-        errorFile << "Error: Illegal token encountered from parser." << std::endl;
+        errorOut() << "Error: Illegal token encountered from parser." << std::endl;
     }
 }
 
-void Parser::printParsedAST(AST* node) {
+void Parser::printParsedAST(AST* node, const char* path) {
     if (node == nullptr) {
         std::cout << "Error: Null AST node encountered." << std::endl;
         return;
     }
-    FILE* outputFile = fopen("../tests/output/output_program.txt", "w");
-
-    print_ast_node(outputFile, node);
+    PhaseTimer timer(phase_print);
+    long bytes = print_ast_file(path, node);
+    if (bytes < 0) {
+        std::cout << "Error: Could not write " << path << std::endl;
+        return;
+    }
+    stats_count(count_output_bytes, bytes);
 }
 
 AST* Parser::start_parsing() {
-    std::cout << "Starting parsing..." << std::endl;
-    
+    TRACE("Starting parsing...");
+    PhaseTimer timer(phase_parse);
+
     ast_list* programStatements = parseProgram();
     AST* programAST = make_ast_node(ast_program, programStatements);
+    if (check_types(programAST, errorOut()) > 0)
+        had_error = true;
+    layout_frames(programAST);
 
     return programAST;
 }
 
 ast_list* Parser::parseProgram() {
-    currentToken = scanner->Scan();
+    currentToken = nextToken();
     match(kw_program);
     ast_list* declList = parseDeclList();
     
@@ -164,18 +277,19 @@ ast_list* Parser::parseProgram() {
 }
 
 
+// Lists are built in a loop, appending through a pointer to the last tail,
+// so a long list costs no stack
 ast_list* Parser::parseDeclList() {
     ast_list* declList = nullptr;
+    ast_list** tail = &declList;
 
-    if(currentToken->type == lx_eof) {
-        return declList;
-    }
-    else {
+    while (currentToken->type != lx_eof) {
         AST* decl = parseDecl();
         match(lx_semicolon);
-        declList = cons_ast(decl, parseDeclList());
-        return declList;
+        *tail = cons_ast(decl, nullptr);
+        tail = &(*tail)->tail;
     }
+    return declList;
 }
 
 STE_TYPE getSTE_type(j_type typeNode) {
@@ -218,7 +332,7 @@ AST* Parser::parseDecl() {
             STE = checkAndAddSymbol(idToken, STE_INT);
             
             AST* exprNode = parseExpr();
-            STE->ConstValue = eval_ast_expr(scanner->fd, exprNode);
+            STE->ConstValue = eval_ast_expr(scanner, exprNode);
             
             declNode = make_ast_node(ast_const_decl, STE, make_ast_node(ast_integer, STE->ConstValue));
             break;
@@ -277,7 +391,7 @@ AST* Parser::parseDecl() {
         
         default: {
             had_error = true;
-            errorFile << "Syntax Error: Expected a declaration but found " 
+            errorOut() << "Syntax Error: Expected a declaration but found " 
                       << getTokenTypeName(currentToken->type) 
                       << "." << std::endl;
             break;
@@ -312,7 +426,7 @@ j_type Parser::parseType() {
             return type_boolean;
         default:
             had_error = true;
-            errorFile << "Syntax Error: Expected a type but found " 
+            errorOut() << "Syntax Error: Expected a type but found " 
                       << getTokenTypeName(currentToken->type) 
                       << "." << std::endl;
     }
@@ -320,133 +434,59 @@ j_type Parser::parseType() {
 }
 
 
-AST* Parser::parseExpr() {
-    AST* leftNode = parseExpr2();
-    return parseExprTail(leftNode);
-}
-
-AST* Parser::parseExprTail(AST* leftNode) {
-    if (currentToken->type == kw_and || currentToken->type == kw_or) {
-        AST_type nodeType;
-        
-        if (currentToken->type == kw_and) {
-            match(kw_and);
-            nodeType = ast_and;
-        } else {
-            match(kw_or);
-            nodeType = ast_or;
-        }
-        
-        AST* rightNode = parseExpr2();
-        AST* binaryNode = make_ast_node(nodeType, leftNode, rightNode);
-        return parseExprTail(binaryNode);
-    }
-    
-    return leftNode;
-}
-
-AST* Parser::parseExpr2() {
-    AST* leftNode = parseExpr3();
-    return parseExpr2Tail(leftNode);
-}
+// Binary operators: the binding power of each token and the node it
+// makes, 0 for tokens that don't continue an expression. From loosest to
+// tightest: and/or, relational, additive, multiplicative.
+struct BinaryOperator {
+    unsigned char power;
+    unsigned char node;     // AST_type
+};
 
-AST* Parser::parseExpr2Tail(AST* leftNode) {
-    if (currentToken->type == lx_eq || currentToken->type == lx_neq || 
-        currentToken->type == lx_lt || currentToken->type == lx_le ||
-        currentToken->type == lx_gt || currentToken->type == lx_ge) {
-            
-        AST_type nodeType;
-        
-        switch (currentToken->type) {
-            case lx_eq:
-                match(lx_eq);
-                nodeType = ast_eq;
-                break;
-            case lx_neq:
-                match(lx_neq);
-                nodeType = ast_neq;
-                break;
-            case lx_lt:
-                match(lx_lt);
-                nodeType = ast_lt;
-                break;
-            case lx_le:
-                match(lx_le);
-                nodeType = ast_le;
-                break;
-            case lx_gt:
-                match(lx_gt);
-                nodeType = ast_gt;
-                break;
-            case lx_ge:
-                match(lx_ge);
-                nodeType = ast_ge;
-                break;
-            default:
-                had_error = true;
-                errorFile << "Unexpected relational operator" << std::endl;
-                return nullptr;
-        }
-        
-        AST* rightNode = parseExpr3();
-        AST* binaryNode = make_ast_node(nodeType, leftNode, rightNode);
-        return parseExpr2Tail(binaryNode);
-    }
-    
-    return leftNode;
-}
+struct BinaryOperatorTable {
+    BinaryOperator op[illegal_token + 1];
+};
 
-AST* Parser::parseExpr3() {
-    AST* leftNode = parseExpr4();
-    return parseExpr3Tail(leftNode);
+constexpr BinaryOperatorTable makeBinaryOperators() {
+    BinaryOperatorTable t{};
+    t.op[kw_and] = {1, ast_and};
+    t.op[kw_or] = {1, ast_or};
+    t.op[lx_eq] = {2, ast_eq};
+    t.op[lx_neq] = {2, ast_neq};
+    t.op[lx_lt] = {2, ast_lt};
+    t.op[lx_le] = {2, ast_le};
+    t.op[lx_gt] = {2, ast_gt};
+    t.op[lx_ge] = {2, ast_ge};
+    t.op[lx_plus] = {3, ast_plus};
+    t.op[lx_minus] = {3, ast_minus};
+    t.op[lx_star] = {4, ast_times};
+    t.op[lx_slash] = {4, ast_divide};
+    return t;
 }
 
-AST* Parser::parseExpr3Tail(AST* leftNode) {
-    if (currentToken->type == lx_plus || currentToken->type == lx_minus) {
-        AST_type nodeType;
-        
-        if (currentToken->type == lx_plus) {
-            match(lx_plus);
-            nodeType = ast_plus;
-        } else {
-            match(lx_minus);
-            nodeType = ast_minus;
-        }
-        
-        AST* rightNode = parseExpr4();
-        AST* binaryNode = make_ast_node(nodeType, leftNode, rightNode);
-        return parseExpr3Tail(binaryNode);
-    }
-    
-    return leftNode;
-}
+static constexpr BinaryOperatorTable binary_operators = makeBinaryOperators();
 
-AST* Parser::parseExpr4() {
-    AST* leftNode = parseExpr5();
-    return parseExpr4Tail(leftNode);
+AST* Parser::parseExpr() {
+    return parseBinaryExpr(1);
 }
 
-AST* Parser::parseExpr4Tail(AST* leftNode) {
-    if (currentToken->type == lx_star || currentToken->type == lx_slash) {
-        AST_type nodeType;
-        
-        if (currentToken->type == lx_star) {
-            match(lx_star);
-            nodeType = ast_times;
-        } else {
-            match(lx_slash);
-            nodeType = ast_divide;
-        }
-        
-        AST* rightNode = parseExpr5();
-        AST* binaryNode = make_ast_node(nodeType, leftNode, rightNode);
-        return parseExpr4Tail(binaryNode);
+// Precedence climbing: an operand, then every operator binding at least
+// minPower, each with a right operand of the operators that bind tighter.
+// Operators of equal power fold into the left operand, so they associate
+// to the left, and the recursion is as deep as the precedence levels, not
+// as long as the expression.
+AST* Parser::parseBinaryExpr(int minPower) {
+    AST* leftNode = parseUnaryExpr();
+    while (true) {
+        BinaryOperator op = binary_operators.op[currentToken->type];
+        if (op.power < minPower || op.power == 0)
+            return leftNode;
+        match(currentToken->type);
+        AST* rightNode = parseBinaryExpr(op.power + 1);
+        leftNode = make_ast_node((AST_type)op.node, leftNode, rightNode);
     }
-    
-    return leftNode;
 }
 
-AST* Parser::parseExpr5() {
+AST* Parser::parseUnaryExpr() {
     if (currentToken->type == lx_minus || currentToken->type == kw_not) {
         AST_type nodeType;
         
@@ -473,11 +513,11 @@ AST* Parser::parsePrimaryExpr() {
     switch (currentToken->type) {
         case lx_identifier: {
             TOKEN* idToken = match(lx_identifier);
-            STEntry* entry = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+            STEntry* entry = lookupSymbol(idToken);
             if (!entry) {
                 had_error = true;
-                errorFile << "Undefined identifier: " << idToken->str_ptr << std::endl;
-                entry = current_scope->PutSymbol(idToken->str_ptr, STE_INT, scanner->getLineNum());
+                errorOut() << "Undefined identifier: " << idToken->str_ptr << std::endl;
+                entry = addSymbol(idToken->str_ptr, STE_INT);
             }
             
             node = make_ast_node(ast_var, entry);
@@ -493,7 +533,10 @@ AST* Parser::parsePrimaryExpr() {
         
         case lx_string: {
             TOKEN* strToken = match(lx_string);
-            node = make_ast_node(ast_string, strToken->str_ptr);
+            // The token's buffer is reused, so the node gets a copy
+            char* text = strdup(strToken->str_ptr);
+            stats_count(count_bytes_allocated, strlen(text) + 1);
+            node = make_ast_node(ast_string, text);
             break;
         }
         
@@ -518,9 +561,9 @@ AST* Parser::parsePrimaryExpr() {
         
         default: {
             had_error = true;
-            errorFile << "Syntax Error: Expected a primary expression but found " 
+            errorOut() << "Syntax Error: Expected a primary expression but found " 
                       << getTokenTypeName(currentToken->type) 
-                      << "on line:" << scanner->fd->GetLineNum() << std::endl;
+                      << "on line:" << lineNum() << std::endl;
             node = make_ast_node(ast_integer, 0);
             break;
         }
@@ -533,7 +576,7 @@ AST* Parser::parsePrimaryExprTail(AST* idNode) {
     if (currentToken->type == lx_lparen) {
         if (idNode->type != ast_var) {
             had_error = true;
-            errorFile << "Expected a function name." << std::endl;
+            errorOut() << "Expected a function name." << std::endl;
             return idNode;
         }
         
@@ -598,16 +641,16 @@ ste_list* Parser::parseVarDeclList() {
     if(noVariableDecl()) 
         return nullptr;
     ste_list* varDeclList = nullptr;
-    STEntry* varDecl = parseVarDecl();
+    ste_list** tail = &varDeclList;
 
-    match(lx_semicolon);
+    do {
+        STEntry* varDecl = parseVarDecl();
+        match(lx_semicolon);
+        *tail = cons_ste(varDecl, nullptr);
+        tail = &(*tail)->tail;
+    } while (currentToken->type == kw_var);
 
-    if (currentToken->type == kw_var) {
-        varDeclList = cons_ste(varDecl, parseVarDeclList());
-    } else {
-        varDeclList = cons_ste(varDecl, nullptr);
-    }
-      return varDeclList;
+    return varDeclList;
 }
 
 bool Parser::noVariableDecl() {
@@ -636,16 +679,14 @@ STEntry* Parser::parseVarDecl() {
 
 ast_list* Parser::parseStmtList() {
     ast_list* stmtList = nullptr;
-    
-    if (currentToken->type == kw_end) {
-        return stmtList;
+    ast_list** tail = &stmtList;
+
+    while (currentToken->type != kw_end) {
+        AST* stmtNode = parseStmt();
+        match(lx_semicolon);
+        *tail = cons_ast(stmtNode, nullptr);
+        tail = &(*tail)->tail;
     }
-    
-    AST* stmtNode = parseStmt();
-    match(lx_semicolon);
-    
-    stmtList = cons_ast(stmtNode, parseStmtList());
-    
     return stmtList;
 }
 
@@ -654,11 +695,11 @@ AST* Parser::parseStmt() {
     switch (currentToken->type) {
         case lx_identifier: {
             TOKEN* idToken = match(lx_identifier);
-            STEntry* entry = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+            STEntry* entry = lookupSymbol(idToken);
             if (entry == nullptr) {
                 had_error = true;
-                errorFile << "Undefined identifier: " << idToken->str_ptr << std::endl;
-                scanner->fd->ReportError(" ");
+                errorOut() << "Undefined identifier: " << idToken->str_ptr << std::endl;
+                reportError(" ");
             }
 
             return parseStmtIdTail(entry);
@@ -685,11 +726,11 @@ AST* Parser::parseStmt() {
         case kw_for : {
             match(kw_for);
             TOKEN* idToken = match(lx_identifier);
-            STEntry* entry = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+            STEntry* entry = lookupSymbol(idToken);
             if(entry == nullptr) {
                 had_error = true;
-                errorFile << "Undefined identifier: " << idToken->str_ptr << "on line: " 
-                          << scanner->getLineNum() << std::endl;
+                errorOut() << "Undefined identifier: " << idToken->str_ptr << "on line: " 
+                          << lineNum() << std::endl;
             }
             match(lx_colon_eq);
             AST* lowerBoundNode = parseExpr();
@@ -706,11 +747,11 @@ AST* Parser::parseStmt() {
             match(kw_read);
             match(lx_lparen);
             TOKEN* idToken = match(lx_identifier);
-            STEntry* entry = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+            STEntry* entry = lookupSymbol(idToken);
             if (entry == nullptr) {
                 had_error = true;
-                errorFile << "Undefined identifier: " << idToken->str_ptr << std::endl;
-                scanner->fd->ReportError(" ");
+                errorOut() << "Undefined identifier: " << idToken->str_ptr << std::endl;
+                reportError(" ");
             }
             match(lx_rparen);
             stmtNode = make_ast_node(ast_read, entry);
@@ -721,11 +762,11 @@ AST* Parser::parseStmt() {
             match(kw_write);
             match(lx_lparen);
             TOKEN* idToken = match(lx_identifier);
-            STEntry* entry = current_scope->GetSymbolFromScopes(idToken->str_ptr);
+            STEntry* entry = lookupSymbol(idToken);
             if (entry == nullptr) {
                 had_error = true;
-                errorFile << "Undefined identifier: " << idToken->str_ptr << std::endl;
-                scanner->fd->ReportError(" ");
+                errorOut() << "Undefined identifier: " << idToken->str_ptr << std::endl;
+                reportError(" ");
             }
             match(lx_rparen);
             stmtNode = make_ast_node(ast_write, entry);
@@ -749,7 +790,7 @@ AST* Parser::parseStmt() {
         }
         default: {
             had_error = true;
-            errorFile << "Syntax Error: Expected a statement but found " 
+            errorOut() << "Syntax Error: Expected a statement but found " 
                       << getTokenTypeName(currentToken->type) 
                       << "." << std::endl;
             break;
@@ -768,8 +809,8 @@ AST* Parser::parseStmtIdTail(STEntry* entry) {
         //assignment statement
         //check if entry is a function
         if (entry->Type == STE_ROUTINE) {
-            errorFile << "Semantic Error: Cannot assign to a function on line: " 
-                      << scanner->getLineNum() << std::endl;
+            errorOut() << "Semantic Error: Cannot assign to a function on line: " 
+                      << lineNum() << std::endl;
         }
         match(lx_colon_eq);
         AST* exprNode = parseExpr();
@@ -780,8 +821,8 @@ AST* Parser::parseStmtIdTail(STEntry* entry) {
         //note from grammar that the arg_list is the same as primary_expr_tail
         //check if entry is a variable
         if(entry->Type != STE_ROUTINE) {
-            errorFile << "Semantic Error: Expected a function call but found a variable on line: " 
-                      << scanner->getLineNum() << std::endl;
+            errorOut() << "Semantic Error: Expected a function call but found a variable on line: " 
+                      << lineNum() << std::endl;
             
             
         }
@@ -790,9 +831,9 @@ AST* Parser::parseStmtIdTail(STEntry* entry) {
         
     else {
         had_error = true;
-        errorFile << "Syntax Error: Expected assignment or function call but found " 
+        errorOut() << "Syntax Error: Expected assignment or function call but found " 
                   << getTokenTypeName(currentToken->type) 
-                  << "." << "on line: " << scanner->getLineNum() << std::endl;
+                  << "." << "on line: " << lineNum() << std::endl;
         
 
     }
@@ -0,0 +1,425 @@
+//stats.cpp
+// Per-thread phase times and counters, merged into a global total when a
+// thread exits. Hardware counters come from perf_event_open, one group per
+// thread, counting user mode only.
+#include "../include/stats.h"
+#include "../include/ast.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <mutex>
+
+bool stats_enabled = false;
+
+static const char* phase_names[NUM_PHASES] = {
+    "other", "io", "scan", "parse", "symbol", "print", "wait", "types", "layout", "compile",
+    "optimize", "codegen", "run"
+};
+
+static const char* counter_names[NUM_COUNTERS] = {
+    "source_bytes", "lines", "tokens", "ast_nodes", "list_cells",
+    "symbol_lookups", "symbol_probes", "symbol_hits", "symbols_added",
+    "scopes", "bytes_allocated", "output_bytes", "rewrites", "deopts",
+    "promotions", "code_bytes", "image_bytes"
+};
+
+// Names of the AST_type values, in order
+static const char* ast_type_names[] = {
+    "var_decl", "const_decl", "routine_decl", "assign", "if", "while", "for",
+    "read", "write", "call", "block", "return", "var", "integer", "string",
+    "boolean", "times", "divide", "plus", "minus", "eq", "neq", "lt", "le",
+    "gt", "ge", "and", "or", "cand", "cor", "not", "uminus", "eof", "float",
+    "itof", "program"
+};
+static_assert(sizeof(ast_type_names) / sizeof(ast_type_names[0]) == ast_program + 1,
+              "ast_type_names must match AST_type");
+static_assert(ast_program < STATS_AST_TYPES, "STATS_AST_TYPES is too small");
+
+// Hardware events, in the order they are opened; the first that opens
+// leads the group
+enum { event_cycles, event_instructions, event_branch_misses, event_cache_misses, NUM_EVENTS };
+
+static const char* event_names[NUM_EVENTS] = {
+    "cycles", "instructions", "branch_misses", "cache_misses"
+};
+
+static const unsigned long long event_configs[NUM_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+};
+
+struct StatsData {
+    double seconds[NUM_PHASES];
+    long calls[NUM_PHASES];
+    long counters[NUM_COUNTERS];
+    long nodes[STATS_AST_TYPES];
+    unsigned long long events[NUM_PHASES][NUM_EVENTS];
+    unsigned long long time_enabled, time_running;  // of the counter groups
+
+    void add(const StatsData& other) {
+        for (int i = 0; i < NUM_PHASES; i++) {
+            seconds[i] += other.seconds[i];
+            calls[i] += other.calls[i];
+            for (int e = 0; e < NUM_EVENTS; e++)
+                events[i][e] += other.events[i][e];
+        }
+        time_enabled += other.time_enabled;
+        time_running += other.time_running;
+        for (int i = 0; i < NUM_COUNTERS; i++)
+            counters[i] += other.counters[i];
+        for (int i = 0; i < STATS_AST_TYPES; i++)
+            nodes[i] += other.nodes[i];
+    }
+};
+
+static std::mutex total_mutex;
+static StatsData total;         // threads that have exited
+static double start_time;
+
+static bool counters_wanted = false;
+static bool event_opened[NUM_EVENTS];   // by the first thread to open them
+static int counters_error = 0;          // errno if no event could be opened
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The calling thread's hardware counters. A group is read with one
+// system call, so sampling at every phase change is affordable, though the
+// read itself perturbs the caches a little.
+struct Counters {
+    int fds[NUM_EVENTS];
+    int slot[NUM_EVENTS];       // position in the group's read, or -1
+    int leader;                 // -1 when nothing is being counted
+    int opened;
+    unsigned long long last[NUM_EVENTS];
+    unsigned long long last_enabled, last_running;
+
+    Counters() : leader(-1), opened(0), last(), last_enabled(0), last_running(0) {
+        for (int e = 0; e < NUM_EVENTS; e++) {
+            fds[e] = -1;
+            slot[e] = -1;
+        }
+    }
+    ~Counters() {
+        for (int e = 0; e < NUM_EVENTS; e++)
+            if (fds[e] >= 0) close(fds[e]);
+    }
+
+    // Returns 0, or the errno of the first event that failed if none opened
+    int open() {
+        int error = 0;
+        for (int e = 0; e < NUM_EVENTS; e++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = event_configs[e];
+            attr.exclude_kernel = 1;    // allowed at perf_event_paranoid 2
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = leader < 0;
+            fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[e] < 0) {
+                if (error == 0) error = errno;
+                continue;
+            }
+            if (leader < 0) leader = fds[e];
+            slot[e] = opened++;
+        }
+        if (leader < 0)
+            return error;
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        sample(last, &last_enabled, &last_running);
+        return 0;
+    }
+
+    bool sample(unsigned long long values[NUM_EVENTS], unsigned long long *enabled,
+                unsigned long long *running) {
+        unsigned long long buffer[3 + NUM_EVENTS];  // nr, enabled, running, values
+        if (read(leader, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(buffer[0])))
+            return false;
+        *enabled = buffer[1];
+        *running = buffer[2];
+        for (int e = 0; e < NUM_EVENTS; e++)
+            values[e] = slot[e] >= 0 ? buffer[3 + slot[e]] : 0;
+        return true;
+    }
+
+    // Adds the events since the last call to a phase
+    void charge(StatsData& data, int phase) {
+        unsigned long long values[NUM_EVENTS], enabled, running;
+        if (leader < 0 || !sample(values, &enabled, &running))
+            return;
+        for (int e = 0; e < NUM_EVENTS; e++) {
+            data.events[phase][e] += values[e] - last[e];
+            last[e] = values[e];
+        }
+        data.time_enabled += enabled - last_enabled;
+        data.time_running += running - last_running;
+        last_enabled = enabled;
+        last_running = running;
+    }
+};
+
+// One thread's statistics; the phase being timed started at last
+struct ThreadStats {
+    StatsData data;
+    Counters counters;
+    int current;
+    double last;
+
+    ThreadStats() : data(), current(phase_other), last(0) {
+        if (counters_wanted)
+            counters.open();
+    }
+    ~ThreadStats() {
+        if (last != 0) {
+            data.seconds[current] += now() - last;
+        }
+        counters.charge(data, current);
+        std::lock_guard<std::mutex> lock(total_mutex);
+        total.add(data);
+    }
+};
+
+static thread_local ThreadStats thread_stats;
+
+void stats_start(bool counters) {
+    ThreadStats& stats = thread_stats;
+    if (counters && stats.counters.leader < 0)
+        counters_error = stats.counters.open();
+    // Threads started from here on open their own
+    counters_wanted = counters;
+    for (int e = 0; e < NUM_EVENTS; e++)
+        event_opened[e] = stats.counters.slot[e] >= 0;
+    stats_enabled = true;
+    start_time = now();
+    stats.last = start_time;
+}
+
+int stats_enter(STATS_PHASE phase) {
+    ThreadStats& stats = thread_stats;
+    // Nested in the same phase (a lookup's probes, say): nothing changes
+    if (stats.current == phase)
+        return -1;
+    double t = now();
+    if (stats.last != 0)
+        stats.data.seconds[stats.current] += t - stats.last;
+    stats.last = t;
+    stats.counters.charge(stats.data, stats.current);
+    int saved = stats.current;
+    stats.current = phase;
+    stats.data.calls[phase]++;
+    return saved;
+}
+
+void stats_leave(int saved) {
+    ThreadStats& stats = thread_stats;
+    double t = now();
+    stats.data.seconds[stats.current] += t - stats.last;
+    stats.last = t;
+    stats.counters.charge(stats.data, stats.current);
+    stats.current = saved;
+}
+
+void stats_add(STATS_COUNTER counter, long amount) {
+    thread_stats.data.counters[counter] += amount;
+}
+
+void stats_add_node(int ast_type) {
+    if (!stats_enabled)
+        return;
+    StatsData& data = thread_stats.data;
+    data.counters[count_ast_nodes]++;
+    if (ast_type >= 0 && ast_type < STATS_AST_TYPES)
+        data.nodes[ast_type]++;
+}
+
+// One row of the counter report: the events of a phase divided by per
+static void report_events(FILE *fp, bool json, const char *name,
+                          const unsigned long long *events, double scale, double per) {
+    double values[NUM_EVENTS];
+    for (int e = 0; e < NUM_EVENTS; e++)
+        values[e] = per > 0 ? events[e] * scale / per : 0;
+    double ipc = events[event_cycles] > 0
+                     ? (double)events[event_instructions] / events[event_cycles] : 0;
+    bool has_ipc = event_opened[event_cycles] && event_opened[event_instructions];
+
+    if (json) {
+        fprintf(fp, "\n      \"%s\": {", name);
+        for (int e = 0; e < NUM_EVENTS; e++) {
+            if (event_opened[e])
+                fprintf(fp, "\"%s\": %.*f, ", event_names[e], per == 1 ? 0 : 3, values[e]);
+            else
+                fprintf(fp, "\"%s\": null, ", event_names[e]);
+        }
+        if (has_ipc)
+            fprintf(fp, "\"ipc\": %.3f}", ipc);
+        else
+            fprintf(fp, "\"ipc\": null}");
+        return;
+    }
+
+    fprintf(fp, "%-20s", name);
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (!event_opened[e])
+            fprintf(fp, " %14s", "-");
+        else if (per == 1)
+            fprintf(fp, " %14.0f", values[e]);
+        else
+            fprintf(fp, " %14.2f", values[e]);
+    }
+    if (has_ipc)
+        fprintf(fp, " %6.2f\n", ipc);
+    else
+        fprintf(fp, " %6s\n", "-");
+}
+
+static void report_counters(FILE *fp, bool json, const StatsData& all) {
+    if (counters_error != 0) {
+        if (json) {
+            fprintf(fp, ",\n  \"hardware_counters\": {\"available\": false, \"error\": \"%s\"}",
+                    strerror(counters_error));
+        } else {
+            fprintf(fp, "\nHardware counters unavailable: perf_event_open: %s\n",
+                    strerror(counters_error));
+            fprintf(fp, "(containers and VMs often hide the PMU or forbid the call; "
+                        "see /proc/sys/kernel/perf_event_paranoid)\n");
+        }
+        return;
+    }
+
+    // If the kernel had to multiplex the counters, scale them up to the
+    // whole time they were enabled
+    double scale = 1;
+    if (all.time_running > 0 && all.time_running < all.time_enabled)
+        scale = (double)all.time_enabled / all.time_running;
+
+    unsigned long long sum[NUM_EVENTS] = {};
+    for (int i = 0; i < NUM_PHASES; i++)
+        for (int e = 0; e < NUM_EVENTS; e++)
+            sum[e] += all.events[i][e];
+
+    if (json) {
+        fprintf(fp, ",\n  \"hardware_counters\": {\n    \"available\": true,\n"
+                    "    \"scale\": %.3f,\n    \"phases\": {", scale);
+        for (int i = 0; i < NUM_PHASES; i++) {
+            if (i) fputc(',', fp);
+            report_events(fp, true, phase_names[i], all.events[i], scale, 1);
+        }
+        fprintf(fp, "\n    },\n    \"rates\": {");
+        report_events(fp, true, "scan_per_token", all.events[phase_scan], scale,
+                      all.counters[count_tokens]);
+        fputc(',', fp);
+        report_events(fp, true, "parse_per_ast_node", all.events[phase_parse], scale,
+                      all.counters[count_ast_nodes]);
+        fputc(',', fp);
+        report_events(fp, true, "total_per_token", sum, scale, all.counters[count_tokens]);
+        fprintf(fp, "\n    }\n  }");
+        return;
+    }
+
+    fprintf(fp, "\nHardware counters (user mode)");
+    if (scale != 1)
+        fprintf(fp, ", scaled by %.2f for multiplexing", scale);
+    fprintf(fp, "\n%-20s", "phase");
+    for (int e = 0; e < NUM_EVENTS; e++)
+        fprintf(fp, " %14s", event_names[e]);
+    fprintf(fp, " %6s\n", "IPC");
+    for (int i = 0; i < NUM_PHASES; i++)
+        report_events(fp, false, phase_names[i], all.events[i], scale, 1);
+    report_events(fp, false, "total", sum, scale, 1);
+    fprintf(fp, "\n");
+    report_events(fp, false, "scan per token", all.events[phase_scan], scale,
+                  all.counters[count_tokens]);
+    report_events(fp, false, "parse per AST node", all.events[phase_parse], scale,
+                  all.counters[count_ast_nodes]);
+    report_events(fp, false, "total per token", sum, scale, all.counters[count_tokens]);
+}
+
+void stats_report(FILE *fp, bool json) {
+    // Bring this thread's current phase up to date before reading it
+    ThreadStats& stats = thread_stats;
+    double t = now();
+    if (stats.last != 0) {
+        stats.data.seconds[stats.current] += t - stats.last;
+        stats.last = t;
+    }
+    stats.counters.charge(stats.data, stats.current);
+
+    StatsData all;
+    {
+        std::lock_guard<std::mutex> lock(total_mutex);
+        all = total;
+    }
+    all.add(stats.data);
+
+    double wall = start_time != 0 ? t - start_time : 0;
+    double summed = 0;
+    for (int i = 0; i < NUM_PHASES; i++)
+        summed += all.seconds[i];
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_rss = usage.ru_maxrss * 1024L;   // ru_maxrss is in KB on Linux
+
+    if (json) {
+        fprintf(fp, "{\n  \"wall_seconds\": %.6f,\n  \"phases\": {", wall);
+        for (int i = 0; i < NUM_PHASES; i++) {
+            fprintf(fp, "%s\n    \"%s\": {\"seconds\": %.6f, \"calls\": %ld}",
+                    i ? "," : "", phase_names[i], all.seconds[i], all.calls[i]);
+        }
+        fprintf(fp, "\n  },\n  \"counters\": {");
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            fprintf(fp, "%s\n    \"%s\": %ld", i ? "," : "", counter_names[i],
+                    all.counters[i]);
+        }
+        fprintf(fp, ",\n    \"peak_rss_bytes\": %ld\n  },\n  \"ast_nodes\": {", peak_rss);
+        bool first = true;
+        for (int i = 0; i <= ast_program; i++) {
+            if (all.nodes[i] == 0)
+                continue;
+            fprintf(fp, "%s\n    \"%s\": %ld", first ? "" : ",", ast_type_names[i],
+                    all.nodes[i]);
+            first = false;
+        }
+        fprintf(fp, "\n  }");
+        if (counters_wanted)
+            report_counters(fp, true, all);
+        fprintf(fp, "\n}\n");
+        return;
+    }
+
+    fprintf(fp, "\nCompilation statistics\n");
+    fprintf(fp, "----------------------\n");
+    fprintf(fp, "%-10s %12s %8s %12s\n", "phase", "seconds", "%", "calls");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        fprintf(fp, "%-10s %12.6f %7.1f%% %12ld\n", phase_names[i], all.seconds[i],
+                summed > 0 ? all.seconds[i] * 100 / summed : 0.0, all.calls[i]);
+    }
+    fprintf(fp, "%-10s %12.6f   (wall clock; phase times are summed over threads)\n",
+            "total", wall);
+
+    fprintf(fp, "\n");
+    for (int i = 0; i < NUM_COUNTERS; i++)
+        fprintf(fp, "%-18s %14ld\n", counter_names[i], all.counters[i]);
+    fprintf(fp, "%-18s %14ld\n", "peak_rss_bytes", peak_rss);
+
+    fprintf(fp, "\nAST nodes by type:\n");
+    for (int i = 0; i <= ast_program; i++) {
+        if (all.nodes[i] > 0)
+            fprintf(fp, "  %-16s %12ld\n", ast_type_names[i], all.nodes[i]);
+    }
+
+    if (counters_wanted)
+        report_counters(fp, false, all);
+}
@@ -0,0 +1,141 @@
+// Parses generated programs with very long lists: top-level declarations,
+// variable declarations in a block, and statements in a block; and with a
+// very deep expression tree, which the parser builds in a loop but the
+// constant evaluator and the printer have to walk. Each parse runs on a
+// thread with a small stack, so recursion per list element or per tree
+// level would overflow it.
+// Usage: stress_test [ELEMENTS]   (run from parser/: the parser writes
+// ../tests/output)
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string>
+#include "../../include/parser.h"
+#include "../../include/FlexScanner.h"
+
+static const size_t STACK_SIZE = 1 << 20;
+
+// count top-level blocks, each with one statement
+static std::string manyDecls(int count) {
+    std::string program = "program\nvar x : integer;\n";
+    for (int i = 0; i < count; i++)
+        program += "begin x := " + std::to_string(i % 100) + "; end;\n";
+    return program;
+}
+
+// One block declaring count variables
+static std::string manyVars(int count) {
+    std::string program = "program\nbegin\n";
+    for (int i = 0; i < count; i++)
+        program += "var v" + std::to_string(i) + " : integer;\n";
+    return program + "v0 := 1;\nend;\n";
+}
+
+// One block of count statements
+static std::string manyStmts(int count) {
+    std::string program = "program\nvar x : integer;\nbegin\n";
+    for (int i = 0; i < count; i++)
+        program += i % 2 ? "x := x + 1;\n" : "write(x);\n";
+    return program + "end;\n";
+}
+
+// A constant and an assignment, each a chain of count additions
+static std::string deepExpression(int count) {
+    std::string sum = "1";
+    for (int i = 0; i < count; i++)
+        sum += " + 1";
+    return "program\nconstant c = " + sum + ";\nvar x : integer;\nbegin\nx := " + sum +
+           ";\nend;\n";
+}
+
+static long astLength(ast_list *list) {
+    long length = 0;
+    for (; list != nullptr; list = list->tail) length++;
+    return length;
+}
+
+static long steLength(ste_list *list) {
+    long length = 0;
+    for (; list != nullptr; list = list->tail) length++;
+    return length;
+}
+
+struct Job {
+    const std::string *source;
+    bool flex;
+    AST *root;
+    bool had_error;
+};
+
+static void *parseJob(void *arg) {
+    Job *job = (Job *)arg;
+    Lexer *lexer;
+    if (job->flex)
+        lexer = new FlexScanner(job->source->data(), job->source->size());
+    else
+        lexer = new Scanner(new FileDescriptor(job->source->data(), job->source->size()));
+    Parser parser(lexer);
+    job->root = parser.start_parsing();
+    job->had_error = parser.had_error;
+    // Print too: the printer walks the same lists
+    if (print_ast_file("/dev/null", job->root) < 0)
+        job->had_error = true;
+    return nullptr;
+}
+
+// Parses source on a small stack; returns the program's AST, or nullptr
+static AST *parseOnSmallStack(const std::string &source, bool flex) {
+    Job job = {&source, flex, nullptr, false};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, STACK_SIZE);
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, parseJob, &job) != 0) {
+        printf("Error: could not start the parser thread\n");
+        exit(1);
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    return job.had_error ? nullptr : job.root;
+}
+
+static int failures = 0;
+
+static void check(const char *name, bool flex, bool ok) {
+    printf("%-12s %-5s %s\n", name, flex ? "flex" : "hand", ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    std::string decls = manyDecls(count);
+    // Fewer variables: one scope's inserts grow quadratically with its size
+    int varCount = count / 5;
+    std::string vars = manyVars(varCount);
+    std::string stmts = manyStmts(count);
+    std::string deep = deepExpression(count);
+
+    for (bool flex : {false, true}) {
+        AST *root = parseOnSmallStack(decls, flex);
+        // The global variable, then the blocks
+        check("decl list", flex,
+              root && astLength(root->f.a_program.statements) == count + 1);
+
+        root = parseOnSmallStack(vars, flex);
+        AST *block = root ? root->f.a_program.statements->head : nullptr;
+        check("var list", flex,
+              block && steLength(block->f.a_block.vars) == varCount &&
+                  block->f.a_block.frame_slots == varCount &&
+                  block->f.a_block.frame_size == varCount * 4);
+
+        root = parseOnSmallStack(stmts, flex);
+        check("stmt list", flex,
+              root && astLength(root->f.a_program.statements->tail->head->f.a_block.stmts) == count);
+
+        root = parseOnSmallStack(deep, flex);
+        check("deep expr", flex,
+              root && root->f.a_program.statements->head->f.a_const_decl.value->f.a_integer.value ==
+                          count + 1);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+// type_check.cpp
+#include "../include/type_check.h"
+#include "../include/AstWalker.h"
+#include "../include/stats.h"
+
+static const char* type_names[] = {
+    "none", "integer", "float", "boolean", "string"
+};
+
+static const char* operator_name(AST_type type) {
+    switch (type) {
+        case ast_times:  return "*";
+        case ast_divide: return "/";
+        case ast_plus:   return "+";
+        case ast_minus:  return "-";
+        case ast_eq:     return "=";
+        case ast_neq:    return "!=";
+        case ast_lt:     return "<";
+        case ast_le:     return "<=";
+        case ast_gt:     return ">";
+        case ast_ge:     return ">=";
+        case ast_and:    return "and";
+        case ast_or:     return "or";
+        case ast_cand:   return "cand";
+        case ast_cor:    return "cor";
+        case ast_not:    return "not";
+        default:         return "-";
+    }
+}
+
+static bool is_numeric(j_type type) {
+    return type == type_integer || type == type_float;
+}
+
+static bool is_boolean(j_type type) {
+    return type == type_boolean;
+}
+
+static bool is_typed(j_type type) {
+    return type != type_none;
+}
+
+// Types expressions bottom-up, as they are left. The context is the
+// routine whose body is being walked, nullptr outside routines.
+class TypeChecker : public AstWalker<TypeChecker, STEntry*> {
+public:
+    explicit TypeChecker(std::ostream &errors) : errors(errors), count(0) {}
+
+    bool childRoutineDecl(AST *node, int, AST *, STEntry *&, STEntry *&childRoutine) {
+        childRoutine = node->f.a_routine_decl.name;
+        return true;
+    }
+    void leaveAssign(AST *node, STEntry *&routine);
+    void leaveIf(AST *node, STEntry *&routine) {
+        condition(node->f.a_if.predicate, "if", routine);
+    }
+    void leaveWhile(AST *node, STEntry *&routine) {
+        condition(node->f.a_while.predicate, "while", routine);
+    }
+    void leaveFor(AST *node, STEntry *&routine);
+    void leaveCall(AST *node, STEntry *&routine) { call(node, routine); }
+    void leaveReturn(AST *node, STEntry *&routine);
+
+    void leaveVar(AST *node, STEntry *&routine);
+    void leaveInteger(AST *node, STEntry *&) { node->value_type = type_integer; }
+    void leaveFloat(AST *node, STEntry *&) { node->value_type = type_float; }
+    void leaveString(AST *node, STEntry *&) { node->value_type = type_string; }
+    void leaveBoolean(AST *node, STEntry *&) { node->value_type = type_boolean; }
+    void leaveItof(AST *node, STEntry *&routine);
+
+    // The operand types each operator accepts, and whether it compares them
+    void leaveTimes(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, false); }
+    void leaveDivide(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, false); }
+    void leavePlus(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, false); }
+    void leaveMinus(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, false); }
+    void leaveEq(AST *node, STEntry *&routine) { binary(node, routine, is_typed, true); }
+    void leaveNeq(AST *node, STEntry *&routine) { binary(node, routine, is_typed, true); }
+    void leaveLt(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, true); }
+    void leaveLe(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, true); }
+    void leaveGt(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, true); }
+    void leaveGe(AST *node, STEntry *&routine) { binary(node, routine, is_numeric, true); }
+    void leaveAnd(AST *node, STEntry *&routine) { binary(node, routine, is_boolean, true); }
+    void leaveOr(AST *node, STEntry *&routine) { binary(node, routine, is_boolean, true); }
+    void leaveCand(AST *node, STEntry *&routine) { binary(node, routine, is_boolean, true); }
+    void leaveCor(AST *node, STEntry *&routine) { binary(node, routine, is_boolean, true); }
+    void leaveNot(AST *node, STEntry *&routine) { unary(node, routine, is_boolean); }
+    void leaveUminus(AST *node, STEntry *&routine) { unary(node, routine, is_numeric); }
+
+    int errorCount() const { return count; }
+
+private:
+    std::ostream &errors;
+    int count;
+
+    std::ostream &error(STEntry *routine);
+    j_type valueOf(AST *expr, STEntry *routine);
+    bool convert(AST *&expr, j_type expected);
+    void binary(AST *node, STEntry *routine, bool (*accepts)(j_type), bool compares);
+    void unary(AST *node, STEntry *routine, bool (*accepts)(j_type));
+    void condition(AST *predicate, const char *statement, STEntry *routine);
+    void call(AST *node, STEntry *routine);
+};
+
+std::ostream &TypeChecker::error(STEntry *routine) {
+    count++;
+    errors << "Type Error in " << (routine ? routine->Name : "program") << ": ";
+    return errors;
+}
+
+// The type of an expression used as a value. A procedure call has none,
+// which is an error here; type_none from an earlier error is passed on
+// quietly.
+j_type TypeChecker::valueOf(AST *expr, STEntry *routine) {
+    if (expr == nullptr)
+        return type_none;
+    if (expr->type == ast_call && expr->value_type == type_none && expr->f.a_call.callee &&
+        expr->f.a_call.callee->Type == STE_ROUTINE && expr->f.a_call.callee->ResultType == type_none)
+        error(routine) << "procedure " << expr->f.a_call.callee->Name
+                       << " has no value" << std::endl;
+    return expr->value_type;
+}
+
+// Whether a value of expr's type can be stored where expected is; an
+// integer going to a float is wrapped in ast_itof. A missing type counts
+// as matching, as it has been reported already.
+bool TypeChecker::convert(AST *&expr, j_type expected) {
+    j_type actual = expr ? expr->value_type : type_none;
+    if (actual == type_none || expected == type_none || actual == expected)
+        return true;
+    if (actual == type_integer && expected == type_float) {
+        expr = make_ast_node(ast_itof, expr);
+        expr->value_type = type_float;
+        return true;
+    }
+    return false;
+}
+
+// Types a binary operator whose operands, once brought to a common type,
+// must be accepted; the result is boolean for a comparison, and otherwise
+// of the operands' type
+void TypeChecker::binary(AST *node, STEntry *routine, bool (*accepts)(j_type), bool compares) {
+    AST *&left = node->f.a_binary_op.larg;
+    AST *&right = node->f.a_binary_op.rarg;
+    j_type l = valueOf(left, routine);
+    j_type r = valueOf(right, routine);
+    node->value_type = type_none;
+    if (l == type_none || r == type_none)
+        return;
+
+    // The type both operands are brought to
+    j_type operands = type_none;
+    if (is_numeric(l) && is_numeric(r))
+        operands = l == type_float || r == type_float ? type_float : type_integer;
+    else if (l == r)
+        operands = l;
+
+    if (operands == type_none || !accepts(operands)) {
+        error(routine) << "operands of " << operator_name(node->type) << " are "
+                       << type_names[l] << " and " << type_names[r] << std::endl;
+        return;
+    }
+    convert(left, operands);
+    convert(right, operands);
+    node->f.a_binary_op.rel_type = operands;
+    node->value_type = compares ? type_boolean : operands;
+}
+
+void TypeChecker::unary(AST *node, STEntry *routine, bool (*accepts)(j_type)) {
+    j_type arg = valueOf(node->f.a_unary_op.arg, routine);
+    bool ok = accepts(arg);
+    if (arg != type_none && !ok)
+        error(routine) << "operand of " << operator_name(node->type) << " is "
+                       << type_names[arg] << std::endl;
+    node->value_type = ok ? arg : type_none;
+    node->f.a_unary_op.type = node->value_type;
+}
+
+void TypeChecker::condition(AST *predicate, const char *statement, STEntry *routine) {
+    j_type type = valueOf(predicate, routine);
+    if (type != type_none && type != type_boolean)
+        error(routine) << "condition of " << statement << " is " << type_names[type]
+                       << std::endl;
+}
+
+// Checks a call's arguments against the routine's formals, and gives the
+// call the routine's result type
+void TypeChecker::call(AST *node, STEntry *routine) {
+    STEntry *callee = node->f.a_call.callee;
+    if (callee == nullptr)
+        return;
+    if (callee->Type != STE_ROUTINE) {
+        error(routine) << callee->Name << " is not a routine" << std::endl;
+        return;
+    }
+    ste_list *formal = callee->Formals;
+    ast_list *arg = node->f.a_call.arg_list;
+    int index = 1;
+    for (; formal != nullptr && arg != nullptr; formal = formal->tail, arg = arg->tail, index++) {
+        j_type expected = formal->head->VarType;
+        j_type actual = valueOf(arg->head, routine);
+        if (!convert(arg->head, expected))
+            error(routine) << "argument " << index << " of " << callee->Name << " is "
+                           << type_names[actual] << ", expected " << type_names[expected]
+                           << std::endl;
+    }
+    if (formal != nullptr || arg != nullptr) {
+        int formals = 0, args = 0;
+        for (formal = callee->Formals; formal; formal = formal->tail) formals++;
+        for (arg = node->f.a_call.arg_list; arg; arg = arg->tail) args++;
+        error(routine) << callee->Name << " takes " << formals << " arguments, given "
+                       << args << std::endl;
+    }
+    node->value_type = callee->ResultType;
+}
+
+void TypeChecker::leaveVar(AST *node, STEntry *&routine) {
+    STEntry *var = node->f.a_var.var;
+    if (var == nullptr)
+        return;
+    if (var->Type == STE_ROUTINE)
+        error(routine) << "routine " << var->Name << " used as a variable" << std::endl;
+    else
+        node->value_type = var->VarType;
+}
+
+void TypeChecker::leaveItof(AST *node, STEntry *&routine) {
+    if (valueOf(node->f.a_itof.arg, routine) == type_integer)
+        node->value_type = type_float;
+}
+
+void TypeChecker::leaveAssign(AST *node, STEntry *&routine) {
+    STEntry *lhs = node->f.a_assign.lhs;
+    j_type value = valueOf(node->f.a_assign.rhs, routine);
+    if (lhs == nullptr)
+        return;
+    if (lhs->Type == STE_ROUTINE) {
+        error(routine) << "cannot assign to routine " << lhs->Name << std::endl;
+    } else if (!convert(node->f.a_assign.rhs, lhs->VarType)) {
+        error(routine) << "cannot assign " << type_names[value] << " to "
+                       << type_names[lhs->VarType] << " variable " << lhs->Name
+                       << std::endl;
+    }
+}
+
+void TypeChecker::leaveFor(AST *node, STEntry *&routine) {
+    STEntry *var = node->f.a_for.var;
+    if (var != nullptr && (var->Type == STE_ROUTINE || var->VarType != type_integer))
+        error(routine) << "for loop variable " << var->Name << " is not an integer"
+                       << std::endl;
+    j_type lower = valueOf(node->f.a_for.lower_bound, routine);
+    j_type upper = valueOf(node->f.a_for.upper_bound, routine);
+    if ((lower != type_none && lower != type_integer) ||
+        (upper != type_none && upper != type_integer))
+        error(routine) << "for loop bounds are " << type_names[lower] << " and "
+                       << type_names[upper] << std::endl;
+}
+
+void TypeChecker::leaveReturn(AST *node, STEntry *&routine) {
+    j_type value = valueOf(node->f.a_return.expr, routine);
+    if (routine == nullptr) {
+        error(routine) << "return outside a routine" << std::endl;
+    } else if (routine->ResultType == type_none) {
+        error(routine) << "procedure returns a value" << std::endl;
+    } else if (!convert(node->f.a_return.expr, routine->ResultType)) {
+        error(routine) << "returns " << type_names[value] << ", declared "
+                       << type_names[routine->ResultType] << std::endl;
+    }
+}
+
+int check_types(AST *program, std::ostream &errors) {
+    PhaseTimer timer(phase_types);
+    TypeChecker checker(errors);
+    checker.walk(program, nullptr);
+    return checker.errorCount();
+}
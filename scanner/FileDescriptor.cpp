@@ -1,14 +1,21 @@
 #include "../include/FileDescriptor.h"
+#include "../include/stats.h"
 
 // Constructor for opening a specific file
 FileDescriptor::FileDescriptor(const char *FileName) {
+    mem = nullptr;
+    mem_length = 0;
+    mem_pos = 0;
     line_number = 1;
     char_number = 0;
     flag = UNSET;
     flag2 = UNSET;
     buf_size = BUFFER_SIZE;
+    line_length = 0;
     buffer = new char[buf_size];
     buffer[0] = '\0';
+    messages = &cout;
+    stats_count(count_bytes_allocated, buf_size);
 
     if (FileName == nullptr) {
         fp = stdin;
@@ -25,17 +32,43 @@ FileDescriptor::FileDescriptor(const char *FileName) {
     }
 }
 
+// Constructor for reading an in-memory source. The data isn't copied and
+// must outlive the descriptor; first_line is the line number of its first line.
+FileDescriptor::FileDescriptor(const char *data, long length, int first_line) {
+    fp = nullptr;
+    file = nullptr;
+    mem = data;
+    mem_length = length;
+    mem_pos = 0;
+    line_number = first_line;
+    char_number = 0;
+    flag = UNSET;
+    flag2 = UNSET;
+    buf_size = BUFFER_SIZE;
+    line_length = 0;
+    buffer = new char[buf_size];
+    buffer[0] = '\0';
+    messages = &cout;
+    stats_count(count_bytes_allocated, buf_size);
+}
+
 // Default constructor - opens stdin
 FileDescriptor::FileDescriptor() {
     fp = stdin;
     file = nullptr;
+    mem = nullptr;
+    mem_length = 0;
+    mem_pos = 0;
     line_number = 1;
     char_number = 0;
     flag = UNSET;
     flag2 = UNSET;
     buf_size = BUFFER_SIZE;
+    line_length = 0;
     buffer = new char[buf_size];
     buffer[0] = '\0';
+    messages = &cout;
+    stats_count(count_bytes_allocated, buf_size);
 }
 
 // Destructor to clean up resources
@@ -58,11 +91,15 @@ char* FileDescriptor::GetFileName() {
 
 // Check if file is open without errors
 bool FileDescriptor::IsOpen() {
+    if (mem != nullptr) return true;
     return (fp != nullptr && !ferror(fp));
 }
 
 // Returns a pointer to the current line buffer
 char* FileDescriptor::GetCurrLine() {
+    if (mem != nullptr) {
+        return buffer;
+    }
     if (fp == nullptr || feof(fp)) {
         return nullptr;
     }
@@ -94,16 +131,27 @@ char FileDescriptor::GetChar() {
         flag = UNSET;
         char_number++;
         char ch = buffer[char_number - 1];
-        std::cout << "GetChar: Returning ungot char: '" << ch << "' (ASCII: " << (int)ch << ")" << std::endl;
+        TRACE("GetChar: Returning ungot char: '" << ch << "' (ASCII: " << (int)ch << ")");
         return ch;
     }
 
     // Check if we need to read a new line
     if (buffer[char_number] == '\0') {
+        PhaseTimer timer(phase_io);
         // Reached end of line, read next line
-        std::cout << "GetChar: End of current line, reading next line..." << std::endl;
+        TRACE("GetChar: End of current line, reading next line...");
+        if (mem != nullptr) {
+            if (!ReadMemLine()) {
+                TRACE("GetChar: End of file reached.");
+                return EOF;
+            }
+            line_number++;
+            char_number = 0;
+            stats_count(count_lines);
+            return buffer[char_number++];
+        }
         if (fp == nullptr || feof(fp)) {
-            std::cout << "GetChar: End of file reached." << std::endl;
+            TRACE("GetChar: End of file reached.");
             return EOF;
         }
 
@@ -118,6 +166,7 @@ char FileDescriptor::GetChar() {
             if (result == nullptr) {
                 if (feof(fp)) {
                     buffer[0] = '\0';
+                    line_length = 0;
                     return EOF;
                 }
                 ReportError((char*)"Error reading from file");
@@ -133,6 +182,7 @@ char FileDescriptor::GetChar() {
             // If buffer isn't big enough, double it and try again
             current_size *= 2;
             char *new_buffer = new char[current_size];
+            stats_count(count_bytes_allocated, current_size);
             strcpy(new_buffer, buffer);
             delete[] buffer;
             buffer = new_buffer;
@@ -145,27 +195,79 @@ char FileDescriptor::GetChar() {
             }
         }
 
+        line_length = (int)strlen(buffer);
         line_number++;
         char_number = 0;
+        stats_count(count_lines);
+        stats_count(count_source_bytes, line_length);
     }
 
     // Return the current character and move to the next
     return buffer[char_number++];
 }
 
+// Copies the next line of an in-memory source into the buffer, growing it
+// if needed. Returns false at the end of the source.
+bool FileDescriptor::ReadMemLine() {
+    if (mem_pos >= mem_length) {
+        return false;
+    }
+
+    const char *start = mem + mem_pos;
+    const char *nl = (const char *)memchr(start, '\n', mem_length - mem_pos);
+    long len = nl ? (nl - start) + 1 : mem_length - mem_pos;
+
+    if (len + 1 > buf_size) {
+        while (len + 1 > buf_size) {
+            buf_size *= 2;
+        }
+        delete[] buffer;
+        buffer = new char[buf_size];
+        stats_count(count_bytes_allocated, buf_size);
+    }
+    memcpy(buffer, start, len);
+    buffer[len] = '\0';
+    line_length = (int)len;
+    mem_pos += len;
+    return true;
+}
+
+// Reads a whole file into a new[]-allocated, NUL-terminated buffer.
+// Returns nullptr if the file can't be read.
+char* FileDescriptor::LoadFile(const char *FileName, long *length) {
+    PhaseTimer timer(phase_io);
+    FILE *in = fopen(FileName, "rb");
+    if (in == nullptr) {
+        return nullptr;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    char *data = new char[size + 1];
+    long got = (long)fread(data, 1, size, in);
+    fclose(in);
+    data[got] = '\0';
+    *length = got;
+    stats_count(count_bytes_allocated, size + 1);
+    stats_count(count_source_bytes, got);
+    return data;
+}
+
 // Reports an error with line and character information
 void FileDescriptor::ReportError(char *msg) {
-    cout << msg << " on line: " << line_number << '\n';
-    cout << buffer ;//<< '\n';
+    std::ostream &out = *messages;
+    out << msg << " on line: " << line_number << '\n';
+    out << buffer ;//<< '\n';
 
     // Print spaces or tabs until the caret position
     for (int i = 0; i < char_number - 1; i++)
     {
-        cout << (buffer[i] == '\t' ? '\t' : ' ');
+        out << (buffer[i] == '\t' ? '\t' : ' ');
     }
 
     // Print the caret symbol '^' under the current character
-    cout << "^\n";
+    out << "^\n";
 }
 
 // Puts back one character - can't do consecutive ungets
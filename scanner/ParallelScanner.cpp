@@ -0,0 +1,107 @@
+#include "../include/ParallelScanner.h"
+#include <sstream>
+#include <thread>
+
+ParallelScanner::ParallelScanner(const char *data, long length, int num_threads) {
+    this->data = data;
+    this->length = length;
+    this->num_threads = num_threads < 1 ? 1 : num_threads;
+}
+
+// Counts the newlines in data[begin..end)
+static long countLines(const char *data, long begin, long end) {
+    long lines = 0;
+    const char *p = data + begin;
+    const char *stop = data + end;
+    while ((p = (const char *)memchr(p, '\n', stop - p)) != nullptr) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+// Runs work(i) for every chunk, one thread per chunk
+template <typename Work>
+static void runChunks(int chunks, Work work) {
+    std::vector<std::thread> threads;
+    for (int i = 1; i < chunks; i++) {
+        threads.push_back(std::thread(work, i));
+    }
+    work(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+std::vector<TOKEN*> ParallelScanner::ScanAll() {
+    // Chunk boundaries: an even split, each moved forward to a line start
+    std::vector<long> starts;
+    starts.push_back(0);
+    for (int i = 1; i < num_threads; i++) {
+        long target = length * i / num_threads;
+        if (target <= starts.back()) {
+            continue;
+        }
+        const char *nl = (const char *)memchr(data + target, '\n', length - target);
+        if (nl == nullptr) {
+            break;
+        }
+        long start = (nl - data) + 1;
+        if (start < length && start > starts.back()) {
+            starts.push_back(start);
+        }
+    }
+    int chunks = (int)starts.size();
+    starts.push_back(length);
+
+    // Fix-up pass: the line number each chunk starts at
+    std::vector<long> lines(chunks);
+    runChunks(chunks, [&](int i) {
+        lines[i] = countLines(data, starts[i], starts[i + 1]);
+    });
+    std::vector<int> firstLine(chunks);
+    long line = 1;
+    for (int i = 0; i < chunks; i++) {
+        firstLine[i] = (int)line;
+        line += lines[i];
+    }
+
+    // Scan every chunk; each ends with its own end of file token. A chunk's
+    // error messages are kept, and printed in chunk order once all are done.
+    std::vector<std::vector<TOKEN*>> chunkTokens(chunks);
+    std::vector<std::ostringstream> chunkMessages(chunks);
+    runChunks(chunks, [&](int i) {
+        FileDescriptor *fd = new FileDescriptor(data + starts[i], starts[i + 1] - starts[i],
+                                                firstLine[i]);
+        fd->messages = &chunkMessages[i];
+        Scanner scanner(fd);
+        std::vector<TOKEN*> &out = chunkTokens[i];
+        TOKEN *token;
+        do {
+            token = scanner.Scan();
+            out.push_back(token);
+        } while (token->type != lx_eof);
+    });
+
+    for (auto &messages : chunkMessages) {
+        cout << messages.str();
+    }
+
+    // Join, keeping only the last chunk's end of file token
+    size_t total = 0;
+    for (auto &tokens : chunkTokens) {
+        total += tokens.size();
+    }
+    std::vector<TOKEN*> result;
+    result.reserve(total);
+    for (int i = 0; i < chunks; i++) {
+        std::vector<TOKEN*> &tokens = chunkTokens[i];
+        size_t count = tokens.size();
+        if (i + 1 < chunks) {
+            delete tokens.back();
+            count--;
+        }
+        result.insert(result.end(), tokens.begin(), tokens.begin() + count);
+    }
+    return result;
+}
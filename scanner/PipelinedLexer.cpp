@@ -0,0 +1,133 @@
+#include "../include/PipelinedLexer.h"
+#include <iostream>
+
+static const long QUEUE_MASK = PipelinedLexer::QUEUE_SIZE - 1;
+static_assert((PipelinedLexer::QUEUE_SIZE & QUEUE_MASK) == 0, "QUEUE_SIZE must be a power of two");
+
+// One step of waiting for the other side: spin a little, then give up the
+// CPU, which matters when both threads share one core
+static void backOff(int &spins) {
+    if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+PipelinedLexer::PipelinedLexer(Lexer *lexer) : produced(0), consumed(0), stopping(false) {
+    this->lexer = lexer;
+    batches = new Batch[QUEUE_SIZE];
+    stats_count(count_bytes_allocated, sizeof(Batch) * QUEUE_SIZE);
+    reading = -1;
+    position = 0;
+    ended = false;
+    line = 0;
+    peeked = nullptr;
+    producer = std::thread(&PipelinedLexer::produce, this);
+}
+
+PipelinedLexer::~PipelinedLexer() {
+    stopping.store(true, std::memory_order_relaxed);
+    if (producer.joinable())
+        producer.join();
+    delete[] batches;
+    delete peeked;
+    delete lexer;
+}
+
+// The scanner thread: fills batches until end of file
+void PipelinedLexer::produce() {
+    for (long i = 0;; i++) {
+        if (i - consumed.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+            PhaseTimer timer(phase_wait);
+            int spins = 0;
+            while (i - consumed.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+                if (stopping.load(std::memory_order_relaxed))
+                    return;
+                backOff(spins);
+            }
+        }
+
+        Batch &batch = batches[i & QUEUE_MASK];
+        bool end = false;
+        batch.count = 0;
+        while (batch.count < BATCH_SIZE && !end) {
+            TOKEN &token = batch.tokens[batch.count++];
+            lexer->ScanInto(token);
+            end = token.type == lx_eof;
+        }
+        produced.store(i + 1, std::memory_order_release);
+        if (end)
+            return;
+    }
+}
+
+void PipelinedLexer::ScanInto(TOKEN &token) {
+    if (peeked != nullptr) {
+        token.copyFrom(*peeked);
+        delete peeked;
+        peeked = nullptr;
+        return;
+    }
+    if (ended) {
+        token.reset();
+        token.type = lx_eof;
+        token.line = line;
+        return;
+    }
+
+    if (reading < 0 || position == batches[reading & QUEUE_MASK].count) {
+        // Give the batch back and wait for the next one
+        if (reading >= 0)
+            consumed.store(reading + 1, std::memory_order_release);
+        reading++;
+        if (produced.load(std::memory_order_acquire) <= reading) {
+            PhaseTimer timer(phase_wait);
+            int spins = 0;
+            while (produced.load(std::memory_order_acquire) <= reading)
+                backOff(spins);
+        }
+        position = 0;
+    }
+
+    token.copyFrom(batches[reading & QUEUE_MASK].tokens[position++]);
+    line = token.line;
+    if (token.type == lx_eof) {
+        // The producer is done; joining now also folds its statistics in
+        ended = true;
+        producer.join();
+    }
+}
+
+TOKEN* PipelinedLexer::Scan() {
+    if (peeked != nullptr) {
+        TOKEN *token = peeked;
+        peeked = nullptr;
+        return token;
+    }
+    TOKEN *token = new TOKEN();
+    ScanInto(*token);
+    if (token->type == lx_identifier || token->type == lx_string)
+        token->fitText();
+    return token;
+}
+
+TOKEN* PipelinedLexer::Peek() {
+    if (peeked == nullptr)
+        peeked = Scan();
+    return peeked;
+}
+
+int PipelinedLexer::getLineNum() {
+    return line;
+}
+
+int PipelinedLexer::getCharNum() {
+    return 0;
+}
+
+void PipelinedLexer::ReportError(char *msg) {
+    std::cout << msg << " on line: " << line << '\n';
+}
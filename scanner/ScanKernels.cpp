@@ -0,0 +1,213 @@
+#include "../include/ScanKernels.h"
+#include "../include/Scanner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Scalar kernels, on the scanner's character tables
+ */
+
+static size_t span_space_scalar(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && isSpaceChar(p[i])) i++;
+    return i;
+}
+
+static size_t find_comment_stop_scalar(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && p[i] != '#' && p[i] != '\n') i++;
+    return i;
+}
+
+static size_t span_ident_scalar(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && isIdentChar(p[i])) i++;
+    return i;
+}
+
+static size_t span_digits_scalar(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && isDigitChar(p[i])) i++;
+    return i;
+}
+
+const ScanKernels scan_kernels_scalar = {
+    "scalar",
+    span_space_scalar,
+    find_comment_stop_scalar,
+    span_ident_scalar,
+    span_digits_scalar
+};
+
+#ifdef SCAN_KERNELS_X86
+
+/*
+ * SSE2 kernels. Each builds a 16-bit mask of the bytes in the class; the
+ * first byte outside it ends the run. Unsigned range checks x - lo <= hi - lo
+ * are done as max(x - lo, hi - lo) == hi - lo.
+ */
+
+static inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    __m128i limit = _mm_set1_epi8((char)(hi - lo));
+    return _mm_cmpeq_epi8(_mm_max_epu8(d, limit), limit);
+}
+
+static inline unsigned space_mask_sse2(__m128i x) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), in_range_sse2(x, '\t', '\r'));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static inline unsigned comment_stop_mask_sse2(__m128i x) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('#')),
+                             _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static inline unsigned digit_mask_sse2(__m128i x) {
+    return (unsigned)_mm_movemask_epi8(in_range_sse2(x, '0', '9'));
+}
+
+static inline unsigned ident_mask_sse2(__m128i x) {
+    __m128i letter = in_range_sse2(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i m = _mm_or_si128(_mm_or_si128(letter, in_range_sse2(x, '0', '9')),
+                             _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+// Length of the run of bytes whose mask bit is set
+#define SPAN_SSE2(name, mask_fn, scalar_fn)                                 \
+    static size_t name(const char *p, size_t n) {                          \
+        size_t i = 0;                                                      \
+        for (; i + 16 <= n; i += 16) {                                     \
+            __m128i x = _mm_loadu_si128((const __m128i *)(p + i));         \
+            unsigned out = ~mask_fn(x) & 0xFFFF;                           \
+            if (out) return i + __builtin_ctz(out);                        \
+        }                                                                  \
+        return i + scalar_fn(p + i, n - i);                                \
+    }
+
+// Index of the first byte whose mask bit is set
+#define FIND_SSE2(name, mask_fn, scalar_fn)                                 \
+    static size_t name(const char *p, size_t n) {                          \
+        size_t i = 0;                                                      \
+        for (; i + 16 <= n; i += 16) {                                     \
+            __m128i x = _mm_loadu_si128((const __m128i *)(p + i));         \
+            unsigned hit = mask_fn(x);                                     \
+            if (hit) return i + __builtin_ctz(hit);                        \
+        }                                                                  \
+        return i + scalar_fn(p + i, n - i);                                \
+    }
+
+SPAN_SSE2(span_space_sse2, space_mask_sse2, span_space_scalar)
+FIND_SSE2(find_comment_stop_sse2, comment_stop_mask_sse2, find_comment_stop_scalar)
+SPAN_SSE2(span_ident_sse2, ident_mask_sse2, span_ident_scalar)
+SPAN_SSE2(span_digits_sse2, digit_mask_sse2, span_digits_scalar)
+
+static const ScanKernels sse2_kernels = {
+    "sse2",
+    span_space_sse2,
+    find_comment_stop_sse2,
+    span_ident_sse2,
+    span_digits_sse2
+};
+
+/*
+ * AVX2 kernels: the same tests on 32 bytes at a time. They are compiled for
+ * AVX2 with a target attribute and only selected if the CPU supports it.
+ */
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+AVX2_FN static inline __m256i in_range_avx2(__m256i x, char lo, char hi) {
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    __m256i limit = _mm256_set1_epi8((char)(hi - lo));
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(d, limit), limit);
+}
+
+AVX2_FN static inline unsigned space_mask_avx2(__m256i x) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                                in_range_avx2(x, '\t', '\r'));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+AVX2_FN static inline unsigned comment_stop_mask_avx2(__m256i x) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('#')),
+                                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+AVX2_FN static inline unsigned digit_mask_avx2(__m256i x) {
+    return (unsigned)_mm256_movemask_epi8(in_range_avx2(x, '0', '9'));
+}
+
+AVX2_FN static inline unsigned ident_mask_avx2(__m256i x) {
+    __m256i letter = in_range_avx2(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i m = _mm256_or_si256(_mm256_or_si256(letter, in_range_avx2(x, '0', '9')),
+                                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+#define SPAN_AVX2(name, mask_fn, tail_fn)                                   \
+    AVX2_FN static size_t name(const char *p, size_t n) {                  \
+        size_t i = 0;                                                      \
+        for (; i + 32 <= n; i += 32) {                                     \
+            __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));      \
+            unsigned out = ~mask_fn(x);                                    \
+            if (out) return i + __builtin_ctz(out);                        \
+        }                                                                  \
+        return i + tail_fn(p + i, n - i);                                  \
+    }
+
+#define FIND_AVX2(name, mask_fn, tail_fn)                                   \
+    AVX2_FN static size_t name(const char *p, size_t n) {                  \
+        size_t i = 0;                                                      \
+        for (; i + 32 <= n; i += 32) {                                     \
+            __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));      \
+            unsigned hit = mask_fn(x);                                     \
+            if (hit) return i + __builtin_ctz(hit);                        \
+        }                                                                  \
+        return i + tail_fn(p + i, n - i);                                  \
+    }
+
+// Tails shorter than 32 bytes go through the SSE2 kernels
+SPAN_AVX2(span_space_avx2, space_mask_avx2, span_space_sse2)
+FIND_AVX2(find_comment_stop_avx2, comment_stop_mask_avx2, find_comment_stop_sse2)
+SPAN_AVX2(span_ident_avx2, ident_mask_avx2, span_ident_sse2)
+SPAN_AVX2(span_digits_avx2, digit_mask_avx2, span_digits_sse2)
+
+static const ScanKernels avx2_kernels = {
+    "avx2",
+    span_space_avx2,
+    find_comment_stop_avx2,
+    span_ident_avx2,
+    span_digits_avx2
+};
+
+// Runs from a static initializer, so the CPU model must be initialized first
+static const ScanKernels *detect_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+}
+
+const ScanKernels *scan_kernels_sse2 = &sse2_kernels;
+const ScanKernels *scan_kernels_avx2 = detect_avx2();
+
+#else
+
+const ScanKernels *scan_kernels_sse2 = nullptr;
+const ScanKernels *scan_kernels_avx2 = nullptr;
+
+#endif // SCAN_KERNELS_X86
+
+// Picks the widest kernels the CPU supports
+static const ScanKernels *select_scan_kernels() {
+    if (scan_kernels_avx2) return scan_kernels_avx2;
+    if (scan_kernels_sse2) return scan_kernels_sse2;
+    return &scan_kernels_scalar;
+}
+
+const ScanKernels *scan_kernels = select_scan_kernels();
@@ -1,7 +1,7 @@
 #include "../include/Scanner.h"
-#include <unordered_map>  // Add this include for std::unordered_map
+#include "../include/ScanKernels.h"
 
-char *keywords[] =
+constexpr const char* const keywords[NUM_KEYWORDS] =
         {
         "and", "begin","boolean","by", "constant","do","else", "end",
         "false", "fi", "float", "for", "from", "function", "if", "integer",
@@ -9,7 +9,7 @@ char *keywords[] =
         "then", "to", "true", "var", "while", "write"
 };
 
-LEXEME_TYPE lexTypes[] =
+constexpr LEXEME_TYPE lexTypes[NUM_KEYWORDS] =
         {
         kw_and, kw_begin, kw_bool, kw_by, kw_constant,
         kw_do, kw_else, kw_end, kw_false, kw_fi,kw_float,
@@ -18,26 +18,126 @@ LEXEME_TYPE lexTypes[] =
         kw_string, kw_then, kw_to, kw_true, kw_var, kw_while, kw_write
 };
 
-// Initialize the static keyword map
-std::unordered_map<std::string, int> Scanner::keywordMap = []() {
-    std::unordered_map<std::string, int> map;
-    for (unsigned int i = 0; i < sizeof(lexTypes) / sizeof(LEXEME_TYPE); i++) {
-        map[keywords[i]] = i;
+static_assert(char_tables.cls['x'] == LETTER_CHAR && char_tables.cls['7'] == NUMERIC_DIGIT &&
+              char_tables.cls['\t'] == SEPARATOR && char_tables.cls['<'] == OPERATOR &&
+              char_tables.op_eq['<'] == lx_le && char_tables.op['!'] == illegal_token,
+              "character tables disagree with the scanner's classes");
+
+/*
+ * Keyword lookup through a perfect hash over keywords[]. The hash mixes the
+ * first, second and last characters with the length; the constant below is
+ * searched for at compile time so that no two keywords share a slot.
+ */
+
+#define KEYWORD_SLOTS 128
+#define MAX_KEYWORD_LENGTH 9
+
+constexpr int keywordLength(const char* word) {
+    int len = 0;
+    while (word[len])
+        len++;
+    return len;
+}
+
+constexpr unsigned keywordHash(const char* word, int len, unsigned mult) {
+    return ((unsigned char)word[0] + (unsigned char)word[1] +
+            (unsigned char)word[len - 1] * mult + len) & (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable {
+    unsigned mult;                  // 0 if no perfect hash was found
+    signed char slot[KEYWORD_SLOTS]; // keyword index, -1 for an empty slot
+    unsigned char length[NUM_KEYWORDS];
+};
+
+constexpr KeywordTable makeKeywordTable() {
+    KeywordTable t{};
+    for (int i = 0; i < NUM_KEYWORDS; i++)
+        t.length[i] = keywordLength(keywords[i]);
+
+    for (unsigned mult = 1; mult < 256; mult++) {
+        for (int s = 0; s < KEYWORD_SLOTS; s++)
+            t.slot[s] = -1;
+
+        bool collision = false;
+        for (int i = 0; i < NUM_KEYWORDS && !collision; i++) {
+            unsigned h = keywordHash(keywords[i], t.length[i], mult);
+            if (t.slot[h] != -1)
+                collision = true;
+            else
+                t.slot[h] = i;
+        }
+        if (!collision) {
+            t.mult = mult;
+            return t;
+        }
     }
-    return map;
-}();
+    return t;
+}
+
+static constexpr KeywordTable keywordTable = makeKeywordTable();
+
+static_assert(keywordTable.mult != 0, "no collision-free keyword hash; raise KEYWORD_SLOTS");
+// The hash reads the second character, and checkKeyword rejects longer words early
+constexpr bool keywordLengthsInRange() {
+    for (int i = 0; i < NUM_KEYWORDS; i++)
+        if (keywordTable.length[i] < 2 || keywordTable.length[i] > MAX_KEYWORD_LENGTH)
+            return false;
+    return true;
+}
+
+static_assert(keywordLengthsInRange(), "keywords must be 2 to MAX_KEYWORD_LENGTH characters long");
 
 TOKEN* Scanner::Scan()
 {
-    std::cout << "Scanning next token..." << std::endl;
+    if (peeked != nullptr) {
+        TOKEN* token = peeked;
+        peeked = nullptr;
+        return token;
+    }
+
+    TOKEN* token = new TOKEN();
+    ScanInto(*token);
+    if (token->type == lx_identifier || token->type == lx_string)
+        token->fitText();
+    return token;
+}
+
+void Scanner::ScanInto(TOKEN &token)
+{
+    if (peeked != nullptr) {
+        token.copyFrom(*peeked);
+        delete peeked;
+        peeked = nullptr;
+        return;
+    }
+
+    PhaseTimer timer(phase_scan);
+    stats_count(count_tokens);
+    token.reset();
+    scanToken(&token);
+    // Tokens never span lines, so the current line is the token's line
+    token.line = fd->GetLineNum();
+}
+
+TOKEN* Scanner::Peek()
+{
+    if (peeked == nullptr)
+        peeked = Scan();
+    return peeked;
+}
+
+TOKEN* Scanner::scanToken(TOKEN* token)
+{
+    TRACE("Scanning next token...");
     // Get the next character from the input stream
     char currentChar = fd->GetChar();
-    std::cout << "First char of token: '" << currentChar << "' (ASCII: " << (int)currentChar << ")" << std::endl;
+    TRACE("First char of token: '" << currentChar << "' (ASCII: " << (int)currentChar << ")");
 
     // Skip whitespace and comments
-    while (isspace(currentChar) || getClass(currentChar) == COMMENT_MARKER)
+    while (isSpaceChar(currentChar) || getClass(currentChar) == COMMENT_MARKER)
     {
-        if (isspace(currentChar)) {
+        if (isSpaceChar(currentChar)) {
             skipSpaces(currentChar); // Skip over spaces and newline characters
         }
 
@@ -53,7 +153,6 @@ TOKEN* Scanner::Scan()
             {
                 // Report an error if an incomplete comment is encountered
                 fd->ReportError("Incomplete or wrong comment entered.");
-                TOKEN* token = new TOKEN();
                 token->type = illegal_token;
                 lastToken = token;
                 return token;
@@ -65,36 +164,26 @@ TOKEN* Scanner::Scan()
     if (currentChar == EOF)
     {
         readMore = false;
-        TOKEN* token = new TOKEN();
         token->type = lx_eof; // Set token type to end-of-file
         lastToken = token;
         return token;
     }
 
     // Check for individual characters that represent tokens
-    if (currentChar == '-')
-    {
-        TOKEN* minusToken = new TOKEN();
-        minusToken->type = lx_minus; // Set minusToken type to minus operator
-        privousType = OPERATOR;
-        lastToken = minusToken;
-        return minusToken;
-    }
     if (currentChar == ';')
     {
-        TOKEN* semicolonToken = new TOKEN();
-        semicolonToken->type = lx_semicolon; // Set semicolonToken type to semicolon
-        lastToken = semicolonToken;
-        return semicolonToken;
+        token->type = lx_semicolon; // Set token type to semicolon
+        lastToken = token;
+        return token;
     }
     if (getClass(currentChar) == OPERATOR)
     {
-        lastToken = getOperator(currentChar); // Get operator token
+        lastToken = getOperator(currentChar, token); // Get operator token
         return lastToken;
     }
     if (currentChar == '"')
     {
-        lastToken = getString(currentChar); // Get string literal token
+        lastToken = getString(currentChar, token); // Get string literal token
         return lastToken;
     }
 
@@ -104,73 +193,26 @@ TOKEN* Scanner::Scan()
     // Handle identifiers and keywords
     if (charType == LETTER_CHAR || currentChar == '_')
     {
-        lastToken = getId(currentChar); // Get identifier or keyword token
+        lastToken = getId(currentChar, token); // Get identifier or keyword token
         return lastToken;
     }
         // Handle integer and floating-point literals
     else if (charType == NUMERIC_DIGIT)
     {
-        lastToken = getInt(currentChar); // Get integer or floating-point token
+        lastToken = getInt(currentChar, token); // Get integer or floating-point token
         return lastToken;
     }
 
     // Report an error for unknown tokens
     fd->ReportError("Unknown Token");
-    TOKEN* token = new TOKEN();
     token->type = illegal_token;
     lastToken = token;
     return token;
 }
 
-int Scanner::getClass(char c)
-{
-    // Check if the character is an alphabetic character
-    if (isalpha(c))
-    {
-        return LETTER_CHAR;
-    }
-    // Check if the character is a digit
-    else if (c >= '0' && c <= '9')
-    {
-        return NUMERIC_DIGIT;
-    }
-        // Check for delimiters (whitespace, newline, etc.)
-    else if (c == ';' || c == ' ' || c == '\n' || isspace(c) || c == EOF)
-    {
-        return SEPARATOR;
-    }
-        // Check for operators
-    else if (c == '(' || c == ')' || c == '+' || c == '*' ||
-             c == '/' || c == '=' || c == '[' || c == ']' ||
-             c == '{' || c == '}' || c == ',' || c == ':' ||
-             c == '=' || c == '>' || c == '<' || c == '-' ||
-             c == '!')
-    {
-        return OPERATOR;
-    }
-        // Check for the dot character
-    else if (c == '.')
-    {
-        return lx_dot;
-    }
-        // Check for underscore character
-    else if (c == '_')
-    {
-        return SPECIAL_CHAR;
-    }
-        // Check for comment character
-    else if (c == '#')
-    {
-        return COMMENT_MARKER;
-    }
-    // Default case: return 0 for unknown characters
-    return 0;
-}
-
-TOKEN* Scanner::getId(char c)
+TOKEN* Scanner::getId(char c, TOKEN *token)
 {
     string idStr;            // Stores the value of the identifier
-    TOKEN *token = NULL;    // Token to be returned
     int currentClass = getClass(c); // Determine the class of the current character
 
     // Loop to read characters until the identifier is complete
@@ -178,6 +220,12 @@ TOKEN* Scanner::getId(char c)
            currentClass == SPECIAL_CHAR)
     {
         idStr += c; // Add the character to the identifier value
+        // Take the rest of the run on this line in one go
+        if (isIdentChar(*fd->Cursor())) {
+            int run = scan_kernels->span_ident(fd->Cursor(), fd->Remaining());
+            idStr.append(fd->Cursor(), run);
+            fd->Advance(run);
+        }
         c = fd->GetChar();    // Read the next character
         currentClass = getClass(c); // Update the class of the next character
     }
@@ -186,7 +234,6 @@ TOKEN* Scanner::getId(char c)
     if (currentClass != SEPARATOR && currentClass != OPERATOR && c != EOF)
     {
         fd->ReportError("Invalid identifier");
-        TOKEN* token = new TOKEN();
         token->type = illegal_token;
         return token;
     }
@@ -195,30 +242,26 @@ TOKEN* Scanner::getId(char c)
     if (currentClass == OPERATOR || c == ';' || c == EOF )
         fd->UngetChar(c);
 
-    // Using const_cast to remove the const qualifier and check if the identifier is a keyword
-    int keywordIndex = checkKeyword(const_cast<char*>(idStr.c_str()));
+    // Check if the identifier is a keyword
+    int keywordIndex = checkKeyword(idStr.data(), (int)idStr.size());
 
     if (keywordIndex != -1)
     {
-        token = new TOKEN();
         token->type = lexTypes[keywordIndex]; // Set token type as keyword type
         privousType = -2;
         return token;
     }
     else
     {
-        token = new TOKEN();
         token->type = lx_identifier; // Set token type as identifier
-        token->str_ptr = new char[idStr.size() + 1];
-        strcpy(token->str_ptr, idStr.data());
+        token->setText(idStr.data(), idStr.size());
         privousType = -2;
        // cout << "Identifier value: " << idStr << endl;
         return token;
     }
 }
-TOKEN* Scanner::getInt(char c)
+TOKEN* Scanner::getInt(char c, TOKEN *token)
 {
-    TOKEN* token = NULL;
     int currentClass = getClass(c); // Determine the initial class of the character
     string intStr; // To store the token intStr
 
@@ -226,6 +269,12 @@ TOKEN* Scanner::getInt(char c)
     while(currentClass == NUMERIC_DIGIT)
     {
         intStr += c; // Add the current digit to the intStr
+        // Take the rest of the digits on this line in one go
+        if (isDigitChar(*fd->Cursor())) {
+            int run = scan_kernels->span_digits(fd->Cursor(), fd->Remaining());
+            intStr.append(fd->Cursor(), run);
+            fd->Advance(run);
+        }
         c = fd->GetChar(); // Get the next character
         currentClass = getClass(c); // Determine the class of the new character
     }
@@ -238,7 +287,6 @@ TOKEN* Scanner::getInt(char c)
            || currentClass == COMMENT_MARKER || c == EOF)
             fd->UngetChar(c); // Push back the character that doesn't belong to the integer
 
-        token = new TOKEN();
         token->type = lx_integer; // Set the token type to integer
         token->value = atoi(intStr.c_str()); // Convert the string intStr to an integer
         privousType = -2;
@@ -267,7 +315,6 @@ TOKEN* Scanner::getInt(char c)
                || c == ';' || c == EOF)
                 fd->UngetChar(c); // Push back the character that doesn't belong to the floating-point number
 
-            token = new TOKEN();
             token->type = lx_float; // Set the token type to float
             token->float_value = atof(intStr.c_str()); // Convert the string intStr to a float
             privousType = -2;
@@ -276,7 +323,6 @@ TOKEN* Scanner::getInt(char c)
         else
         {
             fd->ReportError("Invalid floating-point number");
-            TOKEN* token = new TOKEN();
             token->type = illegal_token;
             return token;
         }
@@ -285,13 +331,12 @@ TOKEN* Scanner::getInt(char c)
     else
     {
         fd->ReportError("Invalid integer number");
-        TOKEN* token = new TOKEN();
         token->type = illegal_token;
         return token;
     }
     return token;
 }
-TOKEN* Scanner::getString(char startChar)
+TOKEN* Scanner::getString(char startChar, TOKEN *token)
 {
     string stringStr; // To store the value of the string token
     char currentChar = fd->GetChar(); // Get the next character from the file descriptor
@@ -318,17 +363,14 @@ TOKEN* Scanner::getString(char startChar)
     // Check if the loop terminated due to an invalid string representation
     if (currentChar == '\n' || currentChar == EOF) {
         fd->ReportError("Unfinished string ");
-        TOKEN* token = new TOKEN();
         token->type = illegal_token;
         return token;
     }
 
-    TOKEN* token = new TOKEN();
     token->type = lx_string;
 
-    // Allocate memory for the token's string value and copy the token value into it
-    token->str_ptr = new char[stringStr.size() + 1];
-    strcpy(token->str_ptr, stringStr.data());
+    // Copy the token value into the token's string buffer
+    token->setText(stringStr.data(), stringStr.size());
 
     privousType = -2; // Update the previous token type
     return token;
@@ -337,92 +379,28 @@ TOKEN* Scanner::getString(char startChar)
 
 
 
-TOKEN* Scanner::getOperator(char currentChar){
-    TOKEN* token = new TOKEN();
+TOKEN* Scanner::getOperator(char currentChar, TOKEN *token){
+    unsigned char first = (unsigned char)currentChar;
 
-    // Check for various operator characters and assign appropriate token types
-    if(currentChar == '+'){ // Plus operator
-        token->type = lx_plus;
-    }
-    else if(currentChar == '-'){ // Minus operator
-        token->type = lx_minus;
-    }
-    else if(currentChar == '*'){ // Multiply operator
-        token->type = lx_star;
-    }
-    else if(currentChar == '/'){ // Divide operator
-        token->type = lx_slash;
-    }
-
-    // Handle special cases like colons and comparison operators
-    else if(currentChar == ':'){
+    // Two-character DFA: ':', '!', '<' and '>' move to a state that accepts
+    // on '=', anything else ends the operator after its first character
+    if (char_tables.op_eq[first] != illegal_token) {
         currentChar = fd->GetChar();
-        if(currentChar == '='){ // Assignment operator
-            token->type = lx_colon_eq;
-        }
-        else{ // Colon operator
-            token->type = lx_colon;
-            fd->UngetChar(currentChar); // Put back the character into the input stream
-        }
-    }
-    else if(currentChar == '='){ // Equal operator
-        token->type = lx_eq;
-    }
-    else if(currentChar == '!'){
-        currentChar = fd->GetChar();
-        if(currentChar == '='){ // Not equal operator
-            token->type = lx_neq;
+        if (currentChar == '=') {
+            token->type = (LEXEME_TYPE)char_tables.op_eq[first];
+            privousType = OPERATOR;
+            return token;
         }
-        else{
+        if (char_tables.op[first] == illegal_token) {
             // Report error for invalid not operator representation
             fd->ReportError("Error: Invalid operator representation: '!' must be followed by '='");
             token->type = illegal_token;
             return token;
         }
-    }
-    else if(currentChar == '<'){
-        currentChar = fd->GetChar();
-        if(currentChar == '='){ // Less than or equal operator
-            token->type = lx_le;
-        }
-        else{ // Less than operator
-            token->type = lx_lt;
-            fd->UngetChar(currentChar); // Put back the character into the input stream
-        }
-    }
-    else if(currentChar == '>'){
-        currentChar = fd->GetChar();
-        if(currentChar == '='){ // Greater than or equal operator
-            token->type = lx_ge;
-        }
-        else{ // Greater than operator
-            token->type = lx_gt;
-            fd->UngetChar(currentChar); // Put back the character into the input stream
-        }
-    }
-    else if(currentChar == '('){ // Left parenthesis
-        token->type = lx_lparen;
-
-    }
-    else if(currentChar == ')'){ // Right parenthesis
-        token->type = lx_rparen;
-    }
-    else if(currentChar == '{'){ // Left curly brace
-        token->type = lx_lbracket;
-    }
-    else if(currentChar == '}'){ // Right curly brace
-        token->type = lx_rbracket;
-    }
-    else if(currentChar == ','){ // Comma
-        token->type = lx_comma;
-    }
-    else if(currentChar == '['){ // Left square bracket
-        token->type = lx_lsbracket;
-    }
-    else if(currentChar == ']'){ // Right square bracket
-        token->type = lx_rsbracket;
+        fd->UngetChar(currentChar); // Put back the character into the input stream
     }
 
+    token->type = (LEXEME_TYPE)char_tables.op[first];
     privousType = OPERATOR; // Update the previous token type
     return token;
 }
@@ -431,8 +409,11 @@ void Scanner::skipComments(char &currentChar)
 {
     while (true) {
         currentChar = fd->GetChar();
-        while (currentChar != '#' && currentChar != '\n' && currentChar != EOF)
+        while (currentChar != '#' && currentChar != '\n' && currentChar != EOF) {
+            // Jump to the next '#' or newline on this line
+            fd->Advance(scan_kernels->find_comment_stop(fd->Cursor(), fd->Remaining()));
             currentChar = fd->GetChar();
+        }
 
         // Check if a new line was encountered
         if (currentChar == '\n')
@@ -457,26 +438,30 @@ void Scanner::skipComments(char &currentChar)
 void Scanner::skipSpaces(char &currentChar)
 {
     // Skip any whitespace characters
-    while (isspace(currentChar)) {
-        std::cout << "Skipping whitespace: ASCII " << (int)currentChar << 
-                 " (" << (currentChar == '\n' ? "newline" : (currentChar == ' ' ? "space" : "other whitespace")) << ")" << std::endl;
+    while (isSpaceChar(currentChar)) {
+        // Skip the rest of the run on this line in one go
+        if (isSpaceChar(*fd->Cursor())) {
+            int run = scan_kernels->span_space(fd->Cursor(), fd->Remaining());
+            TRACE("Skipping " << run + 1 << " whitespace characters");
+            fd->Advance(run);
+        }
         currentChar = fd->GetChar();
     }
 }
 
-int Scanner::checkKeyword(char *word)
+int Scanner::checkKeyword(const char *word, int len)
 {
-    std::cout << "Checking if '" << word << "' is a keyword... ";
-    
-    // Simply look up the word in our predefined hashmap
-    auto it = keywordMap.find(word);
-    if (it != keywordMap.end()) {
-        std::cout << "Yes! Found at index " << it->second << " with type " << lexTypes[it->second] << std::endl;
-        return it->second;
+    // One hash, one length check and one compare; word needn't be terminated
+    if (len >= 2 && len <= MAX_KEYWORD_LENGTH) {
+        int i = keywordTable.slot[keywordHash(word, len, keywordTable.mult)];
+        if (i >= 0 && keywordTable.length[i] == len && memcmp(word, keywords[i], len) == 0) {
+            TRACE("Checking if '" << std::string(word, len) << "' is a keyword... Yes! Found at index " << i << " with type " << lexTypes[i]);
+            return i;
+        }
     }
-    
+
     // Return -1 if the word is not a keyword
-    std::cout << "No, it's not a keyword." << std::endl;
+    TRACE("Checking if '" << std::string(word, len) << "' is a keyword... No, it's not a keyword.");
     return -1;
 }
 
@@ -484,6 +469,14 @@ int Scanner::getLineNum() {
     return fd->GetLineNum(); // Get the current line number from the file descriptor
 }
 
+int Scanner::getCharNum() {
+    return fd->GetCharNum();
+}
+
+void Scanner::ReportError(char *msg) {
+    fd->ReportError(msg);
+}
+
 FileDescriptor* Scanner::Get_fd() {
     return fd; // Return the file descriptor associated with the scanner
 }
@@ -493,8 +486,8 @@ TOKEN* Scanner::getLastToken() {
 }
 
 Scanner::~Scanner() {
-    // Clean up and release resources
-    delete lastToken;
+    // Clean up and release resources. Tokens belong to the caller of Scan,
+    // lastToken included.
     delete fd;
     lastToken = nullptr;
     fd = nullptr;
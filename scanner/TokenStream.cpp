@@ -0,0 +1,39 @@
+#include "../include/TokenStream.h"
+#include <algorithm>
+
+TokenStream::TokenStream(Lexer *lexer, int batch) {
+    this->lexer = lexer;
+    this->batch = std::min(std::max(batch, 1), MAX_PEEK);
+    ended = false;
+    head = 0;
+    tail = 0;
+}
+
+// Scans until wanted tokens are buffered, and on to a whole batch if the
+// ring has room. Slots of the RETAINED tokens before head are never reused.
+// Returns false if the source ends first.
+bool TokenStream::fill(int wanted) {
+    long limit = head - RETAINED + CAPACITY;
+    long target = std::max(head + wanted, std::min(tail + batch, limit));
+    while (tail < target && !ended) {
+        TOKEN &token = ring[tail & MASK];
+        lexer->ScanInto(token);
+        tail++;
+        ended = token.type == lx_eof;
+    }
+    return tail - head >= wanted;
+}
+
+TOKEN* TokenStream::next() {
+    if (head == tail && !fill(1))
+        return &ring[(tail - 1) & MASK];    // end of file, again
+    return &ring[head++ & MASK];
+}
+
+TOKEN* TokenStream::peek(int k) {
+    if (k < 1 || k > MAX_PEEK)
+        return nullptr;
+    if (tail - head < k && !fill(k))
+        return &ring[(tail - 1) & MASK];
+    return &ring[(head + k - 1) & MASK];
+}
@@ -0,0 +1,4 @@
+#!/bin/sh
+# Regenerates flex_scanner.cpp from flex_scanner.l. The generated file is
+# checked in, so flex is only needed after editing the rules.
+cd "$(dirname "$0")" && flex -o flex_scanner.cpp flex_scanner.l
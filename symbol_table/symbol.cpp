@@ -2,15 +2,16 @@
 #include <ctype.h>
 #include <stdio.h>
 #include "../include/symbol.h"
+#include "../include/stats.h"
 
 // Global current scope variable
-SymbolTable* current_scope = nullptr;
+thread_local SymbolTable* current_scope = nullptr;
 
 // Helper method to process string (fold case if needed)
 char* SymbolTable::processString(char *str) {
     if (!str) return NULL;
     
-    static char buffer[1024]; // Static buffer for the processed string
+    static thread_local char buffer[1024]; // Static buffer for the processed string
     strcpy(buffer, str);
     
     if (fold_case) {
@@ -45,12 +46,14 @@ SymbolTable::SymbolTable() {
     
     // Allocate the hash table
     slots = new STList[table_size];
+    stats_count(count_bytes_allocated, sizeof(SymbolTable) + table_size * sizeof(STList));
     
     // Initialize statistics
     number_entries = 0;
     number_probes = 0;
     number_hits = 0;
     max_search_dist = 0;
+    frozen = 0;
     next = NULL;
     
     // Initialize the global current_scope if this is the first symbol table
@@ -66,12 +69,14 @@ SymbolTable::SymbolTable(int fold_case_flag) {
     
     // Allocate the hash table
     slots = new STList[table_size];
+    stats_count(count_bytes_allocated, sizeof(SymbolTable) + table_size * sizeof(STList));
     
     // Initialize statistics
     number_entries = 0;
     number_probes = 0;
     number_hits = 0;
     max_search_dist = 0;
+    frozen = 0;
     next = NULL;
 }
 
@@ -82,12 +87,14 @@ SymbolTable::SymbolTable(int size, int fold_case_flag) {
     
     // Allocate the hash table
     slots = new STList[table_size];
+    stats_count(count_bytes_allocated, sizeof(SymbolTable) + table_size * sizeof(STList));
     
     // Initialize statistics
     number_entries = 0;
     number_probes = 0;
     number_hits = 0;
     max_search_dist = 0;
+    frozen = 0;
     next = NULL;
 }
 
@@ -99,6 +106,8 @@ SymbolTable::~SymbolTable() {
 // Get a symbol from current scope and parent scopes
 STEntry* SymbolTable::GetSymbolFromScopes(char* str) {
     if (!str) return NULL;
+    PhaseTimer timer(phase_symbol);
+    stats_count(count_symbol_lookups);
     
     SymbolTable *currentTable = this;
     STEntry* entry = NULL;
@@ -108,18 +117,21 @@ STEntry* SymbolTable::GetSymbolFromScopes(char* str) {
         currentTable = currentTable->next;
     }
     
+    if (entry) stats_count(count_symbol_hits);
     return entry;
 }
 
 // Get an entry only from the current scope (does not check parent scopes)
 STEntry *SymbolTable::GetEntryCurrentScope(char *key) {
     if (!key) return NULL;
+    PhaseTimer timer(phase_symbol);
+    stats_count(count_symbol_probes);
     
     // Calculate the hash index using our hash function
     unsigned long index = hash(key);
     
-    // Increment probe count for statistics
-    number_probes++;
+    // Increment probe count for statistics (a frozen table is shared, so it is not updated)
+    if (!frozen) number_probes++;
     
     // Return the entry from the current scope only
     return slots[index].FindEntry(processString(key));
@@ -149,7 +161,8 @@ SymbolTable* SymbolTable::get_parent_scope() {
 
 // Add a symbol to the current scope or return existing one
 STEntry *SymbolTable::PutSymbol(char *str, STE_TYPE type, int line) {
-    if (!str) return NULL;
+    if (!str || frozen) return NULL;
+    PhaseTimer timer(phase_symbol);
     
     STEntry *entry = GetEntryCurrentScope(str);
     
@@ -162,6 +175,8 @@ STEntry *SymbolTable::PutSymbol(char *str, STE_TYPE type, int line) {
     
     // Increment entry count
     number_entries++;
+    stats_count(count_symbols_added);
+    stats_count(count_bytes_allocated, sizeof(STEntry));
     
     // Return the newly added entry
     return slots[index].FindEntry(str);
@@ -169,7 +184,8 @@ STEntry *SymbolTable::PutSymbol(char *str, STE_TYPE type, int line) {
 
 // Add an entry to the symbol table, return false if already exists
 bool SymbolTable::AddEntry(char *str, STE_TYPE type, int line) {
-    if (!str) return false;
+    if (!str || frozen) return false;
+    PhaseTimer timer(phase_symbol);
     
     unsigned long index = hash(str);
     
@@ -179,6 +195,8 @@ bool SymbolTable::AddEntry(char *str, STE_TYPE type, int line) {
     
     if (result) {
         number_entries++;
+        stats_count(count_symbols_added);
+        stats_count(count_bytes_allocated, sizeof(STEntry));
     }
     
     return result;
@@ -186,6 +204,8 @@ bool SymbolTable::AddEntry(char *str, STE_TYPE type, int line) {
 
 // Global function: Create a new scope and return it
 SymbolTable* enter_scope() {
+    PhaseTimer timer(phase_symbol);
+    stats_count(count_scopes);
     // Create a new scope and link it as the new head of the scope chain
     SymbolTable* new_scope = new SymbolTable(SymbolTable::DEFAULT_SIZE, 
                                             current_scope ? current_scope->fold_case : 0);
@@ -208,6 +228,12 @@ SymbolTable* exit_scope() {
     return current_scope; // Return current scope if we can't exit further
 }
 
+// Make the table read-only. Lookups in a frozen table don't touch any
+// member, so several threads can search it at the same time.
+void SymbolTable::Freeze() {
+    frozen = 1;
+}
+
 // Clear all entries in the symbol table
 void SymbolTable::ClearSymbolTable() {
     for (int i = 0; i < table_size; i++) {
@@ -268,6 +294,7 @@ void SymbolTable::Reset(int new_size) {
     // Create new table
     table_size = new_size;
     slots = new STList[table_size];
+    stats_count(count_bytes_allocated, table_size * sizeof(STList));
     
     // Reset statistics
     number_entries = 0;
@@ -24,6 +24,10 @@ STEntry::STEntry() {
     ResultType = type_none;
     Formals = NULL;
     IsConstant = 0;
+    Depth = -1;
+    Slot = -1;
+    Offset = -1;
+    Token = -1;
 }
 
 /**
@@ -45,6 +49,10 @@ STEntry::STEntry(const char* name, STE_TYPE type, int line) {
     ResultType = type_none;
     Formals = NULL;
     IsConstant = 0;
+    Depth = -1;
+    Slot = -1;
+    Offset = -1;
+    Token = -1;
 }
 
 /**
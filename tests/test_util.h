@@ -0,0 +1,63 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+// Helpers shared by the test programs
+
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include "../include/parser.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/PeepholeOptimizer.h"
+#include "../include/ProgramGenerator.h"
+
+// An instruction, for code written out as bytecode
+static inline Instruction I(int op, int a = 0, int b = 0, int c = 0) {
+    return Instruction{op, a, b, c};
+}
+
+// All of an open file, from its start
+static inline std::string test_contents(FILE *file) {
+    std::string text;
+    rewind(file);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, n);
+    return text;
+}
+
+// The file at path; empty if it can't be read
+static inline std::string test_contents(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return std::string();
+    std::string text = test_contents(file);
+    fclose(file);
+    return text;
+}
+
+// Parses source and lowers it to module, optimized and scheduled; false
+// if it does not compile
+static inline bool test_compile(const std::string &source, Module &module) {
+    Parser parser(new Scanner(new FileDescriptor(source.data(), source.size())));
+    AST *program = parser.start_parsing();
+    if (parser.had_error || BytecodeCompiler().compile(program, module) != 0)
+        return false;
+    PeepholeOptimizer optimizer;
+    optimizer.optimize(module);
+    optimizer.schedule(module);
+    return true;
+}
+
+// Calls check on generated programs with seeds 1 to count, named
+// "generated SEED"
+static inline void test_generated(
+    int count, const std::function<void(const char *, const std::string &)> &check) {
+    for (int seed = 1; seed <= count; seed++) {
+        GeneratorConfig config;
+        config.seed = seed;
+        std::string name = "generated " + std::to_string(seed);
+        check(name.c_str(), ProgramGenerator(config).Generate());
+    }
+}
+
+#endif // TEST_UTIL_H